@@ -1914,26 +1914,39 @@ dump_log_spacemaps(spa_t *spa)
 }
 
 static void
-dump_dde(const ddt_t *ddt, const ddt_entry_t *dde, uint64_t index)
+dump_ddt_phys(const ddt_t *ddt, const ddt_key_t *ddk,
+    const ddt_phys_t *ddp, uint64_t index)
 {
-	const ddt_phys_t *ddp = dde->dde_phys;
-	const ddt_key_t *ddk = &dde->dde_key;
 	const char *types[4] = { "ditto", "single", "double", "triple" };
 	char blkbuf[BP_SPRINTF_LEN];
 	blkptr_t blk;
 	int p;
 
-	for (p = 0; p < DDT_PHYS_TYPES; p++, ddp++) {
+	for (p = 0; p < DDT_NPHYS(ddt); p++, ddp++) {
 		if (ddp->ddp_phys_birth == 0)
 			continue;
 		ddt_bp_create(ddt->ddt_checksum, ddk, ddp, &blk);
 		snprintf_blkptr(blkbuf, sizeof (blkbuf), &blk);
-		(void) printf("index %llx refcnt %llu %s %s\n",
-		    (u_longlong_t)index, (u_longlong_t)ddp->ddp_refcnt,
-		    types[p], blkbuf);
+		if (ddt->ddt_flags & DDT_FLAG_FLAT) {
+			(void) printf("index %llx refcnt %llu flat "
+			    "class_start %llu %s\n", (u_longlong_t)index,
+			    (u_longlong_t)ddp->ddp_refcnt, (u_longlong_t)
+			    ((const ddt_phys_flat_t *)ddp)->ddf_class_start,
+			    blkbuf);
+		} else {
+			(void) printf("index %llx refcnt %llu %s %s\n",
+			    (u_longlong_t)index, (u_longlong_t)ddp->ddp_refcnt,
+			    types[p], blkbuf);
+		}
 	}
 }
 
+static void
+dump_dde(const ddt_t *ddt, const ddt_entry_t *dde, uint64_t index)
+{
+	dump_ddt_phys(ddt, &dde->dde_key, dde->dde_phys, index);
+}
+
 static void
 dump_dedup_ratio(const ddt_stat_t *dds)
 {
@@ -2009,6 +2022,37 @@ dump_ddt(ddt_t *ddt, ddt_type_t type, ddt_class_t class)
 	(void) printf("\n");
 }
 
+static void
+dump_ddt_log(ddt_t *ddt)
+{
+	for (int n = 0; n < 2; n++) {
+		ddt_log_t *ddl = &ddt->ddt_log[n];
+		char name[DDT_NAMELEN];
+		uint64_t count = avl_numnodes(&ddl->ddl_tree);
+
+		if (count == 0)
+			continue;
+
+		ddt_log_name(ddt, n, name);
+		(void) printf("%s: %llu log entries, %llu bytes on disk%s\n",
+		    name, (u_longlong_t)count, (u_longlong_t)ddl->ddl_length,
+		    ddl == ddt->ddt_log_flushing ? ", flushing" : "");
+
+		if (dump_opt['D'] < 4)
+			continue;
+
+		(void) printf("%s contents:\n\n", name);
+
+		uint64_t index = 0;
+		for (ddt_log_entry_t *ddle = avl_first(&ddl->ddl_tree);
+		    ddle != NULL; ddle = AVL_NEXT(&ddl->ddl_tree, ddle))
+			dump_ddt_phys(ddt, &ddle->ddle_key, ddle->ddle_phys,
+			    index++);
+
+		(void) printf("\n");
+	}
+}
+
 static void
 dump_all_ddts(spa_t *spa)
 {
@@ -2025,6 +2069,8 @@ dump_all_ddts(spa_t *spa)
 				dump_ddt(ddt, type, class);
 			}
 		}
+		if (ddt->ddt_flags & DDT_FLAG_LOG)
+			dump_ddt_log(ddt);
 	}
 
 	ddt_get_dedup_stats(spa, &dds_total);
@@ -2072,7 +2118,7 @@ dump_brt(spa_t *spa)
 		return;
 
 	for (uint64_t vdevid = 0; vdevid < brt->brt_nvdevs; vdevid++) {
-		brt_vdev_t *brtvd = &brt->brt_vdevs[vdevid];
+		brt_vdev_t *brtvd = brt->brt_vdevs[vdevid];
 		if (brtvd == NULL)
 			continue;
 
@@ -2095,7 +2141,7 @@ dump_brt(spa_t *spa)
 	printf("\n%-16s %-10s\n", "DVA", "REFCNT");
 
 	for (uint64_t vdevid = 0; vdevid < brt->brt_nvdevs; vdevid++) {
-		brt_vdev_t *brtvd = &brt->brt_vdevs[vdevid];
+		brt_vdev_t *brtvd = brt->brt_vdevs[vdevid];
 		if (brtvd == NULL || !brtvd->bv_initiated)
 			continue;
 
@@ -5795,13 +5841,18 @@ zdb_count_block(zdb_cb_t *zcb, zilog_t *zilog, const blkptr_t *bp,
 		ddt_enter(ddt);
 		dde = ddt_lookup(ddt, bp, B_FALSE);
 
-		if (dde == NULL) {
+		/*
+		 * No entry or no phys for this block means its entry was
+		 * pruned, and it's claimed like any other block.
+		 */
+		ddt_phys_t *ddp = (dde != NULL) ?
+		    ddt_phys_select(ddt, dde, bp) : NULL;
+		if (ddp == NULL) {
 			refcnt = 0;
 		} else {
-			ddt_phys_t *ddp = ddt_phys_select(dde, bp);
 			ddt_phys_decref(ddp);
 			refcnt = ddp->ddp_refcnt;
-			if (ddt_phys_total_refcnt(dde) == 0)
+			if (ddt_phys_total_refcnt(ddt, dde->dde_phys) == 0)
 				ddt_remove(ddt, dde);
 		}
 		ddt_exit(ddt);
@@ -6120,47 +6171,84 @@ zdb_load_obsolete_counts(vdev_t *vd)
 	return (counts);
 }
 
+static void
+zdb_ddt_leak_init_entry(zdb_cb_t *zcb, ddt_t *ddt, const ddt_key_t *ddk,
+    const ddt_phys_t *ddp)
+{
+	blkptr_t blk;
+
+	VERIFY(ddt);
+
+	for (int p = 0; p < DDT_NPHYS(ddt); p++, ddp++) {
+		if (ddp->ddp_phys_birth == 0)
+			continue;
+		ddt_bp_create(ddt->ddt_checksum, ddk, ddp, &blk);
+		if (DDT_PHYS_IS_DITTO(ddt, p)) {
+			zdb_count_block(zcb, NULL, &blk, ZDB_OT_DITTO);
+		} else {
+			zcb->zcb_dedup_asize +=
+			    BP_GET_ASIZE(&blk) * (ddp->ddp_refcnt - 1);
+			zcb->zcb_dedup_blocks++;
+		}
+	}
+
+	ddt_enter(ddt);
+	VERIFY(ddt_lookup(ddt, &blk, B_TRUE) != NULL);
+	ddt_exit(ddt);
+}
+
 static void
 zdb_ddt_leak_init(spa_t *spa, zdb_cb_t *zcb)
 {
 	ddt_bookmark_t ddb = {0};
 	ddt_entry_t dde;
 	int error;
-	int p;
 
 	ASSERT(!dump_opt['L']);
 
 	while ((error = ddt_walk(spa, &ddb, &dde)) == 0) {
-		blkptr_t blk;
-		ddt_phys_t *ddp = dde.dde_phys;
+		ddt_t *ddt = spa->spa_ddt[ddb.ddb_checksum];
 
 		if (ddb.ddb_class == DDT_CLASS_UNIQUE)
-			return;
+			break;
 
-		ASSERT(ddt_phys_total_refcnt(&dde) > 1);
-		ddt_t *ddt = spa->spa_ddt[ddb.ddb_checksum];
-		VERIFY(ddt);
+		/*
+		 * A newer version of this entry on the log may have dropped
+		 * it to a single reference; the log pass below sees those.
+		 */
+		if (ddt_phys_total_refcnt(ddt, dde.dde_phys) <= 1)
+			continue;
 
-		for (p = 0; p < DDT_PHYS_TYPES; p++, ddp++) {
-			if (ddp->ddp_phys_birth == 0)
-				continue;
-			ddt_bp_create(ddb.ddb_checksum,
-			    &dde.dde_key, ddp, &blk);
-			if (p == DDT_PHYS_DITTO) {
-				zdb_count_block(zcb, NULL, &blk, ZDB_OT_DITTO);
-			} else {
-				zcb->zcb_dedup_asize +=
-				    BP_GET_ASIZE(&blk) * (ddp->ddp_refcnt - 1);
-				zcb->zcb_dedup_blocks++;
+		zdb_ddt_leak_init_entry(zcb, ddt, &dde.dde_key, dde.dde_phys);
+	}
+
+	ASSERT(error == 0 || error == ENOENT);
+
+	/*
+	 * Entries on the log with multiple references that haven't been
+	 * stored in the duplicate class yet weren't seen by the walk.
+	 */
+	for (enum zio_checksum c = 0; c < ZIO_CHECKSUM_FUNCTIONS; c++) {
+		ddt_t *ddt = spa->spa_ddt[c];
+		if (ddt == NULL || !(ddt->ddt_flags & DDT_FLAG_LOG))
+			continue;
+
+		for (int n = 0; n < 2; n++) {
+			avl_tree_t *t = &ddt->ddt_log[n].ddl_tree;
+			for (ddt_log_entry_t *ddle = avl_first(t);
+			    ddle != NULL; ddle = AVL_NEXT(t, ddle)) {
+				if (ddle->ddle_class == DDT_CLASS_DUPLICATE)
+					continue;
+
+				if (ddt_phys_total_refcnt(ddt,
+				    ddle->ddle_phys) <= 1)
+					continue;
+
+				zdb_ddt_leak_init_entry(zcb, ddt,
+				    &ddle->ddle_key, ddle->ddle_phys);
 			}
 		}
-
-		ddt_enter(ddt);
-		VERIFY(ddt_lookup(ddt, &blk, B_TRUE) != NULL);
-		ddt_exit(ddt);
 	}
-
-	ASSERT(error == ENOENT);
 }
 
 typedef struct checkpoint_sm_exclude_entry_arg {
@@ -8034,10 +8122,22 @@ dump_mos_leaks(spa_t *spa)
 		}
 	}
 
+	for (uint64_t cksum = 0; cksum < ZIO_CHECKSUM_FUNCTIONS; cksum++) {
+		ddt_t *ddt = spa->spa_ddt[cksum];
+		if (!ddt || ddt->ddt_version == DDT_VERSION_UNCONFIGURED)
+			continue;
+		if (ddt->ddt_dir_object != DMU_POOL_DIRECTORY_OBJECT)
+			mos_obj_refd(ddt->ddt_dir_object);
+		if (ddt->ddt_flags & DDT_FLAG_LOG) {
+			mos_obj_refd(ddt->ddt_log[0].ddl_object);
+			mos_obj_refd(ddt->ddt_log[1].ddl_object);
+		}
+	}
+
 	if (spa->spa_brt != NULL) {
 		brt_t *brt = spa->spa_brt;
 		for (uint64_t vdevid = 0; vdevid < brt->brt_nvdevs; vdevid++) {
-			brt_vdev_t *brtvd = &brt->brt_vdevs[vdevid];
+			brt_vdev_t *brtvd = brt->brt_vdevs[vdevid];
 			if (brtvd != NULL && brtvd->bv_initiated) {
 				mos_obj_refd(brtvd->bv_mos_brtvdev);
 				mos_obj_refd(brtvd->bv_mos_entries);
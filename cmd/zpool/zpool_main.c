@@ -91,6 +91,7 @@ static int zpool_do_labelclear(int, char **);
 
 static int zpool_do_checkpoint(int, char **);
 static int zpool_do_prefetch(int, char **);
+static int zpool_do_ddtprune(int, char **);
 
 static int zpool_do_list(int, char **);
 static int zpool_do_iostat(int, char **);
@@ -181,6 +182,7 @@ typedef enum {
 	HELP_OFFLINE,
 	HELP_ONLINE,
 	HELP_PREFETCH,
+	HELP_DDTPRUNE,
 	HELP_REPLACE,
 	HELP_REMOVE,
 	HELP_INITIALIZE,
@@ -393,6 +395,7 @@ static zpool_command_t command_table[] = {
 	{ NULL },
 	{ "checkpoint",	zpool_do_checkpoint,	HELP_CHECKPOINT		},
 	{ "prefetch",	zpool_do_prefetch,	HELP_PREFETCH		},
+	{ "ddtprune",	zpool_do_ddtprune,	HELP_DDTPRUNE		},
 	{ NULL },
 	{ "list",	zpool_do_list,		HELP_LIST		},
 	{ "iostat",	zpool_do_iostat,	HELP_IOSTAT		},
@@ -489,6 +492,8 @@ get_usage(zpool_help_t idx)
 	case HELP_PREFETCH:
 		return (gettext("\tprefetch -t <type> [<type opts>] <pool>\n"
 		    "\t    -t ddt <pool>\n"));
+	case HELP_DDTPRUNE:
+		return (gettext("\tddtprune -d <days> <pool>\n"));
 	case HELP_OFFLINE:
 		return (gettext("\toffline [--power]|[[-f][-t]] <pool> "
 		    "<device> ...\n"));
@@ -4249,6 +4254,87 @@ zpool_do_prefetch(int argc, char **argv)
 	return (err);
 }
 
+/*
+ * zpool ddtprune -d <days> <pool>
+ *
+ *	-d	Prune unique entries that have not changed in this many days.
+ *
+ * Removes old unique entries from the pool's dedup tables, and reports how
+ * much space that gave back.
+ */
+int
+zpool_do_ddtprune(int argc, char **argv)
+{
+	int c;
+	char *poolname;
+	char *end;
+	uint64_t days = UINT64_MAX;
+	ddt_object_t freed;
+	zpool_handle_t *zhp;
+	int err;
+
+	while ((c = getopt(argc, argv, "d:")) != -1) {
+		switch (c) {
+		case 'd':
+			errno = 0;
+			days = strtoull(optarg, &end, 10);
+			if (errno != 0 || *end != '\0' || optarg[0] == '-' ||
+			    days > UINT64_MAX / (24 * 60 * 60)) {
+				(void) fprintf(stderr, gettext("invalid number "
+				    "of days '%s'\n"), optarg);
+				usage(B_FALSE);
+			}
+			break;
+		case ':':
+			(void) fprintf(stderr, gettext("missing argument for "
+			    "'%c' option\n"), optopt);
+			usage(B_FALSE);
+			break;
+		case '?':
+			(void) fprintf(stderr, gettext("invalid option '%c'\n"),
+			    optopt);
+			usage(B_FALSE);
+		}
+	}
+	argc -= optind;
+	argv += optind;
+
+	if (days == UINT64_MAX) {
+		(void) fprintf(stderr, gettext("missing -d option\n"));
+		usage(B_FALSE);
+	}
+
+	if (argc < 1) {
+		(void) fprintf(stderr, gettext("missing pool name argument\n"));
+		usage(B_FALSE);
+	}
+
+	if (argc > 1) {
+		(void) fprintf(stderr, gettext("too many arguments\n"));
+		usage(B_FALSE);
+	}
+
+	poolname = argv[0];
+
+	if ((zhp = zpool_open(g_zfs, poolname)) == NULL)
+		return (1);
+
+	err = zpool_ddt_prune(zhp, days * 24 * 60 * 60, &freed);
+	if (err == 0) {
+		char dspace[32], mspace[32];
+
+		zfs_nicebytes(freed.ddo_dspace, dspace, sizeof (dspace));
+		zfs_nicebytes(freed.ddo_mspace, mspace, sizeof (mspace));
+		(void) printf(gettext("pruned %llu DDT entries, about %s on "
+		    "disk, %s in core\n"), (u_longlong_t)freed.ddo_count,
+		    dspace, mspace);
+	}
+
+	zpool_close(zhp);
+
+	return (err != 0);
+}
+
 /*
  * zpool import [-d dir] [-D]
  *       import [-o mntopts] [-o prop=value] ... [-R root] [-D] [-l]
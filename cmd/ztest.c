@@ -276,6 +276,7 @@ extern unsigned long zio_decompress_fail_fraction;
 extern unsigned long zfs_reconstruct_indirect_damage_fraction;
 extern uint64_t raidz_expand_max_reflow_bytes;
 extern uint_t raidz_expand_pause_point;
+extern int vdev_file_log_mmap;
 
 
 static ztest_shared_opts_t *ztest_shared_opts;
@@ -2193,6 +2194,7 @@ ztest_replay_write(void *arg1, void *arg2, boolean_t byteswap)
 	dmu_tx_t *tx;
 	dmu_buf_t *db;
 	arc_buf_t *abuf = NULL;
+	boolean_t direct = B_FALSE;
 	rl_t *rl;
 
 	if (byteswap)
@@ -2216,7 +2218,16 @@ ztest_replay_write(void *arg1, void *arg2, boolean_t byteswap)
 	if (bt->bt_magic != BT_MAGIC)
 		bt = NULL;
 
-	ztest_object_lock(zd, lr->lr_foid, ZTRL_READER);
+	/*
+	 * The range locks only serialize writes at the same offset, not
+	 * within the same block, so a direct write takes the object lock as
+	 * writer to keep others out of the block while its dirty record is
+	 * overridden, as a whole-block range lock would.
+	 */
+	if (ztest_random(8) == 0)
+		direct = B_TRUE;
+
+	ztest_object_lock(zd, lr->lr_foid, direct ? ZTRL_WRITER : ZTRL_READER);
 	rl = ztest_range_lock(zd, lr->lr_foid, offset, length, ZTRL_WRITER);
 
 	VERIFY0(dmu_bonus_hold(os, lr->lr_foid, FTAG, &db));
@@ -2233,8 +2244,9 @@ ztest_replay_write(void *arg1, void *arg2, boolean_t byteswap)
 
 	dmu_tx_hold_write(tx, lr->lr_foid, offset, length);
 
-	if (ztest_random(8) == 0 && length == doi.doi_data_block_size &&
-	    P2PHASE(offset, length) == 0)
+	if (length != doi.doi_data_block_size || P2PHASE(offset, length) != 0)
+		direct = B_FALSE;
+	else if (!direct && ztest_random(8) == 0)
 		abuf = dmu_request_arcbuf(db, length);
 
 	txg = ztest_tx_assign(tx, TXG_WAIT, FTAG);
@@ -2260,8 +2272,16 @@ ztest_replay_write(void *arg1, void *arg2, boolean_t byteswap)
 			    DMU_READ_PREFETCH : DMU_READ_NO_PREFETCH;
 			ztest_block_tag_t rbt;
 
-			VERIFY(dmu_read(os, lr->lr_foid, offset,
-			    sizeof (rbt), &rbt, prefetch) == 0);
+			if (ztest_random(4) == 0) {
+				abd_t *rabd = abd_get_from_buf(&rbt,
+				    sizeof (rbt));
+				VERIFY0(dmu_read_abd(db, offset, sizeof (rbt),
+				    rabd));
+				abd_free(rabd);
+			} else {
+				VERIFY(dmu_read(os, lr->lr_foid, offset,
+				    sizeof (rbt), &rbt, prefetch) == 0);
+			}
 			if (rbt.bt_magic == BT_MAGIC) {
 				ztest_bt_verify(&rbt, os, lr->lr_foid, 0,
 				    offset, gen, txg, crtxg);
@@ -2288,7 +2308,16 @@ ztest_replay_write(void *arg1, void *arg2, boolean_t byteswap)
 		    crtxg);
 	}
 
-	if (abuf == NULL) {
+	if (direct) {
+		/*
+		 * Direct writes are issued straight from the caller's buffer,
+		 * which has to be suitably aligned, as user pages would be.
+		 */
+		abd_t *wabd = abd_alloc_for_io(length, B_FALSE);
+		abd_copy_from_buf(wabd, data, length);
+		VERIFY0(dmu_write_abd(db, offset, length, wabd, tx));
+		abd_free(wabd);
+	} else if (abuf == NULL) {
 		dmu_write(os, lr->lr_foid, offset, length, data, tx);
 	} else {
 		memcpy(abuf->b_data, data, length);
@@ -7485,6 +7514,13 @@ ztest_resume_thread(void *arg)
 		 */
 		if (ztest_random(10) == 0)
 			zfs_abd_scatter_enabled = ztest_random(2);
+
+		/*
+		 * Periodically change whether log vdevs opened from now on
+		 * are accessed through a mapping.
+		 */
+		if (ztest_random(10) == 0)
+			vdev_file_log_mmap = ztest_random(2);
 	}
 
 	thread_exit();
@@ -411,6 +411,21 @@ AC_DEFUN([ZFS_AC_KERNEL_SRC_BLK_MQ], [
 		struct blk_mq_hw_ctx *hctx = NULL;
 		rq.mq_hctx = hctx;
 	], [])
+	dnl #
+	dnl # 5.0 API change
+	dnl # blk_mq_ops->commit_rqs() added for drivers which defer
+	dnl # processing until the last request of a dispatch.
+	dnl #
+	ZFS_LINUX_TEST_SRC([blk_mq_commit_rqs], [
+		#include <linux/blk-mq.h>
+
+		static void commit_rqs(struct blk_mq_hw_ctx *hctx) { return; }
+
+		static const struct blk_mq_ops
+		    mq_ops __attribute__ ((unused)) = {
+			.commit_rqs = commit_rqs,
+		};
+	], [])
 ])
 
 AC_DEFUN([ZFS_AC_KERNEL_BLK_MQ], [
@@ -425,6 +440,13 @@ AC_DEFUN([ZFS_AC_KERNEL_BLK_MQ], [
 		], [
 			AC_MSG_RESULT(no)
 		])
+		AC_MSG_CHECKING([whether block multiqueue has commit_rqs()])
+		ZFS_LINUX_TEST_RESULT([blk_mq_commit_rqs], [
+			AC_MSG_RESULT(yes)
+			AC_DEFINE(HAVE_BLK_MQ_COMMIT_RQS, 1, [blk_mq_ops->commit_rqs() exists])
+		], [
+			AC_MSG_RESULT(no)
+		])
 	], [
 		AC_MSG_RESULT(no)
 	])
@@ -69,14 +69,39 @@ AC_DEFUN([ZFS_AC_KERNEL_IO_SCHEDULE_TIMEOUT], [
 	])
 ])
 
+dnl #
+dnl # set_cpus_allowed_ptr() is exported GPL-only
+dnl #
+AC_DEFUN([ZFS_AC_KERNEL_SRC_SET_CPUS_ALLOWED_PTR], [
+	ZFS_LINUX_TEST_SRC([set_cpus_allowed_ptr], [
+		#include <linux/sched.h>
+		#include <linux/cpumask.h>
+	], [
+		(void) set_cpus_allowed_ptr(current, cpu_online_mask);
+	], [], [ZFS_META_LICENSE])
+])
+
+AC_DEFUN([ZFS_AC_KERNEL_SET_CPUS_ALLOWED_PTR], [
+	AC_MSG_CHECKING([whether set_cpus_allowed_ptr() is available])
+	ZFS_LINUX_TEST_RESULT([set_cpus_allowed_ptr_license], [
+		AC_MSG_RESULT(yes)
+		AC_DEFINE(HAVE_SET_CPUS_ALLOWED_PTR, 1,
+		    [set_cpus_allowed_ptr() is available])
+	], [
+		AC_MSG_RESULT(no)
+	])
+])
+
 AC_DEFUN([ZFS_AC_KERNEL_SRC_SCHED], [
 	ZFS_AC_KERNEL_SRC_SCHED_RT_HEADER
 	ZFS_AC_KERNEL_SRC_SCHED_SIGNAL_HEADER
 	ZFS_AC_KERNEL_SRC_IO_SCHEDULE_TIMEOUT
+	ZFS_AC_KERNEL_SRC_SET_CPUS_ALLOWED_PTR
 ])
 
 AC_DEFUN([ZFS_AC_KERNEL_SCHED], [
 	ZFS_AC_KERNEL_SCHED_RT_HEADER
 	ZFS_AC_KERNEL_SCHED_SIGNAL_HEADER
 	ZFS_AC_KERNEL_IO_SCHEDULE_TIMEOUT
+	ZFS_AC_KERNEL_SET_CPUS_ALLOWED_PTR
 ])
@@ -0,0 +1,6 @@
+dnl #
+dnl # Check for liburing - used by libzpool for file vdev I/O
+dnl #
+AC_DEFUN([ZFS_AC_CONFIG_USER_LIBURING], [
+	ZFS_AC_FIND_SYSTEM_LIBRARY(LIBURING, [liburing], [liburing.h], [], [uring], [io_uring_queue_init], [user_liburing=yes], [user_liburing=no])
+])
@@ -509,6 +509,7 @@ _LIBZFS_H int zpool_discard_checkpoint(zpool_handle_t *);
 _LIBZFS_H boolean_t zpool_is_draid_spare(const char *);
 
 _LIBZFS_H int zpool_prefetch(zpool_handle_t *, zpool_prefetch_type_t);
+_LIBZFS_H int zpool_ddt_prune(zpool_handle_t *, uint64_t, ddt_object_t *);
 
 /*
  * Basic handle manipulations.  These functions do not create or destroy the
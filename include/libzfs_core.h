@@ -150,6 +150,7 @@ _LIBZFS_CORE_H int lzc_wait_tag(const char *, zpool_wait_activity_t, uint64_t,
     boolean_t *);
 
 _LIBZFS_CORE_H int lzc_pool_prefetch(const char *, zpool_prefetch_type_t);
+_LIBZFS_CORE_H int lzc_ddt_prune(const char *, uint64_t, ddt_object_t *);
 
 _LIBZFS_CORE_H int lzc_wait_fs(const char *, zfs_wait_activity_t, boolean_t *);
 
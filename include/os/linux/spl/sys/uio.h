@@ -54,6 +54,15 @@ typedef enum zfs_uio_seg {
 #endif
 } zfs_uio_seg_t;
 
+/*
+ * User pages pinned for a Direct I/O request, see
+ * zfs_uio_get_dio_pages_alloc().
+ */
+typedef struct {
+	struct page	**pages;	/* pinned pages */
+	unsigned long	npages;		/* number of pinned pages */
+} zfs_uio_dio_t;
+
 typedef struct zfs_uio {
 	union {
 		const struct iovec	*uio_iov;
@@ -73,6 +82,8 @@ typedef struct zfs_uio {
 	size_t		uio_skip;
 
 	struct request	*rq;
+
+	zfs_uio_dio_t	uio_dio;
 } zfs_uio_t;
 
 
@@ -46,6 +46,7 @@ typedef enum abd_flags {
 	ABD_FLAG_GANG_FREE	= 1 << 7, /* gang ABD is responsible for mem */
 	ABD_FLAG_ZEROS		= 1 << 8, /* ABD for zero-filled buffer */
 	ABD_FLAG_ALLOCD		= 1 << 9, /* we allocated the abd_t */
+	ABD_FLAG_FROM_PAGES	= 1 << 10, /* does not own pages it maps */
 } abd_flags_t;
 
 typedef struct abd {
@@ -101,12 +102,17 @@ __attribute__((malloc))
 abd_t *abd_alloc_sametype(abd_t *, size_t);
 boolean_t abd_size_alloc_linear(size_t);
 void abd_gang_add(abd_t *, abd_t *, boolean_t);
+abd_t *abd_gang_next(abd_t *, abd_t *);
 void abd_free(abd_t *);
 abd_t *abd_get_offset(abd_t *, size_t);
 abd_t *abd_get_offset_size(abd_t *, size_t, size_t);
 abd_t *abd_get_offset_struct(abd_t *, abd_t *, size_t, size_t);
 abd_t *abd_get_zeros(size_t);
 abd_t *abd_get_from_buf(void *, size_t);
+#if defined(__linux__) && defined(_KERNEL)
+struct page;
+abd_t *abd_alloc_from_pages(struct page **, unsigned long, uint64_t);
+#endif
 void abd_cache_reap_now(void);
 
 /*
@@ -91,6 +91,7 @@ void abd_update_scatter_stats(abd_t *, abd_stats_op_t);
 void abd_update_linear_stats(abd_t *, abd_stats_op_t);
 void abd_verify_scatter(abd_t *);
 void abd_free_linear_page(abd_t *);
+void abd_free_from_pages(abd_t *);
 /* OS specific abd_iter functions */
 void abd_iter_init(struct abd_iter  *, abd_t *);
 boolean_t abd_iter_at_end(struct abd_iter *);
@@ -377,6 +377,17 @@ typedef struct l2arc_lb_ptr_buf {
 /*
  * L2ARC Internals
  */
+/*
+ * Per-device L2ARC feed statistics, exported as the
+ * zfs/<pool>/l2arc_feed-<vdev guid> kstat.
+ */
+typedef struct l2arc_dev_feed_stats {
+	kstat_named_t		l2fs_feeds;
+	kstat_named_t		l2fs_write_bytes;
+	kstat_named_t		l2fs_abort_lowmem;
+	kstat_named_t		l2fs_interval_ms;
+} l2arc_dev_feed_stats_t;
+
 typedef struct l2arc_dev {
 	vdev_t			*l2ad_vdev;	/* vdev */
 	spa_t			*l2ad_spa;	/* spa */
@@ -420,6 +431,17 @@ typedef struct l2arc_dev {
 	 */
 	zfs_refcount_t		l2ad_lb_count;
 	boolean_t		l2ad_trim_all; /* TRIM whole device */
+	uint_t			l2ad_index;	/* slot in l2arc_dev_table */
+	/*
+	 * Parallel feed state, see l2arc_feed_dispatch().  l2ad_feeding and
+	 * l2ad_feed_next are protected by l2arc_dev_mtx; the rest is only
+	 * touched by whoever is feeding the device.
+	 */
+	boolean_t		l2ad_feeding;	/* feed task in progress */
+	clock_t			l2ad_feed_next;	/* when to feed next */
+	uint_t			l2ad_sublist_rotor; /* next sublist to scan */
+	l2arc_dev_feed_stats_t	l2ad_feed_stats;
+	kstat_t			*l2ad_feed_ksp;
 } l2arc_dev_t;
 
 /*
@@ -452,12 +474,20 @@ typedef struct arc_buf_hdr_crypt {
 	uint8_t			b_mac[ZIO_DATA_MAC_LEN];
 } arc_buf_hdr_crypt_t;
 
+/*
+ * Every block in the L2ARC costs a header in memory, so this is kept small:
+ * the device and the disk address share one word (see l2arc_hdr_dev() and
+ * l2arc_hdr_daddr()), and the hit count and ARC state live in otherwise
+ * unused padding of the common part of arc_buf_hdr_t.
+ *
+ *	64	      48				    0
+ *	+-------------+-------------------------------------+
+ *	| dev index   | disk address >> SPA_MINBLOCKSHIFT   |
+ *	+-------------+-------------------------------------+
+ */
 typedef struct l2arc_buf_hdr {
 	/* protected by arc_buf_hdr mutex */
-	l2arc_dev_t		*b_dev;		/* L2ARC device */
-	uint64_t		b_daddr;	/* disk address, offset byte */
-	uint32_t		b_hits;
-	arc_state_type_t	b_arcs_state;
+	uint64_t		b_loc;		/* device and disk address */
 	list_node_t		b_l2node;
 } l2arc_buf_hdr_t;
 
@@ -475,8 +505,12 @@ struct arc_buf_hdr {
 
 	arc_buf_contents_t	b_type;
 	uint8_t			b_complevel;
-	uint8_t			b_reserved1; /* used for 4 byte alignment */
-	uint16_t		b_reserved2; /* used for 4 byte alignment */
+	/*
+	 * L2ARC fields. Undefined when not in L2ARC, except that a nonzero
+	 * b_l2_hits then means l2arc_admit() has turned the buffer away.
+	 */
+	uint8_t			b_l2_arcs_state; /* arc_state_type_t */
+	uint16_t		b_l2_hits;	/* saturates at UINT16_MAX */
 	arc_buf_hdr_t		*b_hash_next;
 	arc_flags_t		b_flags;
 
@@ -580,7 +614,21 @@ typedef struct arc_stats {
 	kstat_named_t arcstat_hash_elements_max;
 	kstat_named_t arcstat_hash_collisions;
 	kstat_named_t arcstat_hash_chains;
+	/*
+	 * Longest hash chain seen since the hash table last changed size.
+	 */
 	kstat_named_t arcstat_hash_chain_max;
+	/*
+	 * Number of buckets and locks in the hash table.
+	 */
+	kstat_named_t arcstat_hash_table_size;
+	kstat_named_t arcstat_hash_locks;
+	/*
+	 * Number of times the hash table has been grown, and the number of
+	 * locks whose chains are still to be moved by the current resize.
+	 */
+	kstat_named_t arcstat_hash_rehashes;
+	kstat_named_t arcstat_hash_rehash_remaining;
 	kstat_named_t arcstat_meta;
 	kstat_named_t arcstat_pd;
 	kstat_named_t arcstat_pm;
@@ -804,6 +852,13 @@ typedef struct arc_stats {
 	kstat_named_t arcstat_l2_evict_l1cached;
 	kstat_named_t arcstat_l2_free_on_write;
 	kstat_named_t arcstat_l2_abort_lowmem;
+	/*
+	 * Number of eligible buffers the frequency based admission filter
+	 * (l2arc_admit_min_refs) let through, or turned away at least once.
+	 * Each buffer is counted once however many feed scans see it.
+	 */
+	kstat_named_t arcstat_l2_admit_accepted;
+	kstat_named_t arcstat_l2_admit_rejected;
 	kstat_named_t arcstat_l2_cksum_bad;
 	kstat_named_t arcstat_l2_io_error;
 	kstat_named_t arcstat_l2_lsize;
@@ -974,6 +1029,8 @@ typedef struct arc_sums {
 	wmsum_t arcstat_l2_evict_l1cached;
 	wmsum_t arcstat_l2_free_on_write;
 	wmsum_t arcstat_l2_abort_lowmem;
+	wmsum_t arcstat_l2_admit_accepted;
+	wmsum_t arcstat_l2_admit_rejected;
 	wmsum_t arcstat_l2_cksum_bad;
 	wmsum_t arcstat_l2_io_error;
 	wmsum_t arcstat_l2_lsize;
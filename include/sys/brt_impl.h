@@ -87,6 +87,11 @@ typedef struct brt_vdev_phys {
 } brt_vdev_phys_t;
 
 typedef struct brt_vdev {
+	/*
+	 * Protects all the fields below, including bv_tree and the
+	 * bv_entcount[] array.
+	 */
+	krwlock_t	bv_lock;
 	/*
 	 * VDEV id.
 	 */
@@ -101,9 +106,14 @@ typedef struct brt_vdev {
 	 */
 	uint64_t	bv_mos_brtvdev;
 	/*
-	 * Object number in the MOS for the entries table.
+	 * Object number in the MOS for the entries table, and its dnode,
+	 * which is held as long as the object exists.  They only change with
+	 * both bv_lock and bv_mos_entries_lock held as writer, so that the
+	 * table can be read with just bv_mos_entries_lock held.
 	 */
+	krwlock_t	bv_mos_entries_lock;
 	uint64_t	bv_mos_entries;
+	dnode_t		*bv_mos_entries_dnode;
 	/*
 	 * Entries to sync.
 	 */
@@ -158,18 +168,33 @@ typedef struct brt_vdev {
 /*
  * In-core brt
  */
+/*
+ * Blocks cloned in open context are queued per CPU, so that concurrent
+ * clones don't contend on a single tree.  The per-CPU trees are merged
+ * when they are applied in syncing context.
+ */
+typedef struct brt_pending {
+	kmutex_t	bp_lock;
+	avl_tree_t	bp_tree[TXG_SIZE];
+} ____cacheline_aligned brt_pending_t;
+
 typedef struct brt {
+	/*
+	 * Protects brt_vdevs and brt_nvdevs.  Each brt_vdev_t has its own
+	 * lock for everything else, and is never freed or moved before
+	 * brt_unload(), so it may be used after brt_lock is dropped.
+	 */
 	krwlock_t	brt_lock;
 	spa_t		*brt_spa;
 #define	brt_mos		brt_spa->spa_meta_objset
 	uint64_t	brt_rangesize;
 	uint64_t	brt_usedspace;
 	uint64_t	brt_savedspace;
-	avl_tree_t	brt_pending_tree[TXG_SIZE];
-	kmutex_t	brt_pending_lock[TXG_SIZE];
+	brt_pending_t	*brt_pending;
+	uint_t		brt_npending;
 	/* Sum of all entries across all bv_trees. */
 	uint64_t	brt_nentries;
-	brt_vdev_t	*brt_vdevs;
+	brt_vdev_t	**brt_vdevs;
 	uint64_t	brt_nvdevs;
 } brt_t;
 
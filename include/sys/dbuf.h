@@ -176,6 +176,7 @@ typedef struct dbuf_dirty_record {
 			uint8_t dr_copies;
 			boolean_t dr_nopwrite;
 			boolean_t dr_brtwrite;
+			boolean_t dr_diowrite;
 			boolean_t dr_has_raw_params;
 
 			/*
@@ -338,16 +339,46 @@ typedef struct dmu_buf_impl {
 	uint8_t db_partial_read;
 } dmu_buf_impl_t;
 
-#define	DBUF_HASH_MUTEX(h, idx) \
-	(&(h)->hash_mutexes[(idx) & ((h)->hash_mutex_mask)])
+/*
+ * The hash table lock protecting a bucket depends only on the low bits of
+ * the hash, which are shared by every bucket a dbuf can occupy as the table
+ * grows, so either a hash value or a bucket index may be passed in.
+ */
+#define	DBUF_HASH_RWLOCK(h, idx) \
+	(&(h)->hash_rwlocks[(idx) & ((h)->hash_rwlock_mask)])
 
 typedef struct dbuf_hash_table {
 	uint64_t hash_table_mask;
-	uint64_t hash_mutex_mask;
+	uint64_t hash_table_mask_max;
+	uint64_t hash_rwlock_mask;
 	dmu_buf_impl_t **hash_table;
-	kmutex_t *hash_mutexes;
+	krwlock_t *hash_rwlocks;
+	/*
+	 * While the table is being doubled, the chains of each lock whose
+	 * hash_lock_moved entry is still zero remain in hash_old_table.
+	 */
+	uint64_t hash_old_mask;
+	dmu_buf_impl_t **hash_old_table;
+	uint8_t *hash_lock_moved;
+	uint32_t hash_growing;
+	taskq_ent_t hash_grow_ent;
 } dbuf_hash_table_t;
 
+/*
+ * Return the head of the chain for the given hash value, in the old table
+ * if its lock's chains haven't been moved to the new one yet.  The caller
+ * must hold DBUF_HASH_RWLOCK(h, hv).
+ */
+static inline dmu_buf_impl_t **
+dbuf_hash_bucket(dbuf_hash_table_t *h, uint64_t hv)
+{
+	if (h->hash_old_table != NULL &&
+	    !h->hash_lock_moved[hv & h->hash_rwlock_mask])
+		return (&h->hash_old_table[hv & h->hash_old_mask]);
+
+	return (&h->hash_table[hv & h->hash_table_mask]);
+}
+
 typedef void (*dbuf_prefetch_fn)(void *, uint64_t, uint64_t, boolean_t);
 
 uint64_t dbuf_whichblock(const struct dnode *di, const int64_t level,
@@ -384,7 +415,7 @@ dmu_buf_impl_t *dbuf_find(struct objset *os, uint64_t object, uint8_t level,
     uint64_t blkid, uint64_t *hash_out);
 
 int dbuf_read(dmu_buf_impl_t *db, zio_t *zio, uint32_t flags);
-void dmu_buf_will_clone(dmu_buf_t *db, dmu_tx_t *tx);
+void dmu_buf_will_clone_or_dio(dmu_buf_t *db, dmu_tx_t *tx);
 void dmu_buf_will_not_fill(dmu_buf_t *db, dmu_tx_t *tx);
 void dmu_buf_will_fill(dmu_buf_t *db, dmu_tx_t *tx, boolean_t canfail);
 boolean_t dmu_buf_fill_done(dmu_buf_t *db, dmu_tx_t *tx, boolean_t failed);
@@ -39,6 +39,29 @@ extern "C" {
 
 struct abd;
 
+/*
+ * DDT-wide feature flags. These are set in ddt_flags by ddt_configure().
+ */
+#define	DDT_FLAG_LOG	(1 << 0)	/* use in-memory log */
+#define	DDT_FLAG_FLAT	(1 << 1)	/* single phys per entry */
+#define	DDT_FLAG_MASK	(DDT_FLAG_LOG|DDT_FLAG_FLAT)
+
+/*
+ * DDT on-disk version. Tables created before the fast_dedup feature are
+ * "legacy", and have their storage objects linked directly from the MOS
+ * directory. Newer tables have a per-checksum directory object of their own
+ * (DMU_POOL_DDT_DIR), holding the version, flags, storage objects and log
+ * objects. DDT_VERSION_UNCONFIGURED is only used in-core, for a table that
+ * has never had anything written to it.
+ */
+#define	DDT_VERSION_LEGACY		(0)
+#define	DDT_VERSION_FDT			(1)
+#define	DDT_VERSION_UNCONFIGURED	(UINT64_MAX)
+
+/* Names of the version and flags entries in a DDT directory object */
+#define	DDT_DIR_VERSION		"version"
+#define	DDT_DIR_FLAGS		"flags"
+
 /*
  * DDT on-disk storage object types. Each one corresponds to specific
  * implementation, see ddt_ops_t. The value itself is not stored on disk.
@@ -120,10 +143,12 @@ typedef struct {
  * characteristics of the stored block, such as its location on disk (DVAs),
  * birth txg and ref count.
  *
- * Note that an entry has an array of four ddt_phys_t, one for each number of
- * DVAs (copies= property) and another for additional "ditto" copies. Most
- * users of ddt_phys_t will handle indexing into or counting the phys they
- * want.
+ * Note that an entry in a "traditional" table has an array of four
+ * ddt_phys_t, one for each number of DVAs (copies= property) and another for
+ * additional "ditto" copies. An entry in a "flat" table (DDT_FLAG_FLAT) has
+ * just one, for whatever number of DVAs the block was first written with.
+ * Most users of ddt_phys_t will handle indexing into or counting the phys
+ * they want; the DDT_NPHYS() family of macros below cover both formats.
  */
 typedef struct {
 	dva_t		ddp_dva[SPA_DVAS_PER_BP];
@@ -131,6 +156,18 @@ typedef struct {
 	uint64_t	ddp_phys_birth;
 } ddt_phys_t;
 
+/*
+ * The value part of an entry in a flat table. This is a single ddt_phys_t,
+ * followed by the time the entry was last changed, in seconds since the
+ * epoch. Any change to the references of a unique entry also changes its
+ * class, so for those this is how long it has been unique; pruning uses it to
+ * find old unique entries (see ddt_prune_unique_entries()).
+ */
+typedef struct {
+	ddt_phys_t	ddf_phys;
+	uint64_t	ddf_class_start;
+} ddt_phys_flat_t;
+
 /*
  * Named indexes into the ddt_phys_t array in each entry.
  *
@@ -145,6 +182,31 @@ enum ddt_phys_type {
 	DDT_PHYS_TYPES
 };
 
+/*
+ * Flat tables keep their one phys in the first slot of the in-core array,
+ * overlaid with a ddt_phys_flat_t; the rest are unused. Only the part in use
+ * is stored on disk or on the log.
+ */
+#define	DDT_PHYS_FLAT		(0)
+
+#define	_DDT_PHYS_SWITCH(ddt, flat, trad)	\
+	(((ddt)->ddt_flags & DDT_FLAG_FLAT) ? (flat) : (trad))
+
+/* Number of phys slots in use for each entry */
+#define	DDT_NPHYS(ddt)		_DDT_PHYS_SWITCH(ddt, 1, DDT_PHYS_TYPES)
+
+/* Size of the phys part of each entry, as stored */
+#define	DDT_PHYS_SIZE(ddt)	_DDT_PHYS_SWITCH(ddt, \
+	sizeof (ddt_phys_flat_t), sizeof (ddt_phys_t) * DDT_PHYS_TYPES)
+
+/* Slot for a block written with the given number of copies */
+#define	DDT_PHYS_FOR_COPIES(ddt, p)	\
+	_DDT_PHYS_SWITCH(ddt, DDT_PHYS_FLAT, p)
+
+/* True if this slot holds obsolete dedupditto copies */
+#define	DDT_PHYS_IS_DITTO(ddt, p)	\
+	_DDT_PHYS_SWITCH(ddt, B_FALSE, (p) == DDT_PHYS_DITTO)
+
 /*
  * A "live" entry, holding changes to an entry made this txg, and other data to
  * support loading, updating and repairing the entry.
@@ -153,11 +215,16 @@ enum ddt_phys_type {
 /* State flags for dde_flags */
 #define	DDE_FLAG_LOADED		(1 << 0)	/* entry ready for use */
 #define	DDE_FLAG_OVERQUOTA	(1 << 1)	/* entry unusable, no space */
+#define	DDE_FLAG_LOGGED		(1 << 2)	/* loaded from the dedup log */
+#define	DDE_FLAG_FROM_FLUSHING	(1 << 3)	/* ... the flushing log */
 
 typedef struct {
 	/* key must be first for ddt_key_compare */
 	ddt_key_t	dde_key;			/* ddt_tree key */
-	ddt_phys_t	dde_phys[DDT_PHYS_TYPES];	/* on-disk data */
+	union {
+		ddt_phys_t	dde_phys[DDT_PHYS_TYPES]; /* on-disk data */
+		ddt_phys_flat_t	dde_flat;		/* ... flat tables */
+	};
 
 	/* in-flight update IOs */
 	zio_t		*dde_lead_zio[DDT_PHYS_TYPES];
@@ -176,6 +243,37 @@ typedef struct {
 	avl_node_t	dde_node;	/* ddt_tree node */
 } ddt_entry_t;
 
+/*
+ * An entry on the in-core dedup log. This is the most recent version of an
+ * entry that has been synced to the on-disk log, but not yet written back to
+ * its storage object. ddle_type and ddle_class are the storage object the
+ * entry was in when it was logged (DDT_TYPES/DDT_CLASSES if none); that is
+ * where it has to be removed from when the log is flushed.
+ */
+typedef struct {
+	/* key must be first for ddt_key_compare */
+	ddt_key_t	ddle_key;			/* ddl_tree key */
+	union {
+		ddt_phys_t	ddle_phys[DDT_PHYS_TYPES]; /* logged data */
+		ddt_phys_flat_t	ddle_flat;		/* ... flat tables */
+	};
+	uint8_t		ddle_type;			/* storage type */
+	uint8_t		ddle_class;			/* storage class */
+	avl_node_t	ddle_node;			/* ddl_tree node */
+} ddt_log_entry_t;
+
+/*
+ * In-core state for one of the two on-disk dedup logs. See ddt_log.c.
+ */
+typedef struct {
+	avl_tree_t	ddl_tree;	/* logged entries */
+	uint32_t	ddl_flags;	/* DDL_FLAG_* */
+	uint64_t	ddl_object;	/* log object id */
+	uint64_t	ddl_length;	/* on-disk log size, in bytes */
+	uint64_t	ddl_first_txg;	/* txg of the first record */
+	ddt_key_t	ddl_checkpoint;	/* last key flushed to storage */
+} ddt_log_t;
+
 /*
  * In-core DDT object. This covers all entries and stats for a the whole pool
  * for a given checksum type.
@@ -191,6 +289,16 @@ typedef struct {
 	spa_t		*ddt_spa;		/* pool this ddt is on */
 	objset_t	*ddt_os;		/* ddt objset (always MOS) */
 
+	uint64_t	ddt_version;		/* DDT_VERSION_* */
+	uint64_t	ddt_flags;		/* DDT_FLAG_* */
+	uint64_t	ddt_dir_object;		/* MOS dir holding objects */
+
+	/* dedup log, for tables with DDT_FLAG_LOG */
+	ddt_log_t	ddt_log[2];		/* both logs */
+	ddt_log_t	*ddt_log_active;	/* log taking new entries */
+	ddt_log_t	*ddt_log_flushing;	/* log being written back */
+	uint64_t	ddt_flush_count;	/* entries to flush per txg */
+
 	/* per-type/per-class entry store objects */
 	uint64_t	ddt_object[DDT_TYPES][DDT_CLASSES];
 
@@ -201,6 +309,10 @@ typedef struct {
 	/* type/class stats by power-2-sized referenced blocks */
 	ddt_histogram_t	ddt_histogram[DDT_TYPES][DDT_CLASSES];
 	ddt_histogram_t	ddt_histogram_cache[DDT_TYPES][DDT_CLASSES];
+
+	/* stats for entries on the logs, not yet in any storage object */
+	ddt_histogram_t	ddt_log_histogram;
+	ddt_histogram_t	ddt_log_histogram_cache;
 } ddt_t;
 
 /*
@@ -224,7 +336,9 @@ extern void ddt_phys_fill(ddt_phys_t *ddp, const blkptr_t *bp);
 extern void ddt_phys_clear(ddt_phys_t *ddp);
 extern void ddt_phys_addref(ddt_phys_t *ddp);
 extern void ddt_phys_decref(ddt_phys_t *ddp);
-extern ddt_phys_t *ddt_phys_select(const ddt_entry_t *dde, const blkptr_t *bp);
+extern int ddt_phys_dva_count(const ddt_phys_t *ddp, boolean_t encrypted);
+extern ddt_phys_t *ddt_phys_select(const ddt_t *ddt, const ddt_entry_t *dde,
+    const blkptr_t *bp);
 
 extern void ddt_histogram_add(ddt_histogram_t *dst, const ddt_histogram_t *src);
 extern void ddt_histogram_stat(ddt_stat_t *dds, const ddt_histogram_t *ddh);
@@ -264,6 +378,9 @@ extern int ddt_walk(spa_t *spa, ddt_bookmark_t *ddb, ddt_entry_t *dde);
 
 extern boolean_t ddt_addref(spa_t *spa, const blkptr_t *bp);
 
+extern int ddt_prune_unique_entries(spa_t *spa, uint64_t age,
+    ddt_object_t *freed);
+
 #ifdef	__cplusplus
 }
 #endif
@@ -60,7 +60,99 @@ typedef struct {
 
 extern const ddt_ops_t ddt_zap_ops;
 
+/*
+ * On-disk dedup log header, stored in the bonus buffer of each log object.
+ * See ddt_log.c.
+ */
+typedef struct {
+	uint64_t	dlh_info;	/* version and flags, see below */
+	uint64_t	dlh_length;	/* length of log records, in bytes */
+	uint64_t	dlh_first_txg;	/* txg of the first record */
+	ddt_key_t	dlh_checkpoint;	/* last key flushed to storage */
+} ddt_log_header_t;
+
+#define	DLH_GET_VERSION(dlh)	BF64_GET((dlh)->dlh_info, 0, 8)
+#define	DLH_SET_VERSION(dlh, v)	BF64_SET((dlh)->dlh_info, 0, 8, v)
+#define	DLH_GET_FLAGS(dlh)	BF64_GET((dlh)->dlh_info, 8, 8)
+#define	DLH_SET_FLAGS(dlh, f)	BF64_SET((dlh)->dlh_info, 8, 8, f)
+
+#define	DDT_LOG_VERSION		(1)
+
+/* Log header flags, also kept in-core in ddl_flags */
+#define	DDL_FLAG_FLUSHING	(1 << 0)	/* this is the flushing log */
+#define	DDL_FLAG_CHECKPOINT	(1 << 1)	/* dlh_checkpoint is valid */
+#define	DDL_FLAG_MASK		(DDL_FLAG_FLUSHING | DDL_FLAG_CHECKPOINT)
+
+/*
+ * On-disk dedup log record. Records are packed back-to-back into the log
+ * object; each one is a word of info followed by a variable-length payload.
+ * The only record type is DLR_ENTRY, whose payload is the ddt_key_t followed
+ * by the entry's ddt_phys_t array (DDT_PHYS_SIZE() bytes).
+ */
+typedef struct {
+	uint64_t	dlr_info;	/* type, length, entry location */
+	uint64_t	dlr_payload[];	/* record contents */
+} ddt_log_record_t;
+
+#define	DLR_GET_TYPE(dlr)		BF64_GET((dlr)->dlr_info, 0, 8)
+#define	DLR_SET_TYPE(dlr, v)		BF64_SET((dlr)->dlr_info, 0, 8, v)
+#define	DLR_GET_RECLEN(dlr)		BF64_GET((dlr)->dlr_info, 8, 16)
+#define	DLR_SET_RECLEN(dlr, v)		BF64_SET((dlr)->dlr_info, 8, 16, v)
+#define	DLR_GET_ENTRY_TYPE(dlr)		BF64_GET((dlr)->dlr_info, 24, 8)
+#define	DLR_SET_ENTRY_TYPE(dlr, v)	BF64_SET((dlr)->dlr_info, 24, 8, v)
+#define	DLR_GET_ENTRY_CLASS(dlr)	BF64_GET((dlr)->dlr_info, 32, 8)
+#define	DLR_SET_ENTRY_CLASS(dlr, v)	BF64_SET((dlr)->dlr_info, 32, 8, v)
+
+#define	DLR_INVALID		(0)
+#define	DLR_ENTRY		(1)
+
+/*
+ * In-progress append to the active log, see ddt_log_begin().
+ */
+typedef struct {
+	dmu_tx_t	*dlu_tx;	/* tx for this update */
+	uint8_t		*dlu_buf;	/* staging buffer */
+	size_t		dlu_size;	/* size of dlu_buf */
+	size_t		dlu_pos;	/* bytes used in dlu_buf */
+} ddt_log_update_t;
+
+extern void ddt_log_init(void);
+extern void ddt_log_fini(void);
+
+extern void ddt_log_alloc(ddt_t *ddt);
+extern void ddt_log_free(ddt_t *ddt);
+
+extern void ddt_log_create(ddt_t *ddt, dmu_tx_t *tx);
+extern void ddt_log_destroy(ddt_t *ddt, dmu_tx_t *tx);
+extern int ddt_log_load(ddt_t *ddt);
+
+extern ddt_log_entry_t *ddt_log_find_key(ddt_t *ddt, const ddt_key_t *ddk,
+    boolean_t *flushing);
+extern void ddt_log_remove_entry(ddt_t *ddt, ddt_log_t *ddl,
+    ddt_log_entry_t *ddle);
+extern boolean_t ddt_log_remove_key(ddt_t *ddt, ddt_log_t *ddl,
+    const ddt_key_t *ddk);
+
+extern void ddt_log_begin(ddt_t *ddt, dmu_tx_t *tx, ddt_log_update_t *dlu);
+extern void ddt_log_entry(ddt_t *ddt, const ddt_entry_t *dde,
+    ddt_log_update_t *dlu);
+extern void ddt_log_commit(ddt_t *ddt, ddt_log_update_t *dlu);
+
+extern boolean_t ddt_log_swap_ready(ddt_t *ddt, uint64_t txg);
+extern boolean_t ddt_log_over_mem(ddt_t *ddt);
+extern void ddt_log_swap(ddt_t *ddt, dmu_tx_t *tx);
+extern void ddt_log_checkpoint(ddt_t *ddt, const ddt_key_t *ddk,
+    dmu_tx_t *tx);
+extern void ddt_log_truncate(ddt_t *ddt, dmu_tx_t *tx);
+extern boolean_t ddt_log_empty(ddt_t *ddt);
+
 extern void ddt_stat_update(ddt_t *ddt, ddt_entry_t *dde, uint64_t neg);
+extern void ddt_histogram_add_entry(ddt_t *ddt, ddt_histogram_t *ddh,
+    const ddt_key_t *ddk, const ddt_phys_t *phys);
+extern void ddt_histogram_sub_entry(ddt_t *ddt, ddt_histogram_t *ddh,
+    const ddt_key_t *ddk, const ddt_phys_t *phys);
+extern void ddt_object_entry_space(ddt_t *ddt, ddt_type_t type,
+    ddt_class_t clazz, ddt_object_t *ddo);
 
 /*
  * These are only exposed so that zdb can access them. Try not to use them
@@ -74,7 +166,7 @@ extern void ddt_stat_update(ddt_t *ddt, ddt_entry_t *dde, uint64_t neg);
  */
 #define	DDT_NAMELEN	32
 
-extern uint64_t ddt_phys_total_refcnt(const ddt_entry_t *dde);
+extern uint64_t ddt_phys_total_refcnt(const ddt_t *ddt, const ddt_phys_t *ddp);
 
 extern void ddt_key_fill(ddt_key_t *ddk, const blkptr_t *bp);
 
@@ -82,6 +174,7 @@ extern void ddt_stat_add(ddt_stat_t *dst, const ddt_stat_t *src, uint64_t neg);
 
 extern void ddt_object_name(ddt_t *ddt, ddt_type_t type, ddt_class_t clazz,
     char *name);
+extern void ddt_log_name(ddt_t *ddt, uint_t n, char *name);
 extern int ddt_object_walk(ddt_t *ddt, ddt_type_t type, ddt_class_t clazz,
     uint64_t *walk, ddt_entry_t *dde);
 extern int ddt_object_count(ddt_t *ddt, ddt_type_t type, ddt_class_t clazz,
@@ -469,6 +469,7 @@ struct spa {
 	uint64_t	spa_dedup_table_quota;	/* property DDT maximum size */
 	uint64_t	spa_dedup_dsize;	/* cached on-disk size of DDT */
 	uint64_t	spa_dedup_class_full_txg; /* txg dedup class was full */
+	uint32_t	spa_ddt_prune_active;	/* ddt_prune_unique_entries() */
 
 	/*
 	 * spa_refcount & spa_config_lock must be the last elements
@@ -45,6 +45,17 @@ extern int zfs_uiomove(void *, size_t, zfs_uio_rw_t, zfs_uio_t *);
 extern int zfs_uiocopy(void *, size_t, zfs_uio_rw_t, zfs_uio_t *, size_t *);
 extern void zfs_uioskip(zfs_uio_t *, size_t);
 
+/*
+ * Direct I/O: pin the user pages behind the next n bytes of the uio, without
+ * consuming it, and map them with an ABD.  ENOTSUP means the uio can't be
+ * used for Direct I/O, and the caller should copy the data instead.
+ */
+struct abd;
+extern boolean_t zfs_uio_page_aligned(zfs_uio_t *);
+extern int zfs_uio_get_dio_pages_alloc(zfs_uio_t *, zfs_uio_rw_t, size_t,
+    struct abd **);
+extern void zfs_uio_free_dio_pages(zfs_uio_t *, zfs_uio_rw_t, struct abd *);
+
 static inline void
 zfs_uio_iov_at_index(zfs_uio_t *uio, uint_t idx, void **base, uint64_t *len)
 {
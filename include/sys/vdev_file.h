@@ -35,6 +35,10 @@ extern "C" {
 
 typedef struct vdev_file {
 	zfs_file_t	*vf_file;
+#ifndef _KERNEL
+	void		*vf_map;	/* see vdev_file_log_mmap */
+	size_t		vf_map_size;
+#endif
 } vdev_file_t;
 
 extern void vdev_file_init(void);
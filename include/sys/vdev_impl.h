@@ -289,6 +289,14 @@ struct vdev {
 	/* pool checkpoint related */
 	space_map_t	*vdev_checkpoint_sm;	/* contains reserved blocks */
 
+	/*
+	 * ZIL flush epochs, shared by all the datasets logging to this vdev.
+	 * Protected by vdev_zil_flush_lock.
+	 */
+	kmutex_t	vdev_zil_flush_lock;
+	boolean_t	vdev_zil_flush_active;	/* an epoch flush is running */
+	zio_t		*vdev_zil_flush_next;	/* epoch waiting to be issued */
+
 	/* Initialize related */
 	boolean_t	vdev_initialize_exit_wanted;
 	vdev_initializing_state_t	vdev_initialize_state;
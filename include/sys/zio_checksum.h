@@ -45,6 +45,8 @@ typedef void zio_checksum_t(struct abd *abd, uint64_t size,
     const void *ctx_template, zio_cksum_t *zcp);
 typedef void *zio_checksum_tmpl_init_t(const zio_cksum_salt_t *salt);
 typedef void zio_checksum_tmpl_free_t(void *ctx_template);
+typedef void zio_checksum_batch_t(struct abd **abds, const uint64_t *sizes,
+    uint_t n, const void *ctx_template, zio_cksum_t *zcps);
 
 typedef enum zio_checksum_flags {
 	/* Strong enough for metadata? */
@@ -69,6 +71,7 @@ typedef struct zio_abd_checksum_data {
 	fletcher_4_ctx_t	*acd_ctx;
 	zio_cksum_t 		*acd_zcp;
 	void 			*acd_private;
+	void			*acd_batch_private;
 } zio_abd_checksum_data_t;
 
 typedef void zio_abd_checksum_init_t(zio_abd_checksum_data_t *);
@@ -79,6 +82,8 @@ typedef const struct zio_abd_checksum_func {
 	zio_abd_checksum_init_t *acf_init;
 	zio_abd_checksum_fini_t *acf_fini;
 	zio_abd_checksum_iter_t *acf_iter;
+	zio_abd_checksum_init_t *acf_batch_init;
+	zio_abd_checksum_fini_t *acf_batch_fini;
 } zio_abd_checksum_func_t;
 
 /*
@@ -93,6 +98,11 @@ typedef const struct zio_checksum_info {
 	const char			*ci_name;	/* descriptive name */
 } zio_checksum_info_t;
 
+/*
+ * The most zios whose checksums zio_checksum_verify_batch() computes together.
+ */
+#define	ZIO_CHECKSUM_BATCH_MAX	16
+
 typedef struct zio_bad_cksum {
 	const char		*zbc_checksum_name;
 	uint8_t			zbc_byteswapped;
@@ -134,6 +144,8 @@ extern zio_checksum_tmpl_free_t abd_checksum_blake3_tmpl_free;
 _SYS_ZIO_CHECKSUM_H zio_abd_checksum_func_t fletcher_4_abd_ops;
 extern zio_checksum_t abd_fletcher_4_native;
 extern zio_checksum_t abd_fletcher_4_byteswap;
+extern zio_checksum_batch_t abd_fletcher_4_native_batch;
+extern zio_checksum_batch_t abd_fletcher_4_byteswap_batch;
 
 extern int zio_checksum_equal(spa_t *, blkptr_t *, enum zio_checksum,
     void *, uint64_t, uint64_t, zio_bad_cksum_t *);
@@ -142,6 +154,7 @@ extern void zio_checksum_compute(zio_t *, enum zio_checksum,
 extern int zio_checksum_error_impl(spa_t *, const blkptr_t *, enum zio_checksum,
     struct abd *, uint64_t, uint64_t, zio_bad_cksum_t *);
 extern int zio_checksum_error(zio_t *zio, zio_bad_cksum_t *out);
+extern void zio_checksum_verify_batch(zio_t **zios, uint_t nzios);
 extern enum zio_checksum spa_dedup_checksum(spa_t *spa);
 extern void zio_checksum_templates_free(spa_t *spa);
 extern spa_feature_t zio_checksum_to_feature(enum zio_checksum cksum);
@@ -1784,6 +1784,38 @@ zpool_prefetch(zpool_handle_t *zhp, zpool_prefetch_type_t type)
 	return (0);
 }
 
+/*
+ * Prune old unique entries from the pool's dedup tables.
+ */
+int
+zpool_ddt_prune(zpool_handle_t *zhp, uint64_t age, ddt_object_t *freed)
+{
+	libzfs_handle_t *hdl = zhp->zpool_hdl;
+	char msg[1024];
+	int error;
+
+	error = lzc_ddt_prune(zhp->zpool_name, age, freed);
+	if (error != 0) {
+		(void) snprintf(msg, sizeof (msg), dgettext(TEXT_DOMAIN,
+		    "cannot prune dedup table on '%s'"), zhp->zpool_name);
+
+		if (error == EALREADY) {
+			zfs_error_aux(hdl, dgettext(TEXT_DOMAIN,
+			    "a prune is already in progress"));
+			(void) zfs_error(hdl, EZFS_BUSY, msg);
+		} else if (error == ENOTSUP) {
+			zfs_error_aux(hdl, dgettext(TEXT_DOMAIN,
+			    "the fast_dedup feature must be enabled"));
+			(void) zfs_error(hdl, EZFS_POOL_NOTSUP, msg);
+		} else {
+			(void) zpool_standard_error(hdl, error, msg);
+		}
+		return (-1);
+	}
+
+	return (0);
+}
+
 /*
  * Add the given vdevs to the pool.  The caller must have already performed the
  * necessary verification to ensure that the vdev specification is well-formed.
@@ -1649,6 +1649,37 @@ lzc_pool_prefetch(const char *pool, zpool_prefetch_type_t type)
 	return (error);
 }
 
+/*
+ * Remove unique entries older than the given age (in seconds) from the
+ * pool's dedup tables. If freed is not NULL, it is filled in with the number
+ * of entries removed and an estimate of the space they were using.
+ */
+int
+lzc_ddt_prune(const char *pool, uint64_t age, ddt_object_t *freed)
+{
+	int error;
+	nvlist_t *result = NULL;
+	nvlist_t *args = fnvlist_alloc();
+
+	fnvlist_add_uint64(args, DDT_PRUNE_AGE, age);
+
+	error = lzc_ioctl(ZFS_IOC_DDT_PRUNE, pool, args, &result);
+
+	if (error == 0 && freed != NULL) {
+		freed->ddo_count = fnvlist_lookup_uint64(result,
+		    DDT_PRUNE_ENTRIES);
+		freed->ddo_dspace = fnvlist_lookup_uint64(result,
+		    DDT_PRUNE_DSPACE);
+		freed->ddo_mspace = fnvlist_lookup_uint64(result,
+		    DDT_PRUNE_MSPACE);
+	}
+
+	fnvlist_free(args);
+	fnvlist_free(result);
+
+	return (error);
+}
+
 /*
  * Executes a read-only channel program.
  *
@@ -99,6 +99,9 @@ aes_init_keysched(const uint8_t *cipherKey, uint_t keyBits, void *keysched)
 	 * future, move setting key schedule type to individual implementations
 	 */
 	newbie->type = AES_32BIT_KS;
+#ifdef __amd64
+	newbie->gcm_htab_valid = B_FALSE;
+#endif
 }
 
 
@@ -74,6 +74,7 @@ static int gcm_encrypt_final_avx(gcm_ctx_t *, crypto_data_t *, size_t);
 static int gcm_decrypt_final_avx(gcm_ctx_t *, crypto_data_t *, size_t);
 static int gcm_init_avx(gcm_ctx_t *, const uint8_t *, size_t, const uint8_t *,
     size_t, size_t);
+static void gcm_init_keysched_avx(aes_key_t *);
 #endif /* ifdef CAN_USE_GCM_ASM */
 
 /*
@@ -671,8 +672,17 @@ gcm_init_ctx(gcm_ctx_t *gcm_ctx, char *param,
 		    "restore performance.");
 	}
 
-	/* Allocate Htab memory as needed. */
-	if (gcm_ctx->gcm_use_avx == B_TRUE) {
+	/*
+	 * Allocate Htab memory as needed. If the key schedule is a template
+	 * carrying a precomputed table, borrow that one instead; a zero
+	 * gcm_htab_len tells gcm_clear_ctx() not to free it.
+	 */
+	if (gcm_ctx->gcm_use_avx == B_TRUE &&
+	    ((aes_key_t *)gcm_ctx->gcm_keysched)->gcm_htab_valid) {
+		gcm_ctx->gcm_htab_len = 0;
+		gcm_ctx->gcm_Htable =
+		    ((aes_key_t *)gcm_ctx->gcm_keysched)->gcm_Htable;
+	} else if (gcm_ctx->gcm_use_avx == B_TRUE) {
 		size_t htab_len = gcm_simd_get_htab_size(gcm_ctx->gcm_use_avx);
 
 		if (htab_len == 0) {
@@ -705,6 +715,24 @@ gcm_init_ctx(gcm_ctx_t *gcm_ctx, char *param,
 	return (rv);
 }
 
+/*
+ * Prepare a key schedule which will be used as a context template. For the
+ * avx implementation this caches the GHASH subkey tables in the schedule.
+ */
+void
+gcm_init_keysched(void *keysched)
+{
+#ifdef CAN_USE_GCM_ASM
+	aes_key_t *ks = keysched;
+
+	ks->gcm_htab_valid = B_FALSE;
+	if (gcm_avx_will_work() && ks->ops->needs_byteswap == B_FALSE)
+		gcm_init_keysched_avx(ks);
+#else
+	(void) keysched;
+#endif
+}
+
 void *
 gcm_alloc_ctx(int kmflag)
 {
@@ -1058,7 +1086,7 @@ gcm_simd_get_htab_size(boolean_t simd_mode)
 {
 	switch (simd_mode) {
 	case B_TRUE:
-		return (2 * 6 * 2 * sizeof (uint64_t));
+		return (GCM_AVX_HTAB_WORDS * sizeof (uint64_t));
 
 	default:
 		return (0);
@@ -1427,12 +1455,19 @@ gcm_init_avx(gcm_ctx_t *ctx, const uint8_t *iv, size_t iv_len,
 
 	/* Init H (encrypt zero block) and create the initial counter block. */
 	memset(ctx->gcm_ghash, 0, sizeof (ctx->gcm_ghash));
-	memset(H, 0, sizeof (ctx->gcm_H));
-	kfpu_begin();
-	aes_encrypt_intel(keysched, aes_rounds,
-	    (const uint32_t *)H, (uint32_t *)H);
+	if (ctx->gcm_htab_len == 0) {
+		/* H and Htable were precomputed by gcm_init_keysched(). */
+		memcpy(H, ((aes_key_t *)ctx->gcm_keysched)->gcm_H,
+		    sizeof (ctx->gcm_H));
+		kfpu_begin();
+	} else {
+		memset(H, 0, sizeof (ctx->gcm_H));
+		kfpu_begin();
+		aes_encrypt_intel(keysched, aes_rounds,
+		    (const uint32_t *)H, (uint32_t *)H);
 
-	gcm_init_htab_avx(ctx->gcm_Htable, H);
+		gcm_init_htab_avx(ctx->gcm_Htable, H);
+	}
 
 	if (iv_len == 12) {
 		memcpy(cb, iv, 12);
@@ -1489,6 +1524,33 @@ gcm_init_avx(gcm_ctx_t *ctx, const uint8_t *iv, size_t iv_len,
 	return (CRYPTO_SUCCESS);
 }
 
+/*
+ * Contexts borrow the key schedule's table in place of one allocated with
+ * gcm_simd_get_htab_size(), so the two must have the same size.
+ */
+_Static_assert(sizeof (((aes_key_t *)NULL)->gcm_Htable) ==
+    GCM_AVX_HTAB_WORDS * sizeof (uint64_t),
+    "aes_key_t gcm_Htable does not match the gcm avx table size");
+
+/*
+ * Compute H and Htable for a key schedule once, so that every context
+ * created from it can skip the zero block encryption and table setup.
+ */
+static void
+gcm_init_keysched_avx(aes_key_t *ks)
+{
+	ASSERT3S(ks->ops->needs_byteswap, ==, B_FALSE);
+
+	memset(ks->gcm_H, 0, sizeof (ks->gcm_H));
+	kfpu_begin();
+	aes_encrypt_intel(ks->encr_ks.ks32, ks->nr,
+	    (const uint32_t *)ks->gcm_H, (uint32_t *)ks->gcm_H);
+	gcm_init_htab_avx(ks->gcm_Htable, ks->gcm_H);
+	clear_fpu_regs();
+	kfpu_end();
+	ks->gcm_htab_valid = B_TRUE;
+}
+
 #if defined(_KERNEL)
 static int
 icp_gcm_avx_set_chunk_size(const char *buf, zfs_kernel_param_t *kp)
@@ -37,6 +37,7 @@ extern "C" {
 #include <sys/zfs_context.h>
 #include <sys/crypto/common.h>
 #include <sys/asm_linkage.h>
+#include <modes/modes.h>
 
 /* Similar to sysmacros.h IS_P2ALIGNED, but checks two pointers: */
 #define	IS_P2ALIGNED2(v, w, a) \
@@ -116,6 +117,16 @@ struct aes_key {
 	const aes_impl_ops_t	*ops;	/* ops associated with this schedule */
 	int		nr;	  /* number of rounds (10, 12, or 14) */
 	int		type;	  /* key schedule size (32 or 64 bits) */
+#ifdef __amd64
+	/*
+	 * GHASH subkey and its precomputed powers for the gcm avx
+	 * implementation, filled in by gcm_init_keysched() when this
+	 * schedule is used as a context template.
+	 */
+	uint64_t	gcm_H[2];
+	uint64_t	gcm_Htable[GCM_AVX_HTAB_WORDS];
+	boolean_t	gcm_htab_valid;
+#endif	/* __amd64 */
 };
 
 /*
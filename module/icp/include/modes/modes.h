@@ -45,6 +45,12 @@ extern "C" {
 extern boolean_t gcm_avx_can_use_movbe;
 #endif
 
+/*
+ * Number of 64-bit words in the table of pre-shifted powers of H built by
+ * the gcm avx implementation (see gcm_Htable below).
+ */
+#define	GCM_AVX_HTAB_WORDS	(2 * 6 * 2)
+
 #define	CCM_MODE			0x00000010
 #define	GCM_MODE			0x00000020
 
@@ -259,6 +265,8 @@ extern int gcm_init_ctx(gcm_ctx_t *, char *, size_t,
     void (*copy_block)(uint8_t *, uint8_t *),
     void (*xor_block)(uint8_t *, uint8_t *));
 
+extern void gcm_init_keysched(void *);
+
 extern void calculate_ccm_mac(ccm_ctx_t *, uint8_t *,
     int (*encrypt_block)(const void *, const uint8_t *, uint8_t *));
 
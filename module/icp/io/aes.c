@@ -409,6 +409,13 @@ aes_create_ctx_template(crypto_mechanism_t *mechanism, crypto_key_t *key,
 		return (rv);
 	}
 
+	/*
+	 * Every context created from a GCM template uses the same key,
+	 * so derive the GHASH subkey tables once here.
+	 */
+	if (mechanism->cm_type == AES_GCM_MECH_INFO_TYPE)
+		gcm_init_keysched(keysched);
+
 	*tmpl = keysched;
 	*tmpl_size = size;
 
@@ -115,3 +115,28 @@ zfs_uio_fault_move(void *p, size_t n, zfs_uio_rw_t dir, zfs_uio_t *uio)
 	ASSERT3U(zfs_uio_rw(uio), ==, dir);
 	return (vn_io_fault_uiomove(p, n, GET_UIO_STRUCT(uio)));
 }
+
+/*
+ * Direct I/O is not yet supported on FreeBSD, so these requests are always
+ * handled through the ARC.
+ */
+boolean_t
+zfs_uio_page_aligned(zfs_uio_t *uio)
+{
+	(void) uio;
+	return (B_FALSE);
+}
+
+int
+zfs_uio_get_dio_pages_alloc(zfs_uio_t *uio, zfs_uio_rw_t rw, size_t n,
+    struct abd **abdp)
+{
+	(void) uio, (void) rw, (void) n, (void) abdp;
+	return (SET_ERROR(ENOTSUP));
+}
+
+void
+zfs_uio_free_dio_pages(zfs_uio_t *uio, zfs_uio_rw_t rw, struct abd *abd)
+{
+	(void) uio, (void) rw, (void) abd;
+}
@@ -351,6 +351,17 @@ abd_free_linear_page(abd_t *abd)
 	VERIFY(0);
 }
 
+void
+abd_free_from_pages(abd_t *abd)
+{
+	/*
+	 * FreeBSD does not build ABDs from user pages
+	 * so there is an error.
+	 */
+	(void) abd;
+	VERIFY(0);
+}
+
 /*
  * If we're going to use this ABD for doing I/O using the block layer, the
  * consumer of the ABD data doesn't care if it's scattered or not, and we don't
@@ -1027,7 +1027,33 @@ taskq_thread_create(taskq_t *tq)
 		return (NULL);
 	}
 
-	if (spl_taskq_thread_bind) {
+	if (tq->tq_node != NUMA_NO_NODE) {
+		/*
+		 * Let the threads of a node-local taskq run on any CPU of that
+		 * node.  Where set_cpus_allowed_ptr() is GPL-only, bind each
+		 * thread to one of the node's online CPUs, picked by its pid.
+		 * A node without online CPUs leaves the thread unbound rather
+		 * than failing the taskq.
+		 */
+		const struct cpumask *mask = cpumask_of_node(tq->tq_node);
+#ifdef HAVE_SET_CPUS_ALLOWED_PTR
+		(void) set_cpus_allowed_ptr(tqt->tqt_thread, mask);
+#else
+		int cpu, ncpus = 0;
+
+		for_each_cpu_and(cpu, mask, cpu_online_mask)
+			ncpus++;
+		if (ncpus > 0) {
+			int skip = tqt->tqt_thread->pid % ncpus;
+
+			for_each_cpu_and(cpu, mask, cpu_online_mask) {
+				if (skip-- == 0)
+					break;
+			}
+			kthread_bind(tqt->tqt_thread, cpu);
+		}
+#endif
+	} else if (spl_taskq_thread_bind) {
 		last_used_cpu = (last_used_cpu + 1) % num_online_cpus();
 		kthread_bind(tqt->tqt_thread, last_used_cpu);
 	}
@@ -1040,9 +1066,13 @@ taskq_thread_create(taskq_t *tq)
 	return (tqt);
 }
 
+/*
+ * Create a taskq whose threads are bound to the CPUs of the given NUMA
+ * node, or which behaves like taskq_create() when node is NUMA_NO_NODE.
+ */
 taskq_t *
-taskq_create(const char *name, int threads_arg, pri_t pri,
-    int minalloc, int maxalloc, uint_t flags)
+taskq_create_node(const char *name, int threads_arg, pri_t pri,
+    int minalloc, int maxalloc, uint_t flags, int node)
 {
 	taskq_t *tq;
 	taskq_thread_t *tqt;
@@ -1104,6 +1134,7 @@ taskq_create(const char *name, int threads_arg, pri_t pri,
 	init_waitqueue_head(&tq->tq_wait_waitq);
 	tq->tq_lock_class = TQ_LOCK_GENERAL;
 	INIT_LIST_HEAD(&tq->tq_taskqs);
+	tq->tq_node = node;
 
 	if (flags & TASKQ_PREPOPULATE) {
 		spin_lock_irqsave_nested(&tq->tq_lock, irqflags,
@@ -1147,6 +1178,15 @@ taskq_create(const char *name, int threads_arg, pri_t pri,
 
 	return (tq);
 }
+EXPORT_SYMBOL(taskq_create_node);
+
+taskq_t *
+taskq_create(const char *name, int threads_arg, pri_t pri,
+    int minalloc, int maxalloc, uint_t flags)
+{
+	return (taskq_create_node(name, threads_arg, pri, minalloc, maxalloc,
+	    flags, NUMA_NO_NODE));
+}
 EXPORT_SYMBOL(taskq_create);
 
 void
@@ -473,6 +473,43 @@ abd_free_chunks(abd_t *abd)
 	abd_free_sg_table(abd);
 }
 
+/*
+ * Construct a scatter ABD over an array of pinned pages, such as the user
+ * pages of a Direct I/O request, starting @offset bytes into the first page.
+ * The ABD only maps the pages; the caller keeps its references on them and
+ * must not release them until the ABD has been freed.
+ */
+abd_t *
+abd_alloc_from_pages(struct page **pages, unsigned long offset, uint64_t size)
+{
+	struct scatterlist *sg = NULL;
+	struct sg_table table;
+	gfp_t gfp = __GFP_NOWARN | GFP_NOIO;
+	unsigned int nr_pages = DIV_ROUND_UP(offset + size, PAGESIZE);
+	int i = 0;
+
+	ASSERT3U(offset, <, PAGESIZE);
+	ASSERT3U(size, >, 0);
+	ASSERT3U(size, <=, SPA_MAXBLOCKSIZE);
+
+	while (sg_alloc_table(&table, nr_pages, gfp)) {
+		ABDSTAT_BUMP(abdstat_scatter_sg_table_retry);
+		schedule_timeout_interruptible(1);
+	}
+
+	abd_t *abd = abd_alloc_struct(0);
+	abd->abd_flags |= ABD_FLAG_FROM_PAGES;
+	abd->abd_size = size;
+	ABD_SCATTER(abd).abd_offset = offset;
+	ABD_SCATTER(abd).abd_sgl = table.sgl;
+	ABD_SCATTER(abd).abd_nents = nr_pages;
+
+	abd_for_each_sg(abd, sg, nr_pages, i)
+		sg_set_page(sg, pages[i], PAGESIZE, 0);
+
+	return (abd);
+}
+
 /*
  * Allocate scatter ABD of size SPA_MAXBLOCKSIZE, where each page in
  * the scatterlist will be set to the zero'd out buffer abd_zero_page.
@@ -838,6 +875,16 @@ abd_free_linear_page(abd_t *abd)
 	abd_update_scatter_stats(abd, ABDSTAT_DECR);
 }
 
+/*
+ * Free the scatterlist of an ABD built by abd_alloc_from_pages().  The pages
+ * themselves belong to the caller.
+ */
+void
+abd_free_from_pages(abd_t *abd)
+{
+	abd_free_sg_table(abd);
+}
+
 /*
  * If we're going to use this ABD for doing I/O using the block layer, the
  * consumer of the ABD data doesn't care if it's scattered or not, and we don't
@@ -658,6 +658,16 @@ vdev_bio_max_bytes(struct block_device *bdev)
 }
 
 
+/*
+ * A child of a gang ABD which had to be copied into a fresh buffer before
+ * its pages could be handed to the kernel.
+ */
+typedef struct {
+	abd_t		*vbb_src;	/* child abd the copy was taken from */
+	abd_t		*vbb_abd;	/* page-aligned copy of the child */
+	size_t		vbb_size;	/* bytes copied */
+} vbio_bounce_t;
+
 /*
  * Virtual block IO object (VBIO)
  *
@@ -680,6 +690,10 @@ typedef struct {
 
 	abd_t		*vbio_abd;	/* abd carrying borrowed linear buf */
 
+	vbio_bounce_t	*vbio_bounce;	/* copied children of a gang abd */
+	uint_t		vbio_nbounce;	/* # of copied children */
+	uint_t		vbio_bounce_max; /* # of vbio_bounce entries */
+
 	uint_t		vbio_max_segs;	/* max segs per bio */
 
 	uint_t		vbio_max_bytes;	/* max bytes per bio */
@@ -699,6 +713,7 @@ vbio_alloc(zio_t *zio, struct block_device *bdev, int flags)
 	vbio->vbio_zio = zio;
 	vbio->vbio_bdev = bdev;
 	vbio->vbio_abd = NULL;
+	vbio->vbio_bounce = NULL;
 	vbio->vbio_max_segs = vdev_bio_max_segs(bdev);
 	vbio->vbio_max_bytes = vdev_bio_max_bytes(bdev);
 	vbio->vbio_lbs_mask = ~(bdev_logical_block_size(bdev)-1);
@@ -804,6 +819,35 @@ vbio_submit(vbio_t *vbio, abd_t *abd, uint64_t size)
 	blk_finish_plug(&plug);
 }
 
+/*
+ * Copy the data read into the copies of any gang children back to them.
+ */
+static void
+vbio_copy_bounce(vbio_t *vbio)
+{
+	for (uint_t i = 0; i < vbio->vbio_nbounce; i++) {
+		vbio_bounce_t *vbb = &vbio->vbio_bounce[i];
+
+		abd_copy(vbb->vbb_src, vbb->vbb_abd, vbb->vbb_size);
+	}
+}
+
+/*
+ * Free the copies of any gang children and release the bounce table.
+ */
+static void
+vbio_free_bounce(vbio_t *vbio)
+{
+	for (uint_t i = 0; i < vbio->vbio_nbounce; i++)
+		abd_free(vbio->vbio_bounce[i].vbb_abd);
+
+	kmem_free(vbio->vbio_bounce,
+	    vbio->vbio_bounce_max * sizeof (vbio_bounce_t));
+	vbio->vbio_bounce = NULL;
+	vbio->vbio_nbounce = 0;
+	vbio->vbio_bounce_max = 0;
+}
+
 /* IO completion callback */
 BIO_END_IO_PROTO(vbio_completion, bio, error)
 {
@@ -834,7 +878,13 @@ BIO_END_IO_PROTO(vbio_completion, bio, error)
 	 * If we copied the ABD before issuing it, clean up and return the copy
 	 * to the ADB, with changes if appropriate.
 	 */
-	if (vbio->vbio_abd != NULL) {
+	if (vbio->vbio_bounce != NULL) {
+		abd_free(vbio->vbio_abd);
+		vbio->vbio_abd = NULL;
+		if (zio->io_type == ZIO_TYPE_READ)
+			vbio_copy_bounce(vbio);
+		vbio_free_bounce(vbio);
+	} else if (vbio->vbio_abd != NULL) {
 		void *buf = abd_to_buf(vbio->vbio_abd);
 		abd_free(vbio->vbio_abd);
 		vbio->vbio_abd = NULL;
@@ -918,6 +968,90 @@ vdev_disk_check_pages(abd_t *abd, uint64_t size, struct block_device *bdev)
 	return (B_TRUE);
 }
 
+/*
+ * An aggregated zio carries a gang ABD stitched together from the buffers of
+ * the zios it covers.  When only some of those buffers are misaligned (eg a
+ * small gang block among large data blocks), copy just those children and
+ * pass the pages of all the others to the kernel directly, instead of
+ * copying the whole aggregate.  Returns a new gang ABD to submit, or NULL if
+ * the result still could not be submitted as-is.
+ */
+static abd_t *
+vbio_bounce_gang(vbio_t *vbio, struct block_device *bdev)
+{
+	zio_t *zio = vbio->vbio_zio;
+	abd_t *abd = zio->io_abd;
+	abd_t *cabd;
+	uint_t nchildren = 0;
+
+	ASSERT(abd_is_gang(abd));
+
+	for (cabd = abd_gang_next(abd, NULL); cabd != NULL;
+	    cabd = abd_gang_next(abd, cabd))
+		nchildren++;
+
+	vbio->vbio_bounce_max = nchildren;
+	vbio->vbio_bounce = kmem_alloc(nchildren * sizeof (vbio_bounce_t),
+	    KM_SLEEP);
+	vbio->vbio_nbounce = 0;
+
+	abd_t *gabd = abd_alloc_gang();
+	uint64_t off = 0;
+	for (cabd = abd_gang_next(abd, NULL);
+	    cabd != NULL && off < zio->io_size;
+	    cabd = abd_gang_next(abd, cabd)) {
+		size_t size = MIN(abd_get_size(cabd), zio->io_size - off);
+
+		/*
+		 * Only the very first page of the whole BIO may start at a
+		 * misaligned offset, so count a page for every later child.
+		 */
+		vdev_disk_check_pages_t cs = {
+		    .bmask = bdev_logical_block_size(bdev)-1,
+		    .npages = (off != 0),
+		    .end = 0,
+		};
+
+		/*
+		 * A child that ends partway through a block leaves a gap
+		 * before the next one, unless it is the last.
+		 */
+		if (abd_iterate_page_func(cabd, 0, size,
+		    vdev_disk_check_pages_cb, &cs) == 0 &&
+		    (cs.end == 0 || off + size == zio->io_size)) {
+			abd_gang_add(gabd, cabd, B_FALSE);
+		} else {
+			vbio_bounce_t *vbb =
+			    &vbio->vbio_bounce[vbio->vbio_nbounce++];
+
+			/*
+			 * Borrowing would hand back a linear child's own
+			 * misaligned buffer, so always take a fresh one.
+			 */
+			vbb->vbb_src = cabd;
+			vbb->vbb_abd = abd_alloc_for_io(size, B_FALSE);
+			vbb->vbb_size = size;
+			if (zio->io_type != ZIO_TYPE_READ)
+				abd_copy(vbb->vbb_abd, cabd, size);
+			abd_gang_add(gabd, vbb->vbb_abd, B_FALSE);
+		}
+		off += size;
+	}
+
+	/*
+	 * Without scatter ABDs the copies are linear buffers which may still
+	 * be misaligned in the middle of a BIO; leave it to the caller to copy
+	 * everything in that case.
+	 */
+	if (!vdev_disk_check_pages(gabd, zio->io_size, bdev)) {
+		abd_free(gabd);
+		vbio_free_bounce(vbio);
+		return (NULL);
+	}
+
+	return (gabd);
+}
+
 static int
 vdev_disk_io_rw(zio_t *zio)
 {
@@ -944,16 +1078,22 @@ vdev_disk_io_rw(zio_t *zio)
 		    zfs_vdev_failfast_mask & 2, zfs_vdev_failfast_mask & 4);
 	}
 
+	/* Allocate vbio, with a pointer to the borrowed ABD if necessary */
+	vbio_t *vbio = vbio_alloc(zio, bdev, flags);
+
 	/*
 	 * Check alignment of the incoming ABD. If any part of it would require
 	 * submitting a page that is not aligned to the logical block size,
 	 * then we take a copy into a linear buffer and submit that instead.
 	 * This should be impossible on a 512b LBS, and fairly rare on 4K,
 	 * usually requiring abnormally-small data blocks (eg gang blocks)
-	 * mixed into the same ABD as larger ones (eg aggregated).
+	 * mixed into the same ABD as larger ones (eg aggregated).  For the
+	 * aggregated case, try to copy only the offending children first.
 	 */
 	abd_t *abd = zio->io_abd;
-	if (!vdev_disk_check_pages(abd, zio->io_size, bdev)) {
+	if (!vdev_disk_check_pages(abd, zio->io_size, bdev) &&
+	    (!abd_is_gang(abd) ||
+	    (abd = vbio_bounce_gang(vbio, bdev)) == NULL)) {
 		void *buf;
 		if (zio->io_type == ZIO_TYPE_READ)
 			buf = abd_borrow_buf(zio->io_abd, zio->io_size);
@@ -979,8 +1119,6 @@ vdev_disk_io_rw(zio_t *zio)
 		VERIFY(vdev_disk_check_pages(abd, zio->io_size, bdev));
 	}
 
-	/* Allocate vbio, with a pointer to the borrowed ABD if necessary */
-	vbio_t *vbio = vbio_alloc(zio, bdev, flags);
 	if (abd != zio->io_abd)
 		vbio->vbio_abd = abd;
 
@@ -39,12 +39,45 @@
 #ifdef _KERNEL
 #include <linux/falloc.h>
 #endif
+#ifndef _KERNEL
+#include <sys/mman.h>
+#include <sys/stat.h>
+#endif
+#if !defined(_KERNEL) && defined(HAVE_LIBURING)
+#include <liburing.h>
+#endif
 /*
  * Virtual device vector for files.
  */
 
 static taskq_t *vdev_file_taskq;
 
+#if !defined(_KERNEL) && defined(HAVE_LIBURING)
+/*
+ * In userspace, reads and writes to file vdevs are submitted to a single
+ * io_uring shared by all of them, instead of each one tying up a
+ * z_vdev_file thread for the duration of a pread()/pwrite().  One thread
+ * reaps the completions.  If the ring cannot be set up, for example because
+ * io_uring is blocked by a seccomp policy, the taskq is used as before.
+ */
+#define	VDEV_FILE_RING_ENTRIES	256
+
+static struct io_uring vdev_file_ring;
+static boolean_t vdev_file_ring_active = B_FALSE;
+static kmutex_t vdev_file_ring_lock;	/* serializes SQ access */
+static kcondvar_t vdev_file_ring_cv;	/* signalled as completions drain */
+static uint_t vdev_file_ring_waiters;	/* waiting for SQ space, lock held */
+static kthread_t *vdev_file_ring_thread;
+
+typedef struct vdev_file_ring_io {
+	zio_t		*vfr_zio;
+	void		*vfr_buf;	/* borrowed from zio->io_abd */
+	int		vfr_pending;	/* SQEs not yet completed */
+	int		vfr_error;
+	ssize_t		vfr_done;	/* bytes transferred */
+} vdev_file_ring_io_t;
+#endif
+
 /*
  * By default, the logical/physical ashift for file vdevs is set to
  * SPA_MINBLOCKSHIFT (9). This allows all file vdevs to use 512B (1 << 9)
@@ -56,6 +89,85 @@ static taskq_t *vdev_file_taskq;
 static uint_t vdev_file_logical_ashift = SPA_MINBLOCKSHIFT;
 static uint_t vdev_file_physical_ashift = SPA_MINBLOCKSHIFT;
 
+#ifndef _KERNEL
+/*
+ * In userspace, map file vdevs that belong to dedicated log devices into
+ * memory, and copy blocks straight to and from the mapping in
+ * vdev_file_io_start() instead of handing them to a thread.  This stands in
+ * for a DAX mapping of a persistent memory SLOG: each write is made durable
+ * with msync() before it completes, in place of flushing its cache lines,
+ * so cache flushes to these vdevs have nothing left to do.  The on-disk
+ * format is unchanged.  Only read when a vdev is opened.
+ */
+int vdev_file_log_mmap = 0;
+
+static void
+vdev_file_unmap(vdev_file_t *vf)
+{
+	if (vf->vf_map == NULL)
+		return;
+
+	VERIFY0(munmap(vf->vf_map, vf->vf_map_size));
+	vf->vf_map = NULL;
+	vf->vf_map_size = 0;
+}
+
+static void
+vdev_file_map(vdev_t *vd, vdev_file_t *vf, const zfs_file_attr_t *zfa)
+{
+	uint64_t size = zfa->zfa_size;
+	void *map;
+
+	if (vf->vf_map != NULL && vf->vf_map_size == size)
+		return;
+	vdev_file_unmap(vf);
+
+	if (!vdev_file_log_mmap || vd->vdev_top == NULL ||
+	    !vd->vdev_top->vdev_islog || size == 0 ||
+	    vf->vf_file->f_dump_fd != -1 ||
+	    (spa_mode(vd->vdev_spa) & SPA_MODE_WRITE) == 0)
+		return;
+
+	/* Block devices are opened with O_DIRECT; leave them alone. */
+	if (!S_ISREG(zfa->zfa_mode))
+		return;
+
+	map = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_SHARED,
+	    vf->vf_file->f_fd, 0);
+	if (map == MAP_FAILED)
+		return;
+
+	vf->vf_map = map;
+	vf->vf_map_size = size;
+}
+
+static boolean_t
+vdev_file_mapped(vdev_file_t *vf, zio_t *zio)
+{
+	return (vf->vf_map != NULL &&
+	    zio->io_offset + zio->io_size <= vf->vf_map_size);
+}
+
+static void
+vdev_file_map_io(zio_t *zio)
+{
+	vdev_file_t *vf = zio->io_vd->vdev_tsd;
+	char *addr = (char *)vf->vf_map + zio->io_offset;
+
+	if (zio->io_type == ZIO_TYPE_READ) {
+		abd_copy_from_buf(zio->io_abd, addr, zio->io_size);
+	} else {
+		char *start = (char *)P2ALIGN_TYPED(addr, PAGESIZE, uintptr_t);
+
+		abd_copy_to_buf(addr, zio->io_abd, zio->io_size);
+		if (msync(start, addr + zio->io_size - start, MS_SYNC) != 0)
+			zio->io_error = SET_ERROR(errno);
+	}
+
+	zio_delay_interrupt(zio);
+}
+#endif
+
 static void
 vdev_file_hold(vdev_t *vd)
 {
@@ -170,6 +282,9 @@ skip_open:
 	}
 
 	*max_psize = *psize = zfa.zfa_size;
+#ifndef _KERNEL
+	vdev_file_map(vd, vf, &zfa);
+#endif
 	*logical_ashift = vdev_file_logical_ashift;
 	*physical_ashift = vdev_file_physical_ashift;
 
@@ -184,6 +299,9 @@ vdev_file_close(vdev_t *vd)
 	if (vd->vdev_reopening || vf == NULL)
 		return;
 
+#ifndef _KERNEL
+	vdev_file_unmap(vf);
+#endif
 	if (vf->vf_file != NULL) {
 		(void) zfs_file_close(vf->vf_file);
 	}
@@ -236,6 +354,197 @@ vdev_file_io_fsync(void *arg)
 	zio_interrupt(zio);
 }
 
+#if !defined(_KERNEL) && defined(HAVE_LIBURING)
+static struct io_uring_sqe *
+vdev_file_ring_get_sqe(void)
+{
+	struct io_uring_sqe *sqe;
+
+	ASSERT(MUTEX_HELD(&vdev_file_ring_lock));
+
+	/*
+	 * Everything prepared is submitted straight away, so the SQ can only
+	 * be full if the kernel pushed back on an earlier submission because
+	 * the CQ is full.  Wait for the reaper to drain some completions
+	 * before trying again.  It only takes the lock to signal us if it
+	 * sees a waiter, and the timeout covers a signal lost to that race.
+	 */
+	while ((sqe = io_uring_get_sqe(&vdev_file_ring)) == NULL) {
+		vdev_file_ring_waiters++;
+		if (io_uring_submit(&vdev_file_ring) <= 0) {
+			(void) cv_timedwait(&vdev_file_ring_cv,
+			    &vdev_file_ring_lock,
+			    ddi_get_lbolt() + MSEC_TO_TICK(10));
+		}
+		vdev_file_ring_waiters--;
+	}
+
+	return (sqe);
+}
+
+static void
+vdev_file_ring_start(zio_t *zio)
+{
+	vdev_file_t *vf = zio->io_vd->vdev_tsd;
+	int fd = vf->vf_file->f_fd;
+	vdev_file_ring_io_t *vfr = kmem_zalloc(sizeof (*vfr), KM_SLEEP);
+	struct io_uring_sqe *sqe;
+
+	vfr->vfr_zio = zio;
+
+	mutex_enter(&vdev_file_ring_lock);
+	if (zio->io_type == ZIO_TYPE_READ) {
+		vfr->vfr_buf = abd_borrow_buf(zio->io_abd, zio->io_size);
+		vfr->vfr_pending = 1;
+		sqe = vdev_file_ring_get_sqe();
+		io_uring_prep_read(sqe, fd, vfr->vfr_buf, zio->io_size,
+		    zio->io_offset);
+		io_uring_sqe_set_data(sqe, vfr);
+	} else {
+		/*
+		 * Like zfs_file_pwrite(), split writes in two at a random
+		 * sector so that ztest can kill the process in between.  The
+		 * halves are linked so they are still written in order.
+		 */
+		int sectors = zio->io_size >> SPA_MINBLOCKSHIFT;
+		size_t split = (sectors > 0 ? rand() % sectors : 0) <<
+		    SPA_MINBLOCKSHIFT;
+
+		vfr->vfr_buf = abd_borrow_buf_copy(zio->io_abd, zio->io_size);
+		vfr->vfr_pending = (split > 0) ? 2 : 1;
+		if (split > 0) {
+			sqe = vdev_file_ring_get_sqe();
+			io_uring_prep_write(sqe, fd, vfr->vfr_buf, split,
+			    zio->io_offset);
+			io_uring_sqe_set_data(sqe, vfr);
+			sqe->flags |= IOSQE_IO_LINK;
+		}
+		sqe = vdev_file_ring_get_sqe();
+		io_uring_prep_write(sqe, fd, (char *)vfr->vfr_buf + split,
+		    zio->io_size - split, zio->io_offset + split);
+		io_uring_sqe_set_data(sqe, vfr);
+	}
+	(void) io_uring_submit(&vdev_file_ring);
+	mutex_exit(&vdev_file_ring_lock);
+}
+
+static void
+vdev_file_ring_done(vdev_file_ring_io_t *vfr, int res)
+{
+	zio_t *zio = vfr->vfr_zio;
+
+	if (res >= 0) {
+		vfr->vfr_done += res;
+	} else if (res == -ECANCELED) {
+		/*
+		 * The second half of a split write is cancelled when the first
+		 * one fails or comes up short.  That completion already
+		 * recorded the error, or the bytes it didn't transfer, which
+		 * are reported as ENOSPC below just as by
+		 * vdev_file_io_strategy().
+		 */
+	} else if (vfr->vfr_error == 0) {
+		/*
+		 * Under Linux, this most likely means an alignment issue
+		 * (memory or disk) due to O_DIRECT, so we abort() in order to
+		 * catch the offender.  See zfs_file_pread().
+		 */
+		if (res == -EINVAL)
+			abort();
+		vfr->vfr_error = -res;
+	}
+
+	if (--vfr->vfr_pending > 0)
+		return;
+
+	zio->io_error = vfr->vfr_error;
+	if (vfr->vfr_done != zio->io_size && zio->io_error == 0)
+		zio->io_error = SET_ERROR(ENOSPC);
+
+	if (zio->io_type == ZIO_TYPE_READ)
+		abd_return_buf_copy(zio->io_abd, vfr->vfr_buf, zio->io_size);
+	else
+		abd_return_buf(zio->io_abd, vfr->vfr_buf, zio->io_size);
+	kmem_free(vfr, sizeof (*vfr));
+
+	zio_delay_interrupt(zio);
+}
+
+static __attribute__((noreturn)) void
+vdev_file_ring_reap(void *arg)
+{
+	(void) arg;
+
+	for (;;) {
+		struct io_uring_cqe *cqe;
+		int err = io_uring_wait_cqe(&vdev_file_ring, &cqe);
+		if (err == -EINTR)
+			continue;
+		VERIFY0(err);
+
+		vdev_file_ring_io_t *vfr = io_uring_cqe_get_data(cqe);
+		int res = cqe->res;
+		io_uring_cqe_seen(&vdev_file_ring, cqe);
+
+		if (atomic_load_int(&vdev_file_ring_waiters) > 0) {
+			mutex_enter(&vdev_file_ring_lock);
+			cv_broadcast(&vdev_file_ring_cv);
+			mutex_exit(&vdev_file_ring_lock);
+		}
+
+		/* A NOP without data is posted by vdev_file_fini(). */
+		if (vfr == NULL)
+			break;
+		vdev_file_ring_done(vfr, res);
+	}
+
+	thread_exit();
+}
+
+static void
+vdev_file_ring_init(void)
+{
+	if (io_uring_queue_init(VDEV_FILE_RING_ENTRIES, &vdev_file_ring,
+	    0) != 0)
+		return;
+
+	/*
+	 * Without IORING_FEAT_NODROP, completions beyond the size of the CQ
+	 * are dropped, and there is no bound on the I/Os in flight.
+	 */
+	if (!(vdev_file_ring.features & IORING_FEAT_NODROP)) {
+		io_uring_queue_exit(&vdev_file_ring);
+		return;
+	}
+
+	mutex_init(&vdev_file_ring_lock, NULL, MUTEX_DEFAULT, NULL);
+	cv_init(&vdev_file_ring_cv, NULL, CV_DEFAULT, NULL);
+	vdev_file_ring_thread = thread_create(NULL, 0, vdev_file_ring_reap,
+	    NULL, 0, &p0, TS_RUN | TS_JOINABLE, defclsyspri);
+	vdev_file_ring_active = B_TRUE;
+}
+
+static void
+vdev_file_ring_fini(void)
+{
+	if (!vdev_file_ring_active)
+		return;
+
+	mutex_enter(&vdev_file_ring_lock);
+	struct io_uring_sqe *sqe = vdev_file_ring_get_sqe();
+	io_uring_prep_nop(sqe);
+	io_uring_sqe_set_data(sqe, NULL);
+	(void) io_uring_submit(&vdev_file_ring);
+	mutex_exit(&vdev_file_ring_lock);
+
+	VERIFY0(thread_join(vdev_file_ring_thread));
+	io_uring_queue_exit(&vdev_file_ring);
+	cv_destroy(&vdev_file_ring_cv);
+	mutex_destroy(&vdev_file_ring_lock);
+	vdev_file_ring_active = B_FALSE;
+}
+#endif
+
 static void
 vdev_file_io_start(zio_t *zio)
 {
@@ -255,6 +564,14 @@ vdev_file_io_start(zio_t *zio)
 			return;
 		}
 
+#ifndef _KERNEL
+		/* Writes through the mapping are already durable. */
+		if (vf->vf_map != NULL) {
+			zio_execute(zio);
+			return;
+		}
+#endif
+
 		/*
 		 * We cannot safely call vfs_fsync() when PF_FSTRANS
 		 * is set in the current context.  Filesystems like
@@ -288,6 +605,21 @@ vdev_file_io_start(zio_t *zio)
 
 	zio->io_target_timestamp = zio_handle_io_delay(zio);
 
+#ifndef _KERNEL
+	if (vdev_file_mapped(vf, zio)) {
+		vdev_file_map_io(zio);
+		return;
+	}
+#endif
+
+#if !defined(_KERNEL) && defined(HAVE_LIBURING)
+	/* Reads mirrored to vn_dumpdir still go through the taskq. */
+	if (vdev_file_ring_active && vf->vf_file->f_dump_fd == -1) {
+		vdev_file_ring_start(zio);
+		return;
+	}
+#endif
+
 	VERIFY3U(taskq_dispatch(vdev_file_taskq, vdev_file_io_strategy, zio,
 	    TQ_SLEEP), !=, TASKQID_INVALID);
 }
@@ -330,11 +662,18 @@ vdev_file_init(void)
 	    minclsyspri, boot_ncpus, INT_MAX, TASKQ_DYNAMIC);
 
 	VERIFY(vdev_file_taskq);
+
+#if !defined(_KERNEL) && defined(HAVE_LIBURING)
+	vdev_file_ring_init();
+#endif
 }
 
 void
 vdev_file_fini(void)
 {
+#if !defined(_KERNEL) && defined(HAVE_LIBURING)
+	vdev_file_ring_fini();
+#endif
 	taskq_destroy(vdev_file_taskq);
 }
 
@@ -45,6 +45,8 @@
 #include <sys/uio_impl.h>
 #include <sys/sysmacros.h>
 #include <sys/string.h>
+#include <sys/vmem.h>
+#include <sys/abd.h>
 #include <linux/kmap_compat.h>
 #include <linux/uaccess.h>
 
@@ -442,4 +444,136 @@ zfs_uioskip(zfs_uio_t *uio, size_t n)
 }
 EXPORT_SYMBOL(zfs_uioskip);
 
+/*
+ * Check that the user buffers behind the uio are page-aligned, both in
+ * address and in length, as Direct I/O requires.  Only user iov_iters are
+ * supported for Direct I/O.
+ */
+boolean_t
+zfs_uio_page_aligned(zfs_uio_t *uio)
+{
+#if defined(HAVE_VFS_IOV_ITER)
+	if (uio->uio_segflg == UIO_ITER && uio->uio_skip == 0) {
+		unsigned long align = iov_iter_alignment(uio->uio_iter);
+		return (IS_P2ALIGNED(align, PAGE_SIZE));
+	}
+#endif
+	return (B_FALSE);
+}
+
+#if defined(HAVE_VFS_IOV_ITER) && \
+	(defined(HAVE_IOV_ITER_GET_PAGES2) || defined(HAVE_IOV_ITER_GET_PAGES))
+#define	HAVE_ZFS_UIO_DIO	1
+
+static boolean_t
+zfs_uio_user_backed(zfs_uio_t *uio)
+{
+#if defined(HAVE_USER_BACKED_ITER)
+	return (user_backed_iter(uio->uio_iter));
+#else
+	return (iter_is_iovec(uio->uio_iter));
+#endif
+}
+#endif
+
+static void
+zfs_uio_put_dio_pages(struct page **pages, unsigned long npages,
+    zfs_uio_rw_t rw)
+{
+	for (unsigned long i = 0; i < npages; i++) {
+		/* Data was read into these pages, so they're now dirty. */
+		if (rw == UIO_READ)
+			set_page_dirty_lock(pages[i]);
+		put_page(pages[i]);
+	}
+}
+
+/*
+ * Pin the user pages behind the next n bytes of the uio, and map them with
+ * a new ABD for Direct I/O.  The uio itself is left where it was; once the
+ * I/O is done the caller advances it with zfs_uioskip() and releases the
+ * pages with zfs_uio_free_dio_pages().
+ */
+int
+zfs_uio_get_dio_pages_alloc(zfs_uio_t *uio, zfs_uio_rw_t rw, size_t n,
+    abd_t **abdp)
+{
+#if defined(HAVE_ZFS_UIO_DIO)
+	struct iov_iter *iter = uio->uio_iter;
+	unsigned long npages = DIV_ROUND_UP(n, PAGE_SIZE);
+	struct page **pages;
+	size_t pinned = 0;
+	unsigned long npinned = 0;
+	int error = 0;
+
+	if (uio->uio_segflg != UIO_ITER || uio->uio_skip != 0 ||
+	    !zfs_uio_user_backed(uio) || n == 0 || n > uio->uio_resid)
+		return (SET_ERROR(ENOTSUP));
+
+	pages = vmem_alloc(npages * sizeof (struct page *), KM_SLEEP);
+
+	while (pinned < n) {
+		size_t start;
+#if defined(HAVE_IOV_ITER_GET_PAGES2)
+		ssize_t cnt = iov_iter_get_pages2(iter, &pages[npinned],
+		    n - pinned, npages - npinned, &start);
+#else
+		ssize_t cnt = iov_iter_get_pages(iter, &pages[npinned],
+		    n - pinned, npages - npinned, &start);
+		if (cnt > 0)
+			iov_iter_advance(iter, cnt);
+#endif
+		if (cnt <= 0) {
+			error = SET_ERROR(ENOTSUP);
+			break;
+		}
+
+		pinned += cnt;
+		npinned += DIV_ROUND_UP(start + cnt, PAGE_SIZE);
+
+		/* Every segment must start on a page boundary. */
+		if (start != 0 ||
+		    (pinned < n && !IS_P2ALIGNED(cnt, PAGE_SIZE))) {
+			error = SET_ERROR(ENOTSUP);
+			break;
+		}
+	}
+
+	/* Put the iov_iter back; the caller consumes it after the I/O. */
+	iov_iter_revert(iter, pinned);
+
+	if (error != 0) {
+		zfs_uio_put_dio_pages(pages, npinned, UIO_WRITE);
+		vmem_free(pages, npages * sizeof (struct page *));
+		return (error);
+	}
+
+	ASSERT3U(npinned, ==, npages);
+	uio->uio_dio.pages = pages;
+	uio->uio_dio.npages = npages;
+	*abdp = abd_alloc_from_pages(pages, 0, n);
+
+	return (0);
+#else
+	(void) uio, (void) rw, (void) n, (void) abdp;
+	return (SET_ERROR(ENOTSUP));
+#endif
+}
+
+/*
+ * Free the ABD from zfs_uio_get_dio_pages_alloc() and release the user pages
+ * it mapped.
+ */
+void
+zfs_uio_free_dio_pages(zfs_uio_t *uio, zfs_uio_rw_t rw, abd_t *abd)
+{
+	abd_free(abd);
+
+	zfs_uio_put_dio_pages(uio->uio_dio.pages, uio->uio_dio.npages, rw);
+	vmem_free(uio->uio_dio.pages,
+	    uio->uio_dio.npages * sizeof (struct page *));
+	uio->uio_dio.pages = NULL;
+	uio->uio_dio.npages = 0;
+}
+
 #endif /* _KERNEL */
@@ -51,6 +51,10 @@
 
 static void zvol_request_impl(zvol_state_t *zv, struct bio *bio,
     struct request *rq, boolean_t force_sync);
+#ifdef HAVE_BLK_MQ_COMMIT_RQS
+static void zvol_write_batch(zvol_state_t *zv, struct request **rqs,
+    uint_t count);
+#endif
 
 static unsigned int zvol_major = ZVOL_MAJOR;
 static unsigned int zvol_request_sync = 0;
@@ -84,10 +88,38 @@ static boolean_t zvol_use_blk_mq = B_FALSE;
  * read and write tests to a zvol in an NVMe pool (with 16 CPUs).
  */
 static unsigned int zvol_blk_mq_blocks_per_thread = 8;
+
+#ifdef HAVE_BLK_MQ_COMMIT_RQS
+/*
+ * Low-latency mode.  When set, plain asynchronous writes are not handed to
+ * the zvol taskqs.  Instead they are collected per hardware queue and, once
+ * the block layer signals the end of its dispatch batch, written by the
+ * dispatching thread under a single dmu_tx.  Flush, FUA, discard and sync
+ * writes, as well as reads, still take the regular taskq path.
+ */
+static unsigned int zvol_blk_mq_low_latency = 0;
+
+/* Upper bound on the number of requests written under one dmu_tx. */
+#define	ZVOL_BLK_MQ_BATCH_MAX	16
+
+typedef struct zv_hctx_batch {
+	kmutex_t	zhb_lock;
+	uint_t		zhb_count;
+	uint64_t	zhb_bytes;
+	struct request	*zhb_rqs[ZVOL_BLK_MQ_BATCH_MAX];
+} zv_hctx_batch_t;
+#endif
 #endif
 
 static unsigned int zvol_num_taskqs = 0;
 
+/*
+ * On NUMA systems, split the zvol taskqs into one group per node with CPUs
+ * and bind each group's threads to that node.  Requests are then handled
+ * by a taskq local to the CPU which submitted them.
+ */
+static unsigned int zvol_numa_taskqs = 1;
+
 #ifndef	BLKDEV_DEFAULT_RQ
 /* BLKDEV_MAX_RQ was renamed to BLKDEV_DEFAULT_RQ in the 5.16 kernel */
 #define	BLKDEV_DEFAULT_RQ BLKDEV_MAX_RQ
@@ -129,6 +161,8 @@ struct zvol_state_os {
 typedef struct zv_taskq {
 	uint_t tqs_cnt;
 	taskq_t **tqs_taskq;
+	uint_t tqs_nodes;	/* taskq groups, one per NUMA node */
+	int *tqs_node_group;	/* node id -> group, or -1 */
 } zv_taskq_t;
 static zv_taskq_t zvol_taskqs;
 static struct ida zvol_ida;
@@ -167,6 +201,152 @@ zv_request_task_free(zv_request_task_t *task)
 
 #ifdef HAVE_BLK_MQ
 
+#ifdef HAVE_BLK_MQ_COMMIT_RQS
+static int
+zvol_mq_init_hctx(struct blk_mq_hw_ctx *hctx, void *data, unsigned int idx)
+{
+	(void) data, (void) idx;
+	zv_hctx_batch_t *zhb = kmem_zalloc(sizeof (*zhb), KM_SLEEP);
+
+	mutex_init(&zhb->zhb_lock, NULL, MUTEX_DEFAULT, NULL);
+	hctx->driver_data = zhb;
+
+	return (0);
+}
+
+static void
+zvol_mq_exit_hctx(struct blk_mq_hw_ctx *hctx, unsigned int idx)
+{
+	(void) idx;
+	zv_hctx_batch_t *zhb = hctx->driver_data;
+
+	ASSERT0(zhb->zhb_count);
+	mutex_destroy(&zhb->zhb_lock);
+	kmem_free(zhb, sizeof (*zhb));
+	hctx->driver_data = NULL;
+}
+
+/*
+ * Only plain asynchronous writes are batched.  Anything which needs the ZIL
+ * to be committed, or which is going to be failed anyway, takes the regular
+ * path so that all of the error handling stays in zvol_request_impl().
+ */
+static boolean_t
+zvol_mq_can_batch(zvol_state_t *zv, struct request *rq)
+{
+	uint64_t offset = io_offset(NULL, rq);
+	uint64_t size = io_size(NULL, rq);
+
+	if (io_data_dir(NULL, rq) != WRITE || size == 0 ||
+	    io_is_flush(NULL, rq) || io_is_fua(NULL, rq) ||
+	    io_is_discard(NULL, rq) || io_is_secure_erase(NULL, rq))
+		return (B_FALSE);
+
+	if (size > DMU_MAX_ACCESS >> 1 || offset + size > zv->zv_volsize)
+		return (B_FALSE);
+
+	if (zv->zv_flags & (ZVOL_RDONLY | ZVOL_REMOVING) ||
+	    zv->zv_zilog == NULL ||
+	    zv->zv_objset->os_sync == ZFS_SYNC_ALWAYS)
+		return (B_FALSE);
+
+	return (B_TRUE);
+}
+
+/*
+ * Hand the caller everything collected so far.  Must be called with
+ * zhb_lock held.
+ */
+static uint_t
+zvol_mq_batch_take(zv_hctx_batch_t *zhb, struct request **rqs)
+{
+	uint_t count = zhb->zhb_count;
+
+	ASSERT(MUTEX_HELD(&zhb->zhb_lock));
+	memcpy(rqs, zhb->zhb_rqs, count * sizeof (struct request *));
+	zhb->zhb_count = 0;
+	zhb->zhb_bytes = 0;
+
+	return (count);
+}
+
+/*
+ * Two requests in the same batch must never overlap since each of them
+ * takes its own range lock as writer.
+ */
+static boolean_t
+zvol_mq_batch_overlaps(zv_hctx_batch_t *zhb, uint64_t offset, uint64_t size)
+{
+	for (uint_t i = 0; i < zhb->zhb_count; i++) {
+		struct request *rq = zhb->zhb_rqs[i];
+		uint64_t o = io_offset(NULL, rq);
+
+		if (offset < o + io_size(NULL, rq) && o < offset + size)
+			return (B_TRUE);
+	}
+
+	return (B_FALSE);
+}
+
+static void
+zvol_mq_batch_add(struct blk_mq_hw_ctx *hctx, zvol_state_t *zv,
+    struct request *rq, boolean_t last)
+{
+	zv_hctx_batch_t *zhb = hctx->driver_data;
+	struct request *rqs[ZVOL_BLK_MQ_BATCH_MAX];
+	uint64_t offset = io_offset(NULL, rq);
+	uint64_t size = io_size(NULL, rq);
+	uint_t count;
+
+	mutex_enter(&zhb->zhb_lock);
+	if (zhb->zhb_count == ZVOL_BLK_MQ_BATCH_MAX ||
+	    zhb->zhb_bytes + size > DMU_MAX_ACCESS >> 1 ||
+	    zvol_mq_batch_overlaps(zhb, offset, size)) {
+		count = zvol_mq_batch_take(zhb, rqs);
+		mutex_exit(&zhb->zhb_lock);
+		zvol_write_batch(zv, rqs, count);
+		mutex_enter(&zhb->zhb_lock);
+	}
+
+	zhb->zhb_rqs[zhb->zhb_count++] = rq;
+	zhb->zhb_bytes += size;
+	count = last ? zvol_mq_batch_take(zhb, rqs) : 0;
+	mutex_exit(&zhb->zhb_lock);
+
+	if (count > 0)
+		zvol_write_batch(zv, rqs, count);
+}
+
+/*
+ * Called by the block layer when it stops dispatching before it could
+ * flag a request as the last one, so whatever is batched must go now.
+ */
+static void
+zvol_mq_commit_rqs(struct blk_mq_hw_ctx *hctx)
+{
+	zv_hctx_batch_t *zhb = hctx->driver_data;
+	zvol_state_t *zv = hctx->queue->queuedata;
+	struct request *rqs[ZVOL_BLK_MQ_BATCH_MAX];
+	uint_t count;
+
+	/*
+	 * This runs for every request that isn't batched, so don't take the
+	 * lock unless something may be waiting.  Anything batched by this
+	 * thread is always visible here; requests being added concurrently
+	 * on another CPU are flushed by that CPU.
+	 */
+	if (zhb->zhb_count == 0)
+		return;
+
+	mutex_enter(&zhb->zhb_lock);
+	count = zvol_mq_batch_take(zhb, rqs);
+	mutex_exit(&zhb->zhb_lock);
+
+	if (count > 0)
+		zvol_write_batch(zv, rqs, count);
+}
+#endif /* HAVE_BLK_MQ_COMMIT_RQS */
+
 /*
  * This is called when a new block multiqueue request comes in.  A request
  * contains one or more BIOs.
@@ -186,6 +366,19 @@ static blk_status_t zvol_mq_queue_rq(struct blk_mq_hw_ctx *hctx,
 		return (BLK_STS_IOERR);
 	}
 
+#ifdef HAVE_BLK_MQ_COMMIT_RQS
+	if (zvol_blk_mq_low_latency && zvol_mq_can_batch(zv, rq)) {
+		zvol_mq_batch_add(hctx, zv, rq, bd->last);
+		return (BLK_STS_OK);
+	}
+
+	/*
+	 * A request taking the regular path ends the current batch, so
+	 * that it is not reordered behind it.
+	 */
+	zvol_mq_commit_rqs(hctx);
+#endif
+
 	zvol_request_impl(zv, NULL, rq, 0);
 
 	/* Acknowledge to the kernel that we got this request */
@@ -194,6 +387,11 @@ static blk_status_t zvol_mq_queue_rq(struct blk_mq_hw_ctx *hctx,
 
 static struct blk_mq_ops zvol_blk_mq_queue_ops = {
 	.queue_rq = zvol_mq_queue_rq,
+#ifdef HAVE_BLK_MQ_COMMIT_RQS
+	.commit_rqs = zvol_mq_commit_rqs,
+	.init_hctx = zvol_mq_init_hctx,
+	.exit_hctx = zvol_mq_exit_hctx,
+#endif
 };
 
 /* Initialize our blk-mq struct */
@@ -343,6 +541,109 @@ zvol_write_task(void *arg)
 	zv_request_task_free(task);
 }
 
+#ifdef HAVE_BLK_MQ_COMMIT_RQS
+/*
+ * Write a batch of non-overlapping, asynchronous blk-mq write requests under
+ * a single dmu_tx.  The range locks are taken in offset order, so concurrent
+ * batches from other hardware queues cannot deadlock against each other.
+ */
+static void
+zvol_write_batch(zvol_state_t *zv, struct request **rqs, uint_t count)
+{
+	fstrans_cookie_t cookie = spl_fstrans_mark();
+	zfs_locked_range_t *lrs[ZVOL_BLK_MQ_BATCH_MAX];
+	int errors[ZVOL_BLK_MQ_BATCH_MAX];
+	int64_t nwritten = 0;
+	int error;
+
+	ASSERT3U(count, <=, ZVOL_BLK_MQ_BATCH_MAX);
+
+	for (uint_t i = 1; i < count; i++) {
+		struct request *rq = rqs[i];
+		uint_t j;
+
+		for (j = i; j > 0 &&
+		    blk_rq_pos(rqs[j - 1]) > blk_rq_pos(rq); j--)
+			rqs[j] = rqs[j - 1];
+		rqs[j] = rq;
+	}
+
+	rw_enter(&zv->zv_suspend_lock, RW_READER);
+
+	/*
+	 * The zvol may have been closed for writing or be going away since
+	 * the requests were batched; let the regular path sort that out.
+	 */
+	if (zv->zv_zilog == NULL ||
+	    (zv->zv_flags & (ZVOL_RDONLY | ZVOL_REMOVING))) {
+		rw_exit(&zv->zv_suspend_lock);
+		for (uint_t i = 0; i < count; i++)
+			zvol_request_impl(zv, NULL, rqs[i], 0);
+		spl_fstrans_unmark(cookie);
+		return;
+	}
+
+	for (uint_t i = 0; i < count; i++) {
+		lrs[i] = zfs_rangelock_enter(&zv->zv_rangelock,
+		    io_offset(NULL, rqs[i]), io_size(NULL, rqs[i]), RL_WRITER);
+		errors[i] = 0;
+	}
+
+	uint64_t volsize = zv->zv_volsize;
+	dmu_tx_t *tx = dmu_tx_create(zv->zv_objset);
+	for (uint_t i = 0; i < count; i++) {
+		uint64_t off = io_offset(NULL, rqs[i]);
+		uint64_t size = io_size(NULL, rqs[i]);
+
+		if (off + size > volsize) {
+			errors[i] = SET_ERROR(EIO);
+			continue;
+		}
+		dmu_tx_hold_write_by_dnode(tx, zv->zv_dn, off, size);
+	}
+
+	/* This will only fail for ENOSPC */
+	error = dmu_tx_assign(tx, TXG_WAIT);
+	if (error) {
+		dmu_tx_abort(tx);
+		for (uint_t i = 0; i < count; i++)
+			errors[i] = error;
+	} else {
+		for (uint_t i = 0; i < count; i++) {
+			uint64_t off = io_offset(NULL, rqs[i]);
+			zfs_uio_t uio;
+
+			if (errors[i] != 0)
+				continue;
+
+			zfs_uio_bvec_init(&uio, NULL, rqs[i]);
+			ssize_t start_resid = uio.uio_resid;
+			errors[i] = dmu_write_uio_dnode(zv->zv_dn, &uio,
+			    start_resid, tx);
+			if (errors[i] == 0) {
+				zvol_log_write(zv, tx, off, start_resid,
+				    B_FALSE);
+			}
+			nwritten += start_resid - uio.uio_resid;
+		}
+		dmu_tx_commit(tx);
+	}
+
+	for (uint_t i = 0; i < count; i++)
+		zfs_rangelock_exit(lrs[i]);
+
+	dataset_kstats_update_write_kstats(&zv->zv_kstat, nwritten);
+	task_io_account_write(nwritten);
+
+	rw_exit(&zv->zv_suspend_lock);
+
+	for (uint_t i = 0; i < count; i++)
+		blk_mq_end_request(rqs[i], errno_to_bi_status(-errors[i]));
+
+	spl_fstrans_unmark(cookie);
+}
+#endif
+
 static void
 zvol_discard(zv_request_t *zvr)
 {
@@ -569,6 +870,13 @@ zvol_request_impl(zvol_state_t *zv, struct bio *bio, struct request *rq,
 	taskq_hash = cityhash4((uintptr_t)zv, offset >> ZVOL_TASKQ_OFFSET_SHIFT,
 	    blk_mq_hw_queue, 0);
 	tq_idx = taskq_hash % ztqs->tqs_cnt;
+	if (ztqs->tqs_nodes > 1) {
+		int group = ztqs->tqs_node_group[numa_node_id()];
+		if (group >= 0) {
+			uint_t per_node = ztqs->tqs_cnt / ztqs->tqs_nodes;
+			tq_idx = group * per_node + taskq_hash % per_node;
+		}
+	}
 
 	if (rw == WRITE) {
 		if (unlikely(zv->zv_flags & ZVOL_RDONLY)) {
@@ -1803,6 +2111,16 @@ zvol_os_set_capacity(zvol_state_t *zv, uint64_t capacity)
 	set_capacity(zv->zv_zso->zvo_disk, capacity);
 }
 
+static void
+zvol_taskq_node_group_free(zv_taskq_t *ztqs)
+{
+	if (ztqs->tqs_node_group != NULL) {
+		kmem_free(ztqs->tqs_node_group, nr_node_ids * sizeof (int));
+		ztqs->tqs_node_group = NULL;
+	}
+	ztqs->tqs_nodes = 0;
+}
+
 int
 zvol_init(void)
 {
@@ -1852,6 +2170,32 @@ zvol_init(void)
 		while (num_tqs * num_tqs > zvol_actual_threads)
 			num_tqs--;
 	}
+
+	/*
+	 * With zvol_numa_taskqs, every node with CPUs gets the same number
+	 * of taskqs, so round the count up to a multiple of the node count.
+	 */
+	uint_t num_nodes = 0;
+	int node;
+	ztqs->tqs_node_group = NULL;
+	if (zvol_numa_taskqs) {
+		for_each_node_with_cpus(node)
+			num_nodes++;
+	}
+	if (num_nodes > 1) {
+		num_tqs = roundup(num_tqs, num_nodes);
+		ztqs->tqs_node_group = kmem_alloc(nr_node_ids * sizeof (int),
+		    KM_SLEEP);
+		for (node = 0; node < nr_node_ids; node++)
+			ztqs->tqs_node_group[node] = -1;
+		num_nodes = 0;
+		for_each_node_with_cpus(node)
+			ztqs->tqs_node_group[node] = num_nodes++;
+	} else {
+		num_nodes = 1;
+	}
+	ztqs->tqs_nodes = num_nodes;
+
 	uint_t per_tq_thread = zvol_actual_threads / num_tqs;
 	if (per_tq_thread * num_tqs < zvol_actual_threads)
 		per_tq_thread++;
@@ -1861,6 +2205,7 @@ zvol_init(void)
 	if (error) {
 		kmem_free(ztqs->tqs_taskq, ztqs->tqs_cnt * sizeof (taskq_t *));
 		ztqs->tqs_taskq = NULL;
+		zvol_taskq_node_group_free(ztqs);
 		printk(KERN_INFO "ZFS: register_blkdev() failed %d\n", error);
 		return (error);
 	}
@@ -1882,11 +2227,19 @@ zvol_init(void)
 #endif
 	for (uint_t i = 0; i < num_tqs; i++) {
 		char name[32];
+		int tq_node = NUMA_NO_NODE;
 		(void) snprintf(name, sizeof (name), "%s_tq-%u",
 		    ZVOL_DRIVER, i);
-		ztqs->tqs_taskq[i] = taskq_create(name, per_tq_thread,
+		if (num_nodes > 1) {
+			int group = i / (num_tqs / num_nodes);
+			for_each_node_with_cpus(node) {
+				if (ztqs->tqs_node_group[node] == group)
+					tq_node = node;
+			}
+		}
+		ztqs->tqs_taskq[i] = taskq_create_node(name, per_tq_thread,
 		    maxclsyspri, per_tq_thread, INT_MAX,
-		    TASKQ_PREPOPULATE | TASKQ_DYNAMIC);
+		    TASKQ_PREPOPULATE | TASKQ_DYNAMIC, tq_node);
 		if (ztqs->tqs_taskq[i] == NULL) {
 			for (int j = i - 1; j >= 0; j--)
 				taskq_destroy(ztqs->tqs_taskq[j]);
@@ -1894,6 +2247,7 @@ zvol_init(void)
 			kmem_free(ztqs->tqs_taskq, ztqs->tqs_cnt *
 			    sizeof (taskq_t *));
 			ztqs->tqs_taskq = NULL;
+			zvol_taskq_node_group_free(ztqs);
 			return (-ENOMEM);
 		}
 	}
@@ -1921,6 +2275,7 @@ zvol_fini(void)
 		    sizeof (taskq_t *));
 		ztqs->tqs_taskq = NULL;
 	}
+	zvol_taskq_node_group_free(ztqs);
 
 	ida_destroy(&zvol_ida);
 }
@@ -1945,6 +2300,9 @@ MODULE_PARM_DESC(zvol_max_discard_blocks, "Max number of blocks to discard");
 module_param(zvol_num_taskqs, uint, 0444);
 MODULE_PARM_DESC(zvol_num_taskqs, "Number of zvol taskqs");
 
+module_param(zvol_numa_taskqs, uint, 0444);
+MODULE_PARM_DESC(zvol_numa_taskqs, "Bind zvol taskqs to NUMA nodes");
+
 module_param(zvol_prefetch_bytes, uint, 0644);
 MODULE_PARM_DESC(zvol_prefetch_bytes, "Prefetch N bytes at zvol start+end");
 
@@ -1961,6 +2319,12 @@ MODULE_PARM_DESC(zvol_use_blk_mq, "Use the blk-mq API for zvols");
 module_param(zvol_blk_mq_blocks_per_thread, uint, 0644);
 MODULE_PARM_DESC(zvol_blk_mq_blocks_per_thread,
     "Process volblocksize blocks per thread");
+
+#ifdef HAVE_BLK_MQ_COMMIT_RQS
+module_param(zvol_blk_mq_low_latency, uint, 0644);
+MODULE_PARM_DESC(zvol_blk_mq_low_latency,
+    "Batch async blk-mq writes into one tx instead of using the taskqs");
+#endif
 #endif
 
 #ifndef HAVE_BLKDEV_GET_ERESTARTSYS
@@ -825,12 +825,19 @@ fletcher_4_fini(void)
 static void
 abd_fletcher_4_init(zio_abd_checksum_data_t *cdp)
 {
-	const fletcher_4_ops_t *ops = fletcher_4_impl_get();
-	cdp->acd_private = (void *) ops;
+	const fletcher_4_ops_t *ops;
 
-	if (ops->uses_fpu == B_TRUE) {
-		kfpu_begin();
+	if (cdp->acd_batch_private != NULL) {
+		/* The FPU is already held for the whole batch. */
+		ops = cdp->acd_batch_private;
+	} else {
+		ops = fletcher_4_impl_get();
+		if (ops->uses_fpu == B_TRUE) {
+			kfpu_begin();
+		}
 	}
+	cdp->acd_private = (void *) ops;
+
 	if (cdp->acd_byteorder == ZIO_CHECKSUM_NATIVE)
 		ops->init_native(cdp->acd_ctx);
 	else
@@ -850,6 +857,34 @@ abd_fletcher_4_fini(zio_abd_checksum_data_t *cdp)
 	else
 		ops->fini_byteswap(cdp->acd_ctx, cdp->acd_zcp);
 
+	if (ops->uses_fpu == B_TRUE && cdp->acd_batch_private == NULL) {
+		kfpu_end();
+	}
+}
+
+/*
+ * Choose the implementation once for a batch of buffers, and hold the FPU
+ * across all of them rather than saving and restoring it for each one.
+ */
+static void
+abd_fletcher_4_batch_init(zio_abd_checksum_data_t *cdp)
+{
+	const fletcher_4_ops_t *ops = fletcher_4_impl_get();
+	cdp->acd_batch_private = (void *) ops;
+
+	if (ops->uses_fpu == B_TRUE) {
+		kfpu_begin();
+	}
+}
+
+static void
+abd_fletcher_4_batch_fini(zio_abd_checksum_data_t *cdp)
+{
+	fletcher_4_ops_t *ops = (fletcher_4_ops_t *)cdp->acd_batch_private;
+
+	ASSERT(ops);
+
+	cdp->acd_batch_private = NULL;
 	if (ops->uses_fpu == B_TRUE) {
 		kfpu_end();
 	}
@@ -906,7 +941,9 @@ abd_fletcher_4_iter(void *data, size_t size, void *private)
 zio_abd_checksum_func_t fletcher_4_abd_ops = {
 	.acf_init = abd_fletcher_4_init,
 	.acf_fini = abd_fletcher_4_fini,
-	.acf_iter = abd_fletcher_4_iter
+	.acf_iter = abd_fletcher_4_iter,
+	.acf_batch_init = abd_fletcher_4_batch_init,
+	.acf_batch_fini = abd_fletcher_4_batch_fini
 };
 
 #if defined(_KERNEL)
@@ -113,7 +113,8 @@ abd_verify(abd_t *abd)
 	ASSERT3U(abd->abd_flags, ==, abd->abd_flags & (ABD_FLAG_LINEAR |
 	    ABD_FLAG_OWNER | ABD_FLAG_META | ABD_FLAG_MULTI_ZONE |
 	    ABD_FLAG_MULTI_CHUNK | ABD_FLAG_LINEAR_PAGE | ABD_FLAG_GANG |
-	    ABD_FLAG_GANG_FREE | ABD_FLAG_ZEROS | ABD_FLAG_ALLOCD));
+	    ABD_FLAG_GANG_FREE | ABD_FLAG_ZEROS | ABD_FLAG_ALLOCD |
+	    ABD_FLAG_FROM_PAGES));
 	IMPLY(abd->abd_parent != NULL, !(abd->abd_flags & ABD_FLAG_OWNER));
 	IMPLY(abd->abd_flags & ABD_FLAG_META, abd->abd_flags & ABD_FLAG_OWNER);
 	if (abd_is_linear(abd)) {
@@ -307,6 +308,8 @@ abd_free(abd_t *abd)
 	} else {
 		if (abd->abd_flags & ABD_FLAG_OWNER)
 			abd_free_scatter(abd);
+		else if (abd->abd_flags & ABD_FLAG_FROM_PAGES)
+			abd_free_from_pages(abd);
 	}
 
 #ifdef ZFS_DEBUG
@@ -476,6 +479,19 @@ abd_gang_add(abd_t *pabd, abd_t *cabd, boolean_t free_on_free)
 	pabd->abd_size += child_abd->abd_size;
 }
 
+/*
+ * Walk the children of a gang ABD.  Returns the first child if cabd is NULL,
+ * otherwise the child following cabd, or NULL after the last one.
+ */
+abd_t *
+abd_gang_next(abd_t *pabd, abd_t *cabd)
+{
+	ASSERT(abd_is_gang(pabd));
+	if (cabd == NULL)
+		return (list_head(&ABD_GANG(pabd).abd_gang_chain));
+	return (list_next(&ABD_GANG(pabd).abd_gang_chain, cabd));
+}
+
 /*
  * Locate the ABD for the supplied offset in the gang ABD.
  * Return a new offset relative to the returned ABD.
@@ -330,6 +330,30 @@ static zthr_t *arc_evict_zthr;
 static arc_buf_hdr_t **arc_state_evict_markers;
 static int arc_state_evict_marker_count;
 
+/*
+ * When there is enough to evict, arc_evict_zthr hands the work to a pool of
+ * worker threads, each of which owns every arc_evict_nthreads'th sublist of
+ * the multilist being evicted from (see arc_evict_state_tasks()). Each worker
+ * has its own slot in arc_evict_args, and its own counters in the
+ * "arc_evict" kstat.
+ */
+typedef struct arc_evict_arg {
+	taskq_ent_t	eva_tqent;
+	multilist_t	*eva_ml;
+	arc_buf_hdr_t	**eva_markers;
+	uint_t		eva_thread;
+	uint_t		eva_start;
+	uint64_t	eva_spa;
+	uint64_t	eva_bytes;
+	uint64_t	eva_evicted;
+} arc_evict_arg_t;
+
+static taskq_t *arc_evict_taskq;
+static arc_evict_arg_t *arc_evict_args;
+static uint_t arc_evict_nthreads;
+static kstat_t *arc_evict_ksp;
+static kstat_named_t *arc_evict_kstats;
+
 static kmutex_t arc_evict_lock;
 static boolean_t arc_evict_needed = B_FALSE;
 static clock_t arc_last_uncached_flush;
@@ -365,6 +389,12 @@ static uint_t zfs_arc_eviction_pct = 200;
  */
 static uint_t zfs_arc_evict_batch_limit = 10;
 
+/*
+ * The number of threads used to evict from the ARC. Zero picks a number
+ * based on the number of CPUs; see arc_evict_threads_default().
+ */
+static uint_t zfs_arc_evict_threads = 0;
+
 /* number of seconds before growing cache again */
 uint_t arc_grow_retry = 5;
 
@@ -510,6 +540,10 @@ arc_stats_t arc_stats = {
 	{ "hash_collisions",		KSTAT_DATA_UINT64 },
 	{ "hash_chains",		KSTAT_DATA_UINT64 },
 	{ "hash_chain_max",		KSTAT_DATA_UINT64 },
+	{ "hash_table_size",		KSTAT_DATA_UINT64 },
+	{ "hash_locks",			KSTAT_DATA_UINT64 },
+	{ "hash_rehashes",		KSTAT_DATA_UINT64 },
+	{ "hash_rehash_remaining",	KSTAT_DATA_UINT64 },
 	{ "meta",			KSTAT_DATA_UINT64 },
 	{ "pd",				KSTAT_DATA_UINT64 },
 	{ "pm",				KSTAT_DATA_UINT64 },
@@ -579,6 +613,8 @@ arc_stats_t arc_stats = {
 	{ "l2_evict_l1cached",		KSTAT_DATA_UINT64 },
 	{ "l2_free_on_write",		KSTAT_DATA_UINT64 },
 	{ "l2_abort_lowmem",		KSTAT_DATA_UINT64 },
+	{ "l2_admit_accepted",		KSTAT_DATA_UINT64 },
+	{ "l2_admit_rejected",		KSTAT_DATA_UINT64 },
 	{ "l2_cksum_bad",		KSTAT_DATA_UINT64 },
 	{ "l2_io_error",		KSTAT_DATA_UINT64 },
 	{ "l2_size",			KSTAT_DATA_UINT64 },
@@ -753,22 +789,39 @@ taskq_t *arc_prune_taskq;
 
 /*
  * Hash table routines
- */
-
-#define	BUF_LOCKS 2048
+ *
+ * The hash table grows online as headers (including L2-only headers) are
+ * added.  The lock protecting a header depends only on the low bits of its
+ * hash, which every bucket it can occupy in any size table shares, so it
+ * never changes.  To grow, arc_hash_grow_cb() briefly takes every lock to
+ * install a table twice the size, then moves the old chains across one lock
+ * at a time.  Until a lock's chains have moved, lookups under it continue
+ * to use the old table.  Tables beyond the initial one are charged to the
+ * ARC as header space.
+ */
+
+#define	BUF_LOCKS_MIN		2048
+#define	BUF_LOCKS_PER_CPU	128
 typedef struct buf_hash_table {
 	uint64_t ht_mask;
 	arc_buf_hdr_t **ht_table;
-	kmutex_t ht_locks[BUF_LOCKS] ____cacheline_aligned;
+	uint64_t ht_old_mask;
+	arc_buf_hdr_t **ht_old_table;
+	uint64_t ht_lock_mask;
+	kmutex_t *ht_locks;
+	uint8_t *ht_lock_moved;
+	uint64_t ht_moved;
+	uint64_t ht_initial_mask;
+	hrtime_t ht_grow_retry;
 } buf_hash_table_t;
 
 static buf_hash_table_t buf_hash_table;
+static zthr_t *arc_hash_zthr;
 
-#define	BUF_HASH_INDEX(spa, dva, birth) \
-	(buf_hash(spa, dva, birth) & buf_hash_table.ht_mask)
-#define	BUF_HASH_LOCK(idx)	(&buf_hash_table.ht_locks[idx & (BUF_LOCKS-1)])
+#define	BUF_HASH_LOCK(hv) \
+	(&buf_hash_table.ht_locks[(hv) & buf_hash_table.ht_lock_mask])
 #define	HDR_LOCK(hdr) \
-	(BUF_HASH_LOCK(BUF_HASH_INDEX(hdr->b_spa, &hdr->b_dva, hdr->b_birth)))
+	(BUF_HASH_LOCK(buf_hash(hdr->b_spa, &hdr->b_dva, hdr->b_birth)))
 
 uint64_t zfs_crc64_table[256];
 
@@ -804,6 +857,11 @@ int l2arc_noprefetch = B_TRUE;			/* don't cache prefetch bufs */
 int l2arc_feed_again = B_TRUE;			/* turbo warmup */
 int l2arc_norw = B_FALSE;			/* no reads during writes */
 static uint_t l2arc_meta_percent = 33;	/* limit on headers size */
+/*
+ * Number of threads feeding cache devices in parallel.  With 0, the
+ * l2arc_feed_thread writes to one device at a time, round-robin.
+ */
+static uint_t l2arc_feed_threads = 4;
 
 /*
  * L2ARC Internals
@@ -817,6 +875,47 @@ static list_t *l2arc_free_on_write;		/* free after write list ptr */
 static kmutex_t l2arc_free_on_write_mtx;	/* mutex for list */
 static uint64_t l2arc_ndev;			/* number of devices */
 
+/*
+ * L2ARC headers refer to their device by its index in this table.  The
+ * remaining 54 bits of the location hold the device address in 512-byte
+ * units, which is enough for 8 EiB per device.  A slot is only reused once
+ * all headers of its previous device have been evicted.
+ */
+#define	L2ARC_DEV_INDEX_BITS	10
+#define	L2ARC_DEV_INDEX_SHIFT	(64 - L2ARC_DEV_INDEX_BITS)
+#define	L2ARC_DEV_MAX		(1ULL << L2ARC_DEV_INDEX_BITS)
+static l2arc_dev_t *l2arc_dev_table[L2ARC_DEV_MAX]; /* l2arc_dev_mtx */
+
+/*
+ * Readers don't take l2arc_dev_mtx.  A slot is filled before any header
+ * can be given its index, and is cleared only after l2arc_remove_vdev()
+ * has evicted every header of the device.  So whoever holds a header
+ * (via its hash lock or the device's l2ad_mtx) always finds the slot
+ * filled with the header's own device.
+ */
+static inline l2arc_dev_t *
+l2arc_hdr_dev(const arc_buf_hdr_t *hdr)
+{
+	return (l2arc_dev_table[hdr->b_l2hdr.b_loc >> L2ARC_DEV_INDEX_SHIFT]);
+}
+
+static inline uint64_t
+l2arc_hdr_daddr(const arc_buf_hdr_t *hdr)
+{
+	return (BF64_GET_SB(hdr->b_l2hdr.b_loc, 0, L2ARC_DEV_INDEX_SHIFT,
+	    SPA_MINBLOCKSHIFT, 0));
+}
+
+static inline void
+l2arc_hdr_set_loc(arc_buf_hdr_t *hdr, l2arc_dev_t *dev, uint64_t daddr)
+{
+	ASSERT3P(l2arc_dev_table[dev->l2ad_index], ==, dev);
+
+	hdr->b_l2hdr.b_loc = (uint64_t)dev->l2ad_index << L2ARC_DEV_INDEX_SHIFT;
+	BF64_SET_SB(hdr->b_l2hdr.b_loc, 0, L2ARC_DEV_INDEX_SHIFT,
+	    SPA_MINBLOCKSHIFT, 0, daddr);
+}
+
 typedef struct l2arc_read_callback {
 	arc_buf_hdr_t		*l2rcb_hdr;		/* read header */
 	blkptr_t		l2rcb_bp;		/* original blkptr */
@@ -827,6 +926,7 @@ typedef struct l2arc_read_callback {
 
 typedef struct l2arc_data_free {
 	/* protected by l2arc_free_on_write_mtx */
+	l2arc_dev_t	*l2df_dev;	/* device whose write borrows it */
 	abd_t		*l2df_abd;
 	size_t		l2df_size;
 	arc_buf_contents_t l2df_type;
@@ -850,6 +950,7 @@ typedef enum arc_ovf_level {
 static kmutex_t l2arc_feed_thr_lock;
 static kcondvar_t l2arc_feed_thr_cv;
 static uint8_t l2arc_thread_exit;
+static taskq_t *l2arc_feed_taskq;
 
 static kmutex_t l2arc_rebuild_thr_lock;
 static kcondvar_t l2arc_rebuild_thr_cv;
@@ -881,8 +982,11 @@ static inline void arc_hdr_set_flags(arc_buf_hdr_t *hdr, arc_flags_t flags);
 static inline void arc_hdr_clear_flags(arc_buf_hdr_t *hdr, arc_flags_t flags);
 
 static boolean_t l2arc_write_eligible(uint64_t, arc_buf_hdr_t *);
+static void l2arc_admit_init(void);
+static void l2arc_admit_fini(void);
+static void l2arc_admit_record(arc_buf_hdr_t *);
 static void l2arc_read_done(zio_t *);
-static void l2arc_do_free_on_write(void);
+static void l2arc_do_free_on_write(l2arc_dev_t *dev);
 static void l2arc_hdr_arcstats_update(arc_buf_hdr_t *hdr, boolean_t incr,
     boolean_t state_only);
 
@@ -911,6 +1015,28 @@ int l2arc_exclude_special = 0;
  */
 static int l2arc_mfuonly = 0;
 
+/*
+ * l2arc_admit_min_refs : A ZFS module parameter that enables frequency based
+ * 		admission to the L2ARC. Demand accesses to every buffer are
+ * 		counted in a small count-min sketch whose counters are halved
+ * 		periodically (TinyLFU), and a buffer is only written to the
+ * 		L2ARC once its estimated number of recent accesses reaches
+ * 		this value. 0 disables the filter.
+ */
+static uint_t l2arc_admit_min_refs = 0;
+
+#define	L2ARC_SKETCH_DEPTH	4	/* rows (hash functions) */
+#define	L2ARC_SKETCH_MAX	15	/* counters saturate here */
+#define	L2ARC_SKETCH_MIN_WIDTH	(1ULL << 12)
+#define	L2ARC_SKETCH_MAX_WIDTH	(1ULL << 20)
+#define	L2ARC_SKETCH_BYTES_PER	(1ULL << 14) /* ARC bytes per counter */
+#define	L2ARC_SKETCH_SAMPLE	10	/* age after width * SAMPLE adds */
+
+static uint8_t *l2arc_sketch;		/* DEPTH rows of width counters */
+static uint64_t l2arc_sketch_width;	/* power of 2 */
+static wmsum_t l2arc_sketch_adds;	/* counter increments */
+static uint64_t l2arc_sketch_aged;	/* increments at last aging */
+
 /*
  * L2ARC TRIM
  * l2arc_trim_ahead : A ZFS module parameter that controls how much ahead of
@@ -1010,17 +1136,35 @@ buf_discard_identity(arc_buf_hdr_t *hdr)
 	hdr->b_birth = 0;
 }
 
+/*
+ * Return the head of the chain for the given hash value, in the old table
+ * if its lock's chains haven't been moved to the new one yet.
+ */
+static inline arc_buf_hdr_t **
+buf_hash_bucket(uint64_t hv)
+{
+	buf_hash_table_t *ht = &buf_hash_table;
+
+	ASSERT(MUTEX_HELD(BUF_HASH_LOCK(hv)));
+
+	if (ht->ht_old_table != NULL &&
+	    !ht->ht_lock_moved[hv & ht->ht_lock_mask])
+		return (&ht->ht_old_table[hv & ht->ht_old_mask]);
+
+	return (&ht->ht_table[hv & ht->ht_mask]);
+}
+
 static arc_buf_hdr_t *
 buf_hash_find(uint64_t spa, const blkptr_t *bp, kmutex_t **lockp)
 {
 	const dva_t *dva = BP_IDENTITY(bp);
 	uint64_t birth = BP_GET_BIRTH(bp);
-	uint64_t idx = BUF_HASH_INDEX(spa, dva, birth);
-	kmutex_t *hash_lock = BUF_HASH_LOCK(idx);
+	uint64_t hv = buf_hash(spa, dva, birth);
+	kmutex_t *hash_lock = BUF_HASH_LOCK(hv);
 	arc_buf_hdr_t *hdr;
 
 	mutex_enter(hash_lock);
-	for (hdr = buf_hash_table.ht_table[idx]; hdr != NULL;
+	for (hdr = *buf_hash_bucket(hv); hdr != NULL;
 	    hdr = hdr->b_hash_next) {
 		if (HDR_EQUAL(spa, dva, birth, hdr)) {
 			*lockp = hash_lock;
@@ -1042,9 +1186,9 @@ buf_hash_find(uint64_t spa, const blkptr_t *bp, kmutex_t **lockp)
 static arc_buf_hdr_t *
 buf_hash_insert(arc_buf_hdr_t *hdr, kmutex_t **lockp)
 {
-	uint64_t idx = BUF_HASH_INDEX(hdr->b_spa, &hdr->b_dva, hdr->b_birth);
-	kmutex_t *hash_lock = BUF_HASH_LOCK(idx);
-	arc_buf_hdr_t *fhdr;
+	uint64_t hv = buf_hash(hdr->b_spa, &hdr->b_dva, hdr->b_birth);
+	kmutex_t *hash_lock = BUF_HASH_LOCK(hv);
+	arc_buf_hdr_t *fhdr, **bucket;
 	uint32_t i;
 
 	ASSERT(!DVA_IS_EMPTY(&hdr->b_dva));
@@ -1058,14 +1202,15 @@ buf_hash_insert(arc_buf_hdr_t *hdr, kmutex_t **lockp)
 		ASSERT(MUTEX_HELD(hash_lock));
 	}
 
-	for (fhdr = buf_hash_table.ht_table[idx], i = 0; fhdr != NULL;
+	bucket = buf_hash_bucket(hv);
+	for (fhdr = *bucket, i = 0; fhdr != NULL;
 	    fhdr = fhdr->b_hash_next, i++) {
 		if (HDR_EQUAL(hdr->b_spa, &hdr->b_dva, hdr->b_birth, fhdr))
 			return (fhdr);
 	}
 
-	hdr->b_hash_next = buf_hash_table.ht_table[idx];
-	buf_hash_table.ht_table[idx] = hdr;
+	hdr->b_hash_next = *bucket;
+	*bucket = hdr;
 	arc_hdr_set_flags(hdr, ARC_FLAG_IN_HASH_TABLE);
 
 	/* collect some hash table performance data */
@@ -1080,19 +1225,24 @@ buf_hash_insert(arc_buf_hdr_t *hdr, kmutex_t **lockp)
 	    &arc_stats.arcstat_hash_elements.value.ui64);
 	ARCSTAT_MAX(arcstat_hash_elements_max, he);
 
+	if (he > buf_hash_table.ht_mask + 1 &&
+	    buf_hash_table.ht_old_table == NULL &&
+	    gethrtime() >= buf_hash_table.ht_grow_retry)
+		zthr_wakeup(arc_hash_zthr);
+
 	return (NULL);
 }
 
 static void
 buf_hash_remove(arc_buf_hdr_t *hdr)
 {
-	arc_buf_hdr_t *fhdr, **hdrp;
-	uint64_t idx = BUF_HASH_INDEX(hdr->b_spa, &hdr->b_dva, hdr->b_birth);
+	arc_buf_hdr_t *fhdr, **hdrp, **bucket;
+	uint64_t hv = buf_hash(hdr->b_spa, &hdr->b_dva, hdr->b_birth);
 
-	ASSERT(MUTEX_HELD(BUF_HASH_LOCK(idx)));
+	ASSERT(MUTEX_HELD(BUF_HASH_LOCK(hv)));
 	ASSERT(HDR_IN_HASH_TABLE(hdr));
 
-	hdrp = &buf_hash_table.ht_table[idx];
+	hdrp = bucket = buf_hash_bucket(hv);
 	while ((fhdr = *hdrp) != hdr) {
 		ASSERT3P(fhdr, !=, NULL);
 		hdrp = &fhdr->b_hash_next;
@@ -1104,11 +1254,173 @@ buf_hash_remove(arc_buf_hdr_t *hdr)
 	/* collect some hash table performance data */
 	atomic_dec_64(&arc_stats.arcstat_hash_elements.value.ui64);
 
-	if (buf_hash_table.ht_table[idx] &&
-	    buf_hash_table.ht_table[idx]->b_hash_next == NULL)
+	if (*bucket && (*bucket)->b_hash_next == NULL)
 		ARCSTAT_BUMPDOWN(arcstat_hash_chains);
 }
 
+static arc_buf_hdr_t **
+buf_hash_table_alloc(uint64_t hsize, int kmflag)
+{
+#if defined(_KERNEL)
+	/*
+	 * Large allocations which do not require contiguous pages
+	 * should be using vmem_alloc() in the linux kernel
+	 */
+	return (vmem_zalloc(hsize * sizeof (void *), kmflag));
+#else
+	return (kmem_zalloc(hsize * sizeof (void *), kmflag));
+#endif
+}
+
+static void
+buf_hash_table_free(arc_buf_hdr_t **table, uint64_t hsize)
+{
+#if defined(_KERNEL)
+	vmem_free(table, hsize * sizeof (void *));
+#else
+	kmem_free(table, hsize * sizeof (void *));
+#endif
+}
+
+/*
+ * Every header describes at least SPA_MINBLOCKSIZE of data in the ARC, in
+ * its ghost lists (which track up to arc_c of evicted data) or in the
+ * L2ARC, so there can never be much more than one header per
+ * SPA_MINBLOCKSIZE of 2 * arc_c_max plus the L2ARC capacity.  The table
+ * isn't grown past one bucket for each of those.
+ */
+static uint64_t
+buf_hash_mask_max(void)
+{
+	uint64_t bytes = 2 * arc_c_max;
+
+	mutex_enter(&l2arc_dev_mtx);
+	if (l2arc_dev_list != NULL) {
+		for (l2arc_dev_t *dev = list_head(l2arc_dev_list); dev != NULL;
+		    dev = list_next(l2arc_dev_list, dev))
+			bytes += dev->l2ad_end - dev->l2ad_start;
+	}
+	mutex_exit(&l2arc_dev_mtx);
+
+	return ((1ULL << highbit64(bytes >> SPA_MINBLOCKSHIFT)) - 1);
+}
+
+static void
+buf_hash_table_account(uint64_t mask, boolean_t consume)
+{
+	if (mask == buf_hash_table.ht_initial_mask)
+		return;
+	if (consume)
+		arc_space_consume((mask + 1) * sizeof (void *), ARC_SPACE_HDRS);
+	else
+		arc_space_return((mask + 1) * sizeof (void *), ARC_SPACE_HDRS);
+}
+
+static boolean_t
+arc_hash_grow_cb_check(void *arg, zthr_t *zthr)
+{
+	(void) arg, (void) zthr;
+	buf_hash_table_t *ht = &buf_hash_table;
+
+	if (ht->ht_old_table != NULL)
+		return (B_TRUE);
+
+	return (ARCSTAT(arcstat_hash_elements) > ht->ht_mask + 1 &&
+	    gethrtime() >= ht->ht_grow_retry);
+}
+
+/*
+ * Double the size of the hash table, or finish a resize which was
+ * interrupted by the zthr being cancelled.  The new table is allocated
+ * without sleeping.  If that fails, or the table has reached the size
+ * given by buf_hash_mask_max(), growing is retried a second later.
+ */
+static void
+arc_hash_grow_cb(void *arg, zthr_t *zthr)
+{
+	(void) arg;
+	buf_hash_table_t *ht = &buf_hash_table;
+	uint64_t nlocks = ht->ht_lock_mask + 1;
+
+	if (ht->ht_old_table == NULL) {
+		uint64_t nmask = (ht->ht_mask << 1) | 1;
+		arc_buf_hdr_t **ntable = NULL;
+
+		if (nmask <= buf_hash_mask_max())
+			ntable = buf_hash_table_alloc(nmask + 1, KM_NOSLEEP);
+		if (ntable == NULL) {
+			ht->ht_grow_retry = gethrtime() + SEC2NSEC(1);
+			return;
+		}
+		buf_hash_table_account(nmask, B_TRUE);
+
+		for (uint64_t i = 0; i < nlocks; i++)
+			mutex_enter(&ht->ht_locks[i]);
+		ht->ht_old_table = ht->ht_table;
+		ht->ht_old_mask = ht->ht_mask;
+		ht->ht_table = ntable;
+		ht->ht_mask = nmask;
+		memset(ht->ht_lock_moved, 0, nlocks);
+		ht->ht_moved = 0;
+		for (uint64_t i = 0; i < nlocks; i++)
+			mutex_exit(&ht->ht_locks[i]);
+
+		/* Only track the longest chain since the last resize. */
+		ARCSTAT(arcstat_hash_chain_max) = 0;
+	}
+
+	for (uint64_t i = 0; i < nlocks; i++) {
+		int64_t ochains = 0, nchains = 0;
+		uint32_t chain_max = 0;
+
+		if (ht->ht_lock_moved[i])
+			continue;
+		if (zthr_iscancelled(zthr))
+			return;
+
+		mutex_enter(&ht->ht_locks[i]);
+		for (uint64_t idx = i; idx <= ht->ht_old_mask; idx += nlocks) {
+			arc_buf_hdr_t *hdr, **obucket = &ht->ht_old_table[idx];
+
+			if (*obucket != NULL && (*obucket)->b_hash_next != NULL)
+				ochains++;
+			while ((hdr = *obucket) != NULL) {
+				arc_buf_hdr_t **nbucket = &ht->ht_table[
+				    buf_hash(hdr->b_spa, &hdr->b_dva,
+				    hdr->b_birth) & ht->ht_mask];
+				uint32_t len = 0;
+
+				for (arc_buf_hdr_t *f = *nbucket; f != NULL;
+				    f = f->b_hash_next)
+					len++;
+				if (len == 1)
+					nchains++;
+				chain_max = MAX(chain_max, len);
+
+				*obucket = hdr->b_hash_next;
+				hdr->b_hash_next = *nbucket;
+				*nbucket = hdr;
+			}
+		}
+		ht->ht_lock_moved[i] = 1;
+		ht->ht_moved++;
+		mutex_exit(&ht->ht_locks[i]);
+
+		ARCSTAT_INCR(arcstat_hash_chains, nchains - ochains);
+		ARCSTAT_MAX(arcstat_hash_chain_max, chain_max);
+	}
+
+	/*
+	 * Every lookup now finds its lock's chains moved and uses the new
+	 * table, so nothing can still be referencing the old one.
+	 */
+	arc_buf_hdr_t **otable = ht->ht_old_table;
+	ht->ht_old_table = NULL;
+	buf_hash_table_free(otable, ht->ht_old_mask + 1);
+	buf_hash_table_account(ht->ht_old_mask, B_FALSE);
+	ARCSTAT(arcstat_hash_rehashes)++;
+}
+
 /*
  * Global data structures and functions for the buf kmem cache.
  */
@@ -1120,19 +1432,19 @@ static kmem_cache_t *buf_cache;
 static void
 buf_fini(void)
 {
-#if defined(_KERNEL)
-	/*
-	 * Large allocations which do not require contiguous pages
-	 * should be using vmem_free() in the linux kernel\
-	 */
-	vmem_free(buf_hash_table.ht_table,
-	    (buf_hash_table.ht_mask + 1) * sizeof (void *));
-#else
-	kmem_free(buf_hash_table.ht_table,
-	    (buf_hash_table.ht_mask + 1) * sizeof (void *));
-#endif
-	for (int i = 0; i < BUF_LOCKS; i++)
-		mutex_destroy(BUF_HASH_LOCK(i));
+	buf_hash_table_t *ht = &buf_hash_table;
+	uint64_t nlocks = ht->ht_lock_mask + 1;
+
+	buf_hash_table_free(ht->ht_table, ht->ht_mask + 1);
+	buf_hash_table_account(ht->ht_mask, B_FALSE);
+	if (ht->ht_old_table != NULL) {
+		buf_hash_table_free(ht->ht_old_table, ht->ht_old_mask + 1);
+		buf_hash_table_account(ht->ht_old_mask, B_FALSE);
+	}
+	for (uint64_t i = 0; i < nlocks; i++)
+		mutex_destroy(&ht->ht_locks[i]);
+	kmem_free(ht->ht_locks, nlocks * sizeof (kmutex_t));
+	kmem_free(ht->ht_lock_moved, nlocks);
 	kmem_cache_destroy(hdr_full_cache);
 	kmem_cache_destroy(hdr_l2only_cache);
 	kmem_cache_destroy(buf_cache);
@@ -1231,31 +1543,43 @@ buf_init(void)
 	int i, j;
 
 	/*
-	 * The hash table is big enough to fill all of physical memory
+	 * The hash table starts out big enough to fill all of physical memory
 	 * with an average block size of zfs_arc_average_blocksize (default 8K).
 	 * By default, the table will take up
 	 * totalmem * sizeof(void*) / 8K (1MB per GB with 8-byte pointers).
+	 * It is grown later if there are more headers than buckets, e.g.
+	 * because of a large L2ARC or hot-added memory.
 	 */
 	while (hsize * zfs_arc_average_blocksize < arc_all_memory())
 		hsize <<= 1;
 retry:
 	buf_hash_table.ht_mask = hsize - 1;
 #if defined(_KERNEL)
-	/*
-	 * Large allocations which do not require contiguous pages
-	 * should be using vmem_alloc() in the linux kernel
-	 */
-	buf_hash_table.ht_table =
-	    vmem_zalloc(hsize * sizeof (void*), KM_SLEEP);
+	buf_hash_table.ht_table = buf_hash_table_alloc(hsize, KM_SLEEP);
 #else
-	buf_hash_table.ht_table =
-	    kmem_zalloc(hsize * sizeof (void*), KM_NOSLEEP);
+	buf_hash_table.ht_table = buf_hash_table_alloc(hsize, KM_NOSLEEP);
 #endif
 	if (buf_hash_table.ht_table == NULL) {
 		ASSERT(hsize > (1ULL << 8));
 		hsize >>= 1;
 		goto retry;
 	}
+	buf_hash_table.ht_old_table = NULL;
+	buf_hash_table.ht_initial_mask = hsize - 1;
+	buf_hash_table.ht_grow_retry = 0;
+
+	/*
+	 * Scale the number of hash locks with the number of CPUs, but never
+	 * have more locks than buckets.
+	 */
+	uint64_t nlocks = BUF_LOCKS_MIN;
+	while (nlocks < (uint64_t)max_ncpus * BUF_LOCKS_PER_CPU)
+		nlocks <<= 1;
+	nlocks = MIN(nlocks, hsize);
+	buf_hash_table.ht_lock_mask = nlocks - 1;
+	buf_hash_table.ht_locks = kmem_zalloc(nlocks * sizeof (kmutex_t),
+	    KM_SLEEP);
+	buf_hash_table.ht_lock_moved = kmem_zalloc(nlocks, KM_SLEEP);
 
 	hdr_full_cache = kmem_cache_create("arc_buf_hdr_t_full", HDR_FULL_SIZE,
 	    0, hdr_full_cons, hdr_full_dest, NULL, NULL, NULL, KMC_RECLAIMABLE);
@@ -1269,8 +1593,10 @@ retry:
 		for (ct = zfs_crc64_table + i, *ct = i, j = 8; j > 0; j--)
 			*ct = (*ct >> 1) ^ (-(*ct & 1) & ZFS_CRC64_POLY);
 
-	for (i = 0; i < BUF_LOCKS; i++)
-		mutex_init(BUF_HASH_LOCK(i), NULL, MUTEX_DEFAULT, NULL);
+	for (i = 0; i < nlocks; i++) {
+		mutex_init(&buf_hash_table.ht_locks[i], NULL, MUTEX_NOLOCKDEP,
+		    NULL);
+	}
 }
 
 #define	ARC_MINTIME	(hz>>4) /* 62 ms */
@@ -1735,9 +2061,9 @@ arc_buf_alloc_l2only(size_t size, arc_buf_contents_t type, l2arc_dev_t *dev,
 
 	hdr->b_dva = dva;
 
-	hdr->b_l2hdr.b_dev = dev;
-	hdr->b_l2hdr.b_daddr = daddr;
-	hdr->b_l2hdr.b_arcs_state = arcs_state;
+	l2arc_hdr_set_loc(hdr, dev, daddr);
+	hdr->b_l2_hits = 0;
+	hdr->b_l2_arcs_state = arcs_state;
 
 	return (hdr);
 }
@@ -2371,8 +2697,8 @@ arc_buf_info(arc_buf_t *ab, arc_buf_info_t *abi, int state_index)
 	}
 
 	if (l2hdr) {
-		abi->abi_l2arc_dattr = l2hdr->b_daddr;
-		abi->abi_l2arc_hits = l2hdr->b_hits;
+		abi->abi_l2arc_dattr = l2arc_hdr_daddr(hdr);
+		abi->abi_l2arc_hits = hdr->b_l2_hits;
 	}
 
 	abi->abi_state_type = state ? state->arcs_state : ARC_STATE_ANON;
@@ -2573,7 +2899,7 @@ arc_change_state(arc_state_t *new_state, arc_buf_hdr_t *hdr)
 
 		if (HDR_HAS_L2HDR(hdr) && new_state != arc_l2c_only) {
 			l2arc_hdr_arcstats_decrement_state(hdr);
-			hdr->b_l2hdr.b_arcs_state = new_state->arcs_state;
+			hdr->b_l2_arcs_state = new_state->arcs_state;
 			l2arc_hdr_arcstats_increment_state(hdr);
 		}
 	}
@@ -2897,10 +3223,12 @@ arc_loan_inuse_buf(arc_buf_t *buf, const void *tag)
 }
 
 static void
-l2arc_free_abd_on_write(abd_t *abd, size_t size, arc_buf_contents_t type)
+l2arc_free_abd_on_write(l2arc_dev_t *dev, abd_t *abd, size_t size,
+    arc_buf_contents_t type)
 {
 	l2arc_data_free_t *df = kmem_alloc(sizeof (*df), KM_SLEEP);
 
+	df->l2df_dev = dev;
 	df->l2df_abd = abd;
 	df->l2df_size = size;
 	df->l2df_type = type;
@@ -2915,6 +3243,12 @@ arc_hdr_free_on_write(arc_buf_hdr_t *hdr, boolean_t free_rdata)
 	arc_state_t *state = hdr->b_l1hdr.b_state;
 	arc_buf_contents_t type = arc_buf_type(hdr);
 	uint64_t size = (free_rdata) ? HDR_GET_PSIZE(hdr) : arc_hdr_size(hdr);
+	/*
+	 * The hdr's L2 header may already have been destroyed by
+	 * arc_release(), but its location is left in place until the write
+	 * it was part of completes, so it still names the device.
+	 */
+	l2arc_dev_t *dev = l2arc_hdr_dev(hdr);
 
 	/* protected by hash lock, if in the hash table */
 	if (multilist_link_active(&hdr->b_l1hdr.b_arc_node)) {
@@ -2933,9 +3267,10 @@ arc_hdr_free_on_write(arc_buf_hdr_t *hdr, boolean_t free_rdata)
 	}
 
 	if (free_rdata) {
-		l2arc_free_abd_on_write(hdr->b_crypt_hdr.b_rabd, size, type);
+		l2arc_free_abd_on_write(dev, hdr->b_crypt_hdr.b_rabd, size,
+		    type);
 	} else {
-		l2arc_free_abd_on_write(hdr->b_l1hdr.b_pabd, size, type);
+		l2arc_free_abd_on_write(dev, hdr->b_l1hdr.b_pabd, size, type);
 	}
 }
 
@@ -3266,6 +3601,7 @@ arc_hdr_alloc(uint64_t spa, int32_t psize, int32_t lsize,
 	arc_hdr_set_flags(hdr, arc_bufc_to_flags(type) | ARC_FLAG_HAS_L1HDR);
 	arc_hdr_set_compress(hdr, compression_type);
 	hdr->b_complevel = complevel;
+	hdr->b_l2_hits = 0;
 	if (protected)
 		arc_hdr_set_flags(hdr, ARC_FLAG_PROTECTED);
 
@@ -3295,7 +3631,7 @@ arc_hdr_realloc(arc_buf_hdr_t *hdr, kmem_cache_t *old, kmem_cache_t *new)
 	ASSERT(HDR_HAS_L2HDR(hdr));
 
 	arc_buf_hdr_t *nhdr;
-	l2arc_dev_t *dev = hdr->b_l2hdr.b_dev;
+	l2arc_dev_t *dev = l2arc_hdr_dev(hdr);
 
 	ASSERT((old == hdr_full_cache && new == hdr_l2only_cache) ||
 	    (old == hdr_l2only_cache && new == hdr_full_cache));
@@ -3515,8 +3851,7 @@ static void
 l2arc_hdr_arcstats_update(arc_buf_hdr_t *hdr, boolean_t incr,
     boolean_t state_only)
 {
-	l2arc_buf_hdr_t *l2hdr = &hdr->b_l2hdr;
-	l2arc_dev_t *dev = l2hdr->b_dev;
+	l2arc_dev_t *dev = l2arc_hdr_dev(hdr);
 	uint64_t lsize = HDR_GET_LSIZE(hdr);
 	uint64_t psize = HDR_GET_PSIZE(hdr);
 	uint64_t asize = vdev_psize_to_asize(dev->l2ad_vdev, psize);
@@ -3548,7 +3883,7 @@ l2arc_hdr_arcstats_update(arc_buf_hdr_t *hdr, boolean_t incr,
 		 * possibly absent L1 header (apparent in buffers restored
 		 * from persistent L2ARC).
 		 */
-		switch (hdr->b_l2hdr.b_arcs_state) {
+		switch (hdr->b_l2_arcs_state) {
 			case ARC_STATE_MRU_GHOST:
 			case ARC_STATE_MRU:
 				ARCSTAT_INCR(arcstat_l2_mru_asize, asize_s);
@@ -3584,8 +3919,7 @@ l2arc_hdr_arcstats_update(arc_buf_hdr_t *hdr, boolean_t incr,
 static void
 arc_hdr_l2hdr_destroy(arc_buf_hdr_t *hdr)
 {
-	l2arc_buf_hdr_t *l2hdr = &hdr->b_l2hdr;
-	l2arc_dev_t *dev = l2hdr->b_dev;
+	l2arc_dev_t *dev = l2arc_hdr_dev(hdr);
 	uint64_t psize = HDR_GET_PSIZE(hdr);
 	uint64_t asize = vdev_psize_to_asize(dev->l2ad_vdev, psize);
 
@@ -3600,6 +3934,7 @@ arc_hdr_l2hdr_destroy(arc_buf_hdr_t *hdr)
 	(void) zfs_refcount_remove_many(&dev->l2ad_alloc, arc_hdr_size(hdr),
 	    hdr);
 	arc_hdr_clear_flags(hdr, ARC_FLAG_HAS_L2HDR);
+	hdr->b_l2_hits = 0;
 }
 
 static void
@@ -3613,7 +3948,7 @@ arc_hdr_destroy(arc_buf_hdr_t *hdr)
 	ASSERT(!HDR_IN_HASH_TABLE(hdr));
 
 	if (HDR_HAS_L2HDR(hdr)) {
-		l2arc_dev_t *dev = hdr->b_l2hdr.b_dev;
+		l2arc_dev_t *dev = l2arc_hdr_dev(hdr);
 		boolean_t buflist_held = MUTEX_HELD(&dev->l2ad_mtx);
 
 		if (!buflist_held)
@@ -4028,6 +4363,70 @@ arc_state_free_markers(arc_buf_hdr_t **markers, int count)
 	kmem_free(markers, sizeof (*markers) * count);
 }
 
+/*
+ * Evict from the sublists owned by one eviction worker, starting at a random
+ * one, until its share of the bytes is gone or it has been through them all.
+ */
+static void
+arc_evict_task(void *arg)
+{
+	arc_evict_arg_t *eva = arg;
+	int num_sublists = multilist_get_num_sublists(eva->eva_ml);
+	uint_t nowned = (num_sublists - eva->eva_thread +
+	    arc_evict_nthreads - 1) / arc_evict_nthreads;
+	hrtime_t start = gethrtime();
+
+	eva->eva_evicted = 0;
+	for (uint_t i = 0; i < nowned && eva->eva_evicted < eva->eva_bytes;
+	    i++) {
+		int idx = eva->eva_thread +
+		    ((eva->eva_start + i) % nowned) * arc_evict_nthreads;
+
+		eva->eva_evicted += arc_evict_state_impl(eva->eva_ml, idx,
+		    eva->eva_markers[idx], eva->eva_spa,
+		    eva->eva_bytes - eva->eva_evicted);
+	}
+
+	/* Only this worker updates its own counters. */
+	arc_evict_kstats[eva->eva_thread * 2].value.ui64 += eva->eva_evicted;
+	arc_evict_kstats[eva->eva_thread * 2 + 1].value.ui64 +=
+	    gethrtime() - start;
+}
+
+/*
+ * Make one pass over the multilist, like the loop in arc_evict_state(), but
+ * split between the eviction workers, each taking an equal share of the
+ * bytes. Only used by arc_evict_zthr, which owns the markers.
+ */
+static uint64_t
+arc_evict_state_tasks(multilist_t *ml, arc_buf_hdr_t **markers, uint64_t spa,
+    uint64_t bytes)
+{
+	uint64_t share = DIV_ROUND_UP(bytes, arc_evict_nthreads);
+	uint64_t evicted = 0;
+
+	ASSERT(zthr_iscurthread(arc_evict_zthr));
+	ASSERT3P(markers, ==, arc_state_evict_markers);
+
+	for (uint_t t = 0; t < arc_evict_nthreads; t++) {
+		arc_evict_arg_t *eva = &arc_evict_args[t];
+
+		eva->eva_ml = ml;
+		eva->eva_markers = markers;
+		eva->eva_start = random_in_range(UINT16_MAX);
+		eva->eva_spa = spa;
+		eva->eva_bytes = share;
+		taskq_dispatch_ent(arc_evict_taskq, arc_evict_task, eva, 0,
+		    &eva->eva_tqent);
+	}
+	taskq_wait(arc_evict_taskq);
+
+	for (uint_t t = 0; t < arc_evict_nthreads; t++)
+		evicted += arc_evict_args[t].eva_evicted;
+
+	return (evicted);
+}
+
 /*
  * Evict buffers from the given arc state, until we've removed the
  * specified number of bytes. Move the removed buffers to the
@@ -4049,6 +4448,7 @@ arc_evict_state(arc_state_t *state, arc_buf_contents_t type, uint64_t spa,
 	multilist_t *ml = &state->arcs_list[type];
 	int num_sublists;
 	arc_buf_hdr_t **markers;
+	uint64_t parallel_min = 0;
 
 	num_sublists = multilist_get_num_sublists(ml);
 
@@ -4073,6 +4473,16 @@ arc_evict_state(arc_state_t *state, arc_buf_contents_t type, uint64_t spa,
 		multilist_sublist_unlock(mls);
 	}
 
+	/*
+	 * Only arc_evict_zthr hands work to the eviction workers, since it
+	 * owns the preallocated markers they share.
+	 */
+	if (markers == arc_state_evict_markers && arc_evict_taskq != NULL &&
+	    bytes != ARC_EVICT_ALL) {
+		parallel_min = (uint64_t)arc_evict_nthreads *
+		    zfs_arc_evict_batch_limit * SPA_OLD_MAXBLOCKSIZE;
+	}
+
 	/*
 	 * While we haven't hit our target number of bytes to evict, or
 	 * we're evicting all available buffers.
@@ -4082,30 +4492,42 @@ arc_evict_state(arc_state_t *state, arc_buf_contents_t type, uint64_t spa,
 		uint64_t scan_evicted = 0;
 
 		/*
-		 * Start eviction using a randomly selected sublist,
-		 * this is to try and evenly balance eviction across all
-		 * sublists. Always starting at the same sublist
-		 * (e.g. index 0) would cause evictions to favor certain
-		 * sublists over others.
+		 * If there's enough left to give each eviction worker at
+		 * least a full batch, spread this pass over all of them.
 		 */
-		for (int i = 0; i < num_sublists; i++) {
-			uint64_t bytes_remaining;
-			uint64_t bytes_evicted;
+		if (parallel_min != 0 &&
+		    bytes - total_evicted >= parallel_min) {
+			scan_evicted = arc_evict_state_tasks(ml, markers, spa,
+			    bytes - total_evicted);
+			total_evicted += scan_evicted;
+		} else {
+			/*
+			 * Start eviction using a randomly selected sublist,
+			 * this is to try and evenly balance eviction across
+			 * all sublists. Always starting at the same sublist
+			 * (e.g. index 0) would cause evictions to favor
+			 * certain sublists over others.
+			 */
+			for (int i = 0; i < num_sublists; i++) {
+				uint64_t bytes_remaining;
+				uint64_t bytes_evicted;
 
-			if (total_evicted < bytes)
-				bytes_remaining = bytes - total_evicted;
-			else
-				break;
+				if (total_evicted < bytes)
+					bytes_remaining = bytes - total_evicted;
+				else
+					break;
 
-			bytes_evicted = arc_evict_state_impl(ml, sublist_idx,
-			    markers[sublist_idx], spa, bytes_remaining);
+				bytes_evicted = arc_evict_state_impl(ml,
+				    sublist_idx, markers[sublist_idx], spa,
+				    bytes_remaining);
 
-			scan_evicted += bytes_evicted;
-			total_evicted += bytes_evicted;
+				scan_evicted += bytes_evicted;
+				total_evicted += bytes_evicted;
 
-			/* we've reached the end, wrap to the beginning */
-			if (++sublist_idx >= num_sublists)
-				sublist_idx = 0;
+				/* reached the end, wrap to the beginning */
+				if (++sublist_idx >= num_sublists)
+					sublist_idx = 0;
+			}
 		}
 
 		/*
@@ -5072,6 +5494,8 @@ arc_access(arc_buf_hdr_t *hdr, arc_flags_t arc_flags, boolean_t hit)
 	}
 	if (arc_flags & ARC_FLAG_L2CACHE)
 		arc_hdr_set_flags(hdr, ARC_FLAG_L2CACHE);
+	if (!now_prefetch)
+		l2arc_admit_record(hdr);
 
 	clock_t now = ddi_get_lbolt();
 	if (hdr->b_l1hdr.b_state == arc_anon) {
@@ -5927,9 +6351,9 @@ top:
 		hdr->b_l1hdr.b_acb = acb;
 
 		if (HDR_HAS_L2HDR(hdr) &&
-		    (vd = hdr->b_l2hdr.b_dev->l2ad_vdev) != NULL) {
-			devw = hdr->b_l2hdr.b_dev->l2ad_writing;
-			addr = hdr->b_l2hdr.b_daddr;
+		    (vd = l2arc_hdr_dev(hdr)->l2ad_vdev) != NULL) {
+			devw = l2arc_hdr_dev(hdr)->l2ad_writing;
+			addr = l2arc_hdr_daddr(hdr);
 			/*
 			 * Lock out L2ARC device removal.
 			 */
@@ -5992,7 +6416,8 @@ top:
 
 				DTRACE_PROBE1(l2arc__hit, arc_buf_hdr_t *, hdr);
 				ARCSTAT_BUMP(arcstat_l2_hits);
-				hdr->b_l2hdr.b_hits++;
+				if (hdr->b_l2_hits < UINT16_MAX)
+					hdr->b_l2_hits++;
 
 				cb = kmem_zalloc(sizeof (l2arc_read_callback_t),
 				    KM_SLEEP);
@@ -6324,7 +6749,7 @@ arc_release(arc_buf_t *buf, const void *tag)
 	ASSERT3S(zfs_refcount_count(&hdr->b_l1hdr.b_refcnt), >, 0);
 
 	if (HDR_HAS_L2HDR(hdr)) {
-		mutex_enter(&hdr->b_l2hdr.b_dev->l2ad_mtx);
+		mutex_enter(&l2arc_hdr_dev(hdr)->l2ad_mtx);
 
 		/*
 		 * We have to recheck this conditional again now that
@@ -6337,7 +6762,7 @@ arc_release(arc_buf_t *buf, const void *tag)
 		if (HDR_HAS_L2HDR(hdr))
 			arc_hdr_l2hdr_destroy(hdr);
 
-		mutex_exit(&hdr->b_l2hdr.b_dev->l2ad_mtx);
+		mutex_exit(&l2arc_hdr_dev(hdr)->l2ad_mtx);
 	}
 
 	/*
@@ -7013,6 +7438,11 @@ arc_kstat_update(kstat_t *ksp, int rw)
 	    wmsum_value(&arc_sums.arcstat_hash_collisions);
 	as->arcstat_hash_chains.value.ui64 =
 	    wmsum_value(&arc_sums.arcstat_hash_chains);
+	as->arcstat_hash_table_size.value.ui64 = buf_hash_table.ht_mask + 1;
+	as->arcstat_hash_locks.value.ui64 = buf_hash_table.ht_lock_mask + 1;
+	as->arcstat_hash_rehash_remaining.value.ui64 =
+	    buf_hash_table.ht_old_table == NULL ? 0 :
+	    buf_hash_table.ht_lock_mask + 1 - buf_hash_table.ht_moved;
 	as->arcstat_size.value.ui64 =
 	    aggsum_value(&arc_sums.arcstat_size);
 	as->arcstat_compressed_size.value.ui64 =
@@ -7117,6 +7547,10 @@ arc_kstat_update(kstat_t *ksp, int rw)
 	    wmsum_value(&arc_sums.arcstat_l2_free_on_write);
 	as->arcstat_l2_abort_lowmem.value.ui64 =
 	    wmsum_value(&arc_sums.arcstat_l2_abort_lowmem);
+	as->arcstat_l2_admit_accepted.value.ui64 =
+	    wmsum_value(&arc_sums.arcstat_l2_admit_accepted);
+	as->arcstat_l2_admit_rejected.value.ui64 =
+	    wmsum_value(&arc_sums.arcstat_l2_admit_rejected);
 	as->arcstat_l2_cksum_bad.value.ui64 =
 	    wmsum_value(&arc_sums.arcstat_l2_cksum_bad);
 	as->arcstat_l2_io_error.value.ui64 =
@@ -7465,6 +7899,8 @@ arc_state_init(void)
 	wmsum_init(&arc_sums.arcstat_l2_evict_l1cached, 0);
 	wmsum_init(&arc_sums.arcstat_l2_free_on_write, 0);
 	wmsum_init(&arc_sums.arcstat_l2_abort_lowmem, 0);
+	wmsum_init(&arc_sums.arcstat_l2_admit_accepted, 0);
+	wmsum_init(&arc_sums.arcstat_l2_admit_rejected, 0);
 	wmsum_init(&arc_sums.arcstat_l2_cksum_bad, 0);
 	wmsum_init(&arc_sums.arcstat_l2_io_error, 0);
 	wmsum_init(&arc_sums.arcstat_l2_lsize, 0);
@@ -7623,6 +8059,8 @@ arc_state_fini(void)
 	wmsum_fini(&arc_sums.arcstat_l2_evict_l1cached);
 	wmsum_fini(&arc_sums.arcstat_l2_free_on_write);
 	wmsum_fini(&arc_sums.arcstat_l2_abort_lowmem);
+	wmsum_fini(&arc_sums.arcstat_l2_admit_accepted);
+	wmsum_fini(&arc_sums.arcstat_l2_admit_rejected);
 	wmsum_fini(&arc_sums.arcstat_l2_cksum_bad);
 	wmsum_fini(&arc_sums.arcstat_l2_io_error);
 	wmsum_fini(&arc_sums.arcstat_l2_lsize);
@@ -7659,6 +8097,84 @@ arc_state_fini(void)
 	wmsum_fini(&arc_sums.arcstat_abd_chunk_waste_size);
 }
 
+/*
+ * One eviction thread is plenty for small systems. Beyond that, add threads
+ * slowly as the CPU count grows: 3 for 8 CPUs, 6 for 32, 11 for 128.
+ */
+static uint_t
+arc_evict_threads_default(void)
+{
+	if (max_ncpus < 6)
+		return (1);
+	return ((highbit64(max_ncpus) - 1) + max_ncpus / 32);
+}
+
+static void
+arc_evict_threads_init(void)
+{
+	uint_t nthreads = zfs_arc_evict_threads;
+
+	if (nthreads == 0)
+		nthreads = arc_evict_threads_default();
+	nthreads = MIN(nthreads, arc_state_evict_marker_count);
+
+	if (nthreads <= 1)
+		return;
+
+	arc_evict_nthreads = nthreads;
+	arc_evict_taskq = taskq_create("arc_evict", nthreads, defclsyspri,
+	    nthreads, nthreads, TASKQ_PREPOPULATE);
+	arc_evict_args = kmem_zalloc(sizeof (arc_evict_arg_t) * nthreads,
+	    KM_SLEEP);
+	arc_evict_kstats = kmem_zalloc(sizeof (kstat_named_t) * nthreads * 2,
+	    KM_SLEEP);
+
+	for (uint_t t = 0; t < nthreads; t++) {
+		arc_evict_args[t].eva_thread = t;
+		taskq_init_ent(&arc_evict_args[t].eva_tqent);
+
+		kstat_named_t *ks = &arc_evict_kstats[t * 2];
+		(void) snprintf(ks[0].name, KSTAT_STRLEN, "thread%u_evicted",
+		    t);
+		ks[0].data_type = KSTAT_DATA_UINT64;
+		(void) snprintf(ks[1].name, KSTAT_STRLEN, "thread%u_nsecs", t);
+		ks[1].data_type = KSTAT_DATA_UINT64;
+	}
+
+	arc_evict_ksp = kstat_create("zfs", 0, "arc_evict", "misc",
+	    KSTAT_TYPE_NAMED, 0, KSTAT_FLAG_VIRTUAL);
+	if (arc_evict_ksp != NULL) {
+		arc_evict_ksp->ks_data = arc_evict_kstats;
+		arc_evict_ksp->ks_ndata = nthreads * 2;
+		arc_evict_ksp->ks_data_size =
+		    sizeof (kstat_named_t) * nthreads * 2;
+		kstat_install(arc_evict_ksp);
+	}
+}
+
+static void
+arc_evict_threads_fini(void)
+{
+	if (arc_evict_taskq == NULL)
+		return;
+
+	if (arc_evict_ksp != NULL) {
+		kstat_delete(arc_evict_ksp);
+		arc_evict_ksp = NULL;
+	}
+
+	taskq_destroy(arc_evict_taskq);
+	arc_evict_taskq = NULL;
+
+	kmem_free(arc_evict_args,
+	    sizeof (arc_evict_arg_t) * arc_evict_nthreads);
+	kmem_free(arc_evict_kstats,
+	    sizeof (kstat_named_t) * arc_evict_nthreads * 2);
+	arc_evict_args = NULL;
+	arc_evict_kstats = NULL;
+	arc_evict_nthreads = 0;
+}
+
 uint64_t
 arc_target_bytes(void)
 {
@@ -7743,6 +8259,7 @@ arc_init(void)
 	arc_state_init();
 
 	buf_init();
+	l2arc_admit_init();
 
 	list_create(&arc_prune_list, sizeof (arc_prune_t),
 	    offsetof(arc_prune_t, p_node));
@@ -7762,10 +8279,13 @@ arc_init(void)
 
 	arc_state_evict_markers =
 	    arc_state_alloc_markers(arc_state_evict_marker_count);
+	arc_evict_threads_init();
 	arc_evict_zthr = zthr_create_timer("arc_evict",
 	    arc_evict_cb_check, arc_evict_cb, NULL, SEC2NSEC(1), defclsyspri);
 	arc_reap_zthr = zthr_create_timer("arc_reap",
 	    arc_reap_cb_check, arc_reap_cb, NULL, SEC2NSEC(1), minclsyspri);
+	arc_hash_zthr = zthr_create("arc_hash",
+	    arc_hash_grow_cb_check, arc_hash_grow_cb, NULL, minclsyspri);
 
 	arc_warm = B_FALSE;
 
@@ -7840,6 +8360,8 @@ arc_fini(void)
 
 	(void) zthr_cancel(arc_evict_zthr);
 	(void) zthr_cancel(arc_reap_zthr);
+	(void) zthr_cancel(arc_hash_zthr);
+	arc_evict_threads_fini();
 	arc_state_free_markers(arc_state_evict_markers,
 	    arc_state_evict_marker_count);
 
@@ -7851,7 +8373,7 @@ arc_fini(void)
 	 * to occur before arc_state_fini() runs and destroys the aggsum
 	 * values which are updated when freeing scatter ABDs.
 	 */
-	l2arc_do_free_on_write();
+	l2arc_do_free_on_write(NULL);
 
 	/*
 	 * buf_fini() must proceed arc_state_fini() because buf_fin() may
@@ -7859,6 +8381,7 @@ arc_fini(void)
 	 * arc_space_return() which accesses aggsums freed in act_state_fini().
 	 */
 	buf_fini();
+	l2arc_admit_fini();
 	arc_state_fini();
 
 	arc_unregister_hotplug();
@@ -7870,6 +8393,7 @@ arc_fini(void)
 	 */
 	zthr_destroy(arc_evict_zthr);
 	zthr_destroy(arc_reap_zthr);
+	zthr_destroy(arc_hash_zthr);
 
 	ASSERT0(arc_loaned_bytes);
 }
@@ -8133,6 +8657,126 @@ l2arc_write_eligible(uint64_t spa_guid, arc_buf_hdr_t *hdr)
 	return (B_TRUE);
 }
 
+/*
+ * Admission filter sketch.  The sketch is sized from arc_c_max, one
+ * counter per L2ARC_SKETCH_BYTES_PER bytes of ARC in each row, and is
+ * indexed by the same hash as the ARC hash table.  Counter updates are
+ * deliberately not atomic: a lost increment only makes the estimate
+ * slightly lower, which is harmless for an admission heuristic.
+ */
+static void
+l2arc_admit_init(void)
+{
+	uint64_t width = arc_c_max / L2ARC_SKETCH_BYTES_PER;
+
+	width = MIN(MAX(width, L2ARC_SKETCH_MIN_WIDTH), L2ARC_SKETCH_MAX_WIDTH);
+	l2arc_sketch_width = 1ULL << (highbit64(width) - 1);
+	l2arc_sketch = vmem_zalloc(L2ARC_SKETCH_DEPTH * l2arc_sketch_width,
+	    KM_SLEEP);
+	wmsum_init(&l2arc_sketch_adds, 0);
+	l2arc_sketch_aged = 0;
+}
+
+static void
+l2arc_admit_fini(void)
+{
+	wmsum_fini(&l2arc_sketch_adds);
+	vmem_free(l2arc_sketch, L2ARC_SKETCH_DEPTH * l2arc_sketch_width);
+	l2arc_sketch = NULL;
+}
+
+static inline uint8_t *
+l2arc_sketch_counter(uint64_t hash, int row)
+{
+	uint64_t idx = (hash + row * ((hash >> 32) | 1)) &
+	    (l2arc_sketch_width - 1);
+
+	return (&l2arc_sketch[row * l2arc_sketch_width + idx]);
+}
+
+/*
+ * Count a demand access to hdr.  Only the smallest counters are bumped
+ * (conservative update), which keeps hash collisions from inflating the
+ * estimate of rarely used buffers.
+ */
+static void
+l2arc_admit_record(arc_buf_hdr_t *hdr)
+{
+	uint8_t *c[L2ARC_SKETCH_DEPTH];
+	uint8_t min = UINT8_MAX;
+
+	if (l2arc_admit_min_refs == 0 || l2arc_ndev == 0 || HDR_EMPTY(hdr))
+		return;
+
+	uint64_t hash = buf_hash(hdr->b_spa, &hdr->b_dva, hdr->b_birth);
+	for (int i = 0; i < L2ARC_SKETCH_DEPTH; i++) {
+		c[i] = l2arc_sketch_counter(hash, i);
+		min = MIN(min, *c[i]);
+	}
+	if (min >= L2ARC_SKETCH_MAX)
+		return;
+	for (int i = 0; i < L2ARC_SKETCH_DEPTH; i++) {
+		if (*c[i] == min)
+			*c[i] = min + 1;
+	}
+	wmsum_add(&l2arc_sketch_adds, 1);
+}
+
+static uint_t
+l2arc_admit_estimate(arc_buf_hdr_t *hdr)
+{
+	uint8_t min = UINT8_MAX;
+
+	uint64_t hash = buf_hash(hdr->b_spa, &hdr->b_dva, hdr->b_birth);
+	for (int i = 0; i < L2ARC_SKETCH_DEPTH; i++)
+		min = MIN(min, *l2arc_sketch_counter(hash, i));
+
+	return (min);
+}
+
+/*
+ * Halve every counter once enough accesses have been counted since the
+ * last time, so that the sketch reflects recent popularity.  Called from
+ * the L2ARC feed thread.
+ */
+static void
+l2arc_admit_age(void)
+{
+	uint64_t sample = l2arc_sketch_width * L2ARC_SKETCH_SAMPLE;
+	uint64_t adds = wmsum_value(&l2arc_sketch_adds);
+
+	if (adds - l2arc_sketch_aged < sample)
+		return;
+
+	for (uint64_t i = 0; i < L2ARC_SKETCH_DEPTH * l2arc_sketch_width; i++)
+		l2arc_sketch[i] >>= 1;
+	l2arc_sketch_aged = adds;
+}
+
+/*
+ * Decide whether a buffer which is eligible for the L2ARC is popular
+ * enough to be worth the device bandwidth and write endurance.  A buffer
+ * that is turned away is seen again on every later scan, so it is only
+ * counted the first time, which is marked in b_l2_hits while it is not in
+ * the L2ARC.  One that is let through is written and not scanned again.
+ */
+static boolean_t
+l2arc_admit(arc_buf_hdr_t *hdr)
+{
+	if (l2arc_admit_min_refs == 0)
+		return (B_TRUE);
+
+	if (l2arc_admit_estimate(hdr) < l2arc_admit_min_refs) {
+		if (hdr->b_l2_hits == 0) {
+			hdr->b_l2_hits = 1;
+			ARCSTAT_BUMP(arcstat_l2_admit_rejected);
+		}
+		return (B_FALSE);
+	}
+	ARCSTAT_BUMP(arcstat_l2_admit_accepted);
+	return (B_TRUE);
+}
+
 static uint64_t
 l2arc_write_size(l2arc_dev_t *dev)
 {
@@ -8263,15 +8907,21 @@ out:
 }
 
 /*
- * Free buffers that were tagged for destruction.
+ * Free buffers that were tagged for destruction while being written to dev,
+ * or all of them if dev is NULL.  Other devices may still have writes in
+ * flight that borrow the rest.
  */
 static void
-l2arc_do_free_on_write(void)
+l2arc_do_free_on_write(l2arc_dev_t *dev)
 {
-	l2arc_data_free_t *df;
+	l2arc_data_free_t *df, *df_next;
 
 	mutex_enter(&l2arc_free_on_write_mtx);
-	while ((df = list_remove_head(l2arc_free_on_write)) != NULL) {
+	for (df = list_head(l2arc_free_on_write); df != NULL; df = df_next) {
+		df_next = list_next(l2arc_free_on_write, df);
+		if (dev != NULL && df->l2df_dev != dev)
+			continue;
+		list_remove(l2arc_free_on_write, df);
 		ASSERT3P(df->l2df_abd, !=, NULL);
 		abd_free(df->l2df_abd);
 		kmem_free(df, sizeof (l2arc_data_free_t));
@@ -8460,7 +9110,7 @@ top:
 	ASSERT(dev->l2ad_vdev != NULL);
 	vdev_space_update(dev->l2ad_vdev, -bytes_dropped, 0, 0);
 
-	l2arc_do_free_on_write();
+	l2arc_do_free_on_write(dev);
 
 	kmem_free(cb, sizeof (l2arc_write_callback_t));
 }
@@ -8711,7 +9361,7 @@ l2arc_read_done(zio_t *zio)
  * the lock pointer.
  */
 static multilist_sublist_t *
-l2arc_sublist_lock(int list_num)
+l2arc_sublist_lock(l2arc_dev_t *dev, int list_num)
 {
 	multilist_t *ml = NULL;
 	unsigned int idx;
@@ -8736,12 +9386,14 @@ l2arc_sublist_lock(int list_num)
 	}
 
 	/*
-	 * Return a randomly-selected sublist. This is acceptable
-	 * because the caller feeds only a little bit of data for each
-	 * call (8MB). Subsequent calls will result in different
-	 * sublists being selected.
+	 * Each device walks the sublists round-robin from a random starting
+	 * point. This is acceptable because the caller feeds only a little
+	 * bit of data for each call (8MB), and keeps devices which are fed
+	 * in parallel mostly scanning different sublists.
 	 */
-	idx = multilist_get_random_index(ml);
+	if (dev->l2ad_sublist_rotor == 0)
+		dev->l2ad_sublist_rotor = multilist_get_random_index(ml) + 1;
+	idx = dev->l2ad_sublist_rotor++ % multilist_get_num_sublists(ml);
 	return (multilist_sublist_lock_idx(ml, idx));
 }
 
@@ -8922,8 +9574,8 @@ retry:
 		ASSERT(!HDR_L2_WRITING(hdr));
 		ASSERT(!HDR_L2_WRITE_HEAD(hdr));
 
-		if (!all && (hdr->b_l2hdr.b_daddr >= dev->l2ad_evict ||
-		    hdr->b_l2hdr.b_daddr < dev->l2ad_hand)) {
+		if (!all && (l2arc_hdr_daddr(hdr) >= dev->l2ad_evict ||
+		    l2arc_hdr_daddr(hdr) < dev->l2ad_hand)) {
 			/*
 			 * We've evicted to the target address,
 			 * or the end of the device.
@@ -9175,7 +9827,7 @@ l2arc_write_buffers(spa_t *spa, l2arc_dev_t *dev, uint64_t target_sz)
 		 * Until the ARC is warm and starts to evict, read from the
 		 * head of the ARC lists rather than the tail.
 		 */
-		multilist_sublist_t *mls = l2arc_sublist_lock(pass);
+		multilist_sublist_t *mls = l2arc_sublist_lock(dev, pass);
 		ASSERT3P(mls, !=, NULL);
 		if (from_head)
 			hdr = multilist_sublist_head(mls);
@@ -9206,7 +9858,8 @@ skip:
 				break;
 			}
 
-			if (!l2arc_write_eligible(guid, hdr)) {
+			if (!l2arc_write_eligible(guid, hdr) ||
+			    !l2arc_admit(hdr)) {
 				mutex_exit(hash_lock);
 				goto skip;
 			}
@@ -9280,13 +9933,13 @@ skip:
 					goto next;
 				}
 
-				l2arc_free_abd_on_write(to_write, asize, type);
+				l2arc_free_abd_on_write(dev, to_write, asize,
+				    type);
 			}
 
-			hdr->b_l2hdr.b_dev = dev;
-			hdr->b_l2hdr.b_daddr = dev->l2ad_hand;
-			hdr->b_l2hdr.b_hits = 0;
-			hdr->b_l2hdr.b_arcs_state =
+			l2arc_hdr_set_loc(hdr, dev, dev->l2ad_hand);
+			hdr->b_l2_hits = 0;
+			hdr->b_l2_arcs_state =
 			    hdr->b_l1hdr.b_state->arcs_state;
 			mutex_enter(&dev->l2ad_mtx);
 			if (pio == NULL) {
@@ -9405,6 +10058,143 @@ l2arc_hdr_limit_reached(void)
 	    (s > (arc_warm ? arc_c : arc_c_max) * l2arc_meta_percent / 100));
 }
 
+/*
+ * Write one round of buffers to a cache device, returning when it should
+ * be fed next.  The caller holds the device's spa config lock.
+ */
+static clock_t
+l2arc_feed_dev(l2arc_dev_t *dev, clock_t begin)
+{
+	l2arc_dev_feed_stats_t *l2fs = &dev->l2ad_feed_stats;
+	spa_t *spa = dev->l2ad_spa;
+	uint64_t size, wrote;
+	clock_t next;
+
+	ASSERT3P(spa, !=, NULL);
+
+	/*
+	 * If the pool is read-only then force the feed thread to
+	 * sleep a little longer.
+	 */
+	if (!spa_writeable(spa))
+		return (ddi_get_lbolt() + 5 * l2arc_feed_secs * hz);
+
+	/*
+	 * Avoid contributing to memory pressure.
+	 */
+	if (l2arc_hdr_limit_reached()) {
+		ARCSTAT_BUMP(arcstat_l2_abort_lowmem);
+		l2fs->l2fs_abort_lowmem.value.ui64++;
+		return (ddi_get_lbolt() + hz);
+	}
+
+	ARCSTAT_BUMP(arcstat_l2_feeds);
+	l2fs->l2fs_feeds.value.ui64++;
+
+	size = l2arc_write_size(dev);
+
+	/*
+	 * Evict L2ARC buffers that will be overwritten.
+	 */
+	l2arc_evict(dev, size, B_FALSE);
+
+	/*
+	 * Write ARC buffers.
+	 */
+	wrote = l2arc_write_buffers(spa, dev, size);
+	l2fs->l2fs_write_bytes.value.ui64 += wrote;
+
+	/*
+	 * Calculate interval between writes.
+	 */
+	next = l2arc_write_interval(begin, size, wrote);
+	l2fs->l2fs_interval_ms.value.ui64 = ((next - begin) * 1000) / hz;
+
+	return (next);
+}
+
+static void
+l2arc_feed_task(void *arg)
+{
+	l2arc_dev_t *dev = arg;
+	fstrans_cookie_t cookie = spl_fstrans_mark();
+
+	clock_t next = l2arc_feed_dev(dev, ddi_get_lbolt());
+
+	/*
+	 * Hand the device back before dropping the config lock, which is
+	 * all that keeps it from being removed.
+	 */
+	mutex_enter(&l2arc_dev_mtx);
+	dev->l2ad_feed_next = next;
+	dev->l2ad_feeding = B_FALSE;
+	mutex_exit(&l2arc_dev_mtx);
+	spa_config_exit(dev->l2ad_spa, SCL_L2ARC, dev);
+
+	spl_fstrans_unmark(cookie);
+}
+
+/*
+ * Dispatch a feed to l2arc_feed_taskq for every usable cache device which
+ * is due for one, so that each device is written at its own pace and a
+ * slow device does not hold up the others.  Returns when the feed thread
+ * should look again.
+ */
+static clock_t
+l2arc_feed_dispatch(void)
+{
+	clock_t now = ddi_get_lbolt();
+	clock_t next = now + hz;
+	clock_t busy = now + MAX((hz * l2arc_feed_min_ms) / 1000, 1);
+	l2arc_dev_t **devs;
+	uint64_t ndevs, n = 0;
+
+	ndevs = l2arc_ndev;
+	if (ndevs == 0)
+		return (next);
+	devs = kmem_alloc(ndevs * sizeof (l2arc_dev_t *), KM_SLEEP);
+
+	/*
+	 * As in l2arc_dev_get_next(), spa_namespace_lock keeps the devices
+	 * from being removed until their config locks are held.
+	 */
+	mutex_enter(&spa_namespace_lock);
+	mutex_enter(&l2arc_dev_mtx);
+	for (l2arc_dev_t *dev = list_head(l2arc_dev_list); dev != NULL;
+	    dev = list_next(l2arc_dev_list, dev)) {
+		if (vdev_is_dead(dev->l2ad_vdev) || dev->l2ad_rebuild ||
+		    dev->l2ad_trim_all || dev->l2ad_spa->spa_is_exporting)
+			continue;
+		if (dev->l2ad_feeding || n == ndevs) {
+			next = MIN(next, busy);
+			continue;
+		}
+		if (dev->l2ad_feed_next > now) {
+			next = MIN(next, dev->l2ad_feed_next);
+			continue;
+		}
+		dev->l2ad_feeding = B_TRUE;
+		devs[n++] = dev;
+	}
+	mutex_exit(&l2arc_dev_mtx);
+
+	for (uint64_t i = 0; i < n; i++) {
+		spa_config_enter(devs[i]->l2ad_spa, SCL_L2ARC, devs[i],
+		    RW_READER);
+	}
+	mutex_exit(&spa_namespace_lock);
+
+	for (uint64_t i = 0; i < n; i++) {
+		VERIFY3U(taskq_dispatch(l2arc_feed_taskq, l2arc_feed_task,
+		    devs[i], TQ_SLEEP), !=, TASKQID_INVALID);
+	}
+	if (n > 0)
+		next = MIN(next, busy);
+
+	kmem_free(devs, ndevs * sizeof (l2arc_dev_t *));
+	return (next);
+}
+
 /*
  * This thread feeds the L2ARC at regular intervals.  This is the beating
  * heart of the L2ARC.
@@ -9416,7 +10206,6 @@ l2arc_feed_thread(void *unused)
 	callb_cpr_t cpr;
 	l2arc_dev_t *dev;
 	spa_t *spa;
-	uint64_t size, wrote;
 	clock_t begin, next = ddi_get_lbolt();
 	fstrans_cookie_t cookie;
 
@@ -9441,6 +10230,13 @@ l2arc_feed_thread(void *unused)
 			continue;
 		}
 		mutex_exit(&l2arc_dev_mtx);
+
+		l2arc_admit_age();
+
+		if (l2arc_feed_taskq != NULL) {
+			next = l2arc_feed_dispatch();
+			continue;
+		}
 		begin = ddi_get_lbolt();
 
 		/*
@@ -9457,45 +10253,7 @@ l2arc_feed_thread(void *unused)
 			continue;
 
 		spa = dev->l2ad_spa;
-		ASSERT3P(spa, !=, NULL);
-
-		/*
-		 * If the pool is read-only then force the feed thread to
-		 * sleep a little longer.
-		 */
-		if (!spa_writeable(spa)) {
-			next = ddi_get_lbolt() + 5 * l2arc_feed_secs * hz;
-			spa_config_exit(spa, SCL_L2ARC, dev);
-			continue;
-		}
-
-		/*
-		 * Avoid contributing to memory pressure.
-		 */
-		if (l2arc_hdr_limit_reached()) {
-			ARCSTAT_BUMP(arcstat_l2_abort_lowmem);
-			spa_config_exit(spa, SCL_L2ARC, dev);
-			continue;
-		}
-
-		ARCSTAT_BUMP(arcstat_l2_feeds);
-
-		size = l2arc_write_size(dev);
-
-		/*
-		 * Evict L2ARC buffers that will be overwritten.
-		 */
-		l2arc_evict(dev, size, B_FALSE);
-
-		/*
-		 * Write ARC buffers.
-		 */
-		wrote = l2arc_write_buffers(spa, dev, size);
-
-		/*
-		 * Calculate interval between writes.
-		 */
-		next = l2arc_write_interval(begin, size, wrote);
+		next = l2arc_feed_dev(dev, begin);
 		spa_config_exit(spa, SCL_L2ARC, dev);
 	}
 	spl_fstrans_unmark(cookie);
@@ -9606,6 +10364,58 @@ l2arc_rebuild_dev(l2arc_dev_t *dev, boolean_t reopen)
 	}
 }
 
+/*
+ * Give a new cache device a slot in l2arc_dev_table.  Returns B_FALSE if
+ * all slots are in use.
+ */
+static boolean_t
+l2arc_dev_index_alloc(l2arc_dev_t *dev)
+{
+	uint64_t idx;
+
+	mutex_enter(&l2arc_dev_mtx);
+	for (idx = 0; idx < L2ARC_DEV_MAX; idx++) {
+		if (l2arc_dev_table[idx] == NULL)
+			break;
+	}
+	if (idx < L2ARC_DEV_MAX) {
+		l2arc_dev_table[idx] = dev;
+		dev->l2ad_index = idx;
+	}
+	mutex_exit(&l2arc_dev_mtx);
+
+	return (idx < L2ARC_DEV_MAX);
+}
+
+static const l2arc_dev_feed_stats_t l2arc_dev_feed_stats_template = {
+	{ "feeds",			KSTAT_DATA_UINT64 },
+	{ "write_bytes",		KSTAT_DATA_UINT64 },
+	{ "abort_lowmem",		KSTAT_DATA_UINT64 },
+	{ "interval_ms",		KSTAT_DATA_UINT64 },
+};
+
+static void
+l2arc_dev_kstat_init(l2arc_dev_t *dev)
+{
+	l2arc_dev_feed_stats_t *l2fs = &dev->l2ad_feed_stats;
+	char *module, *name;
+
+	*l2fs = l2arc_dev_feed_stats_template;
+
+	module = kmem_asprintf("zfs/%s", spa_name(dev->l2ad_spa));
+	name = kmem_asprintf("l2arc_feed-%llu",
+	    (u_longlong_t)dev->l2ad_vdev->vdev_guid);
+	dev->l2ad_feed_ksp = kstat_create(module, 0, name, "misc",
+	    KSTAT_TYPE_NAMED, sizeof (*l2fs) / sizeof (kstat_named_t),
+	    KSTAT_FLAG_VIRTUAL);
+	if (dev->l2ad_feed_ksp != NULL) {
+		dev->l2ad_feed_ksp->ks_data = l2fs;
+		kstat_install(dev->l2ad_feed_ksp);
+	}
+	kmem_strfree(name);
+	kmem_strfree(module);
+}
+
 /*
  * Add a vdev for use by the L2ARC.  By this point the spa has already
  * validated the vdev and opened it.
@@ -9624,6 +10434,13 @@ l2arc_add_vdev(spa_t *spa, vdev_t *vd)
 	adddev = vmem_zalloc(sizeof (l2arc_dev_t), KM_SLEEP);
 	adddev->l2ad_spa = spa;
 	adddev->l2ad_vdev = vd;
+	if (!l2arc_dev_index_alloc(adddev)) {
+		cmn_err(CE_WARN, "l2arc: more than %llu cache devices, "
+		    "not using %s", (u_longlong_t)L2ARC_DEV_MAX,
+		    vd->vdev_path ? vd->vdev_path : "");
+		vmem_free(adddev, sizeof (l2arc_dev_t));
+		return;
+	}
 	/* leave extra size for an l2arc device header */
 	l2dhdr_asize = adddev->l2ad_dev_hdr_asize =
 	    MAX(sizeof (*adddev->l2ad_dev_hdr), 1 << vd->vdev_ashift);
@@ -9657,6 +10474,7 @@ l2arc_add_vdev(spa_t *spa, vdev_t *vd)
 	zfs_refcount_create(&adddev->l2ad_alloc);
 	zfs_refcount_create(&adddev->l2ad_lb_asize);
 	zfs_refcount_create(&adddev->l2ad_lb_count);
+	l2arc_dev_kstat_init(adddev);
 
 	/*
 	 * Decide if dev is eligible for L2ARC rebuild or whole device
@@ -9745,12 +10563,20 @@ l2arc_remove_vdev(vdev_t *vd)
 	 */
 	l2arc_evict(remdev, 0, B_TRUE);
 	list_destroy(&remdev->l2ad_buflist);
+	l2arc_do_free_on_write(remdev);
+
+	/* No headers refer to the device anymore; release its slot. */
+	mutex_enter(&l2arc_dev_mtx);
+	l2arc_dev_table[remdev->l2ad_index] = NULL;
+	mutex_exit(&l2arc_dev_mtx);
 	ASSERT(list_is_empty(&remdev->l2ad_lbptr_list));
 	list_destroy(&remdev->l2ad_lbptr_list);
 	mutex_destroy(&remdev->l2ad_mtx);
 	zfs_refcount_destroy(&remdev->l2ad_alloc);
 	zfs_refcount_destroy(&remdev->l2ad_lb_asize);
 	zfs_refcount_destroy(&remdev->l2ad_lb_count);
+	if (remdev->l2ad_feed_ksp != NULL)
+		kstat_delete(remdev->l2ad_feed_ksp);
 	kmem_free(remdev->l2ad_dev_hdr, remdev->l2ad_dev_hdr_asize);
 	vmem_free(remdev, sizeof (l2arc_dev_t));
 }
@@ -9796,6 +10622,12 @@ l2arc_start(void)
 	if (!(spa_mode_global & SPA_MODE_WRITE))
 		return;
 
+	if (l2arc_feed_threads > 0) {
+		l2arc_feed_taskq = taskq_create("l2arc_feed",
+		    l2arc_feed_threads, defclsyspri, 1, INT_MAX,
+		    TASKQ_DYNAMIC);
+	}
+
 	(void) thread_create(NULL, 0, l2arc_feed_thread, NULL, 0, &p0,
 	    TS_RUN, defclsyspri);
 }
@@ -9812,6 +10644,12 @@ l2arc_stop(void)
 	while (l2arc_thread_exit != 0)
 		cv_wait(&l2arc_feed_thr_cv, &l2arc_feed_thr_lock);
 	mutex_exit(&l2arc_feed_thr_lock);
+
+	/* Wait for any feeds the thread dispatched before it exited. */
+	if (l2arc_feed_taskq != NULL) {
+		taskq_destroy(l2arc_feed_taskq);
+		l2arc_feed_taskq = NULL;
+	}
 }
 
 /*
@@ -10383,9 +11221,9 @@ l2arc_hdr_restore(const l2arc_log_ent_phys_t *le, l2arc_dev_t *dev)
 		 */
 		if (!HDR_HAS_L2HDR(exists)) {
 			arc_hdr_set_flags(exists, ARC_FLAG_HAS_L2HDR);
-			exists->b_l2hdr.b_dev = dev;
-			exists->b_l2hdr.b_daddr = le->le_daddr;
-			exists->b_l2hdr.b_arcs_state =
+			l2arc_hdr_set_loc(exists, dev, le->le_daddr);
+			exists->b_l2_hits = 0;
+			exists->b_l2_arcs_state =
 			    L2BLK_GET_STATE((le)->le_prop);
 			mutex_enter(&dev->l2ad_mtx);
 			list_insert_tail(&dev->l2ad_buflist, exists);
@@ -10679,7 +11517,7 @@ l2arc_log_blk_insert(l2arc_dev_t *dev, const arc_buf_hdr_t *hdr)
 	memset(le, 0, sizeof (*le));
 	le->le_dva = hdr->b_dva;
 	le->le_birth = hdr->b_birth;
-	le->le_daddr = hdr->b_l2hdr.b_daddr;
+	le->le_daddr = l2arc_hdr_daddr(hdr);
 	if (index == 0)
 		dev->l2ad_log_blk_payload_start = le->le_daddr;
 	L2BLK_SET_LSIZE((le)->le_prop, HDR_GET_LSIZE(hdr));
@@ -10689,7 +11527,7 @@ l2arc_log_blk_insert(l2arc_dev_t *dev, const arc_buf_hdr_t *hdr)
 	L2BLK_SET_TYPE((le)->le_prop, hdr->b_type);
 	L2BLK_SET_PROTECTED((le)->le_prop, !!(HDR_PROTECTED(hdr)));
 	L2BLK_SET_PREFETCH((le)->le_prop, !!(HDR_PREFETCH(hdr)));
-	L2BLK_SET_STATE((le)->le_prop, hdr->b_l2hdr.b_arcs_state);
+	L2BLK_SET_STATE((le)->le_prop, hdr->b_l2_arcs_state);
 
 	dev->l2ad_log_blk_payload_asize += vdev_psize_to_asize(dev->l2ad_vdev,
 	    HDR_GET_PSIZE(hdr));
@@ -10800,6 +11638,9 @@ ZFS_MODULE_PARAM(zfs_l2arc, l2arc_, feed_min_ms, U64, ZMOD_RW,
 ZFS_MODULE_PARAM(zfs_l2arc, l2arc_, noprefetch, INT, ZMOD_RW,
 	"Skip caching prefetched buffers");
 
+ZFS_MODULE_PARAM(zfs_l2arc, l2arc_, feed_threads, UINT, ZMOD_RD,
+	"Number of threads feeding L2ARC devices in parallel");
+
 ZFS_MODULE_PARAM(zfs_l2arc, l2arc_, feed_again, INT, ZMOD_RW,
 	"Turbo L2ARC warmup");
 
@@ -10815,6 +11656,9 @@ ZFS_MODULE_PARAM(zfs_l2arc, l2arc_, rebuild_enabled, INT, ZMOD_RW,
 ZFS_MODULE_PARAM(zfs_l2arc, l2arc_, rebuild_blocks_min_l2size, U64, ZMOD_RW,
 	"Min size in bytes to write rebuild log blocks in L2ARC");
 
+ZFS_MODULE_PARAM(zfs_l2arc, l2arc_, admit_min_refs, UINT, ZMOD_RW,
+	"Min. estimated recent accesses for a buffer to be written to L2ARC");
+
 ZFS_MODULE_PARAM(zfs_l2arc, l2arc_, mfuonly, INT, ZMOD_RW,
 	"Cache only MFU data from ARC into L2ARC");
 
@@ -10845,3 +11689,6 @@ ZFS_MODULE_PARAM(zfs_arc, zfs_arc_, evict_batch_limit, UINT, ZMOD_RW,
 
 ZFS_MODULE_PARAM(zfs_arc, zfs_arc_, prune_task_threads, INT, ZMOD_RW,
 	"Number of arc_prune threads");
+
+ZFS_MODULE_PARAM(zfs_arc, zfs_arc_, evict_threads, UINT, ZMOD_RD,
+	"Number of threads to use for ARC eviction (0 for automatic)");
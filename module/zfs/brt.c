@@ -186,7 +186,10 @@
  * function.
  *
  * We use this pending list to keep track of all BPs that got new references
- * within this transaction group.
+ * within this transaction group.  There is one pending list per CPU, so that
+ * concurrent clones don't serialize on it; the lists are merged when they are
+ * applied.  The BRT entries a clone will need are prefetched once for the
+ * whole request by brt_prefetch_bps().
  *
  * Some special cases to consider and how we address them:
  * - The block we want to clone may have been created within the same
@@ -219,6 +222,11 @@
  * function. This function will sync all dirty per-top-level-vdev BRTs,
  * the entry counters arrays, etc.
  *
+ * Locking: brt_lock only protects the array of per-top-level-vdev BRTs, which
+ * grows when a vdev is added.  Everything else about a vdev's BRT, including
+ * its in-memory entries, is protected by its own bv_lock, so frees and clones
+ * of blocks on different vdevs don't contend with each other.
+ *
  * Block Cloning and ZIL.
  *
  * Every clone operation is divided into chunks (similar to write) and each
@@ -336,6 +344,24 @@ brt_unlock(brt_t *brt)
 	rw_exit(&brt->brt_lock);
 }
 
+static void
+brt_vdev_rlock(brt_vdev_t *brtvd)
+{
+	rw_enter(&brtvd->bv_lock, RW_READER);
+}
+
+static void
+brt_vdev_wlock(brt_vdev_t *brtvd)
+{
+	rw_enter(&brtvd->bv_lock, RW_WRITER);
+}
+
+static void
+brt_vdev_unlock(brt_vdev_t *brtvd)
+{
+	rw_exit(&brtvd->bv_lock);
+}
+
 static uint16_t
 brt_vdev_entcount_get(const brt_vdev_t *brtvd, uint64_t idx)
 {
@@ -427,18 +453,30 @@ brt_vdev_dump(brt_vdev_t *brtvd)
 }
 #endif
 
+static void brt_vdevs_expand(brt_t *brt, uint64_t nvdevs);
+
+/*
+ * Return the BRT of the given top-level vdev, or NULL if it is not known yet
+ * and alloc is not set.  The returned brt_vdev_t stays valid without holding
+ * the BRT lock.
+ */
 static brt_vdev_t *
-brt_vdev(brt_t *brt, uint64_t vdevid)
+brt_vdev(brt_t *brt, uint64_t vdevid, boolean_t alloc)
 {
-	brt_vdev_t *brtvd;
-
-	ASSERT(RW_LOCK_HELD(&brt->brt_lock));
+	brt_vdev_t *brtvd = NULL;
 
+	brt_rlock(brt);
 	if (vdevid < brt->brt_nvdevs) {
-		brtvd = &brt->brt_vdevs[vdevid];
-	} else {
-		brtvd = NULL;
+		brtvd = brt->brt_vdevs[vdevid];
+	} else if (alloc) {
+		/* New VDEV was added. */
+		brt_unlock(brt);
+		brt_wlock(brt);
+		if (vdevid >= brt->brt_nvdevs)
+			brt_vdevs_expand(brt, vdevid + 1);
+		brtvd = brt->brt_vdevs[vdevid];
 	}
+	brt_unlock(brt);
 
 	return (brtvd);
 }
@@ -448,7 +486,7 @@ brt_vdev_create(brt_t *brt, brt_vdev_t *brtvd, dmu_tx_t *tx)
 {
 	char name[64];
 
-	ASSERT(RW_WRITE_HELD(&brt->brt_lock));
+	ASSERT(RW_WRITE_HELD(&brtvd->bv_lock));
 	ASSERT0(brtvd->bv_mos_brtvdev);
 	ASSERT0(brtvd->bv_mos_entries);
 	ASSERT(brtvd->bv_entcount != NULL);
@@ -456,10 +494,15 @@ brt_vdev_create(brt_t *brt, brt_vdev_t *brtvd, dmu_tx_t *tx)
 	ASSERT(brtvd->bv_bitmap != NULL);
 	ASSERT(brtvd->bv_nblocks > 0);
 
-	brtvd->bv_mos_entries = zap_create_flags(brt->brt_mos, 0,
+	uint64_t mos_entries = zap_create_flags(brt->brt_mos, 0,
 	    ZAP_FLAG_HASH64 | ZAP_FLAG_UINT64_KEY, DMU_OTN_ZAP_METADATA,
 	    brt_zap_default_bs, brt_zap_default_ibs, DMU_OT_NONE, 0, tx);
-	VERIFY(brtvd->bv_mos_entries != 0);
+	VERIFY(mos_entries != 0);
+	rw_enter(&brtvd->bv_mos_entries_lock, RW_WRITER);
+	VERIFY0(dnode_hold(brt->brt_mos, mos_entries, brtvd,
+	    &brtvd->bv_mos_entries_dnode));
+	brtvd->bv_mos_entries = mos_entries;
+	rw_exit(&brtvd->bv_mos_entries_lock);
 	BRT_DEBUG("MOS entries created, object=%llu",
 	    (u_longlong_t)brtvd->bv_mos_entries);
 
@@ -492,7 +535,7 @@ brt_vdev_realloc(brt_t *brt, brt_vdev_t *brtvd)
 	ulong_t *bitmap;
 	uint64_t nblocks, size;
 
-	ASSERT(RW_WRITE_HELD(&brt->brt_lock));
+	ASSERT(RW_WRITE_HELD(&brtvd->bv_lock));
 
 	spa_config_enter(brt->brt_spa, SCL_VDEV, FTAG, RW_READER);
 	vd = vdev_lookup_top(brt->brt_spa, brtvd->bv_vdevid);
@@ -587,8 +630,12 @@ brt_vdev_load(brt_t *brt, brt_vdev_t *brtvd)
 	    brtvd->bv_entcount, DMU_READ_NO_PREFETCH);
 	ASSERT0(error);
 
+	rw_enter(&brtvd->bv_mos_entries_lock, RW_WRITER);
 	brtvd->bv_mos_entries = bvphys->bvp_mos_entries;
 	ASSERT(brtvd->bv_mos_entries != 0);
+	VERIFY0(dnode_hold(brt->brt_mos, brtvd->bv_mos_entries, brtvd,
+	    &brtvd->bv_mos_entries_dnode));
+	rw_exit(&brtvd->bv_mos_entries_lock);
 	brtvd->bv_need_byteswap =
 	    (bvphys->bvp_byteorder != BRT_NATIVE_BYTEORDER);
 	brtvd->bv_totalcount = bvphys->bvp_totalcount;
@@ -607,10 +654,18 @@ brt_vdev_load(brt_t *brt, brt_vdev_t *brtvd)
 static void
 brt_vdev_dealloc(brt_t *brt, brt_vdev_t *brtvd)
 {
+	(void) brt;
 
-	ASSERT(RW_WRITE_HELD(&brt->brt_lock));
+	ASSERT(RW_WRITE_HELD(&brtvd->bv_lock));
 	ASSERT(brtvd->bv_initiated);
 
+	rw_enter(&brtvd->bv_mos_entries_lock, RW_WRITER);
+	if (brtvd->bv_mos_entries_dnode != NULL) {
+		dnode_rele(brtvd->bv_mos_entries_dnode, brtvd);
+		brtvd->bv_mos_entries_dnode = NULL;
+	}
+	rw_exit(&brtvd->bv_mos_entries_lock);
+
 	vmem_free(brtvd->bv_entcount, sizeof (uint16_t) * brtvd->bv_size);
 	brtvd->bv_entcount = NULL;
 	kmem_free(brtvd->bv_bitmap, BT_SIZEOFMAP(brtvd->bv_nblocks));
@@ -633,16 +688,20 @@ brt_vdev_destroy(brt_t *brt, brt_vdev_t *brtvd, dmu_tx_t *tx)
 	dmu_buf_t *db;
 	brt_vdev_phys_t *bvphys;
 
-	ASSERT(RW_WRITE_HELD(&brt->brt_lock));
+	ASSERT(RW_WRITE_HELD(&brtvd->bv_lock));
 	ASSERT(brtvd->bv_mos_brtvdev != 0);
 	ASSERT(brtvd->bv_mos_entries != 0);
 
 	VERIFY0(zap_count(brt->brt_mos, brtvd->bv_mos_entries, &count));
 	VERIFY0(count);
+	rw_enter(&brtvd->bv_mos_entries_lock, RW_WRITER);
+	dnode_rele(brtvd->bv_mos_entries_dnode, brtvd);
+	brtvd->bv_mos_entries_dnode = NULL;
 	VERIFY0(zap_destroy(brt->brt_mos, brtvd->bv_mos_entries, tx));
 	BRT_DEBUG("MOS entries destroyed, object=%llu",
 	    (u_longlong_t)brtvd->bv_mos_entries);
 	brtvd->bv_mos_entries = 0;
+	rw_exit(&brtvd->bv_mos_entries_lock);
 
 	VERIFY0(dmu_bonus_hold(brt->brt_mos, brtvd->bv_mos_brtvdev, FTAG, &db));
 	bvphys = db->db_data;
@@ -669,26 +728,32 @@ brt_vdev_destroy(brt_t *brt, brt_vdev_t *brtvd, dmu_tx_t *tx)
 static void
 brt_vdevs_expand(brt_t *brt, uint64_t nvdevs)
 {
-	brt_vdev_t *brtvd, *vdevs;
+	brt_vdev_t *brtvd, **vdevs;
 	uint64_t vdevid;
 
 	ASSERT(RW_WRITE_HELD(&brt->brt_lock));
 	ASSERT3U(nvdevs, >, brt->brt_nvdevs);
 
+	/*
+	 * Only the array of pointers is reallocated, so brt_vdev_t's already
+	 * handed out by brt_vdev() stay valid.
+	 */
 	vdevs = kmem_zalloc(sizeof (vdevs[0]) * nvdevs, KM_SLEEP);
 	if (brt->brt_nvdevs > 0) {
 		ASSERT(brt->brt_vdevs != NULL);
 
 		memcpy(vdevs, brt->brt_vdevs,
-		    sizeof (brt_vdev_t) * brt->brt_nvdevs);
+		    sizeof (vdevs[0]) * brt->brt_nvdevs);
 		kmem_free(brt->brt_vdevs,
-		    sizeof (brt_vdev_t) * brt->brt_nvdevs);
+		    sizeof (vdevs[0]) * brt->brt_nvdevs);
 	}
 	for (vdevid = brt->brt_nvdevs; vdevid < nvdevs; vdevid++) {
-		brtvd = &vdevs[vdevid];
-
+		brtvd = kmem_zalloc(sizeof (*brtvd), KM_SLEEP);
+		rw_init(&brtvd->bv_lock, NULL, RW_DEFAULT, NULL);
+		rw_init(&brtvd->bv_mos_entries_lock, NULL, RW_DEFAULT, NULL);
 		brtvd->bv_vdevid = vdevid;
 		brtvd->bv_initiated = FALSE;
+		vdevs[vdevid] = brtvd;
 	}
 
 	BRT_DEBUG("BRT VDEVs expanded from %llu to %llu.",
@@ -703,7 +768,7 @@ brt_vdev_lookup(brt_t *brt, brt_vdev_t *brtvd, const brt_entry_t *bre)
 {
 	uint64_t idx;
 
-	ASSERT(RW_LOCK_HELD(&brt->brt_lock));
+	ASSERT(RW_LOCK_HELD(&brtvd->bv_lock));
 
 	idx = bre->bre_offset / brt->brt_rangesize;
 	if (brtvd->bv_entcount != NULL && idx < brtvd->bv_size) {
@@ -720,11 +785,11 @@ brt_vdev_addref(brt_t *brt, brt_vdev_t *brtvd, const brt_entry_t *bre,
 {
 	uint64_t idx;
 
-	ASSERT(RW_LOCK_HELD(&brt->brt_lock));
 	ASSERT(brtvd != NULL);
+	ASSERT(RW_WRITE_HELD(&brtvd->bv_lock));
 	ASSERT(brtvd->bv_entcount != NULL);
 
-	brt->brt_savedspace += dsize;
+	atomic_add_64(&brt->brt_savedspace, dsize);
 	brtvd->bv_savedspace += dsize;
 	brtvd->bv_meta_dirty = TRUE;
 
@@ -732,7 +797,7 @@ brt_vdev_addref(brt_t *brt, brt_vdev_t *brtvd, const brt_entry_t *bre,
 		return;
 	}
 
-	brt->brt_usedspace += dsize;
+	atomic_add_64(&brt->brt_usedspace, dsize);
 	brtvd->bv_usedspace += dsize;
 
 	idx = bre->bre_offset / brt->brt_rangesize;
@@ -761,11 +826,11 @@ brt_vdev_decref(brt_t *brt, brt_vdev_t *brtvd, const brt_entry_t *bre,
 {
 	uint64_t idx;
 
-	ASSERT(RW_WRITE_HELD(&brt->brt_lock));
 	ASSERT(brtvd != NULL);
+	ASSERT(RW_WRITE_HELD(&brtvd->bv_lock));
 	ASSERT(brtvd->bv_entcount != NULL);
 
-	brt->brt_savedspace -= dsize;
+	atomic_add_64(&brt->brt_savedspace, -dsize);
 	brtvd->bv_savedspace -= dsize;
 	brtvd->bv_meta_dirty = TRUE;
 
@@ -773,7 +838,7 @@ brt_vdev_decref(brt_t *brt, brt_vdev_t *brtvd, const brt_entry_t *bre,
 		return;
 	}
 
-	brt->brt_usedspace -= dsize;
+	atomic_add_64(&brt->brt_usedspace, -dsize);
 	brtvd->bv_usedspace -= dsize;
 
 	idx = bre->bre_offset / brt->brt_rangesize;
@@ -798,6 +863,7 @@ brt_vdev_sync(brt_t *brt, brt_vdev_t *brtvd, dmu_tx_t *tx)
 	dmu_buf_t *db;
 	brt_vdev_phys_t *bvphys;
 
+	ASSERT(RW_WRITE_HELD(&brtvd->bv_lock));
 	ASSERT(brtvd->bv_meta_dirty);
 	ASSERT(brtvd->bv_mos_brtvdev != 0);
 	ASSERT(dmu_tx_is_syncing(tx));
@@ -845,10 +911,12 @@ brt_vdevs_alloc(brt_t *brt, boolean_t load)
 
 	if (load) {
 		for (vdevid = 0; vdevid < brt->brt_nvdevs; vdevid++) {
-			brtvd = &brt->brt_vdevs[vdevid];
+			brtvd = brt->brt_vdevs[vdevid];
 			ASSERT(brtvd->bv_entcount == NULL);
 
+			brt_vdev_wlock(brtvd);
 			brt_vdev_load(brt, brtvd);
+			brt_vdev_unlock(brtvd);
 		}
 	}
 
@@ -868,11 +936,19 @@ brt_vdevs_free(brt_t *brt)
 	brt_wlock(brt);
 
 	for (vdevid = 0; vdevid < brt->brt_nvdevs; vdevid++) {
-		brtvd = &brt->brt_vdevs[vdevid];
+		brtvd = brt->brt_vdevs[vdevid];
+		brt_vdev_wlock(brtvd);
 		if (brtvd->bv_initiated)
 			brt_vdev_dealloc(brt, brtvd);
+		brt_vdev_unlock(brtvd);
+		rw_destroy(&brtvd->bv_lock);
+		rw_destroy(&brtvd->bv_mos_entries_lock);
+		kmem_free(brtvd, sizeof (*brtvd));
+	}
+	if (brt->brt_vdevs != NULL) {
+		kmem_free(brt->brt_vdevs,
+		    sizeof (brt->brt_vdevs[0]) * brt->brt_nvdevs);
 	}
-	kmem_free(brt->brt_vdevs, sizeof (brt_vdev_t) * brt->brt_nvdevs);
 
 	brt_unlock(brt);
 }
@@ -899,51 +975,38 @@ brt_entry_compare(const void *x1, const void *x2)
 static int
 brt_entry_lookup(brt_t *brt, brt_vdev_t *brtvd, brt_entry_t *bre)
 {
-	uint64_t mos_entries;
 	int error;
 
-	ASSERT(RW_LOCK_HELD(&brt->brt_lock));
+	ASSERT(RW_LOCK_HELD(&brtvd->bv_lock));
 
 	if (!brt_vdev_lookup(brt, brtvd, bre))
 		return (SET_ERROR(ENOENT));
 
+	if (brtvd->bv_mos_entries == 0)
+		return (SET_ERROR(ENOENT));
+
 	/*
-	 * Remember mos_entries object number. After we reacquire the BRT lock,
-	 * the brtvd pointer may be invalid.
+	 * Don't hold the vdev's BRT lock while reading the table; the table
+	 * itself is kept around by bv_mos_entries_lock.
 	 */
-	mos_entries = brtvd->bv_mos_entries;
-	if (mos_entries == 0)
-		return (SET_ERROR(ENOENT));
+	brt_vdev_unlock(brtvd);
 
-	brt_unlock(brt);
+	rw_enter(&brtvd->bv_mos_entries_lock, RW_READER);
+	if (brtvd->bv_mos_entries_dnode != NULL) {
+		error = zap_lookup_uint64_by_dnode(
+		    brtvd->bv_mos_entries_dnode, &bre->bre_offset,
+		    BRT_KEY_WORDS, 1, sizeof (bre->bre_refcount),
+		    &bre->bre_refcount);
+	} else {
+		error = SET_ERROR(ENOENT);
+	}
+	rw_exit(&brtvd->bv_mos_entries_lock);
 
-	error = zap_lookup_uint64(brt->brt_mos, mos_entries, &bre->bre_offset,
-	    BRT_KEY_WORDS, 1, sizeof (bre->bre_refcount), &bre->bre_refcount);
-
-	brt_wlock(brt);
+	brt_vdev_wlock(brtvd);
 
 	return (error);
 }
 
-static void
-brt_entry_prefetch(brt_t *brt, uint64_t vdevid, brt_entry_t *bre)
-{
-	brt_vdev_t *brtvd;
-	uint64_t mos_entries = 0;
-
-	brt_rlock(brt);
-	brtvd = brt_vdev(brt, vdevid);
-	if (brtvd != NULL)
-		mos_entries = brtvd->bv_mos_entries;
-	brt_unlock(brt);
-
-	if (mos_entries == 0)
-		return;
-
-	(void) zap_prefetch_uint64(brt->brt_mos, mos_entries,
-	    (uint64_t *)&bre->bre_offset, BRT_KEY_WORDS);
-}
-
 /*
  * Return TRUE if we _can_ have BRT entry for this bp. It might be false
  * positive, but gives us quick answer if we should look into BRT, which
@@ -960,17 +1023,16 @@ brt_maybe_exists(spa_t *spa, const blkptr_t *bp)
 
 	brt_entry_fill(bp, &bre_search, &vdevid);
 
-	brt_rlock(brt);
+	brtvd = brt_vdev(brt, vdevid, B_FALSE);
+	if (brtvd == NULL)
+		return (FALSE);
 
-	brtvd = brt_vdev(brt, vdevid);
-	if (brtvd != NULL && brtvd->bv_initiated) {
-		if (!avl_is_empty(&brtvd->bv_tree) ||
-		    brt_vdev_lookup(brt, brtvd, &bre_search)) {
-			mayexists = TRUE;
-		}
+	brt_vdev_rlock(brtvd);
+	if (brtvd->bv_initiated && (!avl_is_empty(&brtvd->bv_tree) ||
+	    brt_vdev_lookup(brt, brtvd, &bre_search))) {
+		mayexists = TRUE;
 	}
-
-	brt_unlock(brt);
+	brt_vdev_unlock(brtvd);
 
 	return (mayexists);
 }
@@ -1157,21 +1219,12 @@ brt_entry_addref(brt_t *brt, const blkptr_t *bp)
 	uint64_t vdevid;
 	int error;
 
-	ASSERT(!RW_WRITE_HELD(&brt->brt_lock));
-
 	brt_entry_fill(bp, &bre_search, &vdevid);
 
-	brt_wlock(brt);
-
-	brtvd = brt_vdev(brt, vdevid);
-	if (brtvd == NULL) {
-		ASSERT3U(vdevid, >=, brt->brt_nvdevs);
-
-		/* New VDEV was added. */
-		brt_vdevs_expand(brt, vdevid + 1);
-		brtvd = brt_vdev(brt, vdevid);
-	}
+	brtvd = brt_vdev(brt, vdevid, B_TRUE);
 	ASSERT(brtvd != NULL);
+
+	brt_vdev_wlock(brtvd);
 	if (!brtvd->bv_initiated)
 		brt_vdev_realloc(brt, brtvd);
 
@@ -1180,8 +1233,8 @@ brt_entry_addref(brt_t *brt, const blkptr_t *bp)
 		BRTSTAT_BUMP(brt_addref_entry_in_memory);
 	} else {
 		/*
-		 * brt_entry_lookup() may drop the BRT (read) lock and
-		 * reacquire it (write).
+		 * brt_entry_lookup() may drop the vdev's BRT lock and
+		 * reacquire it.
 		 */
 		error = brt_entry_lookup(brt, brtvd, &bre_search);
 		/* bre_search now contains correct bre_refcount */
@@ -1190,23 +1243,16 @@ brt_entry_addref(brt_t *brt, const blkptr_t *bp)
 			BRTSTAT_BUMP(brt_addref_entry_on_disk);
 		else
 			BRTSTAT_BUMP(brt_addref_entry_not_on_disk);
-		/*
-		 * When the BRT lock was dropped, brt_vdevs[] may have been
-		 * expanded and reallocated, we need to update brtvd's pointer.
-		 */
-		brtvd = brt_vdev(brt, vdevid);
-		ASSERT(brtvd != NULL);
 
 		racebre = avl_find(&brtvd->bv_tree, &bre_search, &where);
 		if (racebre == NULL) {
 			bre = brt_entry_alloc(&bre_search);
-			ASSERT(RW_WRITE_HELD(&brt->brt_lock));
 			avl_insert(&brtvd->bv_tree, bre, where);
-			brt->brt_nentries++;
+			atomic_inc_64(&brt->brt_nentries);
 		} else {
 			/*
-			 * The entry was added when the BRT lock was dropped in
-			 * brt_entry_lookup().
+			 * The entry was added when the vdev's BRT lock was
+			 * dropped in brt_entry_lookup().
 			 */
 			BRTSTAT_BUMP(brt_addref_entry_read_lost_race);
 			bre = racebre;
@@ -1215,7 +1261,7 @@ brt_entry_addref(brt_t *brt, const blkptr_t *bp)
 	bre->bre_refcount++;
 	brt_vdev_addref(brt, brtvd, bre, bp_get_dsize(brt->brt_spa, bp));
 
-	brt_unlock(brt);
+	brt_vdev_unlock(brtvd);
 }
 
 /* Return TRUE if block should be freed immediately. */
@@ -1232,11 +1278,11 @@ brt_entry_decref(spa_t *spa, const blkptr_t *bp)
 
 	brt_entry_fill(bp, &bre_search, &vdevid);
 
-	brt_wlock(brt);
-
-	brtvd = brt_vdev(brt, vdevid);
+	brtvd = brt_vdev(brt, vdevid, B_FALSE);
 	ASSERT(brtvd != NULL);
 
+	brt_vdev_wlock(brtvd);
+
 	bre = avl_find(&brtvd->bv_tree, &bre_search, NULL);
 	if (bre != NULL) {
 		BRTSTAT_BUMP(brt_decref_entry_in_memory);
@@ -1246,17 +1292,11 @@ brt_entry_decref(spa_t *spa, const blkptr_t *bp)
 	}
 
 	/*
-	 * brt_entry_lookup() may drop the BRT lock and reacquire it.
+	 * brt_entry_lookup() may drop the vdev's BRT lock and reacquire it.
 	 */
 	error = brt_entry_lookup(brt, brtvd, &bre_search);
 	/* bre_search now contains correct bre_refcount */
 	ASSERT(error == 0 || error == ENOENT);
-	/*
-	 * When the BRT lock was dropped, brt_vdevs[] may have been expanded
-	 * and reallocated, we need to update brtvd's pointer.
-	 */
-	brtvd = brt_vdev(brt, vdevid);
-	ASSERT(brtvd != NULL);
 
 	if (error == ENOENT) {
 		BRTSTAT_BUMP(brt_decref_entry_not_on_disk);
@@ -1267,7 +1307,7 @@ brt_entry_decref(spa_t *spa, const blkptr_t *bp)
 	racebre = avl_find(&brtvd->bv_tree, &bre_search, &where);
 	if (racebre != NULL) {
 		/*
-		 * The entry was added when the BRT lock was dropped in
+		 * The entry was added when the vdev's BRT lock was dropped in
 		 * brt_entry_lookup().
 		 */
 		BRTSTAT_BUMP(brt_decref_entry_read_lost_race);
@@ -1277,21 +1317,20 @@ brt_entry_decref(spa_t *spa, const blkptr_t *bp)
 
 	BRTSTAT_BUMP(brt_decref_entry_loaded_from_disk);
 	bre = brt_entry_alloc(&bre_search);
-	ASSERT(RW_WRITE_HELD(&brt->brt_lock));
 	avl_insert(&brtvd->bv_tree, bre, where);
-	brt->brt_nentries++;
+	atomic_inc_64(&brt->brt_nentries);
 
 out:
 	if (bre == NULL) {
 		/*
 		 * This is a free of a regular (not cloned) block.
 		 */
-		brt_unlock(brt);
+		brt_vdev_unlock(brtvd);
 		BRTSTAT_BUMP(brt_decref_no_entry);
 		return (B_TRUE);
 	}
 	if (bre->bre_refcount == 0) {
-		brt_unlock(brt);
+		brt_vdev_unlock(brtvd);
 		BRTSTAT_BUMP(brt_decref_free_data_now);
 		return (B_TRUE);
 	}
@@ -1304,7 +1343,7 @@ out:
 		BRTSTAT_BUMP(brt_decref_entry_still_referenced);
 	brt_vdev_decref(brt, brtvd, bre, bp_get_dsize(brt->brt_spa, bp));
 
-	brt_unlock(brt);
+	brt_vdev_unlock(brtvd);
 
 	return (B_FALSE);
 }
@@ -1320,11 +1359,11 @@ brt_entry_get_refcount(spa_t *spa, const blkptr_t *bp)
 
 	brt_entry_fill(bp, &bre_search, &vdevid);
 
-	brt_rlock(brt);
-
-	brtvd = brt_vdev(brt, vdevid);
+	brtvd = brt_vdev(brt, vdevid, B_FALSE);
 	ASSERT(brtvd != NULL);
 
+	brt_vdev_rlock(brtvd);
+
 	bre = avl_find(&brtvd->bv_tree, &bre_search, NULL);
 	if (bre == NULL) {
 		error = brt_entry_lookup(brt, brtvd, &bre_search);
@@ -1336,24 +1375,59 @@ brt_entry_get_refcount(spa_t *spa, const blkptr_t *bp)
 	} else
 		refcnt = bre->bre_refcount;
 
-	brt_unlock(brt);
+	brt_vdev_unlock(brtvd);
 	return (refcnt);
 }
 
-static void
-brt_prefetch(brt_t *brt, const blkptr_t *bp)
+/*
+ * Prefetch the BRT entries that syncing context will need to add references
+ * to the given blocks, e.g. all the blocks of one clone request.  Blocks in
+ * ranges with no entries on disk are skipped, and the vdev is only looked up
+ * once for a run of blocks on the same vdev.
+ */
+void
+brt_prefetch_bps(spa_t *spa, const blkptr_t *bps, size_t nbps)
 {
-	brt_entry_t bre;
-	uint64_t vdevid;
-
-	ASSERT(bp != NULL);
+	brt_t *brt = spa->spa_brt;
+	brt_vdev_t *brtvd = NULL;
+	uint64_t curvdev = UINT64_MAX;
 
 	if (!brt_zap_prefetch)
 		return;
 
-	brt_entry_fill(bp, &bre, &vdevid);
+	for (size_t i = 0; i < nbps; i++) {
+		const blkptr_t *bp = &bps[i];
+		brt_entry_t bre;
+		uint64_t vdevid;
+		boolean_t ondisk;
+
+		if (BP_IS_HOLE(bp) || BP_IS_EMBEDDED(bp))
+			continue;
+
+		brt_entry_fill(bp, &bre, &vdevid);
+
+		if (vdevid != curvdev) {
+			curvdev = vdevid;
+			brtvd = brt_vdev(brt, vdevid, B_FALSE);
+		}
+		if (brtvd == NULL)
+			continue;
+
+		brt_vdev_rlock(brtvd);
+		ondisk = brtvd->bv_initiated &&
+		    brt_vdev_lookup(brt, brtvd, &bre);
+		brt_vdev_unlock(brtvd);
+		if (!ondisk)
+			continue;
 
-	brt_entry_prefetch(brt, vdevid, &bre);
+		rw_enter(&brtvd->bv_mos_entries_lock, RW_READER);
+		if (brtvd->bv_mos_entries_dnode != NULL) {
+			(void) zap_prefetch_uint64_by_dnode(
+			    brtvd->bv_mos_entries_dnode, &bre.bre_offset,
+			    BRT_KEY_WORDS);
+		}
+		rw_exit(&brtvd->bv_mos_entries_lock);
+	}
 }
 
 static int
@@ -1380,8 +1454,8 @@ void
 brt_pending_add(spa_t *spa, const blkptr_t *bp, dmu_tx_t *tx)
 {
 	brt_t *brt;
+	brt_pending_t *bpp;
 	avl_tree_t *pending_tree;
-	kmutex_t *pending_lock;
 	brt_pending_entry_t *bpe, *newbpe;
 	avl_index_t where;
 	uint64_t txg;
@@ -1389,14 +1463,14 @@ brt_pending_add(spa_t *spa, const blkptr_t *bp, dmu_tx_t *tx)
 	brt = spa->spa_brt;
 	txg = dmu_tx_get_txg(tx);
 	ASSERT3U(txg, !=, 0);
-	pending_tree = &brt->brt_pending_tree[txg & TXG_MASK];
-	pending_lock = &brt->brt_pending_lock[txg & TXG_MASK];
+	bpp = &brt->brt_pending[CPU_SEQID_UNSTABLE % brt->brt_npending];
+	pending_tree = &bpp->bp_tree[txg & TXG_MASK];
 
 	newbpe = kmem_cache_alloc(brt_pending_entry_cache, KM_SLEEP);
 	newbpe->bpe_bp = *bp;
 	newbpe->bpe_count = 1;
 
-	mutex_enter(pending_lock);
+	mutex_enter(&bpp->bp_lock);
 
 	bpe = avl_find(pending_tree, newbpe, &where);
 	if (bpe == NULL) {
@@ -1406,17 +1480,12 @@ brt_pending_add(spa_t *spa, const blkptr_t *bp, dmu_tx_t *tx)
 		bpe->bpe_count++;
 	}
 
-	mutex_exit(pending_lock);
+	mutex_exit(&bpp->bp_lock);
 
 	if (newbpe != NULL) {
 		ASSERT(bpe != NULL);
 		ASSERT(bpe != newbpe);
 		kmem_cache_free(brt_pending_entry_cache, newbpe);
-	} else {
-		ASSERT(bpe == NULL);
-
-		/* Prefetch BRT entry for the syncing context. */
-		brt_prefetch(brt, bp);
 	}
 }
 
@@ -1424,41 +1493,50 @@ void
 brt_pending_remove(spa_t *spa, const blkptr_t *bp, dmu_tx_t *tx)
 {
 	brt_t *brt;
-	avl_tree_t *pending_tree;
-	kmutex_t *pending_lock;
 	brt_pending_entry_t *bpe, bpe_search;
 	uint64_t txg;
+	uint_t start;
 
 	brt = spa->spa_brt;
 	txg = dmu_tx_get_txg(tx);
 	ASSERT3U(txg, !=, 0);
-	pending_tree = &brt->brt_pending_tree[txg & TXG_MASK];
-	pending_lock = &brt->brt_pending_lock[txg & TXG_MASK];
 
 	bpe_search.bpe_bp = *bp;
 
-	mutex_enter(pending_lock);
-
-	bpe = avl_find(pending_tree, &bpe_search, NULL);
-	/* I believe we should always find bpe when this function is called. */
-	if (bpe != NULL) {
-		ASSERT(bpe->bpe_count > 0);
-
-		bpe->bpe_count--;
-		if (bpe->bpe_count == 0) {
-			avl_remove(pending_tree, bpe);
-			kmem_cache_free(brt_pending_entry_cache, bpe);
+	/*
+	 * I believe we should always find bpe when this function is called.
+	 * The clone was most likely queued on this CPU, but may have been
+	 * queued on any of them, so check this CPU's tree first.
+	 */
+	start = CPU_SEQID_UNSTABLE % brt->brt_npending;
+	for (uint_t i = 0; i < brt->brt_npending; i++) {
+		brt_pending_t *bpp =
+		    &brt->brt_pending[(start + i) % brt->brt_npending];
+		avl_tree_t *pending_tree = &bpp->bp_tree[txg & TXG_MASK];
+
+		mutex_enter(&bpp->bp_lock);
+		bpe = avl_find(pending_tree, &bpe_search, NULL);
+		if (bpe != NULL) {
+			ASSERT(bpe->bpe_count > 0);
+
+			bpe->bpe_count--;
+			if (bpe->bpe_count == 0) {
+				avl_remove(pending_tree, bpe);
+				kmem_cache_free(brt_pending_entry_cache, bpe);
+			}
 		}
-	}
+		mutex_exit(&bpp->bp_lock);
 
-	mutex_exit(pending_lock);
+		if (bpe != NULL)
+			return;
+	}
 }
 
 void
 brt_pending_apply(spa_t *spa, uint64_t txg)
 {
 	brt_t *brt = spa->spa_brt;
-	brt_pending_entry_t *bpe;
+	brt_pending_entry_t *bpe, *mbpe;
 	avl_tree_t *pending_tree;
 	void *c;
 
@@ -1466,9 +1544,28 @@ brt_pending_apply(spa_t *spa, uint64_t txg)
 
 	/*
 	 * We are in syncing context, so no other brt_pending_tree accesses
-	 * are possible for the TXG. Don't need to acquire brt_pending_lock.
+	 * are possible for the TXG. Don't need to acquire bp_lock.
+	 *
+	 * Merge the per-CPU trees into the first one, so the entries are
+	 * applied in (vdev, offset) order.
 	 */
-	pending_tree = &brt->brt_pending_tree[txg & TXG_MASK];
+	pending_tree = &brt->brt_pending[0].bp_tree[txg & TXG_MASK];
+	for (uint_t i = 1; i < brt->brt_npending; i++) {
+		avl_tree_t *cpu_tree = &brt->brt_pending[i].bp_tree[txg &
+		    TXG_MASK];
+		avl_index_t where;
+
+		c = NULL;
+		while ((bpe = avl_destroy_nodes(cpu_tree, &c)) != NULL) {
+			mbpe = avl_find(pending_tree, bpe, &where);
+			if (mbpe == NULL) {
+				avl_insert(pending_tree, bpe, where);
+			} else {
+				mbpe->bpe_count += bpe->bpe_count;
+				kmem_cache_free(brt_pending_entry_cache, bpe);
+			}
+		}
+	}
 
 	c = NULL;
 	while ((bpe = avl_destroy_nodes(pending_tree, &c)) != NULL) {
@@ -1513,21 +1610,27 @@ brt_sync_table(brt_t *brt, dmu_tx_t *tx)
 {
 	brt_vdev_t *brtvd;
 	brt_entry_t *bre;
-	dnode_t *dn;
-	uint64_t vdevid;
+	uint64_t vdevid, nvdevs;
 	void *c;
 
-	brt_wlock(brt);
+	brt_rlock(brt);
+	nvdevs = brt->brt_nvdevs;
+	brt_unlock(brt);
 
-	for (vdevid = 0; vdevid < brt->brt_nvdevs; vdevid++) {
-		brtvd = &brt->brt_vdevs[vdevid];
+	for (vdevid = 0; vdevid < nvdevs; vdevid++) {
+		brtvd = brt_vdev(brt, vdevid, B_FALSE);
 
-		if (!brtvd->bv_initiated)
+		brt_vdev_wlock(brtvd);
+
+		if (!brtvd->bv_initiated) {
+			brt_vdev_unlock(brtvd);
 			continue;
+		}
 
 		if (!brtvd->bv_meta_dirty) {
 			ASSERT(!brtvd->bv_entcount_dirty);
 			ASSERT0(avl_numnodes(&brtvd->bv_tree));
+			brt_vdev_unlock(brtvd);
 			continue;
 		}
 
@@ -1537,28 +1640,23 @@ brt_sync_table(brt_t *brt, dmu_tx_t *tx)
 		if (brtvd->bv_mos_brtvdev == 0)
 			brt_vdev_create(brt, brtvd, tx);
 
-		VERIFY0(dnode_hold(brt->brt_mos, brtvd->bv_mos_entries,
-		    FTAG, &dn));
-
 		c = NULL;
 		while ((bre = avl_destroy_nodes(&brtvd->bv_tree, &c)) != NULL) {
-			brt_sync_entry(dn, bre, tx);
+			brt_sync_entry(brtvd->bv_mos_entries_dnode, bre, tx);
 			brt_entry_free(bre);
 			ASSERT(brt->brt_nentries > 0);
-			brt->brt_nentries--;
+			atomic_dec_64(&brt->brt_nentries);
 		}
 
-		dnode_rele(dn, FTAG);
-
 		brt_vdev_sync(brt, brtvd, tx);
 
 		if (brtvd->bv_totalcount == 0)
 			brt_vdev_destroy(brt, brtvd, tx);
+
+		brt_vdev_unlock(brtvd);
 	}
 
 	ASSERT0(brt->brt_nentries);
-
-	brt_unlock(brt);
 }
 
 void
@@ -1570,13 +1668,10 @@ brt_sync(spa_t *spa, uint64_t txg)
 	ASSERT(spa_syncing_txg(spa) == txg);
 
 	brt = spa->spa_brt;
-	brt_rlock(brt);
 	if (brt->brt_nentries == 0) {
 		/* No changes. */
-		brt_unlock(brt);
 		return;
 	}
-	brt_unlock(brt);
 
 	tx = dmu_tx_create_assigned(spa->spa_dsl_pool, txg);
 
@@ -1589,13 +1684,19 @@ static void
 brt_table_alloc(brt_t *brt)
 {
 
-	for (int i = 0; i < TXG_SIZE; i++) {
-		avl_create(&brt->brt_pending_tree[i],
-		    brt_pending_entry_compare,
-		    sizeof (brt_pending_entry_t),
-		    offsetof(brt_pending_entry_t, bpe_node));
-		mutex_init(&brt->brt_pending_lock[i], NULL, MUTEX_DEFAULT,
-		    NULL);
+	brt->brt_npending = MAX(boot_ncpus, 1);
+	brt->brt_pending = kmem_zalloc(brt->brt_npending *
+	    sizeof (brt_pending_t), KM_SLEEP);
+	for (uint_t c = 0; c < brt->brt_npending; c++) {
+		brt_pending_t *bpp = &brt->brt_pending[c];
+
+		mutex_init(&bpp->bp_lock, NULL, MUTEX_DEFAULT, NULL);
+		for (int i = 0; i < TXG_SIZE; i++) {
+			avl_create(&bpp->bp_tree[i],
+			    brt_pending_entry_compare,
+			    sizeof (brt_pending_entry_t),
+			    offsetof(brt_pending_entry_t, bpe_node));
+		}
 	}
 }
 
@@ -1603,12 +1704,17 @@ static void
 brt_table_free(brt_t *brt)
 {
 
-	for (int i = 0; i < TXG_SIZE; i++) {
-		ASSERT(avl_is_empty(&brt->brt_pending_tree[i]));
+	for (uint_t c = 0; c < brt->brt_npending; c++) {
+		brt_pending_t *bpp = &brt->brt_pending[c];
 
-		avl_destroy(&brt->brt_pending_tree[i]);
-		mutex_destroy(&brt->brt_pending_lock[i]);
+		for (int i = 0; i < TXG_SIZE; i++) {
+			ASSERT(avl_is_empty(&bpp->bp_tree[i]));
+			avl_destroy(&bpp->bp_tree[i]);
+		}
+		mutex_destroy(&bpp->bp_lock);
 	}
+	kmem_free(brt->brt_pending, brt->brt_npending *
+	    sizeof (brt_pending_t));
 }
 
 static void
@@ -102,7 +102,21 @@ typedef struct dbuf_stats {
 	 */
 	kstat_named_t hash_insert_race;
 	/*
-	 * Number of entries in the hash table dbuf and mutex arrays.
+	 * Number of hash table operations which found their bucket lock
+	 * held by a conflicting insert, remove or resize and had to wait.
+	 */
+	kstat_named_t hash_lock_retries;
+	/*
+	 * Number of times the hash table has been grown.
+	 */
+	kstat_named_t hash_table_grows;
+	/*
+	 * Number of dbuf_find() hits that were found without taking the
+	 * bucket lock (Linux kernel only, see dbuf_find_lockless()).
+	 */
+	kstat_named_t hash_lockless_hits;
+	/*
+	 * Number of entries in the hash table dbuf and lock arrays.
 	 */
 	kstat_named_t hash_table_count;
 	kstat_named_t hash_mutex_count;
@@ -138,6 +152,9 @@ dbuf_stats_t dbuf_stats = {
 	{ "hash_chains",			KSTAT_DATA_UINT64 },
 	{ "hash_chain_max",			KSTAT_DATA_UINT64 },
 	{ "hash_insert_race",			KSTAT_DATA_UINT64 },
+	{ "hash_lock_retries",			KSTAT_DATA_UINT64 },
+	{ "hash_table_grows",			KSTAT_DATA_UINT64 },
+	{ "hash_lockless_hits",			KSTAT_DATA_UINT64 },
 	{ "hash_table_count",			KSTAT_DATA_UINT64 },
 	{ "hash_mutex_count",			KSTAT_DATA_UINT64 },
 	{ "metadata_cache_count",		KSTAT_DATA_UINT64 },
@@ -156,6 +173,9 @@ struct {
 	wmsum_t hash_collisions;
 	wmsum_t hash_chains;
 	wmsum_t hash_insert_race;
+	wmsum_t hash_lock_retries;
+	wmsum_t hash_table_grows;
+	wmsum_t hash_lockless_hits;
 	wmsum_t metadata_cache_count;
 	wmsum_t metadata_cache_overflow;
 } dbuf_sums;
@@ -183,6 +203,26 @@ static void dbuf_sync_leaf_verify_bonus_dnode(dbuf_dirty_record_t *dr);
  */
 static kmem_cache_t *dbuf_kmem_cache;
 static taskq_t *dbu_evict_taskq;
+static taskq_t *dbuf_hash_taskq;
+
+#if defined(_KERNEL) && defined(__linux__)
+/*
+ * In the Linux kernel dbuf_find() first looks for a hit under
+ * rcu_read_lock() instead of the bucket lock (see dbuf_find_lockless()).
+ * For that to be safe, a dbuf which has been in the hash table is only
+ * returned to dbuf_kmem_cache after an RCU grace period.  dbuf_free()
+ * queues it on dbuf_free_list, linked through db_cache_link which is no
+ * longer in use by then, and dbuf_free_deferred() frees the list from the
+ * dbuf_hash taskq once the grace period has passed.
+ */
+#define	DBUF_FIND_LOCKLESS
+#define	DBUF_FIND_LOCKLESS_HOPS	8
+
+static kmutex_t dbuf_free_lock;
+static list_t dbuf_free_list;
+static boolean_t dbuf_free_pending;
+static taskq_ent_t dbuf_free_ent;
+#endif
 
 static kthread_t *dbuf_cache_evict_thread;
 static kmutex_t dbuf_evict_lock;
@@ -234,7 +274,7 @@ static uint64_t dbuf_metadata_cache_max_bytes = UINT64_MAX;
 static uint_t dbuf_cache_shift = 5;
 static uint_t dbuf_metadata_cache_shift = 6;
 
-/* Set the dbuf hash mutex count as log2 shift (dynamic by default) */
+/* Set the dbuf hash lock count as log2 shift (dynamic by default) */
 static uint_t dbuf_mutex_cache_shift = 0;
 
 static unsigned long dbuf_cache_target_bytes(void);
@@ -338,30 +378,146 @@ dbuf_hash(void *os, uint64_t obj, uint8_t lvl, uint64_t blkid)
 	(dbuf)->db_level == (level) &&			\
 	(dbuf)->db_blkid == (blkid))
 
+/*
+ * Lookups only need the bucket lock as reader, so concurrent holds of
+ * dbufs which hash to the same lock (most often the same hot indirect or
+ * dnode block) don't serialize on it.  Only inserts, removes and the
+ * occasional resize take it as writer.
+ */
+static inline void
+dbuf_hash_enter(dbuf_hash_table_t *h, uint64_t hv, krw_t rw)
+{
+	krwlock_t *lock = DBUF_HASH_RWLOCK(h, hv);
+
+	if (!rw_tryenter(lock, rw)) {
+		DBUF_STAT_BUMP(hash_lock_retries);
+		rw_enter(lock, rw);
+	}
+}
+
+#ifdef DBUF_FIND_LOCKLESS
+/*
+ * Look for a hit without the bucket lock.  dbufs are only freed a grace
+ * period after they have left the hash table, so the chain can be walked
+ * under rcu_read_lock() while it is being changed, and the key fields of
+ * a dbuf never change while it's allocated.  A dbuf which is found is
+ * only returned once its db_mtx is held and it's not being evicted.
+ * Whenever that can't be established without waiting, or the chain is
+ * long, NULL is returned and dbuf_find() takes the bucket lock instead.
+ * That includes lookups under a lock whose chains haven't been moved to
+ * a newly grown table yet, which only look in the new table here.
+ */
+static dmu_buf_impl_t *
+dbuf_find_lockless(dbuf_hash_table_t *h, objset_t *os, uint64_t obj,
+    uint8_t level, uint64_t blkid, uint64_t hv)
+{
+	dmu_buf_impl_t *db;
+	uint64_t mask;
+	int hops = 0;
+
+	rcu_read_lock();
+	/* A new mask is only published after its table, see dbuf_hash_grow */
+	mask = READ_ONCE(h->hash_table_mask);
+	membar_consumer();
+	for (db = READ_ONCE(h->hash_table[hv & mask]);
+	    db != NULL && hops < DBUF_FIND_LOCKLESS_HOPS;
+	    db = READ_ONCE(db->db_hash_next), hops++) {
+		if (!DBUF_EQUAL(db, os, obj, level, blkid))
+			continue;
+		if (mutex_tryenter(&db->db_mtx)) {
+			if (db->db_state != DB_EVICTING) {
+				rcu_read_unlock();
+				return (db);
+			}
+			mutex_exit(&db->db_mtx);
+		}
+		break;
+	}
+	rcu_read_unlock();
+
+	return (NULL);
+}
+
+/*
+ * Free a dbuf that may still be seen by dbuf_find_lockless() once the
+ * current RCU grace period has passed.
+ */
+static void
+dbuf_free_deferred(void *arg)
+{
+	(void) arg;
+	list_t batch;
+	dmu_buf_impl_t *db;
+
+	list_create(&batch, sizeof (dmu_buf_impl_t),
+	    offsetof(dmu_buf_impl_t, db_cache_link));
+
+	mutex_enter(&dbuf_free_lock);
+	while (!list_is_empty(&dbuf_free_list)) {
+		list_move_tail(&batch, &dbuf_free_list);
+		mutex_exit(&dbuf_free_lock);
+
+		synchronize_rcu();
+		while ((db = list_remove_head(&batch)) != NULL)
+			kmem_cache_free(dbuf_kmem_cache, db);
+
+		mutex_enter(&dbuf_free_lock);
+	}
+	dbuf_free_pending = B_FALSE;
+	mutex_exit(&dbuf_free_lock);
+
+	list_destroy(&batch);
+}
+#endif
+
+static void
+dbuf_free(dmu_buf_impl_t *db)
+{
+#ifdef DBUF_FIND_LOCKLESS
+	mutex_enter(&dbuf_free_lock);
+	list_insert_tail(&dbuf_free_list, db);
+	if (!dbuf_free_pending) {
+		dbuf_free_pending = B_TRUE;
+		taskq_dispatch_ent(dbuf_hash_taskq, dbuf_free_deferred, NULL,
+		    0, &dbuf_free_ent);
+	}
+	mutex_exit(&dbuf_free_lock);
+#else
+	kmem_cache_free(dbuf_kmem_cache, db);
+#endif
+}
+
 dmu_buf_impl_t *
 dbuf_find(objset_t *os, uint64_t obj, uint8_t level, uint64_t blkid,
     uint64_t *hash_out)
 {
 	dbuf_hash_table_t *h = &dbuf_hash_table;
 	uint64_t hv;
-	uint64_t idx;
 	dmu_buf_impl_t *db;
 
 	hv = dbuf_hash(os, obj, level, blkid);
-	idx = hv & h->hash_table_mask;
 
-	mutex_enter(DBUF_HASH_MUTEX(h, idx));
-	for (db = h->hash_table[idx]; db != NULL; db = db->db_hash_next) {
+#ifdef DBUF_FIND_LOCKLESS
+	db = dbuf_find_lockless(h, os, obj, level, blkid, hv);
+	if (db != NULL) {
+		DBUF_STAT_BUMP(hash_lockless_hits);
+		return (db);
+	}
+#endif
+
+	dbuf_hash_enter(h, hv, RW_READER);
+	for (db = *dbuf_hash_bucket(h, hv); db != NULL;
+	    db = db->db_hash_next) {
 		if (DBUF_EQUAL(db, os, obj, level, blkid)) {
 			mutex_enter(&db->db_mtx);
 			if (db->db_state != DB_EVICTING) {
-				mutex_exit(DBUF_HASH_MUTEX(h, idx));
+				rw_exit(DBUF_HASH_RWLOCK(h, hv));
 				return (db);
 			}
 			mutex_exit(&db->db_mtx);
 		}
 	}
-	mutex_exit(DBUF_HASH_MUTEX(h, idx));
+	rw_exit(DBUF_HASH_RWLOCK(h, hv));
 	if (hash_out != NULL)
 		*hash_out = hv;
 	return (NULL);
@@ -385,6 +541,101 @@ dbuf_find_bonus(objset_t *os, uint64_t object)
 	return (db);
 }
 
+/*
+ * The hash table starts out small and is doubled whenever the number of
+ * dbufs exceeds the number of buckets, up to the size needed to fill an
+ * eighth of memory with average sized blocks.  All of the bucket locks are
+ * only held long enough to swap in the new table; the chains are then
+ * moved over one lock at a time, with lookups under a lock that hasn't
+ * been done yet still going to the old table (see dbuf_hash_bucket()).
+ * This runs from a taskq rather than in the context of the insert which
+ * triggered it, where the new dbuf's db_mtx is held.
+ */
+static void
+dbuf_hash_grow(void *arg)
+{
+	dbuf_hash_table_t *h = arg;
+	uint64_t nlocks = h->hash_rwlock_mask + 1;
+	uint64_t nmask = (h->hash_table_mask << 1) | 1;
+	dmu_buf_impl_t **ntable;
+
+	ASSERT3U(nmask, <=, h->hash_table_mask_max);
+	ASSERT3P(h->hash_old_table, ==, NULL);
+
+	ntable = vmem_zalloc((nmask + 1) * sizeof (void *), KM_NOSLEEP);
+	if (ntable == NULL) {
+		atomic_swap_32(&h->hash_growing, 0);
+		return;
+	}
+
+	for (uint64_t i = 0; i < nlocks; i++)
+		rw_enter(&h->hash_rwlocks[i], RW_WRITER);
+	h->hash_old_table = h->hash_table;
+	h->hash_old_mask = h->hash_table_mask;
+	h->hash_table = ntable;
+	membar_producer();
+	h->hash_table_mask = nmask;
+	memset(h->hash_lock_moved, 0, nlocks);
+	for (uint64_t i = 0; i < nlocks; i++)
+		rw_exit(&h->hash_rwlocks[i]);
+
+	for (uint64_t i = 0; i < nlocks; i++) {
+		int64_t ochains = 0, nchains = 0;
+
+		rw_enter(&h->hash_rwlocks[i], RW_WRITER);
+		for (uint64_t idx = i; idx <= h->hash_old_mask;
+		    idx += nlocks) {
+			dmu_buf_impl_t *db;
+			dmu_buf_impl_t **obucket = &h->hash_old_table[idx];
+
+			if (*obucket != NULL &&
+			    (*obucket)->db_hash_next != NULL)
+				ochains++;
+			while ((db = *obucket) != NULL) {
+				dmu_buf_impl_t **nbucket =
+				    &h->hash_table[db->db_hash & nmask];
+
+				if (*nbucket != NULL &&
+				    (*nbucket)->db_hash_next == NULL)
+					nchains++;
+				*obucket = db->db_hash_next;
+				db->db_hash_next = *nbucket;
+				membar_producer();
+				*nbucket = db;
+			}
+		}
+		h->hash_lock_moved[i] = 1;
+		rw_exit(&h->hash_rwlocks[i]);
+
+		DBUF_STAT_INCR(hash_chains, nchains - ochains);
+	}
+
+	/*
+	 * Every lookup now finds its lock's chains moved and uses the new
+	 * table, so once lockless lookups which started before the swap are
+	 * done, nothing can still be referencing the old one.
+	 */
+#ifdef DBUF_FIND_LOCKLESS
+	synchronize_rcu();
+#endif
+	dmu_buf_impl_t **otable = h->hash_old_table;
+	h->hash_old_table = NULL;
+	vmem_free(otable, (h->hash_old_mask + 1) * sizeof (void *));
+	DBUF_STAT_BUMP(hash_table_grows);
+	atomic_swap_32(&h->hash_growing, 0);
+}
+
+static void
+dbuf_hash_grow_dispatch(dbuf_hash_table_t *h)
+{
+	if (h->hash_table_mask >= h->hash_table_mask_max ||
+	    atomic_cas_32(&h->hash_growing, 0, 1) != 0)
+		return;
+
+	taskq_dispatch_ent(dbuf_hash_taskq, dbuf_hash_grow, h, 0,
+	    &h->hash_grow_ent);
+}
+
 /*
  * Insert an entry into the hash table.  If there is already an element
  * equal to elem in the hash table, then the already existing element
@@ -398,21 +649,21 @@ dbuf_hash_insert(dmu_buf_impl_t *db)
 	objset_t *os = db->db_objset;
 	uint64_t obj = db->db.db_object;
 	int level = db->db_level;
-	uint64_t blkid, idx;
-	dmu_buf_impl_t *dbf;
+	uint64_t blkid;
+	dmu_buf_impl_t *dbf, **bucket;
 	uint32_t i;
 
 	blkid = db->db_blkid;
 	ASSERT3U(dbuf_hash(os, obj, level, blkid), ==, db->db_hash);
-	idx = db->db_hash & h->hash_table_mask;
 
-	mutex_enter(DBUF_HASH_MUTEX(h, idx));
-	for (dbf = h->hash_table[idx], i = 0; dbf != NULL;
+	dbuf_hash_enter(h, db->db_hash, RW_WRITER);
+	bucket = dbuf_hash_bucket(h, db->db_hash);
+	for (dbf = *bucket, i = 0; dbf != NULL;
 	    dbf = dbf->db_hash_next, i++) {
 		if (DBUF_EQUAL(dbf, os, obj, level, blkid)) {
 			mutex_enter(&dbf->db_mtx);
 			if (dbf->db_state != DB_EVICTING) {
-				mutex_exit(DBUF_HASH_MUTEX(h, idx));
+				rw_exit(DBUF_HASH_RWLOCK(h, db->db_hash));
 				return (dbf);
 			}
 			mutex_exit(&dbf->db_mtx);
@@ -428,12 +679,16 @@ dbuf_hash_insert(dmu_buf_impl_t *db)
 	}
 
 	mutex_enter(&db->db_mtx);
-	db->db_hash_next = h->hash_table[idx];
-	h->hash_table[idx] = db;
-	mutex_exit(DBUF_HASH_MUTEX(h, idx));
+	db->db_hash_next = *bucket;
+	membar_producer();
+	*bucket = db;
+	rw_exit(DBUF_HASH_RWLOCK(h, db->db_hash));
 	uint64_t he = atomic_inc_64_nv(&dbuf_stats.hash_elements.value.ui64);
 	DBUF_STAT_MAX(hash_elements_max, he);
 
+	if (he > h->hash_table_mask + 1)
+		dbuf_hash_grow_dispatch(h);
+
 	return (NULL);
 }
 
@@ -478,33 +733,30 @@ static void
 dbuf_hash_remove(dmu_buf_impl_t *db)
 {
 	dbuf_hash_table_t *h = &dbuf_hash_table;
-	uint64_t idx;
-	dmu_buf_impl_t *dbf, **dbp;
+	dmu_buf_impl_t *dbf, **bucket, **dbp;
 
 	ASSERT3U(dbuf_hash(db->db_objset, db->db.db_object, db->db_level,
 	    db->db_blkid), ==, db->db_hash);
-	idx = db->db_hash & h->hash_table_mask;
 
 	/*
 	 * We mustn't hold db_mtx to maintain lock ordering:
-	 * DBUF_HASH_MUTEX > db_mtx.
+	 * DBUF_HASH_RWLOCK > db_mtx.
 	 */
 	ASSERT(zfs_refcount_is_zero(&db->db_holds));
 	ASSERT(db->db_state == DB_EVICTING);
 	ASSERT(!MUTEX_HELD(&db->db_mtx));
 
-	mutex_enter(DBUF_HASH_MUTEX(h, idx));
-	dbp = &h->hash_table[idx];
+	dbuf_hash_enter(h, db->db_hash, RW_WRITER);
+	dbp = bucket = dbuf_hash_bucket(h, db->db_hash);
 	while ((dbf = *dbp) != db) {
 		dbp = &dbf->db_hash_next;
 		ASSERT(dbf != NULL);
 	}
 	*dbp = db->db_hash_next;
 	db->db_hash_next = NULL;
-	if (h->hash_table[idx] &&
-	    h->hash_table[idx]->db_hash_next == NULL)
+	if (*bucket != NULL && (*bucket)->db_hash_next == NULL)
 		DBUF_STAT_BUMPDOWN(hash_chains);
-	mutex_exit(DBUF_HASH_MUTEX(h, idx));
+	rw_exit(DBUF_HASH_RWLOCK(h, db->db_hash));
 	atomic_dec_64(&dbuf_stats.hash_elements.value.ui64);
 }
 
@@ -899,8 +1151,14 @@ dbuf_kstat_update(kstat_t *ksp, int rw)
 	    wmsum_value(&dbuf_sums.hash_chains);
 	ds->hash_insert_race.value.ui64 =
 	    wmsum_value(&dbuf_sums.hash_insert_race);
+	ds->hash_lock_retries.value.ui64 =
+	    wmsum_value(&dbuf_sums.hash_lock_retries);
+	ds->hash_table_grows.value.ui64 =
+	    wmsum_value(&dbuf_sums.hash_table_grows);
+	ds->hash_lockless_hits.value.ui64 =
+	    wmsum_value(&dbuf_sums.hash_lockless_hits);
 	ds->hash_table_count.value.ui64 = h->hash_table_mask + 1;
-	ds->hash_mutex_count.value.ui64 = h->hash_mutex_mask + 1;
+	ds->hash_mutex_count.value.ui64 = h->hash_rwlock_mask + 1;
 	ds->metadata_cache_count.value.ui64 =
 	    wmsum_value(&dbuf_sums.metadata_cache_count);
 	ds->metadata_cache_size_bytes.value.ui64 = zfs_refcount_count(
@@ -917,51 +1175,62 @@ dbuf_init(void)
 	dbuf_hash_table_t *h = &dbuf_hash_table;
 
 	/*
-	 * The hash table is big enough to fill one eighth of physical memory
-	 * with an average block size of zfs_arc_average_blocksize (default 8K).
-	 * By default, the table will take up
+	 * The hash table may grow to be big enough to fill one eighth of
+	 * physical memory with an average block size of
+	 * zfs_arc_average_blocksize (default 8K), i.e. up to
 	 * totalmem * sizeof(void*) / 8K (1MB per GB with 8-byte pointers).
 	 */
 	while (hsize * zfs_arc_average_blocksize < arc_all_memory() / 8)
 		hsize <<= 1;
-
-	h->hash_table = NULL;
-	while (h->hash_table == NULL) {
-		h->hash_table_mask = hsize - 1;
-
-		h->hash_table = vmem_zalloc(hsize * sizeof (void *), KM_SLEEP);
-		if (h->hash_table == NULL)
-			hsize >>= 1;
-
-		ASSERT3U(hsize, >=, 1ULL << 10);
-	}
+	h->hash_table_mask_max = hsize - 1;
 
 	/*
-	 * The hash table buckets are protected by an array of mutexes where
-	 * each mutex is reponsible for protecting 128 buckets.  A minimum
-	 * array size of 8192 is targeted to avoid contention.
+	 * The hash table buckets are protected by an array of rwlocks where
+	 * each lock is reponsible for protecting 128 buckets of the largest
+	 * table.  A minimum array size of 8192 is targeted to avoid
+	 * contention.  The table never has fewer buckets than there are locks.
 	 */
 	if (dbuf_mutex_cache_shift == 0)
 		hmsize = MAX(hsize >> 7, 1ULL << 13);
 	else
 		hmsize = 1ULL << MIN(dbuf_mutex_cache_shift, 24);
+	hmsize = MIN(hmsize, hsize);
 
-	h->hash_mutexes = NULL;
-	while (h->hash_mutexes == NULL) {
-		h->hash_mutex_mask = hmsize - 1;
+	h->hash_rwlocks = NULL;
+	while (h->hash_rwlocks == NULL) {
+		h->hash_rwlock_mask = hmsize - 1;
 
-		h->hash_mutexes = vmem_zalloc(hmsize * sizeof (kmutex_t),
+		h->hash_rwlocks = vmem_zalloc(hmsize * sizeof (krwlock_t),
 		    KM_SLEEP);
-		if (h->hash_mutexes == NULL)
+		if (h->hash_rwlocks == NULL)
 			hmsize >>= 1;
 	}
 
+	/*
+	 * Start with one bucket per lock (and at least 64K buckets) and let
+	 * dbuf_hash_grow() double the table as dbufs are created.
+	 */
+	hsize = MIN(MAX(hmsize, 1ULL << 16), hsize);
+	h->hash_table_mask = hsize - 1;
+	h->hash_table = vmem_zalloc(hsize * sizeof (void *), KM_SLEEP);
+	h->hash_old_table = NULL;
+	h->hash_lock_moved = vmem_zalloc(hmsize, KM_SLEEP);
+	h->hash_growing = 0;
+	taskq_init_ent(&h->hash_grow_ent);
+#ifdef DBUF_FIND_LOCKLESS
+	mutex_init(&dbuf_free_lock, NULL, MUTEX_DEFAULT, NULL);
+	list_create(&dbuf_free_list, sizeof (dmu_buf_impl_t),
+	    offsetof(dmu_buf_impl_t, db_cache_link));
+	dbuf_free_pending = B_FALSE;
+	taskq_init_ent(&dbuf_free_ent);
+#endif
+
 	dbuf_kmem_cache = kmem_cache_create("dmu_buf_impl_t",
 	    sizeof (dmu_buf_impl_t),
 	    0, dbuf_cons, dbuf_dest, NULL, NULL, NULL, 0);
 
 	for (int i = 0; i < hmsize; i++)
-		mutex_init(&h->hash_mutexes[i], NULL, MUTEX_NOLOCKDEP, NULL);
+		rw_init(&h->hash_rwlocks[i], NULL, RW_NOLOCKDEP, NULL);
 
 	dbuf_stats_init(h);
 
@@ -970,6 +1239,7 @@ dbuf_init(void)
 	 * configuration is not required.
 	 */
 	dbu_evict_taskq = taskq_create("dbu_evict", 1, defclsyspri, 0, 0, 0);
+	dbuf_hash_taskq = taskq_create("dbuf_hash", 1, defclsyspri, 0, 0, 0);
 
 	for (dbuf_cached_state_t dcs = 0; dcs < DB_CACHE_MAX; dcs++) {
 		multilist_create(&dbuf_caches[dcs].cache,
@@ -996,6 +1266,9 @@ dbuf_init(void)
 	wmsum_init(&dbuf_sums.hash_collisions, 0);
 	wmsum_init(&dbuf_sums.hash_chains, 0);
 	wmsum_init(&dbuf_sums.hash_insert_race, 0);
+	wmsum_init(&dbuf_sums.hash_lock_retries, 0);
+	wmsum_init(&dbuf_sums.hash_table_grows, 0);
+	wmsum_init(&dbuf_sums.hash_lockless_hits, 0);
 	wmsum_init(&dbuf_sums.metadata_cache_count, 0);
 	wmsum_init(&dbuf_sums.metadata_cache_overflow, 0);
 
@@ -1026,12 +1299,21 @@ dbuf_fini(void)
 
 	dbuf_stats_destroy();
 
-	for (int i = 0; i < (h->hash_mutex_mask + 1); i++)
-		mutex_destroy(&h->hash_mutexes[i]);
+	taskq_destroy(dbuf_hash_taskq);
+#ifdef DBUF_FIND_LOCKLESS
+	ASSERT(list_is_empty(&dbuf_free_list));
+	list_destroy(&dbuf_free_list);
+	mutex_destroy(&dbuf_free_lock);
+#endif
+
+	for (int i = 0; i < (h->hash_rwlock_mask + 1); i++)
+		rw_destroy(&h->hash_rwlocks[i]);
 
+	ASSERT3P(h->hash_old_table, ==, NULL);
 	vmem_free(h->hash_table, (h->hash_table_mask + 1) * sizeof (void *));
-	vmem_free(h->hash_mutexes, (h->hash_mutex_mask + 1) *
-	    sizeof (kmutex_t));
+	vmem_free(h->hash_lock_moved, h->hash_rwlock_mask + 1);
+	vmem_free(h->hash_rwlocks, (h->hash_rwlock_mask + 1) *
+	    sizeof (krwlock_t));
 
 	kmem_cache_destroy(dbuf_kmem_cache);
 	taskq_destroy(dbu_evict_taskq);
@@ -1068,6 +1350,9 @@ dbuf_fini(void)
 	wmsum_fini(&dbuf_sums.hash_collisions);
 	wmsum_fini(&dbuf_sums.hash_chains);
 	wmsum_fini(&dbuf_sums.hash_insert_race);
+	wmsum_fini(&dbuf_sums.hash_lock_retries);
+	wmsum_fini(&dbuf_sums.hash_table_grows);
+	wmsum_fini(&dbuf_sums.hash_lockless_hits);
 	wmsum_fini(&dbuf_sums.metadata_cache_count);
 	wmsum_fini(&dbuf_sums.metadata_cache_overflow);
 }
@@ -1590,9 +1875,9 @@ dbuf_read_impl(dmu_buf_impl_t *db, dnode_t *dn, zio_t *zio, uint32_t flags,
 	}
 
 	/*
-	 * If we have a pending block clone, we don't want to read the
-	 * underlying block, but the content of the block being cloned,
-	 * pointed by the dirty record, so we have the most recent data.
+	 * If we have a pending block clone or Direct I/O write, we don't want
+	 * to read the underlying block, but the content of the block pointed
+	 * by the dirty record, so we have the most recent data.
 	 * If there is no dirty record, then we hit a race in a sync
 	 * process when the dirty record is already removed, while the
 	 * dbuf is not yet destroyed. Such case is equivalent to uncached.
@@ -1600,7 +1885,8 @@ dbuf_read_impl(dmu_buf_impl_t *db, dnode_t *dn, zio_t *zio, uint32_t flags,
 	if (db->db_state == DB_NOFILL) {
 		dbuf_dirty_record_t *dr = list_head(&db->db_dirty_records);
 		if (dr != NULL) {
-			if (!dr->dt.dl.dr_brtwrite) {
+			if (!dr->dt.dl.dr_brtwrite &&
+			    !dr->dt.dl.dr_diowrite) {
 				err = EIO;
 				goto early_unlock;
 			}
@@ -1936,13 +2222,14 @@ dbuf_unoverride(dbuf_dirty_record_t *dr)
 	if (!BP_IS_HOLE(bp) && !dr->dt.dl.dr_nopwrite)
 		zio_free(db->db_objset->os_spa, txg, bp);
 
-	if (dr->dt.dl.dr_brtwrite) {
+	if (dr->dt.dl.dr_brtwrite || dr->dt.dl.dr_diowrite) {
 		ASSERT0P(dr->dt.dl.dr_data);
 		dr->dt.dl.dr_data = db->db_buf;
 	}
 	dr->dt.dl.dr_override_state = DR_NOT_OVERRIDDEN;
 	dr->dt.dl.dr_nopwrite = B_FALSE;
 	dr->dt.dl.dr_brtwrite = B_FALSE;
+	dr->dt.dl.dr_diowrite = B_FALSE;
 	dr->dt.dl.dr_has_raw_params = B_FALSE;
 
 	/*
@@ -2005,6 +2292,19 @@ dbuf_free_range(dnode_t *dn, uint64_t start_blkid, uint64_t end_blkid,
 			continue;
 		}
 
+		/*
+		 * If that undirtied a pending clone or Direct I/O write, any
+		 * older dirty record left has its data in an ARC buffer, which
+		 * a NOFILL dbuf can't be read from.  Mark it uncached, as
+		 * dmu_buf_will_fill() does, so it is read as freed.
+		 */
+		if (db->db_state == DB_NOFILL) {
+			dbuf_dirty_record_t *dr =
+			    list_head(&db->db_dirty_records);
+			if (dr != NULL && dr->dt.dl.dr_data != NULL)
+				db->db_state = DB_UNCACHED;
+		}
+
 		if (db->db_state == DB_UNCACHED ||
 		    db->db_state == DB_NOFILL ||
 		    db->db_state == DB_EVICTING) {
@@ -2531,7 +2831,7 @@ boolean_t
 dbuf_undirty(dmu_buf_impl_t *db, dmu_tx_t *tx)
 {
 	uint64_t txg = tx->tx_txg;
-	boolean_t brtwrite;
+	boolean_t brtwrite, diowrite;
 
 	ASSERT(txg != 0);
 
@@ -2557,6 +2857,7 @@ dbuf_undirty(dmu_buf_impl_t *db, dmu_tx_t *tx)
 	ASSERT(dr->dr_dbuf == db);
 
 	brtwrite = dr->dt.dl.dr_brtwrite;
+	diowrite = dr->dt.dl.dr_diowrite;
 	if (brtwrite) {
 		/*
 		 * We are freeing a block that we cloned in the same
@@ -2595,7 +2896,13 @@ dbuf_undirty(dmu_buf_impl_t *db, dmu_tx_t *tx)
 		mutex_exit(&dn->dn_mtx);
 	}
 
-	if (db->db_state != DB_NOFILL && !brtwrite) {
+	if (diowrite) {
+		/*
+		 * The Direct I/O write has no data of its own, but the block
+		 * it wrote in this txg has to be freed again.
+		 */
+		dbuf_unoverride(dr);
+	} else if (db->db_state != DB_NOFILL && !brtwrite) {
 		dbuf_unoverride(dr);
 
 		ASSERT(db->db_buf != NULL);
@@ -2610,7 +2917,7 @@ dbuf_undirty(dmu_buf_impl_t *db, dmu_tx_t *tx)
 	db->db_dirtycnt -= 1;
 
 	if (zfs_refcount_remove(&db->db_holds, (void *)(uintptr_t)txg) == 0) {
-		ASSERT(db->db_state == DB_NOFILL || brtwrite ||
+		ASSERT(db->db_state == DB_NOFILL || brtwrite || diowrite ||
 		    arc_released(db->db_buf));
 		dbuf_destroy(db);
 		return (B_TRUE);
@@ -2642,9 +2949,11 @@ dmu_buf_will_dirty_impl(dmu_buf_t *db_fake, int flags, dmu_tx_t *tx)
 		dbuf_dirty_record_t *dr = dbuf_find_dirty_eq(db, tx->tx_txg);
 		if (dr != NULL) {
 			if (db->db_level == 0 &&
-			    dr->dt.dl.dr_brtwrite) {
+			    (dr->dt.dl.dr_brtwrite ||
+			    dr->dt.dl.dr_diowrite)) {
 				/*
-				 * Block cloning: If we are dirtying a cloned
+				 * Block cloning or Direct I/O: If we are
+				 * dirtying a cloned or directly written
 				 * level 0 block, we cannot simply redirty it,
 				 * because this dr has no associated data.
 				 * We will go through a full undirtying below,
@@ -2702,7 +3011,7 @@ dmu_buf_is_dirty(dmu_buf_t *db_fake, dmu_tx_t *tx)
 }
 
 void
-dmu_buf_will_clone(dmu_buf_t *db_fake, dmu_tx_t *tx)
+dmu_buf_will_clone_or_dio(dmu_buf_t *db_fake, dmu_tx_t *tx)
 {
 	dmu_buf_impl_t *db = (dmu_buf_impl_t *)db_fake;
 	ASSERT0(db->db_level);
@@ -2710,9 +3019,9 @@ dmu_buf_will_clone(dmu_buf_t *db_fake, dmu_tx_t *tx)
 	ASSERT(db->db.db_object != DMU_META_DNODE_OBJECT);
 
 	/*
-	 * Block cloning: We are going to clone into this block, so undirty
-	 * modifications done to this block so far in this txg. This includes
-	 * writes and clones into this block.
+	 * Block cloning or Direct I/O: We are going to clone or write directly
+	 * into this block, so undirty modifications done to this block so far
+	 * in this txg. This includes writes and clones into this block.
 	 */
 	mutex_enter(&db->db_mtx);
 	DBUF_VERIFY(db);
@@ -2736,7 +3045,7 @@ dmu_buf_will_clone(dmu_buf_t *db_fake, dmu_tx_t *tx)
 	ASSERT3P(db->db.db_data, ==, NULL);
 
 	db->db_state = DB_NOFILL;
-	DTRACE_SET_STATE(db, "allocating NOFILL buffer for clone");
+	DTRACE_SET_STATE(db, "allocating NOFILL buffer for clone or dio");
 
 	DBUF_VERIFY(db);
 	mutex_exit(&db->db_mtx);
@@ -2995,6 +3304,16 @@ dbuf_assign_arcbuf(dmu_buf_impl_t *db, arc_buf_t *buf, dmu_tx_t *tx)
 		dbuf_dirty_record_t *dr = list_head(&db->db_dirty_records);
 
 		ASSERT(db->db_buf != NULL);
+		if (dr != NULL && dr->dr_txg == tx->tx_txg &&
+		    dr->dt.dl.dr_diowrite) {
+			/*
+			 * Direct I/O: the block was written directly in this
+			 * txg and read back since. That dirty record has no
+			 * data of its own, so undirty it before replacing it.
+			 */
+			VERIFY(!dbuf_undirty(db, tx));
+			dr = list_head(&db->db_dirty_records);
+		}
 		if (dr != NULL && dr->dr_txg == tx->tx_txg) {
 			ASSERT(dr->dt.dl.dr_data == db->db_buf);
 
@@ -3149,7 +3468,7 @@ dbuf_destroy(dmu_buf_impl_t *db)
 		dbuf_rele_and_unlock(parent, db, B_TRUE);
 	}
 
-	kmem_cache_free(dbuf_kmem_cache, db);
+	dbuf_free(db);
 	arc_space_return(sizeof (dmu_buf_impl_t), ARC_SPACE_DBUF);
 }
 
@@ -4551,13 +4870,18 @@ dbuf_sync_leaf(dbuf_dirty_record_t *dr, dmu_tx_t *tx)
 		ASSERT(db->db.db_data != dr->dt.dl.dr_data);
 	} else if (db->db_state == DB_READ) {
 		/*
-		 * This buffer has a clone we need to write, and an in-flight
-		 * read on the BP we're about to clone. Its safe to issue the
-		 * write here because the read has already been issued and the
-		 * contents won't change.
+		 * This buffer was cloned or written directly and has an
+		 * in-flight read on the resulting BP.  It's safe to issue the
+		 * write here because the read has already been issued and
+		 * the contents won't change.  The record being synced may be
+		 * an older one with data of its own, so check the newest.
 		 */
-		ASSERT(dr->dt.dl.dr_brtwrite &&
-		    dr->dt.dl.dr_override_state == DR_OVERRIDDEN);
+		dbuf_dirty_record_t *dr_head =
+		    list_head(&db->db_dirty_records);
+		ASSERT3P(db->db_buf, ==, NULL);
+		ASSERT3P(db->db.db_data, ==, NULL);
+		ASSERT3P(dr_head->dt.dl.dr_data, ==, NULL);
+		ASSERT3U(dr_head->dt.dl.dr_override_state, ==, DR_OVERRIDDEN);
 	} else {
 		ASSERT(db->db_state == DB_CACHED || db->db_state == DB_NOFILL);
 	}
@@ -5239,7 +5563,7 @@ EXPORT_SYMBOL(dbuf_dirty);
 EXPORT_SYMBOL(dmu_buf_set_crypt_params);
 EXPORT_SYMBOL(dmu_buf_will_dirty);
 EXPORT_SYMBOL(dmu_buf_is_dirty);
-EXPORT_SYMBOL(dmu_buf_will_clone);
+EXPORT_SYMBOL(dmu_buf_will_clone_or_dio);
 EXPORT_SYMBOL(dmu_buf_will_not_fill);
 EXPORT_SYMBOL(dmu_buf_will_fill);
 EXPORT_SYMBOL(dmu_buf_fill_done);
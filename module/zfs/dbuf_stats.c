@@ -130,7 +130,7 @@ dbuf_stats_hash_table_data(char *buf, size_t size, void *data)
 {
 	dbuf_stats_t *dsh = (dbuf_stats_t *)data;
 	dbuf_hash_table_t *h = dsh->hash;
-	dmu_buf_impl_t *db;
+	dmu_buf_impl_t *db, *head;
 	int length, error = 0;
 
 	ASSERT3S(dsh->idx, >=, 0);
@@ -138,8 +138,20 @@ dbuf_stats_hash_table_data(char *buf, size_t size, void *data)
 	if (size)
 		buf[0] = 0;
 
-	mutex_enter(DBUF_HASH_MUTEX(h, dsh->idx));
-	for (db = h->hash_table[dsh->idx]; db != NULL; db = db->db_hash_next) {
+	rw_enter(DBUF_HASH_RWLOCK(h, dsh->idx), RW_READER);
+	/*
+	 * While the table is being grown, a lock whose chains haven't been
+	 * moved yet still has them in the smaller old table.  Report each of
+	 * those under its old index so that none is listed twice.
+	 */
+	if (h->hash_old_table != NULL &&
+	    !h->hash_lock_moved[dsh->idx & h->hash_rwlock_mask]) {
+		head = dsh->idx <= h->hash_old_mask ?
+		    h->hash_old_table[dsh->idx] : NULL;
+	} else {
+		head = h->hash_table[dsh->idx];
+	}
+	for (db = head; db != NULL; db = db->db_hash_next) {
 		/*
 		 * Returning ENOMEM will cause the data and header functions
 		 * to be called with a larger scratch buffers.
@@ -159,7 +171,7 @@ dbuf_stats_hash_table_data(char *buf, size_t size, void *data)
 
 		mutex_exit(&db->db_mtx);
 	}
-	mutex_exit(DBUF_HASH_MUTEX(h, dsh->idx));
+	rw_exit(DBUF_HASH_RWLOCK(h, dsh->idx));
 
 	return (error);
 }
@@ -215,15 +227,149 @@ dbuf_stats_hash_table_destroy(void)
 	mutex_destroy(&dsh->lock);
 }
 
+/*
+ * ==========================================================================
+ * Dbuf Hash Chain Length Routines
+ * ==========================================================================
+ */
+#define	DBUF_HASH_CHAIN_BUCKETS	16
+
+typedef struct dbuf_stats_chains_t {
+	kmutex_t		lock;
+	kstat_t			*kstat;
+	dbuf_hash_table_t	*hash;
+	uint64_t		hist[DBUF_HASH_CHAIN_BUCKETS];
+	int			idx;
+} dbuf_stats_chains_t;
+
+static dbuf_stats_chains_t dbuf_stats_hash_chains;
+
+static int
+dbuf_stats_hash_chains_headers(char *buf, size_t size)
+{
+	(void) snprintf(buf, size, "%-8s %s\n", "length", "buckets");
+
+	return (0);
+}
+
+static int
+dbuf_stats_hash_chains_data(char *buf, size_t size, void *data)
+{
+	dbuf_stats_chains_t *dsc = (dbuf_stats_chains_t *)data;
+	char length[16];
+
+	/* The last row counts every chain at least that long. */
+	(void) snprintf(length, sizeof (length), "%d%s", dsc->idx,
+	    dsc->idx == DBUF_HASH_CHAIN_BUCKETS - 1 ? "+" : "");
+	(void) snprintf(buf, size, "%-8s %llu\n", length,
+	    (u_longlong_t)dsc->hist[dsc->idx]);
+
+	return (0);
+}
+
+/*
+ * Build a histogram of the hash chain lengths when the first row is
+ * requested.  Each lock is held only while the buckets it covers are
+ * walked, so this is a snapshot of each bucket but not of the table.
+ */
+static void
+dbuf_stats_hash_chains_update(dbuf_stats_chains_t *dsc)
+{
+	dbuf_hash_table_t *h = dsc->hash;
+
+	memset(dsc->hist, 0, sizeof (dsc->hist));
+
+	for (uint64_t i = 0; i <= h->hash_rwlock_mask; i++) {
+		dmu_buf_impl_t **table;
+		uint64_t mask;
+
+		rw_enter(&h->hash_rwlocks[i], RW_READER);
+		if (h->hash_old_table != NULL && !h->hash_lock_moved[i]) {
+			table = h->hash_old_table;
+			mask = h->hash_old_mask;
+		} else {
+			table = h->hash_table;
+			mask = h->hash_table_mask;
+		}
+		for (uint64_t idx = i; idx <= mask;
+		    idx += h->hash_rwlock_mask + 1) {
+			int len = 0;
+
+			for (dmu_buf_impl_t *db = table[idx];
+			    db != NULL; db = db->db_hash_next)
+				len++;
+
+			dsc->hist[MIN(len, DBUF_HASH_CHAIN_BUCKETS - 1)]++;
+		}
+		rw_exit(&h->hash_rwlocks[i]);
+	}
+}
+
+static void *
+dbuf_stats_hash_chains_addr(kstat_t *ksp, loff_t n)
+{
+	dbuf_stats_chains_t *dsc = ksp->ks_private;
+
+	ASSERT(MUTEX_HELD(&dsc->lock));
+
+	if (n == 0)
+		dbuf_stats_hash_chains_update(dsc);
+
+	if (n < DBUF_HASH_CHAIN_BUCKETS) {
+		dsc->idx = n;
+		return (dsc);
+	}
+
+	return (NULL);
+}
+
+static void
+dbuf_stats_hash_chains_init(dbuf_hash_table_t *hash)
+{
+	dbuf_stats_chains_t *dsc = &dbuf_stats_hash_chains;
+	kstat_t *ksp;
+
+	mutex_init(&dsc->lock, NULL, MUTEX_DEFAULT, NULL);
+	dsc->hash = hash;
+
+	ksp = kstat_create("zfs", 0, "dbuf_hash_chains", "misc",
+	    KSTAT_TYPE_RAW, 0, KSTAT_FLAG_VIRTUAL);
+	dsc->kstat = ksp;
+
+	if (ksp) {
+		ksp->ks_lock = &dsc->lock;
+		ksp->ks_ndata = UINT32_MAX;
+		ksp->ks_private = dsc;
+		kstat_set_raw_ops(ksp, dbuf_stats_hash_chains_headers,
+		    dbuf_stats_hash_chains_data, dbuf_stats_hash_chains_addr);
+		kstat_install(ksp);
+	}
+}
+
+static void
+dbuf_stats_hash_chains_destroy(void)
+{
+	dbuf_stats_chains_t *dsc = &dbuf_stats_hash_chains;
+	kstat_t *ksp;
+
+	ksp = dsc->kstat;
+	if (ksp)
+		kstat_delete(ksp);
+
+	mutex_destroy(&dsc->lock);
+}
+
 void
 dbuf_stats_init(dbuf_hash_table_t *hash)
 {
 	dbuf_stats_hash_table_init(hash);
+	dbuf_stats_hash_chains_init(hash);
 }
 
 void
 dbuf_stats_destroy(void)
 {
+	dbuf_stats_hash_chains_destroy();
 	dbuf_stats_hash_table_destroy();
 }
 
@@ -23,7 +23,7 @@
  * Copyright (c) 2009, 2010, Oracle and/or its affiliates. All rights reserved.
  * Copyright (c) 2012, 2016 by Delphix. All rights reserved.
  * Copyright (c) 2022 by Pawel Jakub Dawidek
- * Copyright (c) 2019, 2023, Klara Inc.
+ * Copyright (c) 2019, 2023, 2024, Klara Inc.
  */
 
 #include <sys/zfs_context.h>
@@ -34,11 +34,14 @@
 #include <sys/ddt_impl.h>
 #include <sys/zap.h>
 #include <sys/dmu_tx.h>
+#include <sys/dmu_objset.h>
 #include <sys/arc.h>
 #include <sys/dsl_pool.h>
 #include <sys/zio_checksum.h>
 #include <sys/dsl_scan.h>
+#include <sys/dsl_synctask.h>
 #include <sys/abd.h>
+#include <sys/zfeature.h>
 
 /*
  * # DDT: Deduplication tables
@@ -81,6 +84,14 @@
  * feature. These are no longer written, and will be freed if encountered on
  * old pools.
  *
+ * Tables created with the fast_dedup feature are "flat" (DDT_FLAG_FLAT): each
+ * entry has only a single ddt_phys_t, which holds the block for whatever
+ * copies value it was first written with. Since almost every pool only ever
+ * uses one copies value, the other slots would just be empty space in every
+ * stored entry. If a block is later written with more copies than the entry
+ * has, it is written as a regular, non-dedup block instead (see
+ * zio_ddt_write()).
+ *
  * ## Lifetime of an entry
  *
  * A DDT can be enormous, and typically is not held in memory all at once.
@@ -101,6 +112,15 @@
  * object and (if necessary), removed from an old one. ddt_tree is cleared and
  * the next txg can start.
  *
+ * ## Dedup log
+ *
+ * On pools with the fast_dedup feature, new tables are created with
+ * DDT_FLAG_LOG. For these tables, ddt_sync_table() does not update the storage
+ * objects directly. Instead, changed entries are appended to a dedup log, and
+ * a few entries at a time are flushed from the log to the storage objects each
+ * txg. ddt_lookup() checks the log before the storage objects, since the log
+ * holds the most recent version of an entry. See ddt_log.c for details.
+ *
  * ## Dedup quota
  *
  * A maximum size for all DDTs on the pool can be set with the
@@ -117,6 +137,18 @@
  * without which, no space would be recovered and the DDT would continue to be
  * considered "over quota". See zap_shrink_enabled.
  *
+ * ## Pruning
+ *
+ * The quota stops the DDT from growing, but does nothing about the entries
+ * already in it. Most of those are usually unique (refcount 1) entries, for
+ * blocks that were written once and never matched again. The administrator
+ * can remove unique entries that have not changed for some time with
+ * `zpool ddtprune` (ddt_prune_unique_entries()). The blocks themselves are not
+ * touched; they keep their D bit, but are no longer tracked by the DDT. When
+ * they are freed, zio_ddt_free() finds no entry for them and frees them like
+ * any other block. Only flat tables record when an entry last changed, so
+ * legacy tables are never pruned.
+ *
  * ## Repair IO
  *
  * If a read on a dedup block fails, but there are other copies of the block in
@@ -174,6 +206,11 @@ int zfs_dedup_prefetch = 0;
  */
 uint_t dedup_class_wait_txgs = 5;
 
+/*
+ * Maximum number of entries ddt_prune_unique_entries() removes in a single
+ * txg. Each one has to be looked up again in syncing context.
+ */
+uint_t zfs_dedup_prune_txg_max = 50000;
 
 static const ddt_ops_t *const ddt_ops[DDT_TYPES] = {
 	&ddt_zap_ops,
@@ -202,7 +239,7 @@ ddt_object_create(ddt_t *ddt, ddt_type_t type, ddt_class_t class,
 	VERIFY0(ddt_ops[type]->ddt_op_create(os, objectp, tx, prehash));
 	ASSERT3U(*objectp, !=, 0);
 
-	VERIFY0(zap_add(os, DMU_POOL_DIRECTORY_OBJECT, name,
+	VERIFY0(zap_add(os, ddt->ddt_dir_object, name,
 	    sizeof (uint64_t), 1, objectp, tx));
 
 	VERIFY0(zap_add(os, spa->spa_ddt_stat_object, name,
@@ -226,7 +263,7 @@ ddt_object_destroy(ddt_t *ddt, ddt_type_t type, ddt_class_t class,
 	ASSERT(ddt_histogram_empty(&ddt->ddt_histogram[type][class]));
 	VERIFY0(ddt_object_count(ddt, type, class, &count));
 	VERIFY0(count);
-	VERIFY0(zap_remove(os, DMU_POOL_DIRECTORY_OBJECT, name, tx));
+	VERIFY0(zap_remove(os, ddt->ddt_dir_object, name, tx));
 	VERIFY0(zap_remove(os, spa->spa_ddt_stat_object, name, tx));
 	VERIFY0(ddt_ops[type]->ddt_op_destroy(os, *objectp, tx));
 	memset(&ddt->ddt_object_stats[type][class], 0, sizeof (ddt_object_t));
@@ -245,7 +282,7 @@ ddt_object_load(ddt_t *ddt, ddt_type_t type, ddt_class_t class)
 
 	ddt_object_name(ddt, type, class, name);
 
-	error = zap_lookup(ddt->ddt_os, DMU_POOL_DIRECTORY_OBJECT, name,
+	error = zap_lookup(ddt->ddt_os, ddt->ddt_dir_object, name,
 	    sizeof (uint64_t), 1, &ddt->ddt_object[type][class]);
 	if (error != 0)
 		return (error);
@@ -315,7 +352,7 @@ ddt_object_lookup(ddt_t *ddt, ddt_type_t type, ddt_class_t class,
 
 	return (ddt_ops[type]->ddt_op_lookup(ddt->ddt_os,
 	    ddt->ddt_object[type][class], &dde->dde_key,
-	    dde->dde_phys, sizeof (dde->dde_phys)));
+	    dde->dde_phys, DDT_PHYS_SIZE(ddt)));
 }
 
 static int
@@ -358,7 +395,7 @@ ddt_object_update(ddt_t *ddt, ddt_type_t type, ddt_class_t class,
 
 	return (ddt_ops[type]->ddt_op_update(ddt->ddt_os,
 	    ddt->ddt_object[type][class], &dde->dde_key, dde->dde_phys,
-	    sizeof (dde->dde_phys), tx));
+	    DDT_PHYS_SIZE(ddt), tx));
 }
 
 static int
@@ -379,7 +416,7 @@ ddt_object_walk(ddt_t *ddt, ddt_type_t type, ddt_class_t class,
 
 	return (ddt_ops[type]->ddt_op_walk(ddt->ddt_os,
 	    ddt->ddt_object[type][class], walk, &dde->dde_key,
-	    dde->dde_phys, sizeof (dde->dde_phys)));
+	    dde->dde_phys, DDT_PHYS_SIZE(ddt)));
 }
 
 int
@@ -511,12 +548,24 @@ ddt_phys_free(ddt_t *ddt, ddt_key_t *ddk, ddt_phys_t *ddp, uint64_t txg)
 	zio_free(ddt->ddt_spa, txg, &blk);
 }
 
+/*
+ * Number of DVAs held by this phys. For encrypted blocks, the third DVA is
+ * the salt and IV, so doesn't count.
+ */
+int
+ddt_phys_dva_count(const ddt_phys_t *ddp, boolean_t encrypted)
+{
+	return (DVA_IS_VALID(&ddp->ddp_dva[0]) +
+	    DVA_IS_VALID(&ddp->ddp_dva[1]) +
+	    (DVA_IS_VALID(&ddp->ddp_dva[2]) && !encrypted));
+}
+
 ddt_phys_t *
-ddt_phys_select(const ddt_entry_t *dde, const blkptr_t *bp)
+ddt_phys_select(const ddt_t *ddt, const ddt_entry_t *dde, const blkptr_t *bp)
 {
 	ddt_phys_t *ddp = (ddt_phys_t *)dde->dde_phys;
 
-	for (int p = 0; p < DDT_PHYS_TYPES; p++, ddp++) {
+	for (int p = 0; p < DDT_NPHYS(ddt); p++, ddp++) {
 		if (DVA_EQUAL(BP_IDENTITY(bp), &ddp->ddp_dva[0]) &&
 		    BP_GET_BIRTH(bp) == ddp->ddp_phys_birth)
 			return (ddp);
@@ -524,13 +573,19 @@ ddt_phys_select(const ddt_entry_t *dde, const blkptr_t *bp)
 	return (NULL);
 }
 
+/*
+ * Total references held by an entry's phys array, not counting any old ditto
+ * copies.
+ */
 uint64_t
-ddt_phys_total_refcnt(const ddt_entry_t *dde)
+ddt_phys_total_refcnt(const ddt_t *ddt, const ddt_phys_t *ddp)
 {
 	uint64_t refcnt = 0;
 
-	for (int p = DDT_PHYS_SINGLE; p <= DDT_PHYS_TRIPLE; p++)
-		refcnt += dde->dde_phys[p].ddp_refcnt;
+	for (int p = 0; p < DDT_NPHYS(ddt); p++) {
+		if (!DDT_PHYS_IS_DITTO(ddt, p))
+			refcnt += ddp[p].ddp_refcnt;
+	}
 
 	return (refcnt);
 }
@@ -561,11 +616,15 @@ ddt_init(void)
 	    sizeof (ddt_t), 0, NULL, NULL, NULL, NULL, NULL, 0);
 	ddt_entry_cache = kmem_cache_create("ddt_entry_cache",
 	    sizeof (ddt_entry_t), 0, NULL, NULL, NULL, NULL, NULL, 0);
+
+	ddt_log_init();
 }
 
 void
 ddt_fini(void)
 {
+	ddt_log_fini();
+
 	kmem_cache_destroy(ddt_entry_cache);
 	kmem_cache_destroy(ddt_cache);
 }
@@ -684,6 +743,30 @@ ddt_prefetch_all(spa_t *spa)
 	}
 }
 
+/*
+ * Decide what sort of table a table that has never been written to will be.
+ * If the pool has the fast_dedup feature, it will be a flat, logged table with
+ * its own directory object, which is created when it is first synced (see
+ * ddt_create_dir()). Otherwise, it is a legacy table, stored directly on the
+ * MOS directory.
+ */
+static void
+ddt_configure(ddt_t *ddt)
+{
+	ASSERT3U(ddt->ddt_version, ==, DDT_VERSION_UNCONFIGURED);
+	ASSERT0(ddt->ddt_dir_object);
+	ASSERT0(avl_numnodes(&ddt->ddt_tree));
+
+	if (spa_feature_is_enabled(ddt->ddt_spa, SPA_FEATURE_FAST_DEDUP)) {
+		ddt->ddt_version = DDT_VERSION_FDT;
+		ddt->ddt_flags = DDT_FLAG_LOG | DDT_FLAG_FLAT;
+	} else {
+		ddt->ddt_version = DDT_VERSION_LEGACY;
+		ddt->ddt_flags = 0;
+		ddt->ddt_dir_object = DMU_POOL_DIRECTORY_OBJECT;
+	}
+}
+
 ddt_entry_t *
 ddt_lookup(ddt_t *ddt, const blkptr_t *bp, boolean_t add)
 {
@@ -693,6 +776,7 @@ ddt_lookup(ddt_t *ddt, const blkptr_t *bp, boolean_t add)
 	ddt_type_t type;
 	ddt_class_t class;
 	avl_index_t where;
+	boolean_t found;
 	int error;
 
 	ASSERT(MUTEX_HELD(&ddt->ddt_lock));
@@ -732,8 +816,51 @@ ddt_lookup(ddt_t *ddt, const blkptr_t *bp, boolean_t add)
 	if (!add)
 		return (NULL);
 
+	/*
+	 * First entry for a table that's never been written to. Decide what
+	 * sort of table it's going to be now, as that sets the entry format.
+	 */
+	if (ddt->ddt_version == DDT_VERSION_UNCONFIGURED)
+		ddt_configure(ddt);
+
 	/* Time to make a new entry. */
 	dde = ddt_alloc(&search);
+
+	/*
+	 * If the entry is on the log, that's the most recent version of it,
+	 * and we can take it as-is without going to the storage objects.
+	 */
+	if (ddt->ddt_flags & DDT_FLAG_LOG) {
+		ddt_log_entry_t *ddle;
+		boolean_t flushing;
+
+		ddle = ddt_log_find_key(ddt, &search, &flushing);
+		if (ddle != NULL) {
+			memcpy(dde->dde_phys, ddle->ddle_phys,
+			    DDT_PHYS_SIZE(ddt));
+			dde->dde_type = ddle->ddle_type;
+			dde->dde_class = ddle->ddle_class;
+			dde->dde_flags |= DDE_FLAG_LOGGED;
+			if (flushing)
+				dde->dde_flags |= DDE_FLAG_FROM_FLUSHING;
+
+			/*
+			 * A zero refcount is a "tombstone", an entry that was
+			 * freed while on the log. It doesn't exist, but still
+			 * has to go through sync so its old storage location
+			 * gets cleaned up.
+			 */
+			found = ddt_phys_total_refcnt(ddt, dde->dde_phys) > 0;
+			if (found)
+				ddt_histogram_sub_entry(ddt,
+				    &ddt->ddt_log_histogram, &dde->dde_key,
+				    dde->dde_phys);
+
+			avl_insert(&ddt->ddt_tree, dde, where);
+			goto loaded;
+		}
+	}
+
 	avl_insert(&ddt->ddt_tree, dde, where);
 
 	/*
@@ -764,9 +891,12 @@ ddt_lookup(ddt_t *ddt, const blkptr_t *bp, boolean_t add)
 	dde->dde_type = type;	/* will be DDT_TYPES if no entry found */
 	dde->dde_class = class;	/* will be DDT_CLASSES if no entry found */
 
-	if (dde->dde_type == DDT_TYPES &&
-	    dde->dde_class == DDT_CLASSES &&
-	    ddt_over_quota(spa)) {
+	found = (error == 0);
+	if (found)
+		ddt_stat_update(ddt, dde, -1ULL);
+
+loaded:
+	if (!found && ddt_over_quota(spa)) {
 		/* Over quota. If no one is waiting, clean up right now. */
 		if (dde->dde_waiters == 0) {
 			avl_remove(&ddt->ddt_tree, dde);
@@ -776,8 +906,6 @@ ddt_lookup(ddt_t *ddt, const blkptr_t *bp, boolean_t add)
 
 		/* Flag cleanup required */
 		dde->dde_flags |= DDE_FLAG_OVERQUOTA;
-	} else if (error == 0) {
-		ddt_stat_update(ddt, dde, -1ULL);
 	}
 
 	/* Entry loaded, everyone can proceed now */
@@ -853,6 +981,9 @@ ddt_table_alloc(spa_t *spa, enum zio_checksum c)
 	ddt->ddt_checksum = c;
 	ddt->ddt_spa = spa;
 	ddt->ddt_os = spa->spa_meta_objset;
+	ddt->ddt_version = DDT_VERSION_UNCONFIGURED;
+
+	ddt_log_alloc(ddt);
 
 	return (ddt);
 }
@@ -860,6 +991,7 @@ ddt_table_alloc(spa_t *spa, enum zio_checksum c)
 static void
 ddt_table_free(ddt_t *ddt)
 {
+	ddt_log_free(ddt);
 	ASSERT0(avl_numnodes(&ddt->ddt_tree));
 	ASSERT0(avl_numnodes(&ddt->ddt_repair_tree));
 	avl_destroy(&ddt->ddt_tree);
@@ -879,6 +1011,163 @@ ddt_create(spa_t *spa)
 	}
 }
 
+static void
+ddt_dir_name(ddt_t *ddt, char *name)
+{
+	(void) snprintf(name, DDT_NAMELEN, DMU_POOL_DDT_DIR,
+	    zio_checksum_table[ddt->ddt_checksum].ci_name);
+}
+
+/*
+ * Create the on-disk directory and logs for a new FDT table, the first time
+ * it has something to store.
+ */
+static void
+ddt_create_dir(ddt_t *ddt, dmu_tx_t *tx)
+{
+	spa_t *spa = ddt->ddt_spa;
+	char name[DDT_NAMELEN];
+
+	ASSERT3U(ddt->ddt_version, ==, DDT_VERSION_FDT);
+	ASSERT0(ddt->ddt_dir_object);
+
+	ddt_dir_name(ddt, name);
+	ddt->ddt_dir_object = zap_create_link(ddt->ddt_os,
+	    DMU_OTN_ZAP_METADATA, DMU_POOL_DIRECTORY_OBJECT, name, tx);
+
+	VERIFY0(zap_add(ddt->ddt_os, ddt->ddt_dir_object, DDT_DIR_VERSION,
+	    sizeof (uint64_t), 1, &ddt->ddt_version, tx));
+	VERIFY0(zap_add(ddt->ddt_os, ddt->ddt_dir_object, DDT_DIR_FLAGS,
+	    sizeof (uint64_t), 1, &ddt->ddt_flags, tx));
+
+	ddt_log_create(ddt, tx);
+
+	spa_feature_incr(spa, SPA_FEATURE_FAST_DEDUP, tx);
+}
+
+/*
+ * Tear down a table that has no entries left anywhere, so that it can be
+ * configured afresh the next time it is written to.
+ */
+static void
+ddt_unconfigure(ddt_t *ddt, dmu_tx_t *tx)
+{
+	char name[DDT_NAMELEN];
+
+	for (ddt_type_t type = 0; type < DDT_TYPES; type++)
+		for (ddt_class_t class = 0; class < DDT_CLASSES; class++)
+			ASSERT(!ddt_object_exists(ddt, type, class));
+
+	if (ddt->ddt_version == DDT_VERSION_FDT && ddt->ddt_dir_object != 0) {
+		ddt_log_destroy(ddt, tx);
+
+		ddt_dir_name(ddt, name);
+		VERIFY0(zap_remove(ddt->ddt_os, DMU_POOL_DIRECTORY_OBJECT,
+		    name, tx));
+		VERIFY0(zap_destroy(ddt->ddt_os, ddt->ddt_dir_object, tx));
+
+		spa_feature_decr(ddt->ddt_spa, SPA_FEATURE_FAST_DEDUP, tx);
+	}
+
+	ddt->ddt_version = DDT_VERSION_UNCONFIGURED;
+	ddt->ddt_flags = 0;
+	ddt->ddt_dir_object = 0;
+}
+
+/*
+ * Work out what sort of table this is from what's on disk. Returns ENOENT if
+ * the table has never been written to.
+ */
+static int
+ddt_table_load_config(ddt_t *ddt)
+{
+	spa_t *spa = ddt->ddt_spa;
+	objset_t *os = ddt->ddt_os;
+	char name[DDT_NAMELEN];
+	uint64_t obj;
+	int error;
+
+	ddt_dir_name(ddt, name);
+	error = zap_lookup(os, DMU_POOL_DIRECTORY_OBJECT, name,
+	    sizeof (uint64_t), 1, &obj);
+	if (error == 0) {
+		if (!spa_feature_is_active(spa, SPA_FEATURE_FAST_DEDUP))
+			return (SET_ERROR(EINVAL));
+
+		error = zap_lookup(os, obj, DDT_DIR_VERSION,
+		    sizeof (uint64_t), 1, &ddt->ddt_version);
+		if (error != 0)
+			return (error);
+		error = zap_lookup(os, obj, DDT_DIR_FLAGS,
+		    sizeof (uint64_t), 1, &ddt->ddt_flags);
+		if (error != 0)
+			return (error);
+
+		if (ddt->ddt_version != DDT_VERSION_FDT ||
+		    (ddt->ddt_flags & ~DDT_FLAG_MASK) != 0)
+			return (SET_ERROR(EINVAL));
+
+		ddt->ddt_dir_object = obj;
+		return (0);
+	}
+	if (error != ENOENT)
+		return (error);
+
+	/* No directory; this is either a legacy table, or a new one. */
+	for (ddt_type_t type = 0; type < DDT_TYPES; type++) {
+		for (ddt_class_t class = 0; class < DDT_CLASSES; class++) {
+			ddt_object_name(ddt, type, class, name);
+			error = zap_contains(os, DMU_POOL_DIRECTORY_OBJECT,
+			    name);
+			if (error == 0) {
+				ddt->ddt_version = DDT_VERSION_LEGACY;
+				ddt->ddt_flags = 0;
+				ddt->ddt_dir_object =
+				    DMU_POOL_DIRECTORY_OBJECT;
+				return (0);
+			}
+			if (error != ENOENT)
+				return (error);
+		}
+	}
+
+	return (SET_ERROR(ENOENT));
+}
+
+static int
+ddt_table_load(ddt_t *ddt)
+{
+	int error;
+
+	error = ddt_table_load_config(ddt);
+	if (error != 0)
+		return (error == ENOENT ? 0 : error);
+
+	for (ddt_type_t type = 0; type < DDT_TYPES; type++) {
+		for (ddt_class_t class = 0; class < DDT_CLASSES; class++) {
+			error = ddt_object_load(ddt, type, class);
+			if (error != 0 && error != ENOENT)
+				return (error);
+		}
+	}
+
+	if (ddt->ddt_flags & DDT_FLAG_LOG) {
+		error = ddt_log_load(ddt);
+		if (error != 0)
+			return (error);
+	}
+
+	/*
+	 * Seed the cached histograms.
+	 */
+	memcpy(&ddt->ddt_histogram_cache, ddt->ddt_histogram,
+	    sizeof (ddt->ddt_histogram));
+	memcpy(&ddt->ddt_log_histogram_cache, &ddt->ddt_log_histogram,
+	    sizeof (ddt->ddt_log_histogram));
+
+	return (0);
+}
+
 int
 ddt_load(spa_t *spa)
 {
@@ -897,25 +1186,14 @@ ddt_load(spa_t *spa)
 		if (!DDT_CHECKSUM_VALID(c))
 			continue;
 
-		ddt_t *ddt = spa->spa_ddt[c];
-		for (ddt_type_t type = 0; type < DDT_TYPES; type++) {
-			for (ddt_class_t class = 0; class < DDT_CLASSES;
-			    class++) {
-				error = ddt_object_load(ddt, type, class);
-				if (error != 0 && error != ENOENT)
-					return (error);
-			}
-		}
-
-		/*
-		 * Seed the cached histograms.
-		 */
-		memcpy(&ddt->ddt_histogram_cache, ddt->ddt_histogram,
-		    sizeof (ddt->ddt_histogram));
-		spa->spa_dedup_dspace = ~0ULL;
-		spa->spa_dedup_dsize = ~0ULL;
+		error = ddt_table_load(spa->spa_ddt[c]);
+		if (error != 0)
+			return (error);
 	}
 
+	spa->spa_dedup_dspace = ~0ULL;
+	spa->spa_dedup_dsize = ~0ULL;
+
 	return (0);
 }
 
@@ -939,13 +1217,23 @@ ddt_class_contains(spa_t *spa, ddt_class_t max_class, const blkptr_t *bp)
 	if (!BP_GET_DEDUP(bp))
 		return (B_FALSE);
 
-	if (max_class == DDT_CLASS_UNIQUE)
-		return (B_TRUE);
-
 	ddt = spa->spa_ddt[BP_GET_CHECKSUM(bp)];
 
+	/*
+	 * Every dedup block has an entry, unless it was pruned. Only flat
+	 * tables can be pruned, so for those we have to look.
+	 */
+	if (max_class == DDT_CLASS_UNIQUE && !(ddt->ddt_flags & DDT_FLAG_FLAT))
+		return (B_TRUE);
+
 	ddt_key_fill(&ddk, bp);
 
+	/*
+	 * This only looks at the storage objects, not the log. That's fine for
+	 * the scan, since the class of an entry only changes for scan purposes
+	 * when the log is flushed, and ddt_sync_flush_entry() notifies the
+	 * scan then.
+	 */
 	for (ddt_type_t type = 0; type < DDT_TYPES; type++) {
 		for (ddt_class_t class = 0; class <= max_class; class++) {
 			if (ddt_object_contains(ddt, type, class, &ddk) == 0)
@@ -966,6 +1254,21 @@ ddt_repair_start(ddt_t *ddt, const blkptr_t *bp)
 
 	dde = ddt_alloc(&ddk);
 
+	/* The log has the most recent version of the entry, if any. */
+	if (ddt->ddt_flags & DDT_FLAG_LOG) {
+		ddt_log_entry_t *ddle;
+
+		ddt_enter(ddt);
+		ddle = ddt_log_find_key(ddt, &ddk, NULL);
+		if (ddle != NULL)
+			memcpy(dde->dde_phys, ddle->ddle_phys,
+			    DDT_PHYS_SIZE(ddt));
+		ddt_exit(ddt);
+
+		if (ddle != NULL)
+			return (dde);
+	}
+
 	for (ddt_type_t type = 0; type < DDT_TYPES; type++) {
 		for (ddt_class_t class = 0; class < DDT_CLASSES; class++) {
 			/*
@@ -1021,7 +1324,7 @@ ddt_repair_entry(ddt_t *ddt, ddt_entry_t *dde, ddt_entry_t *rdde, zio_t *rio)
 	zio = zio_null(rio, rio->io_spa, NULL,
 	    ddt_repair_entry_done, rdde, rio->io_flags);
 
-	for (int p = 0; p < DDT_PHYS_TYPES; p++, ddp++, rddp++) {
+	for (int p = 0; p < DDT_NPHYS(ddt); p++, ddp++, rddp++) {
 		if (ddp->ddp_phys_birth == 0 ||
 		    ddp->ddp_phys_birth != rddp->ddp_phys_birth ||
 		    memcmp(ddp->ddp_dva, rddp->ddp_dva, sizeof (ddp->ddp_dva)))
@@ -1060,27 +1363,24 @@ ddt_repair_table(ddt_t *ddt, zio_t *rio)
 	ddt_exit(ddt);
 }
 
-static void
-ddt_sync_entry(ddt_t *ddt, ddt_entry_t *dde, dmu_tx_t *tx, uint64_t txg)
+/*
+ * Free any phys on the entry that are no longer referenced (or are the old
+ * ditto copies), and return the entry's remaining refcount.
+ */
+static uint64_t
+ddt_sync_entry_phys(ddt_t *ddt, ddt_entry_t *dde, uint64_t txg)
 {
-	dsl_pool_t *dp = ddt->ddt_spa->spa_dsl_pool;
 	ddt_phys_t *ddp = dde->dde_phys;
 	ddt_key_t *ddk = &dde->dde_key;
-	ddt_type_t otype = dde->dde_type;
-	ddt_type_t ntype = DDT_TYPE_DEFAULT;
-	ddt_class_t oclass = dde->dde_class;
-	ddt_class_t nclass;
 	uint64_t total_refcnt = 0;
 
-	ASSERT(dde->dde_flags & DDE_FLAG_LOADED);
-
-	for (int p = 0; p < DDT_PHYS_TYPES; p++, ddp++) {
+	for (int p = 0; p < DDT_NPHYS(ddt); p++, ddp++) {
 		ASSERT3P(dde->dde_lead_zio[p], ==, NULL);
 		if (ddp->ddp_phys_birth == 0) {
 			ASSERT0(ddp->ddp_refcnt);
 			continue;
 		}
-		if (p == DDT_PHYS_DITTO) {
+		if (DDT_PHYS_IS_DITTO(ddt, p)) {
 			/*
 			 * Note, we no longer create DDT-DITTO blocks, but we
 			 * don't want to leak any written by older software.
@@ -1094,7 +1394,29 @@ ddt_sync_entry(ddt_t *ddt, ddt_entry_t *dde, dmu_tx_t *tx, uint64_t txg)
 	}
 
 	/* We do not create new DDT-DITTO blocks. */
-	ASSERT0(dde->dde_phys[DDT_PHYS_DITTO].ddp_phys_birth);
+	IMPLY(!(ddt->ddt_flags & DDT_FLAG_FLAT),
+	    dde->dde_phys[DDT_PHYS_DITTO].ddp_phys_birth == 0);
+
+	/* Note when the entry last changed, for pruning. */
+	if (ddt->ddt_flags & DDT_FLAG_FLAT)
+		dde->dde_flat.ddf_class_start = gethrestime_sec();
+
+	return (total_refcnt);
+}
+
+/*
+ * Move an entry from its old storage object (if any) to the one it belongs
+ * in now, or just remove it if it is no longer referenced.
+ */
+static void
+ddt_sync_entry_store(ddt_t *ddt, ddt_entry_t *dde, ddt_type_t otype,
+    ddt_class_t oclass, uint64_t total_refcnt, dmu_tx_t *tx)
+{
+	dsl_pool_t *dp = ddt->ddt_spa->spa_dsl_pool;
+	ddt_key_t *ddk = &dde->dde_key;
+	ddt_type_t ntype = DDT_TYPE_DEFAULT;
+	ddt_class_t nclass;
+
 	if (total_refcnt > 1)
 		nclass = DDT_CLASS_DUPLICATE;
 	else
@@ -1129,14 +1451,160 @@ ddt_sync_entry(ddt_t *ddt, ddt_entry_t *dde, dmu_tx_t *tx, uint64_t txg)
 	}
 }
 
+static void
+ddt_sync_entry(ddt_t *ddt, ddt_entry_t *dde, dmu_tx_t *tx, uint64_t txg)
+{
+	uint64_t total_refcnt;
+
+	ASSERT(dde->dde_flags & DDE_FLAG_LOADED);
+	ASSERT(!(dde->dde_flags & DDE_FLAG_LOGGED));
+
+	total_refcnt = ddt_sync_entry_phys(ddt, dde, txg);
+	ddt_sync_entry_store(ddt, dde, dde->dde_type, dde->dde_class,
+	    total_refcnt, tx);
+}
+
+/*
+ * Append a live entry to the active log, rather than writing it to its
+ * storage object.
+ */
+static void
+ddt_sync_entry_log(ddt_t *ddt, ddt_entry_t *dde, ddt_log_update_t *dlu,
+    uint64_t txg)
+{
+	uint64_t total_refcnt;
+
+	ASSERT(dde->dde_flags & DDE_FLAG_LOADED);
+
+	total_refcnt = ddt_sync_entry_phys(ddt, dde, txg);
+
+	/*
+	 * The new version is going on the active log, so the old one on the
+	 * flushing log must not be written back.
+	 */
+	if (dde->dde_flags & DDE_FLAG_FROM_FLUSHING) {
+		ddt_enter(ddt);
+		VERIFY(ddt_log_remove_key(ddt, ddt->ddt_log_flushing,
+		    &dde->dde_key));
+		ddt_exit(ddt);
+	}
+
+	/*
+	 * An entry that was never stored or logged and has no references is
+	 * a write that didn't happen; there's nothing to record. Anything
+	 * else, even with no references, has to be logged so that its old
+	 * version is cleaned up.
+	 */
+	if (total_refcnt == 0 && dde->dde_type == DDT_TYPES &&
+	    !(dde->dde_flags & DDE_FLAG_LOGGED))
+		return;
+
+	ddt_histogram_add_entry(ddt, &ddt->ddt_log_histogram, &dde->dde_key,
+	    dde->dde_phys);
+	ddt_log_entry(ddt, dde, dlu);
+}
+
+/*
+ * Write back a single entry from the flushing log to its storage object.
+ */
+static void
+ddt_sync_flush_entry(ddt_t *ddt, ddt_log_entry_t *ddle, dmu_tx_t *tx)
+{
+	ddt_entry_t dde = {{{{0}}}};
+	uint64_t total_refcnt;
+
+	dde.dde_key = ddle->ddle_key;
+	memcpy(dde.dde_phys, ddle->ddle_phys, DDT_PHYS_SIZE(ddt));
+
+	total_refcnt = ddt_phys_total_refcnt(ddt, dde.dde_phys);
+
+	ddt_histogram_sub_entry(ddt, &ddt->ddt_log_histogram, &dde.dde_key,
+	    dde.dde_phys);
+	ddt_sync_entry_store(ddt, &dde, ddle->ddle_type, ddle->ddle_class,
+	    total_refcnt, tx);
+}
+
+/*
+ * Write back some of the flushing log, and if it is now empty, truncate it
+ * and swap the logs if the active log is ready to be flushed.
+ */
+static void
+ddt_sync_flush_log(ddt_t *ddt, dmu_tx_t *tx)
+{
+	ddt_log_t *ddl = ddt->ddt_log_flushing;
+	ddt_log_entry_t *ddle;
+	ddt_key_t last;
+	uint64_t count;
+
+	/* Over the memory limit, so get the whole flushing log out. */
+	count = ddt_log_over_mem(ddt) ? UINT64_MAX : ddt->ddt_flush_count;
+
+	if (count > 0 && avl_numnodes(&ddl->ddl_tree) > 0) {
+		while (count-- > 0 &&
+		    (ddle = avl_first(&ddl->ddl_tree)) != NULL) {
+			ddt_sync_flush_entry(ddt, ddle, tx);
+			last = ddle->ddle_key;
+
+			ddt_enter(ddt);
+			ddt_log_remove_entry(ddt, ddl, ddle);
+			ddt_exit(ddt);
+		}
+		ddt_log_checkpoint(ddt, &last, tx);
+	}
+
+	if (avl_numnodes(&ddl->ddl_tree) == 0 && ddl->ddl_length > 0)
+		ddt_log_truncate(ddt, tx);
+
+	if (ddt_log_swap_ready(ddt, tx->tx_txg))
+		ddt_log_swap(ddt, tx);
+}
+
+/*
+ * True if there's work to do on the log this txg, even with no live entries.
+ */
+static boolean_t
+ddt_sync_flush_pending(ddt_t *ddt, uint64_t txg)
+{
+	ddt_log_t *ddl = ddt->ddt_log_flushing;
+
+	if (!(ddt->ddt_flags & DDT_FLAG_LOG) ||
+	    spa_sync_pass(ddt->ddt_spa) > 1)
+		return (B_FALSE);
+
+	/*
+	 * Like spa_flush_metaslabs(), only flush in txgs that are writing
+	 * something anyway, so an idle pool stays idle and the empty txgs
+	 * at export stay empty (see spa_final_dirty_txg()).
+	 */
+	if (BP_GET_LOGICAL_BIRTH(&ddt->ddt_spa->spa_uberblock.ub_rootbp) <
+	    txg && !dmu_objset_is_dirty(ddt->ddt_os, txg))
+		return (B_FALSE);
+
+	return (avl_numnodes(&ddl->ddl_tree) > 0 || ddl->ddl_length > 0 ||
+	    ddt_log_swap_ready(ddt, txg));
+}
+
+static boolean_t
+ddt_tree_has_refs(ddt_t *ddt)
+{
+	for (ddt_entry_t *dde = avl_first(&ddt->ddt_tree); dde != NULL;
+	    dde = AVL_NEXT(&ddt->ddt_tree, dde)) {
+		if (ddt_phys_total_refcnt(ddt, dde->dde_phys) > 0)
+			return (B_TRUE);
+	}
+	return (B_FALSE);
+}
+
 static void
 ddt_sync_table(ddt_t *ddt, dmu_tx_t *tx, uint64_t txg)
 {
 	spa_t *spa = ddt->ddt_spa;
 	ddt_entry_t *dde;
 	void *cookie = NULL;
+	boolean_t empty = B_TRUE;
 
-	if (avl_numnodes(&ddt->ddt_tree) == 0)
+	if (avl_numnodes(&ddt->ddt_tree) == 0 &&
+	    !ddt_sync_flush_pending(ddt, txg))
 		return;
 
 	ASSERT3U(spa->spa_uberblock.ub_version, >=, SPA_VERSION_DEDUP);
@@ -1147,9 +1615,37 @@ ddt_sync_table(ddt_t *ddt, dmu_tx_t *tx, uint64_t txg)
 		    DMU_POOL_DDT_STATS, tx);
 	}
 
-	while ((dde = avl_destroy_nodes(&ddt->ddt_tree, &cookie)) != NULL) {
-		ddt_sync_entry(ddt, dde, tx, txg);
-		ddt_free(dde);
+	/*
+	 * Nothing has been stored in this new table yet. If there's anything
+	 * to store now, set it up on disk. If not, the entries are only here
+	 * to have their unreferenced blocks freed, which the legacy path
+	 * handles.
+	 */
+	if (ddt->ddt_version == DDT_VERSION_FDT &&
+	    ddt->ddt_dir_object == 0 && ddt_tree_has_refs(ddt))
+		ddt_create_dir(ddt, tx);
+
+	if ((ddt->ddt_flags & DDT_FLAG_LOG) && ddt->ddt_dir_object != 0) {
+		if (avl_numnodes(&ddt->ddt_tree) > 0) {
+			ddt_log_update_t dlu = {0};
+
+			ddt_log_begin(ddt, tx, &dlu);
+			while ((dde = avl_destroy_nodes(&ddt->ddt_tree,
+			    &cookie)) != NULL) {
+				ddt_sync_entry_log(ddt, dde, &dlu, txg);
+				ddt_free(dde);
+			}
+			ddt_log_commit(ddt, &dlu);
+		}
+
+		if (spa_sync_pass(spa) == 1)
+			ddt_sync_flush_log(ddt, tx);
+	} else {
+		while ((dde = avl_destroy_nodes(&ddt->ddt_tree,
+		    &cookie)) != NULL) {
+			ddt_sync_entry(ddt, dde, tx, txg);
+			ddt_free(dde);
+		}
 	}
 
 	for (ddt_type_t type = 0; type < DDT_TYPES; type++) {
@@ -1165,11 +1661,20 @@ ddt_sync_table(ddt_t *ddt, dmu_tx_t *tx, uint64_t txg)
 		for (ddt_class_t class = 0; class < DDT_CLASSES; class++) {
 			if (count == 0 && ddt_object_exists(ddt, type, class))
 				ddt_object_destroy(ddt, type, class, tx);
+			if (ddt_object_exists(ddt, type, class))
+				empty = B_FALSE;
 		}
 	}
 
+	/* Nothing left anywhere, so clean up the table itself. */
+	if (ddt->ddt_version != DDT_VERSION_UNCONFIGURED && empty &&
+	    ddt_log_empty(ddt))
+		ddt_unconfigure(ddt, tx);
+
 	memcpy(&ddt->ddt_histogram_cache, ddt->ddt_histogram,
 	    sizeof (ddt->ddt_histogram));
+	memcpy(&ddt->ddt_log_histogram_cache, &ddt->ddt_log_histogram,
+	    sizeof (ddt->ddt_log_histogram));
 	spa->spa_dedup_dspace = ~0ULL;
 	spa->spa_dedup_dsize = ~0ULL;
 }
@@ -1211,6 +1716,31 @@ ddt_sync(spa_t *spa, uint64_t txg)
 	dmu_tx_commit(tx);
 }
 
+/*
+ * If the entry just walked from a storage object has a newer version on the
+ * log, use that instead. Returns B_FALSE if the entry has been freed since
+ * it was stored, and should be skipped.
+ */
+static boolean_t
+ddt_walk_log_entry(ddt_t *ddt, ddt_entry_t *dde)
+{
+	ddt_log_entry_t *ddle;
+	boolean_t found = B_TRUE;
+
+	if (!(ddt->ddt_flags & DDT_FLAG_LOG))
+		return (B_TRUE);
+
+	ddt_enter(ddt);
+	ddle = ddt_log_find_key(ddt, &dde->dde_key, NULL);
+	if (ddle != NULL) {
+		memcpy(dde->dde_phys, ddle->ddle_phys, DDT_PHYS_SIZE(ddt));
+		found = ddt_phys_total_refcnt(ddt, dde->dde_phys) > 0;
+	}
+	ddt_exit(ddt);
+
+	return (found);
+}
+
 int
 ddt_walk(spa_t *spa, ddt_bookmark_t *ddb, ddt_entry_t *dde)
 {
@@ -1223,9 +1753,13 @@ ddt_walk(spa_t *spa, ddt_bookmark_t *ddb, ddt_entry_t *dde)
 				int error = ENOENT;
 				if (ddt_object_exists(ddt, ddb->ddb_type,
 				    ddb->ddb_class)) {
-					error = ddt_object_walk(ddt,
-					    ddb->ddb_type, ddb->ddb_class,
-					    &ddb->ddb_cursor, dde);
+					do {
+						error = ddt_object_walk(ddt,
+						    ddb->ddb_type,
+						    ddb->ddb_class,
+						    &ddb->ddb_cursor, dde);
+					} while (error == 0 &&
+					    !ddt_walk_log_entry(ddt, dde));
 				}
 				dde->dde_type = ddb->ddb_type;
 				dde->dde_class = ddb->ddb_class;
@@ -1248,8 +1782,7 @@ ddt_walk(spa_t *spa, ddt_bookmark_t *ddb, ddt_entry_t *dde)
  * counter for the DDT entry if the block is already in DDT.
  *
  * Return false if the block, despite having the D bit set, is not present
- * in the DDT. Currently this is not possible but might be in the future.
- * See the comment below.
+ * in the DDT. This happens if its entry was pruned.
  */
 boolean_t
 ddt_addref(spa_t *spa, const blkptr_t *bp)
@@ -1271,12 +1804,21 @@ ddt_addref(spa_t *spa, const blkptr_t *bp)
 		return (B_FALSE);
 	}
 
-	if (dde->dde_type < DDT_TYPES) {
-		ddt_phys_t *ddp;
-
-		ASSERT3S(dde->dde_class, <, DDT_CLASSES);
+	/*
+	 * A logged entry always has a real type and class if it was ever
+	 * stored, even if it has since been freed, so for those the refcount
+	 * is what says whether it exists. Even if the entry exists, it may be
+	 * for a newer copy of the data, written after this block's entry was
+	 * pruned, so it has to be this block's phys.
+	 */
+	boolean_t exists = (dde->dde_flags & DDE_FLAG_LOGGED) ?
+	    ddt_phys_total_refcnt(ddt, dde->dde_phys) > 0 :
+	    dde->dde_type < DDT_TYPES;
+	ddt_phys_t *ddp = exists ? ddt_phys_select(ddt, dde, bp) : NULL;
 
-		ddp = &dde->dde_phys[BP_GET_NDVAS(bp)];
+	if (ddp != NULL) {
+		ASSERT((dde->dde_flags & DDE_FLAG_LOGGED) ||
+		    dde->dde_class < DDT_CLASSES);
 
 		/*
 		 * This entry already existed (dde_type is real), so it must
@@ -1292,18 +1834,22 @@ ddt_addref(spa_t *spa, const blkptr_t *bp)
 
 		ddt_phys_addref(ddp);
 		result = B_TRUE;
-	} else {
+	} else if (!exists) {
 		/*
-		 * At the time of implementating this if the block has the
-		 * DEDUP flag set it must exist in the DEDUP table, but
-		 * there are many advocates that want ability to remove
-		 * entries from DDT with refcnt=1. If this will happen,
-		 * we may have a block with the DEDUP set, but which doesn't
-		 * have a corresponding entry in the DDT. Be ready.
+		 * The block has the DEDUP flag set, but its entry was pruned
+		 * (see ddt_prune_unique_entries()), so it doesn't have one.
+		 * The caller will track it some other way.
 		 */
-		ASSERT3S(dde->dde_class, ==, DDT_CLASSES);
+		ASSERT((dde->dde_flags & DDE_FLAG_LOGGED) ||
+		    dde->dde_class == DDT_CLASSES);
 		ddt_remove(ddt, dde);
 		result = B_FALSE;
+	} else {
+		/*
+		 * The entry is for a newer copy of the data. It's still live,
+		 * so leave it be.
+		 */
+		result = B_FALSE;
 	}
 
 	ddt_exit(ddt);
@@ -1312,5 +1858,188 @@ ddt_addref(spa_t *spa, const blkptr_t *bp)
 	return (result);
 }
 
+/*
+ * An entry found by ddt_prune_unique_entries() that is old enough to prune.
+ * The walk is done in open context, so these are only candidates; each one is
+ * checked again in syncing context before it is removed.
+ */
+typedef struct {
+	ddt_t		*dpc_ddt;
+	ddt_key_t	dpc_key;
+	ddt_phys_t	dpc_phys;
+	list_node_t	dpc_node;
+} ddt_prune_candidate_t;
+
+typedef struct {
+	list_t		dpa_candidates;
+	ddt_object_t	*dpa_freed;
+} ddt_prune_arg_t;
+
+static void
+ddt_prune_sync(void *arg, dmu_tx_t *tx)
+{
+	(void) tx;
+	ddt_prune_arg_t *dpa = arg;
+	ddt_prune_candidate_t *dpc;
+
+	while ((dpc = list_remove_head(&dpa->dpa_candidates)) != NULL) {
+		ddt_t *ddt = dpc->dpc_ddt;
+		spa_t *spa = ddt->ddt_spa;
+		ddt_entry_t *dde;
+		ddt_phys_t *ddp;
+		blkptr_t blk;
+
+		spa_config_enter(spa, SCL_ZIO, FTAG, RW_READER);
+		ddt_enter(ddt);
+
+		/*
+		 * If it's already live, something is using it this txg, so
+		 * it isn't stale after all.
+		 */
+		if (avl_find(&ddt->ddt_tree, &dpc->dpc_key, NULL) != NULL)
+			goto next;
+
+		ddt_bp_create(ddt->ddt_checksum, &dpc->dpc_key, &dpc->dpc_phys,
+		    &blk);
+
+		/*
+		 * Since the walk, the entry may have been updated through the
+		 * log, or freed and written again. Only an entry still in the
+		 * unique object with the same block can go.
+		 */
+		dde = ddt_lookup(ddt, &blk, B_TRUE);
+		if (dde == NULL || (dde->dde_flags & DDE_FLAG_LOGGED) ||
+		    dde->dde_class != DDT_CLASS_UNIQUE)
+			goto next;
+
+		ddp = ddt_phys_select(ddt, dde, &blk);
+		if (ddp == NULL || ddp->ddp_refcnt != 1)
+			goto next;
+
+		/*
+		 * With no phys, the entry goes away when it is synced, without
+		 * the block being freed.
+		 */
+		ddt_object_entry_space(ddt, dde->dde_type, dde->dde_class,
+		    dpa->dpa_freed);
+		ddt_phys_clear(ddp);
+
+next:
+		ddt_exit(ddt);
+		spa_config_exit(spa, SCL_ZIO, FTAG);
+
+		kmem_free(dpc, sizeof (ddt_prune_candidate_t));
+	}
+}
+
+static void
+ddt_prune_candidates_free(list_t *candidates)
+{
+	ddt_prune_candidate_t *dpc;
+
+	while ((dpc = list_remove_head(candidates)) != NULL)
+		kmem_free(dpc, sizeof (ddt_prune_candidate_t));
+}
+
+/*
+ * Remove all unique entries that have not changed in the last "age" seconds
+ * from the pool's flat tables. The blocks stay where they are; see "Pruning"
+ * above. The estimated space given back by the removed entries is returned
+ * in freed.
+ */
+int
+ddt_prune_unique_entries(spa_t *spa, uint64_t age, ddt_object_t *freed)
+{
+	ddt_prune_arg_t dpa;
+	ddt_entry_t dde = {{{{0}}}};
+	uint64_t now = gethrestime_sec();
+	uint64_t cutoff = (age < now) ? now - age : 0;
+	uint64_t ncandidates = 0;
+	int error = 0;
+
+	memset(freed, 0, sizeof (ddt_object_t));
+
+	if (atomic_cas_32(&spa->spa_ddt_prune_active, 0, 1) != 0)
+		return (SET_ERROR(EALREADY));
+
+	list_create(&dpa.dpa_candidates, sizeof (ddt_prune_candidate_t),
+	    offsetof(ddt_prune_candidate_t, dpc_node));
+	dpa.dpa_freed = freed;
+
+	for (enum zio_checksum c = 0; c < ZIO_CHECKSUM_FUNCTIONS; c++) {
+		ddt_t *ddt = spa->spa_ddt[c];
+		if (ddt == NULL || !(ddt->ddt_flags & DDT_FLAG_FLAT))
+			continue;
+
+		for (ddt_type_t type = 0; type < DDT_TYPES; type++) {
+			uint64_t walk = 0;
+
+			/*
+			 * The object can be destroyed under us if the table
+			 * empties, so check it is still there each time.
+			 */
+			while (error == 0 &&
+			    ddt_object_exists(ddt, type, DDT_CLASS_UNIQUE) &&
+			    ddt_object_walk(ddt, type, DDT_CLASS_UNIQUE, &walk,
+			    &dde) == 0) {
+				ddt_phys_t *ddp =
+				    &dde.dde_phys[DDT_PHYS_FLAT];
+				ddt_prune_candidate_t *dpc;
+				boolean_t logged;
+
+				if (issig()) {
+					error = SET_ERROR(EINTR);
+					break;
+				}
+
+				if (ddp->ddp_refcnt != 1 ||
+				    dde.dde_flat.ddf_class_start > cutoff)
+					continue;
+
+				/* A logged entry has changed since storing. */
+				ddt_enter(ddt);
+				logged = ddt_log_find_key(ddt, &dde.dde_key,
+				    NULL) != NULL;
+				ddt_exit(ddt);
+				if (logged)
+					continue;
+
+				dpc = kmem_alloc(sizeof (ddt_prune_candidate_t),
+				    KM_SLEEP);
+				dpc->dpc_ddt = ddt;
+				dpc->dpc_key = dde.dde_key;
+				dpc->dpc_phys = *ddp;
+				list_insert_tail(&dpa.dpa_candidates, dpc);
+
+				if (++ncandidates >= zfs_dedup_prune_txg_max) {
+					error = dsl_sync_task(spa_name(spa),
+					    NULL, ddt_prune_sync, &dpa, 0,
+					    ZFS_SPACE_CHECK_NONE);
+					ncandidates = 0;
+				}
+			}
+		}
+	}
+
+	if (error == 0 && !list_is_empty(&dpa.dpa_candidates)) {
+		error = dsl_sync_task(spa_name(spa), NULL, ddt_prune_sync,
+		    &dpa, 0, ZFS_SPACE_CHECK_NONE);
+	}
+
+	ddt_prune_candidates_free(&dpa.dpa_candidates);
+	list_destroy(&dpa.dpa_candidates);
+
+	zfs_dbgmsg("pool '%s': pruned %llu dedup entries older than %llu "
+	    "seconds", spa_name(spa), (u_longlong_t)freed->ddo_count,
+	    (u_longlong_t)age);
+
+	atomic_swap_32(&spa->spa_ddt_prune_active, 0);
+
+	return (error);
+}
+
 ZFS_MODULE_PARAM(zfs_dedup, zfs_dedup_, prefetch, INT, ZMOD_RW,
 	"Enable prefetching dedup-ed blks");
+
+ZFS_MODULE_PARAM(zfs_dedup, zfs_dedup_, prune_txg_max, UINT, ZMOD_RW,
+	"Max number of DDT entries to prune per txg");
@@ -0,0 +1,669 @@
+/*
+ * CDDL HEADER START
+ *
+ * The contents of this file are subject to the terms of the
+ * Common Development and Distribution License (the "License").
+ * You may not use this file except in compliance with the License.
+ *
+ * You can obtain a copy of the license at usr/src/OPENSOLARIS.LICENSE
+ * or https://opensource.org/licenses/CDDL-1.0.
+ * See the License for the specific language governing permissions
+ * and limitations under the License.
+ *
+ * When distributing Covered Code, include this CDDL HEADER in each
+ * file and include the License file at usr/src/OPENSOLARIS.LICENSE.
+ * If applicable, add the following below this CDDL HEADER, with the
+ * fields enclosed by brackets "[]" replaced with your own identifying
+ * information: Portions Copyright [yyyy] [name of copyright owner]
+ *
+ * CDDL HEADER END
+ */
+
+/*
+ * Copyright (c) 2024, Klara Inc.
+ */
+
+#include <sys/zfs_context.h>
+#include <sys/spa.h>
+#include <sys/ddt.h>
+#include <sys/ddt_impl.h>
+#include <sys/dmu.h>
+#include <sys/dmu_tx.h>
+#include <sys/dbuf.h>
+#include <sys/zap.h>
+#include <sys/zio_checksum.h>
+
+/*
+ * # DDT log
+ *
+ * Updating a storage object (ddt_zap) for every changed entry means a random
+ * lookup and update of a large ZAP for each new or deduplicated block. Once
+ * the table no longer fits in the ARC, each of those turns into several
+ * random reads.
+ *
+ * For tables with DDT_FLAG_LOG, ddt_sync() instead appends every changed entry
+ * to an on-disk log, and keeps an in-memory copy of the log in an AVL tree so
+ * that ddt_lookup() can find the latest version of an entry without reading
+ * the log. Appending to the log is a sequential write, and only ever touches
+ * the tail block of the log object.
+ *
+ * There are two logs. New entries go to the "active" log. Once the active log
+ * is old or big enough (see ddt_log_swap_ready()), it becomes the "flushing"
+ * log, and the (empty) flushing log becomes the active one. Each txg, a slice
+ * of the flushing log is written back to the storage objects, in key order,
+ * and the last key written is saved as the log "checkpoint". When the
+ * flushing log is empty, its object is truncated, and the logs can be swapped
+ * again.
+ *
+ * If an entry on the flushing log is loaded and changed again, its new
+ * version is written to the active log, and the old one is dropped from the
+ * flushing log, so a key is only ever on one of the two logs.
+ *
+ * On import, both logs are read back in full. Records on the flushing log at
+ * or before the checkpoint have already been written to storage and are
+ * skipped; anything on the flushing log that also appears on the active log
+ * has been superseded and is dropped.
+ *
+ * Each log object has a ddt_log_header_t in its bonus buffer, and the records
+ * (ddt_log_record_t) packed in its data blocks. The object type is
+ * DMU_OTN_UINT64_METADATA, so the whole thing is byteswapped as an array of
+ * uint64_t when read on a system of the other endianness.
+ */
+
+static kmem_cache_t *ddt_log_entry_cache;
+
+/*
+ * Swap the logs (and start flushing the active one) once it has been taking
+ * entries for this many txgs.
+ */
+uint_t zfs_dedup_log_txg_max = 8;
+
+/*
+ * Swap the logs once they use this much memory between them. If the logs are
+ * still over this limit after being swapped, the flushing log is flushed in
+ * full in the next txg to release the memory. 0 means 1% of system memory.
+ */
+uint64_t zfs_dedup_log_mem_max = 0;
+
+/*
+ * Minimum number of entries to flush from the flushing log each txg.
+ */
+uint_t zfs_dedup_log_flush_entries_min = 1000;
+
+/*
+ * Try to flush the flushing log over this many txgs.
+ */
+uint_t zfs_dedup_log_flush_txgs = 100;
+
+/* Block size for the log objects, also the size of the staging buffer. */
+static const uint_t ddt_log_blksz = 128 * 1024;
+
+#define	DDT_LOG_RECORD_ENTRY_SIZE(ddt)	\
+	(sizeof (ddt_log_record_t) + sizeof (ddt_key_t) + DDT_PHYS_SIZE(ddt))
+
+void
+ddt_log_init(void)
+{
+	ddt_log_entry_cache = kmem_cache_create("ddt_log_entry_cache",
+	    sizeof (ddt_log_entry_t), 0, NULL, NULL, NULL, NULL, NULL, 0);
+}
+
+void
+ddt_log_fini(void)
+{
+	kmem_cache_destroy(ddt_log_entry_cache);
+}
+
+static uint64_t
+ddt_log_mem_max(void)
+{
+	if (zfs_dedup_log_mem_max != 0)
+		return (zfs_dedup_log_mem_max);
+	return (physmem * PAGESIZE / 100);
+}
+
+void
+ddt_log_name(ddt_t *ddt, uint_t n, char *name)
+{
+	(void) snprintf(name, DDT_NAMELEN, DMU_POOL_DDT_LOG,
+	    zio_checksum_table[ddt->ddt_checksum].ci_name, n);
+}
+
+static void
+ddt_log_empty_tree(ddt_log_t *ddl)
+{
+	ddt_log_entry_t *ddle;
+	void *cookie = NULL;
+
+	while ((ddle = avl_destroy_nodes(&ddl->ddl_tree, &cookie)) != NULL)
+		kmem_cache_free(ddt_log_entry_cache, ddle);
+}
+
+static void
+ddt_log_reset(ddt_t *ddt)
+{
+	for (int n = 0; n < 2; n++) {
+		ddt_log_t *ddl = &ddt->ddt_log[n];
+
+		ASSERT0(avl_numnodes(&ddl->ddl_tree));
+		ddl->ddl_flags = 0;
+		ddl->ddl_object = 0;
+		ddl->ddl_length = 0;
+		ddl->ddl_first_txg = 0;
+		memset(&ddl->ddl_checkpoint, 0, sizeof (ddt_key_t));
+	}
+
+	ddt->ddt_log_active = &ddt->ddt_log[0];
+	ddt->ddt_log_flushing = &ddt->ddt_log[1];
+	ddt->ddt_log_flushing->ddl_flags = DDL_FLAG_FLUSHING;
+	ddt->ddt_flush_count = 0;
+	memset(&ddt->ddt_log_histogram, 0, sizeof (ddt_histogram_t));
+}
+
+void
+ddt_log_alloc(ddt_t *ddt)
+{
+	for (int n = 0; n < 2; n++) {
+		avl_create(&ddt->ddt_log[n].ddl_tree, ddt_key_compare,
+		    sizeof (ddt_log_entry_t),
+		    offsetof(ddt_log_entry_t, ddle_node));
+	}
+	ddt_log_reset(ddt);
+}
+
+void
+ddt_log_free(ddt_t *ddt)
+{
+	for (int n = 0; n < 2; n++) {
+		ddt_log_empty_tree(&ddt->ddt_log[n]);
+		avl_destroy(&ddt->ddt_log[n].ddl_tree);
+	}
+}
+
+static void
+ddt_log_sync_header(ddt_t *ddt, ddt_log_t *ddl, dmu_tx_t *tx)
+{
+	ddt_log_header_t hdr = {0};
+	dmu_buf_t *db;
+
+	DLH_SET_VERSION(&hdr, DDT_LOG_VERSION);
+	DLH_SET_FLAGS(&hdr, ddl->ddl_flags);
+	hdr.dlh_length = ddl->ddl_length;
+	hdr.dlh_first_txg = ddl->ddl_first_txg;
+	hdr.dlh_checkpoint = ddl->ddl_checkpoint;
+
+	VERIFY0(dmu_bonus_hold(ddt->ddt_os, ddl->ddl_object, FTAG, &db));
+	dmu_buf_will_dirty(db, tx);
+	memcpy(db->db_data, &hdr, sizeof (hdr));
+	dmu_buf_rele(db, FTAG);
+}
+
+void
+ddt_log_create(ddt_t *ddt, dmu_tx_t *tx)
+{
+	char name[DDT_NAMELEN];
+
+	ASSERT3U(ddt->ddt_dir_object, !=, 0);
+
+	for (int n = 0; n < 2; n++) {
+		ddt_log_t *ddl = &ddt->ddt_log[n];
+
+		ASSERT0(ddl->ddl_object);
+		ddl->ddl_object = dmu_object_alloc(ddt->ddt_os,
+		    DMU_OTN_UINT64_METADATA, ddt_log_blksz,
+		    DMU_OTN_UINT64_METADATA, sizeof (ddt_log_header_t), tx);
+
+		ddt_log_name(ddt, n, name);
+		VERIFY0(zap_add(ddt->ddt_os, ddt->ddt_dir_object, name,
+		    sizeof (uint64_t), 1, &ddl->ddl_object, tx));
+
+		ddt_log_sync_header(ddt, ddl, tx);
+	}
+}
+
+void
+ddt_log_destroy(ddt_t *ddt, dmu_tx_t *tx)
+{
+	char name[DDT_NAMELEN];
+
+	ASSERT(ddt_log_empty(ddt));
+
+	for (int n = 0; n < 2; n++) {
+		ddt_log_t *ddl = &ddt->ddt_log[n];
+
+		ddt_log_name(ddt, n, name);
+		VERIFY0(zap_remove(ddt->ddt_os, ddt->ddt_dir_object, name,
+		    tx));
+		VERIFY0(dmu_object_free(ddt->ddt_os, ddl->ddl_object, tx));
+	}
+
+	ddt_log_reset(ddt);
+}
+
+/*
+ * Add an entry to a log's tree, or replace the existing version of it.
+ */
+static void
+ddt_log_update_entry(ddt_t *ddt, ddt_log_t *ddl, const ddt_key_t *ddk,
+    const ddt_phys_t *phys, ddt_type_t type, ddt_class_t class)
+{
+	ddt_log_entry_t *ddle;
+	avl_index_t where;
+
+	ddle = avl_find(&ddl->ddl_tree, ddk, &where);
+	if (ddle == NULL) {
+		ddle = kmem_cache_alloc(ddt_log_entry_cache, KM_SLEEP);
+		memset(ddle, 0, sizeof (ddt_log_entry_t));
+		ddle->ddle_key = *ddk;
+		avl_insert(&ddl->ddl_tree, ddle, where);
+	}
+
+	memcpy(ddle->ddle_phys, phys, DDT_PHYS_SIZE(ddt));
+	ddle->ddle_type = type;
+	ddle->ddle_class = class;
+}
+
+static int
+ddt_log_load_record(ddt_t *ddt, ddt_log_t *ddl, const ddt_log_record_t *dlr)
+{
+	if (DLR_GET_TYPE(dlr) != DLR_ENTRY ||
+	    DLR_GET_RECLEN(dlr) != DDT_LOG_RECORD_ENTRY_SIZE(ddt) ||
+	    DLR_GET_ENTRY_TYPE(dlr) > DDT_TYPES ||
+	    DLR_GET_ENTRY_CLASS(dlr) > DDT_CLASSES)
+		return (SET_ERROR(EINVAL));
+
+	const ddt_key_t *ddk = (const ddt_key_t *)dlr->dlr_payload;
+	const ddt_phys_t *phys = (const ddt_phys_t *)(ddk + 1);
+
+	/* Already written back to storage before the last export. */
+	if ((ddl->ddl_flags & DDL_FLAG_CHECKPOINT) &&
+	    ddt_key_compare(ddk, &ddl->ddl_checkpoint) <= 0)
+		return (0);
+
+	ddt_log_update_entry(ddt, ddl, ddk, phys, DLR_GET_ENTRY_TYPE(dlr),
+	    DLR_GET_ENTRY_CLASS(dlr));
+
+	return (0);
+}
+
+static int
+ddt_log_load_one(ddt_t *ddt, uint_t n)
+{
+	ddt_log_t *ddl = &ddt->ddt_log[n];
+	ddt_log_header_t hdr;
+	char name[DDT_NAMELEN];
+	dmu_buf_t *db;
+	int error;
+
+	ddt_log_name(ddt, n, name);
+	error = zap_lookup(ddt->ddt_os, ddt->ddt_dir_object, name,
+	    sizeof (uint64_t), 1, &ddl->ddl_object);
+	if (error != 0)
+		return (error);
+
+	error = dmu_bonus_hold(ddt->ddt_os, ddl->ddl_object, FTAG, &db);
+	if (error != 0)
+		return (error);
+	memcpy(&hdr, db->db_data, sizeof (hdr));
+	dmu_buf_rele(db, FTAG);
+
+	if (DLH_GET_VERSION(&hdr) != DDT_LOG_VERSION ||
+	    (DLH_GET_FLAGS(&hdr) & ~DDL_FLAG_MASK) != 0)
+		return (SET_ERROR(EINVAL));
+
+	ddl->ddl_flags = DLH_GET_FLAGS(&hdr);
+	ddl->ddl_length = hdr.dlh_length;
+	ddl->ddl_first_txg = hdr.dlh_first_txg;
+	ddl->ddl_checkpoint = hdr.dlh_checkpoint;
+
+	if (ddl->ddl_length == 0)
+		return (0);
+
+	/*
+	 * Read the log a buffer at a time. Records can straddle buffers, so
+	 * each read starts at the first record not completely parsed from the
+	 * previous one.
+	 */
+	uint8_t *buf = vmem_alloc(ddt_log_blksz, KM_SLEEP);
+	uint64_t off = 0;
+
+	while (error == 0 && off < ddl->ddl_length) {
+		uint64_t len = MIN(ddt_log_blksz, ddl->ddl_length - off);
+		uint64_t pos = 0;
+
+		error = dmu_read(ddt->ddt_os, ddl->ddl_object, off, len, buf,
+		    DMU_READ_PREFETCH);
+		if (error != 0)
+			break;
+
+		while (pos + sizeof (ddt_log_record_t) <= len) {
+			const ddt_log_record_t *dlr =
+			    (const ddt_log_record_t *)(buf + pos);
+			uint64_t reclen = DLR_GET_RECLEN(dlr);
+
+			if (reclen < sizeof (ddt_log_record_t)) {
+				error = SET_ERROR(EINVAL);
+				break;
+			}
+			if (pos + reclen > len)
+				break;
+
+			error = ddt_log_load_record(ddt, ddl, dlr);
+			if (error != 0)
+				break;
+
+			pos += reclen;
+		}
+
+		if (error == 0 && pos == 0)
+			error = SET_ERROR(EINVAL);
+
+		off += pos;
+	}
+
+	vmem_free(buf, ddt_log_blksz);
+
+	return (error);
+}
+
+static void
+ddt_log_update_flush_count(ddt_t *ddt)
+{
+	uint64_t count = avl_numnodes(&ddt->ddt_log_flushing->ddl_tree);
+
+	if (zfs_dedup_log_flush_txgs > 0)
+		count = DIV_ROUND_UP(count, zfs_dedup_log_flush_txgs);
+
+	ddt->ddt_flush_count = MAX(count, zfs_dedup_log_flush_entries_min);
+}
+
+int
+ddt_log_load(ddt_t *ddt)
+{
+	ddt_log_t *active, *flushing;
+	ddt_log_entry_t *ddle, *next;
+	int error;
+
+	for (int n = 0; n < 2; n++) {
+		error = ddt_log_load_one(ddt, n);
+		if (error != 0)
+			return (error);
+	}
+
+	/* Exactly one of the logs must be the flushing log. */
+	if ((ddt->ddt_log[0].ddl_flags & DDL_FLAG_FLUSHING) ==
+	    (ddt->ddt_log[1].ddl_flags & DDL_FLAG_FLUSHING))
+		return (SET_ERROR(EINVAL));
+
+	if (ddt->ddt_log[0].ddl_flags & DDL_FLAG_FLUSHING) {
+		active = &ddt->ddt_log[1];
+		flushing = &ddt->ddt_log[0];
+	} else {
+		active = &ddt->ddt_log[0];
+		flushing = &ddt->ddt_log[1];
+	}
+	ddt->ddt_log_active = active;
+	ddt->ddt_log_flushing = flushing;
+
+	/* Drop anything on the flushing log superseded by the active log. */
+	for (ddle = avl_first(&flushing->ddl_tree); ddle != NULL;
+	    ddle = next) {
+		next = AVL_NEXT(&flushing->ddl_tree, ddle);
+		if (avl_find(&active->ddl_tree, &ddle->ddle_key, NULL) !=
+		    NULL) {
+			avl_remove(&flushing->ddl_tree, ddle);
+			kmem_cache_free(ddt_log_entry_cache, ddle);
+		}
+	}
+
+	/* Rebuild the stats for logged entries. */
+	memset(&ddt->ddt_log_histogram, 0, sizeof (ddt_histogram_t));
+	spa_config_enter(ddt->ddt_spa, SCL_STATE, FTAG, RW_READER);
+	for (int n = 0; n < 2; n++) {
+		avl_tree_t *t = &ddt->ddt_log[n].ddl_tree;
+		for (ddle = avl_first(t); ddle != NULL;
+		    ddle = AVL_NEXT(t, ddle))
+			ddt_histogram_add_entry(ddt, &ddt->ddt_log_histogram,
+			    &ddle->ddle_key, ddle->ddle_phys);
+	}
+	spa_config_exit(ddt->ddt_spa, SCL_STATE, FTAG);
+
+	ddt_log_update_flush_count(ddt);
+
+	return (0);
+}
+
+/*
+ * Find the most recent logged version of an entry. Caller must hold the
+ * ddt_lock. If found, *flushing is set if it is on the flushing log.
+ */
+ddt_log_entry_t *
+ddt_log_find_key(ddt_t *ddt, const ddt_key_t *ddk, boolean_t *flushing)
+{
+	ddt_log_entry_t *ddle;
+
+	ASSERT(MUTEX_HELD(&ddt->ddt_lock));
+
+	ddle = avl_find(&ddt->ddt_log_active->ddl_tree, ddk, NULL);
+	if (ddle != NULL) {
+		if (flushing != NULL)
+			*flushing = B_FALSE;
+		return (ddle);
+	}
+
+	ddle = avl_find(&ddt->ddt_log_flushing->ddl_tree, ddk, NULL);
+	if (ddle != NULL && flushing != NULL)
+		*flushing = B_TRUE;
+
+	return (ddle);
+}
+
+void
+ddt_log_remove_entry(ddt_t *ddt, ddt_log_t *ddl, ddt_log_entry_t *ddle)
+{
+	ASSERT(MUTEX_HELD(&ddt->ddt_lock));
+
+	avl_remove(&ddl->ddl_tree, ddle);
+	kmem_cache_free(ddt_log_entry_cache, ddle);
+}
+
+boolean_t
+ddt_log_remove_key(ddt_t *ddt, ddt_log_t *ddl, const ddt_key_t *ddk)
+{
+	ddt_log_entry_t *ddle;
+
+	ddle = avl_find(&ddl->ddl_tree, ddk, NULL);
+	if (ddle == NULL)
+		return (B_FALSE);
+
+	ddt_log_remove_entry(ddt, ddl, ddle);
+	return (B_TRUE);
+}
+
+/*
+ * Start appending entries to the active log.
+ */
+void
+ddt_log_begin(ddt_t *ddt, dmu_tx_t *tx, ddt_log_update_t *dlu)
+{
+	ddt_log_t *ddl = ddt->ddt_log_active;
+
+	ASSERT(dmu_tx_is_syncing(tx));
+
+	dlu->dlu_tx = tx;
+	dlu->dlu_size = ddt_log_blksz;
+	dlu->dlu_buf = vmem_alloc(dlu->dlu_size, KM_SLEEP);
+	dlu->dlu_pos = 0;
+
+	if (ddl->ddl_length == 0)
+		ddl->ddl_first_txg = tx->tx_txg;
+}
+
+static void
+ddt_log_write(ddt_t *ddt, ddt_log_update_t *dlu)
+{
+	ddt_log_t *ddl = ddt->ddt_log_active;
+
+	if (dlu->dlu_pos == 0)
+		return;
+
+	dmu_write(ddt->ddt_os, ddl->ddl_object, ddl->ddl_length,
+	    dlu->dlu_pos, dlu->dlu_buf, dlu->dlu_tx);
+	ddl->ddl_length += dlu->dlu_pos;
+	dlu->dlu_pos = 0;
+}
+
+/*
+ * Append an entry to the active log, and make it the latest version of the
+ * entry in memory.
+ */
+void
+ddt_log_entry(ddt_t *ddt, const ddt_entry_t *dde, ddt_log_update_t *dlu)
+{
+	ddt_log_record_t *dlr;
+	ddt_key_t *ddk;
+
+	if (dlu->dlu_pos + DDT_LOG_RECORD_ENTRY_SIZE(ddt) > dlu->dlu_size)
+		ddt_log_write(ddt, dlu);
+
+	dlr = (ddt_log_record_t *)(dlu->dlu_buf + dlu->dlu_pos);
+	dlr->dlr_info = 0;
+	DLR_SET_TYPE(dlr, DLR_ENTRY);
+	DLR_SET_RECLEN(dlr, DDT_LOG_RECORD_ENTRY_SIZE(ddt));
+	DLR_SET_ENTRY_TYPE(dlr, dde->dde_type);
+	DLR_SET_ENTRY_CLASS(dlr, dde->dde_class);
+
+	ddk = (ddt_key_t *)dlr->dlr_payload;
+	*ddk = dde->dde_key;
+	memcpy(ddk + 1, dde->dde_phys, DDT_PHYS_SIZE(ddt));
+
+	dlu->dlu_pos += DDT_LOG_RECORD_ENTRY_SIZE(ddt);
+
+	ddt_enter(ddt);
+	ddt_log_update_entry(ddt, ddt->ddt_log_active, &dde->dde_key,
+	    dde->dde_phys, dde->dde_type, dde->dde_class);
+	ddt_exit(ddt);
+}
+
+void
+ddt_log_commit(ddt_t *ddt, ddt_log_update_t *dlu)
+{
+	ddt_log_write(ddt, dlu);
+	ddt_log_sync_header(ddt, ddt->ddt_log_active, dlu->dlu_tx);
+
+	vmem_free(dlu->dlu_buf, dlu->dlu_size);
+	memset(dlu, 0, sizeof (*dlu));
+}
+
+boolean_t
+ddt_log_over_mem(ddt_t *ddt)
+{
+	uint64_t nentries = avl_numnodes(&ddt->ddt_log[0].ddl_tree) +
+	    avl_numnodes(&ddt->ddt_log[1].ddl_tree);
+
+	return (nentries * sizeof (ddt_log_entry_t) >= ddt_log_mem_max());
+}
+
+/*
+ * The logs can be swapped once the flushing log has been completely written
+ * back and truncated, and the active log is either old or big enough.
+ */
+boolean_t
+ddt_log_swap_ready(ddt_t *ddt, uint64_t txg)
+{
+	ddt_log_t *active = ddt->ddt_log_active;
+	ddt_log_t *flushing = ddt->ddt_log_flushing;
+
+	if (avl_numnodes(&flushing->ddl_tree) > 0 || flushing->ddl_length > 0)
+		return (B_FALSE);
+
+	if (active->ddl_length == 0)
+		return (B_FALSE);
+
+	return (txg - active->ddl_first_txg >= zfs_dedup_log_txg_max ||
+	    ddt_log_over_mem(ddt));
+}
+
+void
+ddt_log_swap(ddt_t *ddt, dmu_tx_t *tx)
+{
+	ddt_log_t *ddl;
+
+	ASSERT(ddt_log_swap_ready(ddt, tx->tx_txg));
+
+	ddt_enter(ddt);
+	ddl = ddt->ddt_log_flushing;
+	ddt->ddt_log_flushing = ddt->ddt_log_active;
+	ddt->ddt_log_active = ddl;
+	ddt_exit(ddt);
+
+	ddt->ddt_log_active->ddl_flags = 0;
+	ddt->ddt_log_active->ddl_first_txg = 0;
+	ddt->ddt_log_flushing->ddl_flags = DDL_FLAG_FLUSHING;
+	memset(&ddt->ddt_log_flushing->ddl_checkpoint, 0, sizeof (ddt_key_t));
+
+	ddt_log_update_flush_count(ddt);
+
+	ddt_log_sync_header(ddt, ddt->ddt_log_active, tx);
+	ddt_log_sync_header(ddt, ddt->ddt_log_flushing, tx);
+}
+
+/*
+ * Record that everything on the flushing log up to and including this key
+ * has been written back to storage.
+ */
+void
+ddt_log_checkpoint(ddt_t *ddt, const ddt_key_t *ddk, dmu_tx_t *tx)
+{
+	ddt_log_t *ddl = ddt->ddt_log_flushing;
+
+	ddl->ddl_checkpoint = *ddk;
+	ddl->ddl_flags |= DDL_FLAG_CHECKPOINT;
+	ddt_log_sync_header(ddt, ddl, tx);
+}
+
+/*
+ * Throw away the on-disk flushing log, once it has been completely written
+ * back.
+ */
+void
+ddt_log_truncate(ddt_t *ddt, dmu_tx_t *tx)
+{
+	ddt_log_t *ddl = ddt->ddt_log_flushing;
+
+	ASSERT0(avl_numnodes(&ddl->ddl_tree));
+
+	VERIFY0(dmu_free_range(ddt->ddt_os, ddl->ddl_object, 0,
+	    DMU_OBJECT_END, tx));
+
+	ddl->ddl_flags &= ~DDL_FLAG_CHECKPOINT;
+	ddl->ddl_length = 0;
+	ddl->ddl_first_txg = 0;
+	memset(&ddl->ddl_checkpoint, 0, sizeof (ddt_key_t));
+	ddt_log_sync_header(ddt, ddl, tx);
+}
+
+boolean_t
+ddt_log_empty(ddt_t *ddt)
+{
+	for (int n = 0; n < 2; n++) {
+		ddt_log_t *ddl = &ddt->ddt_log[n];
+		if (avl_numnodes(&ddl->ddl_tree) > 0 || ddl->ddl_length > 0)
+			return (B_FALSE);
+	}
+	return (B_TRUE);
+}
+
+/* BEGIN CSTYLED */
+ZFS_MODULE_PARAM(zfs_dedup, zfs_dedup_, log_txg_max, UINT, ZMOD_RW,
+	"Max transactions before starting to flush dedup logs");
+
+ZFS_MODULE_PARAM(zfs_dedup, zfs_dedup_, log_mem_max, U64, ZMOD_RW,
+	"Max memory for dedup logs");
+
+ZFS_MODULE_PARAM(zfs_dedup, zfs_dedup_, log_flush_entries_min, UINT, ZMOD_RW,
+	"Min number of log entries to flush each transaction");
+
+ZFS_MODULE_PARAM(zfs_dedup, zfs_dedup_, log_flush_txgs, UINT, ZMOD_RW,
+	"Number of transactions to spread a log flush over");
+/* END CSTYLED */
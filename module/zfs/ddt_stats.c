@@ -23,7 +23,7 @@
  * Copyright (c) 2009, 2010, Oracle and/or its affiliates. All rights reserved.
  * Copyright (c) 2012, 2016 by Delphix. All rights reserved.
  * Copyright (c) 2022 by Pawel Jakub Dawidek
- * Copyright (c) 2023, Klara Inc.
+ * Copyright (c) 2023, 2024, Klara Inc.
  */
 
 #include <sys/zfs_context.h>
@@ -33,24 +33,23 @@
 #include <sys/ddt_impl.h>
 
 static void
-ddt_stat_generate(ddt_t *ddt, ddt_entry_t *dde, ddt_stat_t *dds)
+ddt_stat_generate(ddt_t *ddt, const ddt_key_t *ddk, const ddt_phys_t *ddp,
+    ddt_stat_t *dds)
 {
 	spa_t *spa = ddt->ddt_spa;
-	ddt_phys_t *ddp = dde->dde_phys;
-	ddt_key_t *ddk = &dde->dde_key;
 	uint64_t lsize = DDK_GET_LSIZE(ddk);
 	uint64_t psize = DDK_GET_PSIZE(ddk);
 
 	memset(dds, 0, sizeof (*dds));
 
-	for (int p = 0; p < DDT_PHYS_TYPES; p++, ddp++) {
+	for (int p = 0; p < DDT_NPHYS(ddt); p++, ddp++) {
 		uint64_t dsize = 0;
 		uint64_t refcnt = ddp->ddp_refcnt;
 
 		if (ddp->ddp_phys_birth == 0)
 			continue;
 
-		int ndvas = DDK_GET_CRYPT(&dde->dde_key) ?
+		int ndvas = DDK_GET_CRYPT(ddk) ?
 		    SPA_DVAS_PER_BP - 1 : SPA_DVAS_PER_BP;
 		for (int d = 0; d < ndvas; d++)
 			dsize += dva_get_dsize_sync(spa, &ddp->ddp_dva[d]);
@@ -87,7 +86,7 @@ ddt_stat_update(ddt_t *ddt, ddt_entry_t *dde, uint64_t neg)
 	ddt_histogram_t *ddh;
 	int bucket;
 
-	ddt_stat_generate(ddt, dde, &dds);
+	ddt_stat_generate(ddt, &dde->dde_key, dde->dde_phys, &dds);
 
 	bucket = highbit64(dds.dds_ref_blocks) - 1;
 	ASSERT3U(bucket, >=, 0);
@@ -97,6 +96,40 @@ ddt_stat_update(ddt_t *ddt, ddt_entry_t *dde, uint64_t neg)
 	ddt_stat_add(&ddh->ddh_stat[bucket], &dds, neg);
 }
 
+/*
+ * Add or remove a single entry to an arbitrary histogram, such as the log
+ * histogram. Entries with no references aren't counted.
+ */
+static void
+ddt_histogram_update_entry(ddt_t *ddt, ddt_histogram_t *ddh,
+    const ddt_key_t *ddk, const ddt_phys_t *phys, uint64_t neg)
+{
+	ddt_stat_t dds;
+	int bucket;
+
+	ddt_stat_generate(ddt, ddk, phys, &dds);
+
+	bucket = highbit64(dds.dds_ref_blocks) - 1;
+	if (bucket < 0)
+		return;
+
+	ddt_stat_add(&ddh->ddh_stat[bucket], &dds, neg);
+}
+
+void
+ddt_histogram_add_entry(ddt_t *ddt, ddt_histogram_t *ddh,
+    const ddt_key_t *ddk, const ddt_phys_t *phys)
+{
+	ddt_histogram_update_entry(ddt, ddh, ddk, phys, 0);
+}
+
+void
+ddt_histogram_sub_entry(ddt_t *ddt, ddt_histogram_t *ddh,
+    const ddt_key_t *ddk, const ddt_phys_t *phys)
+{
+	ddt_histogram_update_entry(ddt, ddh, ddk, phys, -1ULL);
+}
+
 void
 ddt_histogram_add(ddt_histogram_t *dst, const ddt_histogram_t *src)
 {
@@ -170,6 +203,28 @@ ddt_get_dedup_object_stats(spa_t *spa, ddt_object_t *ddo_total)
 				ddo_total->ddo_mspace += ddo->ddo_mspace;
 			}
 		}
+
+		if (!(ddt->ddt_flags & DDT_FLAG_LOG))
+			continue;
+
+		/*
+		 * The logs take up space too, but their entries aren't
+		 * counted separately; they are either updates to entries
+		 * already counted above, or will be when the log is flushed.
+		 */
+		for (int n = 0; n < 2; n++) {
+			dmu_object_info_t doi;
+
+			if (ddt->ddt_log[n].ddl_object == 0 ||
+			    dmu_object_info(ddt->ddt_os,
+			    ddt->ddt_log[n].ddl_object, &doi) != 0)
+				continue;
+
+			ddo_total->ddo_dspace +=
+			    doi.doi_physical_blocks_512 << 9;
+			ddo_total->ddo_mspace +=
+			    doi.doi_fill_count * doi.doi_data_block_size;
+		}
 	}
 
 	/*
@@ -180,6 +235,24 @@ ddt_get_dedup_object_stats(spa_t *spa, ddt_object_t *ddo_total)
 	spa->spa_dedup_dsize = ddo_total->ddo_dspace;
 }
 
+/*
+ * Add one entry's share of a storage object's space to ddo, as an estimate of
+ * what removing it from the object gives back. The object stats are only
+ * updated at the end of each txg, so the average is taken from those.
+ */
+void
+ddt_object_entry_space(ddt_t *ddt, ddt_type_t type, ddt_class_t class,
+    ddt_object_t *ddo)
+{
+	const ddt_object_t *ddos = &ddt->ddt_object_stats[type][class];
+
+	ddo->ddo_count++;
+	if (ddos->ddo_count > 0) {
+		ddo->ddo_dspace += ddos->ddo_dspace / ddos->ddo_count;
+		ddo->ddo_mspace += ddos->ddo_mspace / ddos->ddo_count;
+	}
+}
+
 uint64_t
 ddt_get_ddt_dsize(spa_t *spa)
 {
@@ -207,6 +280,8 @@ ddt_get_dedup_histogram(spa_t *spa, ddt_histogram_t *ddh)
 				    &ddt->ddt_histogram_cache[type][class]);
 			}
 		}
+
+		ddt_histogram_add(ddh, &ddt->ddt_log_histogram_cache);
 	}
 }
 
@@ -1996,6 +1996,23 @@ dmu_sync(zio_t *pio, uint64_t txg, dmu_sync_cb_t *done, zgd_t *zgd)
 	SET_BOOKMARK(&zb, ds->ds_object,
 	    db->db.db_object, db->db_level, db->db_blkid);
 
+	/*
+	 * A Direct I/O write has already written the block and left its
+	 * block pointer in the dirty record, so there is nothing more to
+	 * write; just log that block pointer.  The dirty record is kept,
+	 * along with dr_overridden_by, until this txg has finished syncing.
+	 */
+	mutex_enter(&db->db_mtx);
+	dr = dbuf_find_dirty_eq(db, txg);
+	if (dr != NULL && dr->dt.dl.dr_diowrite) {
+		*zgd->zgd_bp = dr->dt.dl.dr_overridden_by;
+		mutex_exit(&db->db_mtx);
+		zil_lwb_add_block(zgd->zgd_lwb, zgd->zgd_bp);
+		done(zgd, 0);
+		return (0);
+	}
+	mutex_exit(&db->db_mtx);
+
 	DB_DNODE_ENTER(db);
 	dmu_write_policy(os, DB_DNODE(db), db->db_level, WP_DMU_SYNC, &zp);
 	DB_DNODE_EXIT(db);
@@ -2566,7 +2583,7 @@ dmu_brt_clone(objset_t *os, uint64_t object, uint64_t offset, uint64_t length,
 		ASSERT(db->db_blkid != DMU_SPILL_BLKID);
 		ASSERT(BP_IS_HOLE(bp) || dbuf->db_size == BP_GET_LSIZE(bp));
 
-		dmu_buf_will_clone(dbuf, tx);
+		dmu_buf_will_clone_or_dio(dbuf, tx);
 
 		mutex_enter(&db->db_mtx);
 
@@ -2598,6 +2615,9 @@ dmu_brt_clone(objset_t *os, uint64_t object, uint64_t offset, uint64_t length,
 			brt_pending_add(spa, bp, tx);
 		}
 	}
+
+	/* Prefetch the BRT entries for the syncing context. */
+	brt_prefetch_bps(spa, bps, nbps);
 out:
 	dmu_buf_rele_array(dbp, numbufs, FTAG);
 
@@ -0,0 +1,417 @@
+/*
+ * CDDL HEADER START
+ *
+ * The contents of this file are subject to the terms of the
+ * Common Development and Distribution License (the "License").
+ * You may not use this file except in compliance with the License.
+ *
+ * You can obtain a copy of the license at usr/src/OPENSOLARIS.LICENSE
+ * or https://opensource.org/licenses/CDDL-1.0.
+ * See the License for the specific language governing permissions
+ * and limitations under the License.
+ *
+ * When distributing Covered Code, include this CDDL HEADER in each
+ * file and include the License file at usr/src/OPENSOLARIS.LICENSE.
+ * If applicable, add the following below this CDDL HEADER, with the
+ * fields enclosed by brackets "[]" replaced with your own identifying
+ * information: Portions Copyright [yyyy] [name of copyright owner]
+ *
+ * CDDL HEADER END
+ */
+
+/*
+ * Direct I/O: reading and writing file data straight between the caller's
+ * buffer (normally the pinned pages of a user request) and disk, without
+ * staging it in the ARC.
+ *
+ * Reads only bypass the ARC for blocks that have no cached or dirty copy;
+ * anything else is served by the normal dbuf path, so a Direct I/O read
+ * always sees the latest data.  Reads that fail are retried through the
+ * ARC as well, which also means a Direct I/O read never repairs a block
+ * from the caller's buffer (see ZIO_FLAG_DIO_READ).
+ *
+ * Writes cover whole blocks.  Each block is written to disk in open
+ * context, much like dmu_sync() does for the ZIL, and the resulting block
+ * pointer is handed to the dirty record as an override, so syncing context
+ * only has to link it into the tree.  Because the caller's buffer may be
+ * changed while the write is in flight, an uncompressed block is checked
+ * against its checksum once it is on disk; if the two disagree the block
+ * is freed again and the data is instead copied into the dbuf, exactly as
+ * a buffered write would.
+ */
+
+#include <sys/dmu.h>
+#include <sys/dmu_impl.h>
+#include <sys/dmu_tx.h>
+#include <sys/dbuf.h>
+#include <sys/dnode.h>
+#include <sys/zfs_context.h>
+#include <sys/dmu_objset.h>
+#include <sys/dsl_dataset.h>
+#include <sys/spa.h>
+#include <sys/zio.h>
+#include <sys/zio_checksum.h>
+#include <sys/abd.h>
+
+typedef struct dmu_direct_blk {
+	blkptr_t	ddb_bp;		/* block pointer read or written */
+	abd_t		*ddb_abd;	/* zio data, NULL if not issued */
+	boolean_t	ddb_bounce;	/* ddb_abd is a private buffer */
+	int		ddb_copies;	/* copies written */
+	int		ddb_error;	/* zio error */
+} dmu_direct_blk_t;
+
+/*
+ * Direct I/O is not used for datasets whose blocks are transformed in a way
+ * that needs the ARC (encryption), or when the pool is frozen for ziltest.
+ */
+static boolean_t
+dmu_direct_allowed(dnode_t *dn, uint64_t txg)
+{
+	objset_t *os = dn->dn_objset;
+
+	if (os->os_encrypted)
+		return (B_FALSE);
+	if (txg != 0 && txg > spa_freeze_txg(os->os_spa))
+		return (B_FALSE);
+	return (B_TRUE);
+}
+
+/*
+ * A block may be read directly from disk if it has no cached or dirty copy,
+ * so that what is on disk is the latest version of the data.  Returns the
+ * block pointer to read in *bp.
+ */
+static boolean_t
+dmu_direct_read_ok(dnode_t *dn, dmu_buf_impl_t *db, blkptr_t *bp)
+{
+	db_lock_type_t dblt;
+	boolean_t ok;
+
+	dblt = dmu_buf_lock_parent(db, RW_READER, FTAG);
+	mutex_enter(&db->db_mtx);
+	ok = (db->db_state == DB_UNCACHED || db->db_state == DB_NOFILL) &&
+	    list_is_empty(&db->db_dirty_records) &&
+	    db->db_blkptr != NULL && !BP_IS_HOLE(db->db_blkptr) &&
+	    !BP_IS_EMBEDDED(db->db_blkptr);
+	if (ok)
+		*bp = *db->db_blkptr;
+	mutex_exit(&db->db_mtx);
+	dmu_buf_unlock_parent(db, dblt, FTAG);
+
+	if (ok && dnode_block_freed(dn, db->db_blkid))
+		ok = B_FALSE;
+
+	return (ok);
+}
+
+static void
+dmu_direct_read_done(zio_t *zio)
+{
+	dmu_direct_blk_t *ddb = zio->io_private;
+
+	ddb->ddb_error = zio->io_error;
+}
+
+static int
+dmu_read_abd_dnode(dnode_t *dn, uint64_t offset, uint64_t size, abd_t *data)
+{
+	objset_t *os = dn->dn_objset;
+	spa_t *spa = os->os_spa;
+	dmu_buf_t **dbp;
+	dmu_direct_blk_t *ddbs;
+	zio_t *rio;
+	boolean_t direct = dmu_direct_allowed(dn, 0);
+	int numbufs, err;
+
+	err = dmu_buf_hold_array_by_dnode(dn, offset, size, B_FALSE, FTAG,
+	    &numbufs, &dbp, DMU_READ_NO_PREFETCH);
+	if (err != 0)
+		return (err);
+
+	ddbs = kmem_zalloc(numbufs * sizeof (dmu_direct_blk_t), KM_SLEEP);
+	rio = zio_root(spa, NULL, NULL, ZIO_FLAG_CANFAIL);
+
+	for (int i = 0; i < numbufs; i++) {
+		dmu_buf_impl_t *db = (dmu_buf_impl_t *)dbp[i];
+		dmu_direct_blk_t *ddb = &ddbs[i];
+		uint64_t bufoff = MAX(offset, db->db.db_offset) -
+		    db->db.db_offset;
+		uint64_t len = MIN(db->db.db_size - bufoff,
+		    offset + size - (db->db.db_offset + bufoff));
+		zbookmark_phys_t zb;
+
+		if (!direct || !dmu_direct_read_ok(dn, db, &ddb->ddb_bp))
+			continue;
+
+		/*
+		 * Blocks only partly covered by the request are read into a
+		 * bounce buffer; the rest go straight to the caller's buffer.
+		 */
+		if (len == db->db.db_size) {
+			ddb->ddb_abd = abd_get_offset_size(data,
+			    db->db.db_offset - offset, len);
+		} else {
+			ddb->ddb_abd = abd_alloc_for_io(db->db.db_size,
+			    B_FALSE);
+			ddb->ddb_bounce = B_TRUE;
+		}
+
+		SET_BOOKMARK(&zb, dmu_objset_id(os), dn->dn_object, 0,
+		    db->db_blkid);
+		zio_nowait(zio_read(rio, spa, &ddb->ddb_bp, ddb->ddb_abd,
+		    db->db.db_size, dmu_direct_read_done, ddb,
+		    ZIO_PRIORITY_SYNC_READ, ZIO_FLAG_CANFAIL |
+		    ZIO_FLAG_SPECULATIVE | ZIO_FLAG_DIO_READ, &zb));
+	}
+
+	(void) zio_wait(rio);
+
+	for (int i = 0; i < numbufs; i++) {
+		dmu_buf_impl_t *db = (dmu_buf_impl_t *)dbp[i];
+		dmu_direct_blk_t *ddb = &ddbs[i];
+		uint64_t bufoff = MAX(offset, db->db.db_offset) -
+		    db->db.db_offset;
+		uint64_t len = MIN(db->db.db_size - bufoff,
+		    offset + size - (db->db.db_offset + bufoff));
+		uint64_t doff = db->db.db_offset + bufoff - offset;
+
+		if (ddb->ddb_abd != NULL) {
+			if (ddb->ddb_bounce && ddb->ddb_error == 0) {
+				abd_copy_off(data, ddb->ddb_abd, doff, bufoff,
+				    len);
+			}
+			abd_free(ddb->ddb_abd);
+			if (ddb->ddb_error == 0)
+				continue;
+		}
+
+		/*
+		 * Not eligible for Direct I/O, or the direct read failed:
+		 * go through the ARC, which also handles self-healing.
+		 */
+		if (err == 0) {
+			err = dbuf_read(db, NULL,
+			    DB_RF_CANFAIL | DB_RF_NOPREFETCH);
+		}
+		if (err == 0) {
+			abd_copy_from_buf_off(data,
+			    (char *)db->db.db_data + bufoff, doff, len);
+		}
+	}
+
+	kmem_free(ddbs, numbufs * sizeof (dmu_direct_blk_t));
+	dmu_buf_rele_array(dbp, numbufs, FTAG);
+
+	return (err);
+}
+
+/*
+ * Read size bytes at offset of the object the bonus buffer zdb belongs to
+ * into data, bypassing the ARC where possible.
+ */
+int
+dmu_read_abd(dmu_buf_t *zdb, uint64_t offset, uint64_t size, abd_t *data)
+{
+	dmu_buf_impl_t *db = (dmu_buf_impl_t *)zdb;
+	int err;
+
+	if (size == 0)
+		return (0);
+
+	DB_DNODE_ENTER(db);
+	err = dmu_read_abd_dnode(DB_DNODE(db), offset, size, data);
+	DB_DNODE_EXIT(db);
+
+	return (err);
+}
+
+static void
+dmu_direct_write_ready(zio_t *zio)
+{
+	blkptr_t *bp = zio->io_bp;
+
+	if (zio->io_error == 0) {
+		if (BP_IS_HOLE(bp)) {
+			/*
+			 * A block of zeros may compress to a hole, but the
+			 * block size still needs to be known for replay.
+			 */
+			BP_SET_LSIZE(bp, zio->io_lsize);
+		} else if (!BP_IS_EMBEDDED(bp)) {
+			ASSERT(BP_GET_LEVEL(bp) == 0);
+			BP_SET_FILL(bp, 1);
+		}
+	}
+}
+
+static void
+dmu_direct_write_done(zio_t *zio)
+{
+	dmu_direct_blk_t *ddb = zio->io_private;
+
+	ddb->ddb_error = zio->io_error;
+	ddb->ddb_copies = zio->io_prop.zp_copies;
+}
+
+/*
+ * Check that a block written from the caller's buffer matches its checksum,
+ * i.e. that the buffer did not change while it was being written.  Blocks
+ * that were compressed (or embedded) were written from a private copy and
+ * are consistent by construction.
+ */
+static boolean_t
+dmu_direct_write_verify(spa_t *spa, const blkptr_t *bp, abd_t *abd,
+    uint64_t size)
+{
+	if (BP_IS_HOLE(bp) || BP_IS_EMBEDDED(bp))
+		return (B_TRUE);
+	if (BP_IS_GANG(bp))
+		return (B_FALSE);
+	if (BP_GET_COMPRESS(bp) != ZIO_COMPRESS_OFF ||
+	    BP_GET_CHECKSUM(bp) == ZIO_CHECKSUM_OFF)
+		return (B_TRUE);
+
+	return (zio_checksum_error_impl(spa, bp, BP_GET_CHECKSUM(bp), abd,
+	    size, 0, NULL) == 0);
+}
+
+static int
+dmu_write_abd_dnode(dnode_t *dn, uint64_t offset, uint64_t size,
+    abd_t *data, dmu_tx_t *tx)
+{
+	objset_t *os = dn->dn_objset;
+	spa_t *spa = os->os_spa;
+	uint64_t txg = dmu_tx_get_txg(tx);
+	boolean_t direct = dmu_direct_allowed(dn, txg);
+	dmu_buf_t **dbp;
+	dmu_direct_blk_t *ddbs;
+	zio_prop_t zp;
+	zio_t *pio;
+	int numbufs, err;
+
+	err = dmu_buf_hold_array_by_dnode(dn, offset, size, B_FALSE, FTAG,
+	    &numbufs, &dbp, DMU_READ_NO_PREFETCH);
+	if (err != 0)
+		return (err);
+
+	ddbs = kmem_zalloc(numbufs * sizeof (dmu_direct_blk_t), KM_SLEEP);
+
+	/*
+	 * The blocks are written like dmu_sync() writes them for the ZIL, so
+	 * there is no dedup or nopwrite; callers should not use Direct I/O
+	 * on dedup datasets.
+	 */
+	dmu_write_policy(os, dn, 0, WP_DMU_SYNC, &zp);
+	zp.zp_nopwrite = B_FALSE;
+
+	pio = zio_root(spa, NULL, NULL, ZIO_FLAG_CANFAIL);
+
+	for (int i = 0; i < numbufs && direct; i++) {
+		dmu_buf_impl_t *db = (dmu_buf_impl_t *)dbp[i];
+		dmu_direct_blk_t *ddb = &ddbs[i];
+		zbookmark_phys_t zb;
+
+		ASSERT3U(db->db.db_offset, >=, offset);
+		ASSERT3U(db->db.db_offset + db->db.db_size, <=,
+		    offset + size);
+
+		ddb->ddb_abd = abd_get_offset_size(data,
+		    db->db.db_offset - offset, db->db.db_size);
+
+		SET_BOOKMARK(&zb, dmu_objset_id(os), dn->dn_object, 0,
+		    db->db_blkid);
+		zio_nowait(zio_write(pio, spa, txg, &ddb->ddb_bp,
+		    ddb->ddb_abd, db->db.db_size, db->db.db_size, &zp,
+		    dmu_direct_write_ready, NULL, dmu_direct_write_done, ddb,
+		    ZIO_PRIORITY_SYNC_WRITE, ZIO_FLAG_CANFAIL, &zb));
+	}
+
+	(void) zio_wait(pio);
+
+	for (int i = 0; i < numbufs; i++) {
+		dmu_buf_impl_t *db = (dmu_buf_impl_t *)dbp[i];
+		dmu_direct_blk_t *ddb = &ddbs[i];
+		blkptr_t *bp = &ddb->ddb_bp;
+		dbuf_dirty_record_t *dr;
+
+		if (ddb->ddb_abd != NULL && ddb->ddb_error == 0 &&
+		    !dmu_direct_write_verify(spa, bp, ddb->ddb_abd,
+		    db->db.db_size)) {
+			zio_free(spa, txg, bp);
+			ddb->ddb_error = SET_ERROR(EIO);
+		}
+
+		if (ddb->ddb_abd == NULL || ddb->ddb_error != 0) {
+			/*
+			 * Not written directly: copy the data into the dbuf
+			 * and let syncing context write it.
+			 */
+			dmu_buf_will_fill(dbp[i], tx, B_FALSE);
+			abd_copy_to_buf_off(db->db.db_data, data,
+			    db->db.db_offset - offset, db->db.db_size);
+			(void) dmu_buf_fill_done(dbp[i], tx, B_FALSE);
+			if (ddb->ddb_abd != NULL)
+				abd_free(ddb->ddb_abd);
+			continue;
+		}
+
+		dmu_buf_will_clone_or_dio(dbp[i], tx);
+
+		mutex_enter(&db->db_mtx);
+		dr = dbuf_find_dirty_eq(db, txg);
+		VERIFY3P(dr, !=, NULL);
+		dr->dt.dl.dr_overridden_by = *bp;
+		dr->dt.dl.dr_override_state = DR_OVERRIDDEN;
+		dr->dt.dl.dr_copies = ddb->ddb_copies;
+		dr->dt.dl.dr_nopwrite = B_FALSE;
+		dr->dt.dl.dr_diowrite = B_TRUE;
+
+		/*
+		 * Old style holes are filled with all zeros; reset the
+		 * BP_SET_LSIZE() done in dmu_direct_write_ready() for them,
+		 * as dmu_sync_done() does.
+		 */
+		if (BP_IS_HOLE(&dr->dt.dl.dr_overridden_by) &&
+		    BP_GET_LOGICAL_BIRTH(&dr->dt.dl.dr_overridden_by) == 0)
+			BP_ZERO(&dr->dt.dl.dr_overridden_by);
+		mutex_exit(&db->db_mtx);
+
+		abd_free(ddb->ddb_abd);
+	}
+
+	kmem_free(ddbs, numbufs * sizeof (dmu_direct_blk_t));
+	dmu_buf_rele_array(dbp, numbufs, FTAG);
+
+	return (0);
+}
+
+/*
+ * Write size bytes at offset of the object the bonus buffer zdb belongs to
+ * from data, bypassing the ARC.  The range must cover whole blocks.  Blocks
+ * that cannot be written directly are written through the dbuf cache
+ * instead, so this only fails if the dbufs cannot be held.
+ */
+int
+dmu_write_abd(dmu_buf_t *zdb, uint64_t offset, uint64_t size, abd_t *data,
+    dmu_tx_t *tx)
+{
+	dmu_buf_impl_t *db = (dmu_buf_impl_t *)zdb;
+	int err;
+
+	if (size == 0)
+		return (0);
+
+	DB_DNODE_ENTER(db);
+	ASSERT0(P2PHASE(offset, DB_DNODE(db)->dn_datablksz));
+	ASSERT0(P2PHASE(size, DB_DNODE(db)->dn_datablksz));
+	err = dmu_write_abd_dnode(DB_DNODE(db), offset, size, data, tx);
+	DB_DNODE_EXIT(db);
+
+	return (err);
+}
+
+#if defined(_KERNEL)
+EXPORT_SYMBOL(dmu_read_abd);
+EXPORT_SYMBOL(dmu_write_abd);
+#endif
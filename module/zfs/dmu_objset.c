@@ -276,6 +276,19 @@ prefetch_changed_cb(void *arg, uint64_t newval)
 	os->os_prefetch = newval;
 }
 
+static void
+direct_changed_cb(void *arg, uint64_t newval)
+{
+	objset_t *os = arg;
+
+	/*
+	 * Inheritance and range checking should have been done by now.
+	 */
+	ASSERT(newval == ZFS_DIRECT_DISABLED ||
+	    newval == ZFS_DIRECT_STANDARD || newval == ZFS_DIRECT_ALWAYS);
+	os->os_direct = newval;
+}
+
 static void
 sync_changed_cb(void *arg, uint64_t newval)
 {
@@ -580,6 +593,11 @@ dmu_objset_open_impl(spa_t *spa, dsl_dataset_t *ds, blkptr_t *bp,
 			    zfs_prop_to_name(ZFS_PROP_PREFETCH),
 			    prefetch_changed_cb, os);
 		}
+		if (err == 0) {
+			err = dsl_prop_register(ds,
+			    zfs_prop_to_name(ZFS_PROP_DIRECT),
+			    direct_changed_cb, os);
+		}
 		if (!ds->ds_is_snapshot) {
 			if (err == 0) {
 				err = dsl_prop_register(ds,
@@ -654,6 +672,7 @@ dmu_objset_open_impl(spa_t *spa, dsl_dataset_t *ds, blkptr_t *bp,
 		os->os_secondary_cache = ZFS_CACHE_ALL;
 		os->os_dnodesize = DNODE_MIN_SIZE;
 		os->os_prefetch = ZFS_PREFETCH_ALL;
+		os->os_direct = ZFS_DIRECT_STANDARD;
 	}
 
 	if (ds == NULL || !ds->ds_is_snapshot)
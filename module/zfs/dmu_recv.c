@@ -71,6 +71,11 @@
 static uint_t zfs_recv_queue_length = SPA_MAXBLOCKSIZE;
 static uint_t zfs_recv_queue_ff = 20;
 static uint_t zfs_recv_write_batch_size = 1024 * 1024;
+/*
+ * Number of threads per receive which write batches of WRITE records in
+ * parallel.  With 0, all batches are written by the receive_writer_thread.
+ */
+static uint_t zfs_recv_write_threads = 0;
 static int zfs_recv_best_effort_corrective = 0;
 
 static const void *const dmu_recv_tag = "dmu_recv_tag";
@@ -126,6 +131,24 @@ struct receive_writer_arg {
 
 	list_t write_batch;
 
+	/*
+	 * When zfs_recv_write_threads is set, full write batches are handed
+	 * to write_taskq.  Batches assign their tx in the order they were
+	 * dispatched (write_assigned), and record the resume state before
+	 * committing it in that same order (write_retired), so that the
+	 * resume point never gets ahead of a batch which is still being
+	 * written or which failed.  Every record other than a WRITE waits
+	 * for all outstanding batches (write_done).
+	 */
+	taskq_t *write_taskq;
+	uint_t write_threads;
+	kmutex_t write_lock;
+	kcondvar_t write_cv;
+	uint64_t write_dispatched;
+	uint64_t write_assigned;
+	uint64_t write_retired;
+	uint64_t write_done;
+
 	/* Encryption parameters for the last received DRR_OBJECT_RANGE */
 	boolean_t or_crypt_params_present;
 	uint64_t or_firstobj;
@@ -140,6 +163,14 @@ struct receive_writer_arg {
 	or_need_sync_t or_need_sync;
 };
 
+typedef struct receive_write_batch {
+	struct receive_writer_arg *rwb_rwa;
+	list_t rwb_records;
+	uint64_t rwb_object;
+	uint64_t rwb_seq;
+	taskq_ent_t rwb_ent;
+} receive_write_batch_t;
+
 typedef struct dmu_recv_begin_arg {
 	const char *drba_origin;
 	dmu_recv_cookie_t *drba_cookie;
@@ -1569,9 +1600,10 @@ deduce_nblkptr(dmu_object_type_t bonus_type, uint64_t bonus_size)
 
 static void
 save_resume_state(struct receive_writer_arg *rwa,
-    uint64_t object, uint64_t offset, dmu_tx_t *tx)
+    uint64_t object, uint64_t offset, uint64_t bytes_read, dmu_tx_t *tx)
 {
 	int txgoff = dmu_tx_get_txg(tx) & TXG_MASK;
+	dsl_dataset_t *ds = rwa->os->os_dsl_dataset;
 
 	if (!rwa->resumable)
 		return;
@@ -1580,7 +1612,7 @@ save_resume_state(struct receive_writer_arg *rwa,
 	 * We use ds_resume_bytes[] != 0 to indicate that we need to
 	 * update this on disk, so it must not be 0.
 	 */
-	ASSERT(rwa->bytes_read != 0);
+	ASSERT(bytes_read != 0);
 
 	/*
 	 * We only resume from write records, which have a valid
@@ -1591,17 +1623,18 @@ save_resume_state(struct receive_writer_arg *rwa,
 	/*
 	 * For resuming to work correctly, we must receive records in order,
 	 * sorted by object,offset.  This is checked by the callers, but
-	 * assert it here for good measure.
+	 * assert it here for good measure.  Write batches flushed in
+	 * parallel get here one at a time and in order, see
+	 * receive_write_batch_retire().
 	 */
-	ASSERT3U(object, >=, rwa->os->os_dsl_dataset->ds_resume_object[txgoff]);
-	ASSERT(object != rwa->os->os_dsl_dataset->ds_resume_object[txgoff] ||
-	    offset >= rwa->os->os_dsl_dataset->ds_resume_offset[txgoff]);
-	ASSERT3U(rwa->bytes_read, >=,
-	    rwa->os->os_dsl_dataset->ds_resume_bytes[txgoff]);
-
-	rwa->os->os_dsl_dataset->ds_resume_object[txgoff] = object;
-	rwa->os->os_dsl_dataset->ds_resume_offset[txgoff] = offset;
-	rwa->os->os_dsl_dataset->ds_resume_bytes[txgoff] = rwa->bytes_read;
+	ASSERT3U(object, >=, ds->ds_resume_object[txgoff]);
+	ASSERT(object != ds->ds_resume_object[txgoff] ||
+	    offset >= ds->ds_resume_offset[txgoff]);
+	ASSERT3U(bytes_read, >=, ds->ds_resume_bytes[txgoff]);
+
+	ds->ds_resume_object[txgoff] = object;
+	ds->ds_resume_offset[txgoff] = offset;
+	ds->ds_resume_bytes[txgoff] = bytes_read;
 }
 
 static int
@@ -2121,7 +2154,7 @@ receive_object(struct receive_writer_arg *rwa, struct drr_object *drro,
 	 * fact that sender always sends object record before anything else,
 	 * after which it will "resend" data at offset 0 and resume normally.
 	 */
-	save_resume_state(rwa, drro->drr_object, 0, tx);
+	save_resume_state(rwa, drro->drr_object, 0, rwa->bytes_read, tx);
 
 	dmu_tx_commit(tx);
 
@@ -2164,45 +2197,117 @@ receive_freeobjects(struct receive_writer_arg *rwa,
 	return (0);
 }
 
+/*
+ * With write_taskq, wait until all batches dispatched before this one have
+ * assigned their tx.
+ */
+static void
+receive_write_batch_enter(struct receive_writer_arg *rwa, uint64_t seq)
+{
+	if (rwa->write_taskq == NULL)
+		return;
+
+	mutex_enter(&rwa->write_lock);
+	while (rwa->write_assigned != seq)
+		cv_wait(&rwa->write_cv, &rwa->write_lock);
+	mutex_exit(&rwa->write_lock);
+}
+
+static void
+receive_write_batch_exit(struct receive_writer_arg *rwa)
+{
+	if (rwa->write_taskq == NULL)
+		return;
+
+	mutex_enter(&rwa->write_lock);
+	rwa->write_assigned++;
+	cv_broadcast(&rwa->write_cv);
+	mutex_exit(&rwa->write_lock);
+}
+
+/*
+ * With write_taskq, wait until all batches dispatched before this one have
+ * finished, then record how far this one got and let the next one go.
+ * The resume point only moves forward if every earlier batch succeeded,
+ * so a failed batch can never be skipped over by a resumed receive.  A
+ * batch that failed part way still records the records it wrote, just as
+ * the serial path does.  The tx is still open, so a batch's resume state
+ * always lands in the txg that holds its data.
+ */
+static void
+receive_write_batch_retire(struct receive_writer_arg *rwa, uint64_t seq,
+    int err, uint64_t object, uint64_t offset, uint64_t bytes_read,
+    dmu_tx_t *tx)
+{
+	boolean_t save;
+
+	if (rwa->write_taskq == NULL)
+		return;
+
+	mutex_enter(&rwa->write_lock);
+	while (rwa->write_retired != seq)
+		cv_wait(&rwa->write_cv, &rwa->write_lock);
+	save = (rwa->err == 0 && bytes_read != 0);
+	mutex_exit(&rwa->write_lock);
+
+	if (save)
+		save_resume_state(rwa, object, offset, bytes_read, tx);
+
+	mutex_enter(&rwa->write_lock);
+	if (rwa->err == 0)
+		rwa->err = err;
+	rwa->write_retired++;
+	cv_broadcast(&rwa->write_cv);
+	mutex_exit(&rwa->write_lock);
+}
+
 /*
  * Note: if this fails, the caller will clean up any records left on the
- * rwa->write_batch list.
+ * batch list.
  */
 static int
-flush_write_batch_impl(struct receive_writer_arg *rwa)
+flush_write_batch_impl(struct receive_writer_arg *rwa, list_t *batch,
+    uint64_t object, uint64_t seq)
 {
 	dnode_t *dn;
+	uint64_t resume_object = 0, resume_offset = 0, resume_bytes = 0;
 	int err;
 
-	if (dnode_hold(rwa->os, rwa->last_object, FTAG, &dn) != 0)
-		return (SET_ERROR(EINVAL));
+	receive_write_batch_enter(rwa, seq);
+	if (dnode_hold(rwa->os, object, FTAG, &dn) != 0) {
+		receive_write_batch_exit(rwa);
+		err = SET_ERROR(EINVAL);
+		receive_write_batch_retire(rwa, seq, err, 0, 0, 0, NULL);
+		return (err);
+	}
 
-	struct receive_record_arg *last_rrd = list_tail(&rwa->write_batch);
+	struct receive_record_arg *last_rrd = list_tail(batch);
 	struct drr_write *last_drrw = &last_rrd->header.drr_u.drr_write;
 
-	struct receive_record_arg *first_rrd = list_head(&rwa->write_batch);
+	struct receive_record_arg *first_rrd = list_head(batch);
 	struct drr_write *first_drrw = &first_rrd->header.drr_u.drr_write;
 
-	ASSERT3U(rwa->last_object, ==, last_drrw->drr_object);
-	ASSERT3U(rwa->last_offset, ==, last_drrw->drr_offset);
+	ASSERT3U(object, ==, last_drrw->drr_object);
 
 	dmu_tx_t *tx = dmu_tx_create(rwa->os);
 	dmu_tx_hold_write_by_dnode(tx, dn, first_drrw->drr_offset,
 	    last_drrw->drr_offset - first_drrw->drr_offset +
 	    last_drrw->drr_logical_size);
 	err = dmu_tx_assign(tx, TXG_WAIT);
+	receive_write_batch_exit(rwa);
 	if (err != 0) {
 		dmu_tx_abort(tx);
 		dnode_rele(dn, FTAG);
+		receive_write_batch_retire(rwa, seq, err, 0, 0, 0, NULL);
 		return (err);
 	}
 
 	struct receive_record_arg *rrd;
-	while ((rrd = list_head(&rwa->write_batch)) != NULL) {
+	while ((rrd = list_head(batch)) != NULL) {
 		struct drr_write *drrw = &rrd->header.drr_u.drr_write;
 		abd_t *abd = rrd->abd;
 
-		ASSERT3U(drrw->drr_object, ==, rwa->last_object);
+		ASSERT3U(drrw->drr_object, ==, object);
 
 		if (drrw->drr_logical_size != dn->dn_datablksz) {
 			/*
@@ -2310,32 +2415,123 @@ flush_write_batch_impl(struct receive_writer_arg *rwa)
 		 * received (as opposed to the next record), so that we can
 		 * verify that we are resuming from the correct location.
 		 */
-		save_resume_state(rwa, drrw->drr_object, drrw->drr_offset, tx);
+		if (rwa->write_taskq == NULL) {
+			save_resume_state(rwa, drrw->drr_object,
+			    drrw->drr_offset, rrd->bytes_read, tx);
+		} else {
+			resume_object = drrw->drr_object;
+			resume_offset = drrw->drr_offset;
+			resume_bytes = rrd->bytes_read;
+		}
 
-		list_remove(&rwa->write_batch, rrd);
+		list_remove(batch, rrd);
 		kmem_free(rrd, sizeof (*rrd));
 	}
 
+	receive_write_batch_retire(rwa, seq, err, resume_object, resume_offset,
+	    resume_bytes, tx);
 	dmu_tx_commit(tx);
 	dnode_rele(dn, FTAG);
 	return (err);
 }
 
+static void
+free_write_batch(list_t *batch)
+{
+	struct receive_record_arg *rrd;
+
+	while ((rrd = list_remove_head(batch)) != NULL) {
+		abd_free(rrd->abd);
+		kmem_free(rrd, sizeof (*rrd));
+	}
+}
+
+static void
+receive_write_batch_task(void *arg)
+{
+	receive_write_batch_t *rwb = arg;
+	struct receive_writer_arg *rwa = rwb->rwb_rwa;
+	fstrans_cookie_t cookie = spl_fstrans_mark();
+
+	if (rwa->err == 0) {
+		(void) flush_write_batch_impl(rwa, &rwb->rwb_records,
+		    rwb->rwb_object, rwb->rwb_seq);
+	} else {
+		/* Later batches still need their turn to assign and retire. */
+		receive_write_batch_enter(rwa, rwb->rwb_seq);
+		receive_write_batch_exit(rwa);
+		receive_write_batch_retire(rwa, rwb->rwb_seq, 0, 0, 0, 0,
+		    NULL);
+	}
+	free_write_batch(&rwb->rwb_records);
+	list_destroy(&rwb->rwb_records);
+
+	mutex_enter(&rwa->write_lock);
+	rwa->write_done++;
+	cv_broadcast(&rwa->write_cv);
+	mutex_exit(&rwa->write_lock);
+
+	kmem_free(rwb, sizeof (*rwb));
+	spl_fstrans_unmark(cookie);
+}
+
+/*
+ * Wait for all batches handed to write_taskq to be written, and return the
+ * first error any of them hit.
+ */
+static int
+receive_write_batch_wait(struct receive_writer_arg *rwa)
+{
+	if (rwa->write_taskq == NULL)
+		return (0);
+
+	mutex_enter(&rwa->write_lock);
+	while (rwa->write_done != rwa->write_dispatched)
+		cv_wait(&rwa->write_cv, &rwa->write_lock);
+	int err = rwa->err;
+	mutex_exit(&rwa->write_lock);
+
+	return (err);
+}
+
 noinline static int
 flush_write_batch(struct receive_writer_arg *rwa)
 {
 	if (list_is_empty(&rwa->write_batch))
 		return (0);
 	int err = rwa->err;
-	if (err == 0)
-		err = flush_write_batch_impl(rwa);
-	if (err != 0) {
-		struct receive_record_arg *rrd;
-		while ((rrd = list_remove_head(&rwa->write_batch)) != NULL) {
-			abd_free(rrd->abd);
-			kmem_free(rrd, sizeof (*rrd));
-		}
+	if (err == 0 && rwa->write_taskq != NULL) {
+		receive_write_batch_t *rwb = kmem_alloc(sizeof (*rwb),
+		    KM_SLEEP);
+
+		/*
+		 * Bound the memory held by batches in flight, since it no
+		 * longer counts against the receive queue.
+		 */
+		mutex_enter(&rwa->write_lock);
+		while (rwa->write_dispatched - rwa->write_done >=
+		    2 * rwa->write_threads)
+			cv_wait(&rwa->write_cv, &rwa->write_lock);
+		mutex_exit(&rwa->write_lock);
+
+		rwb->rwb_rwa = rwa;
+		list_create(&rwb->rwb_records,
+		    sizeof (struct receive_record_arg),
+		    offsetof(struct receive_record_arg, node.bqn_node));
+		list_move_tail(&rwb->rwb_records, &rwa->write_batch);
+		rwb->rwb_object = rwa->last_object;
+		rwb->rwb_seq = rwa->write_dispatched++;
+		taskq_init_ent(&rwb->rwb_ent);
+		taskq_dispatch_ent(rwa->write_taskq, receive_write_batch_task,
+		    rwb, 0, &rwb->rwb_ent);
+		return (0);
 	}
+	if (err == 0) {
+		err = flush_write_batch_impl(rwa, &rwa->write_batch,
+		    rwa->last_object, 0);
+	}
+	if (err != 0)
+		free_write_batch(&rwa->write_batch);
 	ASSERT(list_is_empty(&rwa->write_batch));
 	return (err);
 }
@@ -2475,7 +2671,8 @@ receive_write_embedded(struct receive_writer_arg *rwa,
 	    rwa->byteswap ^ ZFS_HOST_BYTEORDER, tx);
 
 	/* See comment in restore_write. */
-	save_resume_state(rwa, drrwe->drr_object, drrwe->drr_offset, tx);
+	save_resume_state(rwa, drrwe->drr_object, drrwe->drr_offset,
+	    rwa->bytes_read, tx);
 	dmu_tx_commit(tx);
 	return (0);
 }
@@ -3070,6 +3267,8 @@ receive_process_record(struct receive_writer_arg *rwa,
 
 	if (!rwa->heal && rrd->header.drr_type != DRR_WRITE) {
 		err = flush_write_batch(rwa);
+		if (err == 0)
+			err = receive_write_batch_wait(rwa);
 		if (err != 0) {
 			if (rrd->abd != NULL) {
 				abd_free(rrd->abd);
@@ -3206,8 +3405,10 @@ receive_writer_thread(void *arg)
 		 * When healing data we always need to free the record.
 		 */
 		if (err != EAGAIN || rwa->heal) {
+			mutex_enter(&rwa->write_lock);
 			if (rwa->err == 0)
 				rwa->err = err;
+			mutex_exit(&rwa->write_lock);
 			kmem_free(rrd, sizeof (*rrd));
 		}
 	}
@@ -3217,8 +3418,11 @@ receive_writer_thread(void *arg)
 		zio_wait(rwa->heal_pio);
 	} else {
 		int err = flush_write_batch(rwa);
+		(void) receive_write_batch_wait(rwa);
+		mutex_enter(&rwa->write_lock);
 		if (rwa->err == 0)
 			rwa->err = err;
+		mutex_exit(&rwa->write_lock);
 	}
 	mutex_enter(&rwa->mutex);
 	rwa->done = B_TRUE;
@@ -3370,6 +3574,13 @@ dmu_recv_stream(dmu_recv_cookie_t *drc, offset_t *voffp)
 	}
 	list_create(&rwa->write_batch, sizeof (struct receive_record_arg),
 	    offsetof(struct receive_record_arg, node.bqn_node));
+	mutex_init(&rwa->write_lock, NULL, MUTEX_DEFAULT, NULL);
+	cv_init(&rwa->write_cv, NULL, CV_DEFAULT, NULL);
+	rwa->write_threads = zfs_recv_write_threads;
+	if (rwa->write_threads > 0 && !drc->drc_heal) {
+		rwa->write_taskq = taskq_create("z_recv_write",
+		    rwa->write_threads, minclsyspri, 0, INT_MAX, 0);
+	}
 
 	(void) thread_create(NULL, 0, receive_writer_thread, rwa, 0, curproc,
 	    TS_RUN, minclsyspri);
@@ -3453,6 +3664,10 @@ dmu_recv_stream(dmu_recv_cookie_t *drc, offset_t *voffp)
 		}
 	}
 
+	if (rwa->write_taskq != NULL)
+		taskq_destroy(rwa->write_taskq);
+	cv_destroy(&rwa->write_cv);
+	mutex_destroy(&rwa->write_lock);
 	cv_destroy(&rwa->cv);
 	mutex_destroy(&rwa->mutex);
 	bqueue_destroy(&rwa->q);
@@ -3804,6 +4019,9 @@ ZFS_MODULE_PARAM(zfs_recv, zfs_recv_, queue_ff, UINT, ZMOD_RW,
 ZFS_MODULE_PARAM(zfs_recv, zfs_recv_, write_batch_size, UINT, ZMOD_RW,
 	"Maximum amount of writes to batch into one transaction");
 
+ZFS_MODULE_PARAM(zfs_recv, zfs_recv_, write_threads, UINT, ZMOD_RW,
+	"Number of threads writing batches of a receive in parallel");
+
 ZFS_MODULE_PARAM(zfs_recv, zfs_recv_, best_effort_corrective, INT, ZMOD_RW,
 	"Ignore errors during corrective receive");
 /* END CSTYLED */
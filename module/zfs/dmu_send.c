@@ -93,6 +93,15 @@ static uint_t zfs_send_no_prefetch_queue_length = 1024 * 1024;
  */
 static uint_t zfs_send_queue_ff = 20;
 static uint_t zfs_send_no_prefetch_queue_ff = 20;
+/*
+ * Number of threads per send which look up and issue the reads for data
+ * blocks.  A cache hit in the ARC may have to decompress or decrypt the
+ * block before it can be handed back, which is too much work for the single
+ * send_reader_thread on fast pools.  Blocks are still sent in order; the
+ * amount read ahead is bounded by zfs_send_queue_length.  With 0, reads are
+ * issued by send_reader_thread itself.
+ */
+static uint_t zfs_send_reader_threads = 4;
 
 /*
  * Use this to override the recordsize calculation for fast zfs send estimates.
@@ -166,6 +175,7 @@ struct send_range {
 			kcondvar_t		cv;
 			boolean_t		io_outstanding;
 			boolean_t		io_compressed;
+			zio_flag_t		io_flags;
 			int			io_err;
 		} data;
 		struct srh {
@@ -1600,6 +1610,7 @@ send_merge_thread(void *arg)
 struct send_reader_thread_arg {
 	struct send_merge_thread_arg *smta;
 	bqueue_t q;
+	taskq_t *read_taskq;
 	boolean_t cancel;
 	boolean_t issue_reads;
 	uint64_t featureflags;
@@ -1624,6 +1635,67 @@ dmu_send_read_done(zio_t *zio)
 	mutex_exit(&range->sru.data.lock);
 }
 
+/*
+ * Returns B_TRUE if a zio was issued for the block, in which case
+ * dmu_send_read_done() will clear io_outstanding.
+ */
+static boolean_t
+send_read_block(objset_t *os, struct send_range *range)
+{
+	struct srd *srdp = &range->sru.data;
+	blkptr_t *bp = &srdp->bp;
+
+	zbookmark_phys_t zb = {
+	    .zb_objset = dmu_objset_id(os),
+	    .zb_object = range->object,
+	    .zb_level = 0,
+	    .zb_blkid = range->start_blkid,
+	};
+
+	arc_flags_t aflags = ARC_FLAG_CACHED_ONLY;
+
+	int arc_err = arc_read(NULL, os->os_spa, bp,
+	    arc_getbuf_func, &srdp->abuf, ZIO_PRIORITY_ASYNC_READ,
+	    srdp->io_flags, &aflags, &zb);
+	/*
+	 * If the data is not already cached in the ARC, we read directly
+	 * from zio.  This avoids the performance overhead of adding a new
+	 * entry to the ARC, and we also avoid polluting the ARC cache with
+	 * data that is not likely to be used in the future.
+	 */
+	if (arc_err != 0) {
+		srdp->abd = abd_alloc_linear(srdp->datasz, B_FALSE);
+		zio_nowait(zio_read(NULL, os->os_spa, bp, srdp->abd,
+		    srdp->datasz, dmu_send_read_done, range,
+		    ZIO_PRIORITY_ASYNC_READ, srdp->io_flags, &zb));
+		return (B_TRUE);
+	}
+	return (B_FALSE);
+}
+
+typedef struct send_read_task_arg {
+	objset_t *os;
+	struct send_range *range;
+} send_read_task_arg_t;
+
+static void
+send_read_task(void *arg)
+{
+	send_read_task_arg_t *srt = arg;
+	struct send_range *range = srt->range;
+	fstrans_cookie_t cookie = spl_fstrans_mark();
+
+	if (!send_read_block(srt->os, range)) {
+		mutex_enter(&range->sru.data.lock);
+		ASSERT(range->sru.data.io_outstanding);
+		range->sru.data.io_outstanding = B_FALSE;
+		cv_broadcast(&range->sru.data.cv);
+		mutex_exit(&range->sru.data.lock);
+	}
+	kmem_free(srt, sizeof (*srt));
+	spl_fstrans_unmark(cookie);
+}
+
 static void
 issue_data_read(struct send_reader_thread_arg *srta, struct send_range *range)
 {
@@ -1669,6 +1741,7 @@ issue_data_read(struct send_reader_thread_arg *srta, struct send_range *range)
 
 	srdp->datasz = (zioflags & ZIO_FLAG_RAW_COMPRESS) ?
 	    BP_GET_PSIZE(bp) : BP_GET_LSIZE(bp);
+	srdp->io_flags = zioflags;
 
 	if (!srta->issue_reads)
 		return;
@@ -1677,30 +1750,21 @@ issue_data_read(struct send_reader_thread_arg *srta, struct send_range *range)
 	if (send_do_embed(bp, srta->featureflags))
 		return;
 
-	zbookmark_phys_t zb = {
-	    .zb_objset = dmu_objset_id(os),
-	    .zb_object = range->object,
-	    .zb_level = 0,
-	    .zb_blkid = range->start_blkid,
-	};
-
-	arc_flags_t aflags = ARC_FLAG_CACHED_ONLY;
-
-	int arc_err = arc_read(NULL, os->os_spa, bp,
-	    arc_getbuf_func, &srdp->abuf, ZIO_PRIORITY_ASYNC_READ,
-	    zioflags, &aflags, &zb);
 	/*
-	 * If the data is not already cached in the ARC, we read directly
-	 * from zio.  This avoids the performance overhead of adding a new
-	 * entry to the ARC, and we also avoid polluting the ARC cache with
-	 * data that is not likely to be used in the future.
+	 * The range is not on the output queue yet, so nobody can be
+	 * waiting on io_outstanding until it is.  The caller enqueues it
+	 * while the read may still be in progress; do_dump() waits for it.
 	 */
-	if (arc_err != 0) {
-		srdp->abd = abd_alloc_linear(srdp->datasz, B_FALSE);
-		srdp->io_outstanding = B_TRUE;
-		zio_nowait(zio_read(NULL, os->os_spa, bp, srdp->abd,
-		    srdp->datasz, dmu_send_read_done, range,
-		    ZIO_PRIORITY_ASYNC_READ, zioflags, &zb));
+	srdp->io_outstanding = B_TRUE;
+	if (srta->read_taskq != NULL) {
+		send_read_task_arg_t *srt = kmem_alloc(sizeof (*srt),
+		    KM_SLEEP);
+		srt->os = os;
+		srt->range = range;
+		VERIFY3U(taskq_dispatch(srta->read_taskq, send_read_task, srt,
+		    TQ_SLEEP), !=, TASKQID_INVALID);
+	} else if (!send_read_block(os, range)) {
+		srdp->io_outstanding = B_FALSE;
 	}
 }
 
@@ -2149,6 +2213,11 @@ setup_reader_thread(struct send_reader_thread_arg *srt_arg,
 	srt_arg->smta = smt_arg;
 	srt_arg->issue_reads = !dspp->dso->dso_dryrun;
 	srt_arg->featureflags = featureflags;
+	if (srt_arg->issue_reads && zfs_send_reader_threads > 0) {
+		srt_arg->read_taskq = taskq_create("z_send_read",
+		    zfs_send_reader_threads, minclsyspri, 1, INT_MAX,
+		    TASKQ_DYNAMIC);
+	}
 	(void) thread_create(NULL, 0, send_reader_thread, srt_arg, 0,
 	    curproc, TS_RUN, minclsyspri);
 }
@@ -2570,6 +2639,12 @@ dmu_send_impl(struct dmu_send_params *dspp)
 	}
 	range_free(range);
 
+	/*
+	 * Every range handed to the read taskq has been freed above, which
+	 * waited for its read, so this only waits for the tasks to return.
+	 */
+	if (srt_arg->read_taskq != NULL)
+		taskq_destroy(srt_arg->read_taskq);
 	bqueue_destroy(&srt_arg->q);
 	bqueue_destroy(&smt_arg->q);
 	if (dspp->redactbook != NULL)
@@ -3115,6 +3190,9 @@ ZFS_MODULE_PARAM(zfs_send, zfs_send_, no_prefetch_queue_length, UINT, ZMOD_RW,
 ZFS_MODULE_PARAM(zfs_send, zfs_send_, queue_ff, UINT, ZMOD_RW,
 	"Send queue fill fraction");
 
+ZFS_MODULE_PARAM(zfs_send, zfs_send_, reader_threads, UINT, ZMOD_RW,
+	"Number of threads issuing reads for each send");
+
 ZFS_MODULE_PARAM(zfs_send, zfs_send_, no_prefetch_queue_ff, UINT, ZMOD_RW,
 	"Send queue fill fraction for non-prefetch queues");
 
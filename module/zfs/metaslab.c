@@ -101,6 +101,18 @@ uint_t zfs_condense_pct = 200;
  */
 static const int zfs_metaslab_condense_block_threshold = 4;
 
+/*
+ * Loading a metaslab replays every entry of its space map, so the cost of
+ * a load is proportional to the on-disk length, not to the number of free
+ * segments.  zfs_condense_pct only condenses a metaslab that happens to be
+ * dirtied while it is loaded; one that is loaded after import and then
+ * left idle keeps its long log.  If a load finds the space map to be more
+ * than zfs_metaslab_load_condense_pct/100 times its optimal size, we
+ * request a condense so the next load reads a sorted snapshot of the free
+ * segments followed by a short log.  Zero disables this.
+ */
+static uint_t zfs_metaslab_load_condense_pct = 400;
+
 /*
  * The zfs_mg_noalloc_threshold defines which metaslab groups should
  * be eligible for allocation. The value is defined as a percentage of
@@ -2295,6 +2307,52 @@ metaslab_potentially_evict(metaslab_class_t *mc)
 #endif
 }
 
+/*
+ * Called once a load has populated ms_allocatable.  If replaying the space
+ * map was much more work than reading its condensed form would be, flag
+ * the metaslab so that it gets condensed in the next txg.
+ */
+static void
+metaslab_load_condense_check(metaslab_t *msp)
+{
+	space_map_t *sm = msp->ms_sm;
+	vdev_t *vd = msp->ms_group->mg_vd;
+	spa_t *spa = vd->vdev_spa;
+
+	ASSERT(MUTEX_HELD(&msp->ms_lock));
+	ASSERT(msp->ms_loaded);
+
+	if (zfs_metaslab_load_condense_pct == 0 || sm == NULL ||
+	    msp->ms_condense_wanted || !spa_writeable(spa))
+		return;
+
+	uint64_t record_size = MAX(sm->sm_blksz, 1ULL << vd->vdev_ashift);
+	uint64_t object_size = space_map_length(sm);
+	if (object_size <= zfs_metaslab_condense_block_threshold * record_size)
+		return;
+
+	uint64_t optimal_size = space_map_estimate_optimal_size(sm,
+	    msp->ms_allocatable, SM_NO_VDEVID);
+	if (object_size < optimal_size * zfs_metaslab_load_condense_pct / 100)
+		return;
+
+	/*
+	 * See metaslab_recalculate_fragmentation() for why we must not
+	 * dirty the metaslab past the final dirty txg.
+	 */
+	uint64_t txg = spa_syncing_txg(spa);
+	if (txg >= spa_final_dirty_txg(spa))
+		return;
+
+	msp->ms_condense_wanted = B_TRUE;
+	vdev_dirty(vd, VDD_METASLAB, msp, txg + 1);
+	zfs_dbgmsg("txg %llu, requesting condense after load: "
+	    "ms_id %llu, vdev_id %llu, smp_length %llu, optimal %llu",
+	    (u_longlong_t)txg, (u_longlong_t)msp->ms_id,
+	    (u_longlong_t)vd->vdev_id, (u_longlong_t)object_size,
+	    (u_longlong_t)optimal_size);
+}
+
 static int
 metaslab_load_impl(metaslab_t *msp)
 {
@@ -2466,6 +2524,12 @@ metaslab_load_impl(metaslab_t *msp)
 		    range_tree_remove, msp->ms_allocatable);
 	}
 
+	/*
+	 * ms_allocatable is now complete, so we know how long a condensed
+	 * space map for it would be.
+	 */
+	metaslab_load_condense_check(msp);
+
 	/*
 	 * Call metaslab_recalculate_weight_and_sort() now that the
 	 * metaslab is loaded so we get the metaslab's real weight.
@@ -5112,9 +5176,14 @@ metaslab_group_alloc(metaslab_group_t *mg, zio_alloc_list_t *zal,
 	offset = metaslab_group_alloc_normal(mg, zal, asize, txg, want_unique,
 	    dva, d, allocator, try_hard);
 
-	mutex_enter(&mg->mg_lock);
+	/*
+	 * The group counters are statistics only, so bump them atomically
+	 * rather than retaking mg_lock, which is shared by every allocator,
+	 * on each successful allocation.
+	 */
+	atomic_inc_64(&mg->mg_allocations);
 	if (offset == -1ULL) {
-		mg->mg_failed_allocations++;
+		atomic_inc_64(&mg->mg_failed_allocations);
 		metaslab_trace_add(zal, mg, NULL, asize, d,
 		    TRACE_GROUP_FAILURE, allocator);
 		if (asize == SPA_GANGBLOCKSIZE) {
@@ -5129,11 +5198,11 @@ metaslab_group_alloc(metaslab_group_t *mg, zio_alloc_list_t *zal,
 			 * is only responsible for skipping devices and
 			 * not failing block allocations.
 			 */
+			mutex_enter(&mg->mg_lock);
 			mg->mg_no_free_space = B_TRUE;
+			mutex_exit(&mg->mg_lock);
 		}
 	}
-	mg->mg_allocations++;
-	mutex_exit(&mg->mg_lock);
 	return (offset);
 }
 
@@ -6274,6 +6343,10 @@ ZFS_MODULE_PARAM(zfs_metaslab, zfs_metaslab_, max_size_cache_sec, U64,
 ZFS_MODULE_PARAM(zfs_metaslab, zfs_metaslab_, mem_limit, UINT, ZMOD_RW,
 	"Percentage of memory that can be used to store metaslab range trees");
 
+ZFS_MODULE_PARAM(zfs_metaslab, zfs_metaslab_, load_condense_pct, UINT,
+	ZMOD_RW, "Condense a metaslab whose space map was this much larger "
+	"than optimal when it was loaded");
+
 ZFS_MODULE_PARAM(zfs_metaslab, zfs_metaslab_, try_hard_before_gang, INT,
 	ZMOD_RW, "Try hard to allocate before ganging");
 
@@ -216,6 +216,17 @@ static const boolean_t spa_create_process = B_TRUE; /* no process => no sysdc */
 
 static uint_t	zio_taskq_write_tpq = 16;
 
+/*
+ * When set, spa_select_allocator() picks the allocator from the CPU the
+ * write is issued on rather than from a hash of the block's bookmark.
+ * Writers on CPUs mapped to different allocators then don't contend on
+ * the same rotor, active metaslabs and ms_lock, at the cost of spreading
+ * a single object's blocks over several metaslabs.  This only applies to
+ * writes issued outside the pool's sync threads, which already have an
+ * allocator each.
+ */
+static int	spa_allocator_cpu_affinity = B_FALSE;
+
 /*
  * Report any spa_load_verify errors found, but do not fail spa_load.
  * This is used by zdb to analyze non-idle pools.
@@ -2124,6 +2135,11 @@ spa_unload(spa_t *spa)
 		vdev_free(spa->spa_root_vdev);
 	ASSERT(spa->spa_root_vdev == NULL);
 
+	/*
+	 * The BRT holds dnodes of MOS objects, so unload it first.
+	 */
+	brt_unload(spa);
+
 	/*
 	 * Close the dsl pool.
 	 */
@@ -2134,7 +2150,6 @@ spa_unload(spa_t *spa)
 	}
 
 	ddt_unload(spa);
-	brt_unload(spa);
 	spa_unload_log_sm_metadata(spa);
 
 	/*
@@ -10412,6 +10427,19 @@ spa_select_allocator(zio_t *zio)
 		}
 	}
 
+	/*
+	 * Writes issued elsewhere, such as dmu_sync() for the ZIL, Direct
+	 * I/O and the txg sync thread itself, can be spread by CPU instead.
+	 * CPUs are mapped onto the allocators round-robin, so each allocator
+	 * is only shared by a fixed subset of them.  The CPU id is only a
+	 * hint; a preempted thread simply ends up using another allocator,
+	 * which is harmless.
+	 */
+	if (spa_allocator_cpu_affinity) {
+		zio->io_allocator = CPU_SEQID_UNSTABLE % spa->spa_alloc_count;
+		return;
+	}
+
 	/*
 	 * We want to try to use as many allocators as possible to help improve
 	 * performance, but we also want logically adjacent IOs to be physically
@@ -10993,6 +11021,9 @@ ZFS_MODULE_PARAM(zfs_spa, spa_, load_verify_data, INT, ZMOD_RW,
 ZFS_MODULE_PARAM(zfs_spa, spa_, load_print_vdev_tree, INT, ZMOD_RW,
 	"Print vdev tree to zfs_dbgmsg during pool import");
 
+ZFS_MODULE_PARAM(zfs_spa, spa_, allocator_cpu_affinity, INT, ZMOD_RW,
+	"Select the block allocator by CPU instead of by bookmark hash");
+
 ZFS_MODULE_PARAM(zfs_zio, zio_, taskq_batch_pct, UINT, ZMOD_RW,
 	"Percentage of CPUs to run an IO worker thread");
 
@@ -1424,7 +1424,12 @@ vdev_indirect_repair(zio_t *zio)
 {
 	indirect_vsd_t *iv = zio->io_vsd;
 
-	if (!spa_writeable(zio->io_spa))
+	/*
+	 * Direct I/O reads land in user pages which can't be trusted for
+	 * repair; see vdev_mirror_io_done().
+	 */
+	if (!spa_writeable(zio->io_spa) ||
+	    (zio->io_flags & ZIO_FLAG_DIO_READ))
 		return;
 
 	for (indirect_split_t *is = list_head(&iv->iv_splits);
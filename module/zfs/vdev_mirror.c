@@ -857,7 +857,13 @@ vdev_mirror_io_done(zio_t *zio)
 		ASSERT(zio->io_error != 0);
 	}
 
+	/*
+	 * Direct I/O reads land in user pages which may be changed while the
+	 * read is in flight, so that data can't be trusted to repair anything.
+	 * A failed Direct I/O read is retried through the ARC, which repairs.
+	 */
 	if (good_copies && spa_writeable(zio->io_spa) &&
+	    !(zio->io_flags & ZIO_FLAG_DIO_READ) &&
 	    (unexpected_errors ||
 	    (zio->io_flags & ZIO_FLAG_RESILVER) ||
 	    ((zio->io_flags & ZIO_FLAG_SCRUB) && mm->mm_resilvering))) {
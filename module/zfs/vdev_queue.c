@@ -31,6 +31,7 @@
 #include <sys/vdev_impl.h>
 #include <sys/spa_impl.h>
 #include <sys/zio.h>
+#include <sys/zio_checksum.h>
 #include <sys/avl.h>
 #include <sys/dsl_pool.h>
 #include <sys/metaslab_impl.h>
@@ -228,6 +229,15 @@ uint_t zfs_vdev_queue_depth_pct = 300;
  */
 uint_t zfs_vdev_def_queue_depth = 32;
 
+/*
+ * Issue synchronous writes to non-rotational dedicated log devices directly,
+ * without queueing them with the device's other I/O.  ZIL writes are the
+ * only latency-critical I/O on a SLOG, and on very low latency devices such
+ * as persistent memory the queue's scheduling and locking make up a large
+ * part of their latency.
+ */
+static int zfs_vdev_log_bypass_queue = 0;
+
 static int
 vdev_queue_offset_compare(const void *x1, const void *x2)
 {
@@ -596,6 +606,28 @@ vdev_queue_pending_remove(vdev_queue_t *vq, zio_t *zio)
 static void
 vdev_queue_agg_io_done(zio_t *aio)
 {
+	/*
+	 * The data for all of the aggregated reads arrived together, so
+	 * verify their checksums together rather than one by one as each
+	 * read completes.
+	 */
+	if (aio->io_type == ZIO_TYPE_READ && aio->io_error == 0) {
+		zio_t *dios[ZIO_CHECKSUM_BATCH_MAX];
+		zio_link_t *zl = NULL;
+		uint_t n = 0;
+		zio_t *dio;
+
+		while ((dio = zio_walk_parents(aio, &zl)) != NULL) {
+			dios[n++] = dio;
+			if (n == ZIO_CHECKSUM_BATCH_MAX) {
+				zio_checksum_verify_batch(dios, n);
+				n = 0;
+			}
+		}
+		if (n > 0)
+			zio_checksum_verify_batch(dios, n);
+	}
+
 	abd_free(aio->io_abd);
 }
 
@@ -946,6 +978,13 @@ vdev_queue_io(zio_t *zio)
 	zio->io_flags |= ZIO_FLAG_DONT_QUEUE;
 	zio->io_timestamp = gethrtime();
 
+	if (zfs_vdev_log_bypass_queue &&
+	    zio->io_priority == ZIO_PRIORITY_SYNC_WRITE &&
+	    zio->io_vd->vdev_nonrot && zio->io_vd->vdev_top->vdev_islog) {
+		zio->io_queue_state = ZIO_QS_BYPASS;
+		return (zio);
+	}
+
 	mutex_enter(&vq->vq_lock);
 	vdev_queue_io_add(vq, zio);
 	nio = vdev_queue_io_to_issue(vq);
@@ -978,6 +1017,11 @@ vdev_queue_io_done(zio_t *zio)
 	vq->vq_io_complete_ts = now;
 	vq->vq_io_delta_ts = zio->io_delta = now - zio->io_timestamp;
 
+	if (zio->io_queue_state == ZIO_QS_BYPASS) {
+		zio->io_queue_state = ZIO_QS_NONE;
+		return;
+	}
+
 	mutex_enter(&vq->vq_lock);
 	vdev_queue_pending_remove(vq, zio);
 
@@ -1092,6 +1136,9 @@ ZFS_MODULE_PARAM(zfs_vdev, zfs_vdev_, write_gap_limit, UINT, ZMOD_RW,
 ZFS_MODULE_PARAM(zfs_vdev, zfs_vdev_, max_active, UINT, ZMOD_RW,
 	"Maximum number of active I/Os per vdev");
 
+ZFS_MODULE_PARAM(zfs_vdev, zfs_vdev_, log_bypass_queue, INT, ZMOD_RW,
+	"Issue sync writes to non-rotational log devices without queueing");
+
 ZFS_MODULE_PARAM(zfs_vdev, zfs_vdev_, async_write_active_max_dirty_percent,
 	UINT, ZMOD_RW, "Async write concurrency max threshold");
 
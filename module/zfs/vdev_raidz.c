@@ -2760,7 +2760,12 @@ vdev_raidz_io_done_verified(zio_t *zio, raidz_row_t *rr)
 		unexpected_errors += n;
 	}
 
+	/*
+	 * Direct I/O reads land in user pages which can't be trusted for
+	 * repair; see vdev_mirror_io_done().
+	 */
 	if (zio->io_error == 0 && spa_writeable(zio->io_spa) &&
+	    !(zio->io_flags & ZIO_FLAG_DIO_READ) &&
 	    (unexpected_errors > 0 || (zio->io_flags & ZIO_FLAG_RESILVER))) {
 		/*
 		 * Use the good data we have in hand to repair damaged children.
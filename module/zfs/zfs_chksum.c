@@ -47,6 +47,7 @@ typedef struct {
 	uint64_t bs16m;
 	zio_cksum_salt_t salt;
 	zio_checksum_t *(func);
+	zio_checksum_batch_t *(batch);
 	zio_checksum_tmpl_init_t *(init);
 	zio_checksum_tmpl_free_t *(free);
 } chksum_stat_t;
@@ -136,6 +137,25 @@ chksum_kstat_addr(kstat_t *ksp, loff_t n)
 	return (ksp->ks_private);
 }
 
+/*
+ * Batched implementations are benchmarked checksumming each block size
+ * as CHKSUM_BATCH_BLOCKS smaller blocks in one call.
+ */
+#define	CHKSUM_BATCH_BLOCKS	16
+
+/*
+ * Checksum the blocks of a batch one at a time, for comparison with
+ * abd_fletcher_4_native_batch().
+ */
+static void
+chksum_fletcher_4_unbatched(abd_t **abds, const uint64_t *sizes, uint_t n,
+    const void *ctx_template, zio_cksum_t *zcps)
+{
+	for (uint_t i = 0; i < n; i++)
+		abd_fletcher_4_native(abds[i], sizes[i], ctx_template,
+		    &zcps[i]);
+}
+
 static void
 chksum_run(chksum_stat_t *cs, abd_t *abd, void *ctx, int round,
     uint64_t *result)
@@ -144,6 +164,9 @@ chksum_run(chksum_stat_t *cs, abd_t *abd, void *ctx, int round,
 	uint64_t run_bw, run_time_ns, run_count = 0, size = 0;
 	uint32_t l, loops = 0;
 	zio_cksum_t zcp;
+	abd_t *abds[CHKSUM_BATCH_BLOCKS];
+	uint64_t sizes[CHKSUM_BATCH_BLOCKS];
+	zio_cksum_t zcps[CHKSUM_BATCH_BLOCKS];
 
 	switch (round) {
 	case 1: /* 1k */
@@ -164,16 +187,34 @@ chksum_run(chksum_stat_t *cs, abd_t *abd, void *ctx, int round,
 		size = 1<<24; loops = 1; break;
 	}
 
+	if (cs->batch != NULL) {
+		for (int i = 0; i < CHKSUM_BATCH_BLOCKS; i++) {
+			sizes[i] = size / CHKSUM_BATCH_BLOCKS;
+			abds[i] = abd_get_offset_size(abd, i * sizes[i],
+			    sizes[i]);
+		}
+	}
+
 	kpreempt_disable();
 	start = gethrtime();
 	do {
-		for (l = 0; l < loops; l++, run_count++)
-			cs->func(abd, size, ctx, &zcp);
+		for (l = 0; l < loops; l++, run_count++) {
+			if (cs->batch != NULL)
+				cs->batch(abds, sizes, CHKSUM_BATCH_BLOCKS,
+				    ctx, zcps);
+			else
+				cs->func(abd, size, ctx, &zcp);
+		}
 
 		run_time_ns = gethrtime() - start;
 	} while (run_time_ns < MSEC2NSEC(1));
 	kpreempt_enable();
 
+	if (cs->batch != NULL) {
+		for (int i = 0; i < CHKSUM_BATCH_BLOCKS; i++)
+			abd_free(abds[i]);
+	}
+
 	run_bw = size * run_count * NANOSEC;
 	run_bw /= run_time_ns;	/* B/s */
 	*result = run_bw/1024/1024; /* MiB/s */
@@ -251,7 +292,7 @@ chksum_benchmark(void)
 	const zfs_impl_t *sha512 = zfs_impl_get_ops("sha512");
 
 	/* count implementations */
-	chksum_stat_cnt = 2;
+	chksum_stat_cnt = 4;
 	chksum_stat_cnt += sha256->getcnt();
 	chksum_stat_cnt += sha512->getcnt();
 	chksum_stat_cnt += blake3->getcnt();
@@ -278,6 +319,19 @@ chksum_benchmark(void)
 	cs->impl = "generic";
 	chksum_benchit(cs);
 
+	/* fletcher4, with and without batching */
+	cs = &chksum_stat_data[cbid++];
+	cs->batch = chksum_fletcher_4_unbatched;
+	cs->name = "fletcher4";
+	cs->impl = "unbatched";
+	chksum_benchit(cs);
+
+	cs = &chksum_stat_data[cbid++];
+	cs->batch = abd_fletcher_4_native_batch;
+	cs->name = "fletcher4";
+	cs->impl = "batched";
+	chksum_benchit(cs);
+
 	/* sha256 */
 	id_save = sha256->getid();
 	for (max = 0, id = 0; id < sha256->getcnt(); id++) {
@@ -4094,6 +4094,55 @@ zfs_ioc_pool_prefetch(const char *poolname, nvlist_t *innvl, nvlist_t *outnvl)
 	return (error);
 }
 
+/*
+ * Remove unique entries from the pool's dedup tables that have not changed
+ * for the given number of seconds. The space they used in the tables is
+ * estimated and returned.
+ *
+ * innvl: {
+ *     "ddt_prune_age" -> uint64_t
+ * }
+ *
+ * outnvl: {
+ *     "ddt_prune_entries" -> uint64_t
+ *     "ddt_prune_dspace" -> uint64_t
+ *     "ddt_prune_mspace" -> uint64_t
+ * }
+ */
+static const zfs_ioc_key_t zfs_keys_ddt_prune[] = {
+	{DDT_PRUNE_AGE,		DATA_TYPE_UINT64,	0},
+};
+
+static int
+zfs_ioc_ddt_prune(const char *poolname, nvlist_t *innvl, nvlist_t *outnvl)
+{
+	int error;
+	spa_t *spa;
+	uint64_t age;
+	ddt_object_t freed;
+
+	age = fnvlist_lookup_uint64(innvl, DDT_PRUNE_AGE);
+
+	error = spa_open(poolname, &spa, FTAG);
+	if (error != 0)
+		return (error);
+
+	if (!spa_feature_is_enabled(spa, SPA_FEATURE_FAST_DEDUP)) {
+		spa_close(spa, FTAG);
+		return (SET_ERROR(ENOTSUP));
+	}
+
+	error = ddt_prune_unique_entries(spa, age, &freed);
+
+	fnvlist_add_uint64(outnvl, DDT_PRUNE_ENTRIES, freed.ddo_count);
+	fnvlist_add_uint64(outnvl, DDT_PRUNE_DSPACE, freed.ddo_dspace);
+	fnvlist_add_uint64(outnvl, DDT_PRUNE_MSPACE, freed.ddo_mspace);
+
+	spa_close(spa, FTAG);
+
+	return (error);
+}
+
 /*
  * inputs:
  * zc_name		name of dataset to destroy
@@ -7352,6 +7401,11 @@ zfs_ioctl_init(void)
 	    POOL_CHECK_SUSPENDED, B_TRUE, B_TRUE,
 	    zfs_keys_pool_prefetch, ARRAY_SIZE(zfs_keys_pool_prefetch));
 
+	zfs_ioctl_register("ddt_prune", ZFS_IOC_DDT_PRUNE,
+	    zfs_ioc_ddt_prune, zfs_secpolicy_config, POOL_NAME,
+	    POOL_CHECK_SUSPENDED | POOL_CHECK_READONLY, B_TRUE, B_TRUE,
+	    zfs_keys_ddt_prune, ARRAY_SIZE(zfs_keys_ddt_prune));
+
 	zfs_ioctl_register("initialize", ZFS_IOC_POOL_INITIALIZE,
 	    zfs_ioc_pool_initialize, zfs_secpolicy_config, POOL_NAME,
 	    POOL_CHECK_SUSPENDED | POOL_CHECK_READONLY, B_TRUE, B_TRUE,
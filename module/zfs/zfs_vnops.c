@@ -51,6 +51,7 @@
 #include <sys/spa.h>
 #include <sys/txg.h>
 #include <sys/dbuf.h>
+#include <sys/abd.h>
 #include <sys/policy.h>
 #include <sys/zfeature.h>
 #include <sys/zfs_vnops.h>
@@ -202,6 +203,28 @@ zfs_access(znode_t *zp, int mode, int flag, cred_t *cr)
 	return (error);
 }
 
+/*
+ * Decide whether a read or write should use Direct I/O, bypassing the ARC.
+ * That depends on the dataset's direct property and O_DIRECT, and on the
+ * request being page-aligned, both in the file and in memory.  Encrypted
+ * datasets always go through the ARC.
+ */
+static boolean_t
+zfs_dio_requested(znode_t *zp, zfs_uio_t *uio, int ioflag)
+{
+	objset_t *os = ZTOZSB(zp)->z_os;
+
+	if (os->os_direct == ZFS_DIRECT_DISABLED)
+		return (B_FALSE);
+	if (!(ioflag & O_DIRECT) && os->os_direct != ZFS_DIRECT_ALWAYS)
+		return (B_FALSE);
+	if (os->os_encrypted)
+		return (B_FALSE);
+
+	return (IS_P2ALIGNED(zfs_uio_offset(uio), PAGESIZE) &&
+	    zfs_uio_page_aligned(uio));
+}
+
 /*
  * Read bytes from specified file into supplied buffer.
  *
@@ -209,7 +232,8 @@ zfs_access(znode_t *zp, int mode, int flag, cred_t *cr)
  *		uio	- structure supplying read location, range info,
  *			  and return buffer.
  *		ioflag	- O_SYNC flags; used to provide FRSYNC semantics.
- *			  O_DIRECT flag; used to bypass page cache.
+ *			  O_DIRECT flag; used to bypass the ARC (see the
+ *			  direct property).
  *		cr	- credentials of caller.
  *
  *	OUT:	uio	- updated offset and range, buffer filled.
@@ -293,19 +317,34 @@ zfs_read(struct znode *zp, zfs_uio_t *uio, int ioflag, cred_t *cr)
 #endif
 	ssize_t n = MIN(zfs_uio_resid(uio), zp->z_size - zfs_uio_offset(uio));
 	ssize_t start_resid = n;
+	boolean_t dio = zfs_dio_requested(zp, uio, ioflag);
 
 	while (n > 0) {
 		ssize_t nbytes = MIN(n, zfs_vnops_read_chunk_size -
 		    P2PHASE(zfs_uio_offset(uio), zfs_vnops_read_chunk_size));
+		abd_t *dio_abd = NULL;
 #ifdef UIO_NOCOPY
 		if (zfs_uio_segflg(uio) == UIO_NOCOPY)
 			error = mappedread_sf(zp, nbytes, uio);
 		else
 #endif
 		if (zn_has_cached_data(zp, zfs_uio_offset(uio),
-		    zfs_uio_offset(uio) + nbytes - 1) && !(ioflag & O_DIRECT)) {
+		    zfs_uio_offset(uio) + nbytes - 1)) {
+			/*
+			 * Mapped pages may be newer than the ARC, so they are
+			 * read from even for Direct I/O.
+			 */
 			error = mappedread(zp, nbytes, uio);
+		} else if (dio && zfs_uio_get_dio_pages_alloc(uio, UIO_READ,
+		    nbytes, &dio_abd) == 0) {
+			error = dmu_read_abd(sa_get_db(zp->z_sa_hdl),
+			    zfs_uio_offset(uio), nbytes, dio_abd);
+			zfs_uio_free_dio_pages(uio, UIO_READ, dio_abd);
+			if (error == 0)
+				zfs_uioskip(uio, nbytes);
 		} else {
+			/* If the user pages couldn't be pinned, stop trying. */
+			dio = B_FALSE;
 			error = dmu_read_uio_dbuf(sa_get_db(zp->z_sa_hdl),
 			    uio, nbytes);
 		}
@@ -405,7 +444,8 @@ zfs_clear_setid_bits_if_necessary(zfsvfs_t *zfsvfs, znode_t *zp, cred_t *cr,
  *		uio	- structure supplying write location, range info,
  *			  and data buffer.
  *		ioflag	- O_APPEND flag set if in append mode.
- *			  O_DIRECT flag; used to bypass page cache.
+ *			  O_DIRECT flag; used to bypass the ARC (see the
+ *			  direct property).
  *		cr	- credentials of caller.
  *
  *	OUT:	uio	- updated offset and range.
@@ -539,6 +579,12 @@ zfs_write(znode_t *zp, zfs_uio_t *uio, int ioflag, cred_t *cr)
 	const uint64_t gid = KGID_TO_SGID(ZTOGID(zp));
 	const uint64_t projid = zp->z_projid;
 
+	/*
+	 * Direct I/O writes bypass dedup, so dedup datasets always copy.
+	 */
+	boolean_t dio = zfs_dio_requested(zp, uio, ioflag) &&
+	    zfsvfs->z_os->os_dedup_checksum == ZIO_CHECKSUM_OFF;
+
 	/*
 	 * Write the file in reasonable size chunks.  Each chunk is written
 	 * in a separate transaction; this keeps the intent log records small
@@ -577,8 +623,25 @@ zfs_write(znode_t *zp, zfs_uio_t *uio, int ioflag, cred_t *cr)
 		}
 
 		arc_buf_t *abuf = NULL;
+		abd_t *dio_abd = NULL;
 		ssize_t nbytes = n;
-		if (n >= blksz && woff >= zp->z_size &&
+		if (dio && lr->lr_length != UINT64_MAX &&
+		    P2PHASE(woff, blksz) == 0 && n >= blksz) {
+			/*
+			 * Direct I/O: write whole blocks straight from the
+			 * user's pages.  The block size can't change under
+			 * us, as the range lock covers just this range.  Any
+			 * tail shorter than a block is copied as usual.
+			 */
+			nbytes = P2ALIGN_TYPED(MIN(n, SPA_MAXBLOCKSIZE), blksz,
+			    ssize_t);
+			if (zfs_uio_get_dio_pages_alloc(uio, UIO_WRITE, nbytes,
+			    &dio_abd) != 0) {
+				dio = B_FALSE;
+				nbytes = n;
+			}
+		}
+		if (dio_abd == NULL && n >= blksz && woff >= zp->z_size &&
 		    P2PHASE(woff, blksz) == 0 &&
 		    (blksz >= SPA_OLD_MAXBLOCKSIZE || n < 4 * blksz)) {
 			/*
@@ -598,7 +661,7 @@ zfs_write(znode_t *zp, zfs_uio_t *uio, int ioflag, cred_t *cr)
 				break;
 			}
 			ASSERT3S(nbytes, ==, blksz);
-		} else {
+		} else if (dio_abd == NULL) {
 			nbytes = MIN(n, (DMU_MAX_ACCESS >> 1) -
 			    P2PHASE(woff, blksz));
 			if (pfbytes < nbytes) {
@@ -625,6 +688,8 @@ zfs_write(znode_t *zp, zfs_uio_t *uio, int ioflag, cred_t *cr)
 			dmu_tx_abort(tx);
 			if (abuf != NULL)
 				dmu_return_arcbuf(abuf);
+			if (dio_abd != NULL)
+				zfs_uio_free_dio_pages(uio, UIO_WRITE, dio_abd);
 			break;
 		}
 
@@ -645,7 +710,20 @@ zfs_write(znode_t *zp, zfs_uio_t *uio, int ioflag, cred_t *cr)
 		}
 
 		ssize_t tx_bytes;
-		if (abuf == NULL) {
+		boolean_t o_direct = (dio_abd != NULL);
+		if (o_direct) {
+			error = dmu_write_abd(sa_get_db(zp->z_sa_hdl), woff,
+			    nbytes, dio_abd, tx);
+			zfs_uio_free_dio_pages(uio, UIO_WRITE, dio_abd);
+			if (error != 0) {
+				zfs_clear_setid_bits_if_necessary(zfsvfs, zp,
+				    cr, &clear_setid_bits_txg, tx);
+				dmu_tx_commit(tx);
+				break;
+			}
+			zfs_uioskip(uio, nbytes);
+			tx_bytes = nbytes;
+		} else if (abuf == NULL) {
 			tx_bytes = zfs_uio_resid(uio);
 			zfs_uio_fault_disable(uio, B_TRUE);
 			error = dmu_write_uio_dbuf(sa_get_db(zp->z_sa_hdl),
@@ -706,8 +784,7 @@ zfs_write(znode_t *zp, zfs_uio_t *uio, int ioflag, cred_t *cr)
 			tx_bytes = nbytes;
 		}
 		if (tx_bytes &&
-		    zn_has_cached_data(zp, woff, woff + tx_bytes - 1) &&
-		    !(ioflag & O_DIRECT)) {
+		    zn_has_cached_data(zp, woff, woff + tx_bytes - 1)) {
 			update_pages(zp, woff, tx_bytes, zfsvfs->z_os);
 		}
 
@@ -756,7 +833,7 @@ zfs_write(znode_t *zp, zfs_uio_t *uio, int ioflag, cred_t *cr)
 		 * the TX_WRITE records logged here.
 		 */
 		zfs_log_write(zilog, tx, TX_WRITE, zp, woff, tx_bytes, commit,
-		    NULL, NULL);
+		    o_direct, NULL, NULL);
 
 		dmu_tx_commit(tx);
 
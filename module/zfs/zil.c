@@ -141,8 +141,30 @@ static int zil_nocacheflush = 0;
  */
 static uint64_t zil_slog_bulk = 64 * 1024 * 1024;
 
+/*
+ * When a single commit closes several lwbs, fill and issue all but the first
+ * of them from zil_lwb_issue_taskq instead of one after another by the
+ * committing thread.  Filling an lwb copies the log records and their data
+ * into it, so for large commits this spreads that work across CPUs and keeps
+ * more log writes in flight.  The lwbs are still chained and written in
+ * order, so the on-disk log is unaffected.  Only read when the module is
+ * loaded, since the taskq is only created if it is set.
+ */
+static int zil_parallel_issue = 0;
+
+/*
+ * Share the cache flushes that follow lwb writes between all the datasets in
+ * the pool.  Only one ZIL flush is kept in flight per top-level vdev; lwbs
+ * whose writes complete meanwhile all wait for the single next flush, which
+ * is issued as soon as the running one completes.  With many datasets doing
+ * small sync writes to a shared SLOG this turns a flush per lwb into at most
+ * one flush per flush latency.
+ */
+static int zil_flush_coalesce = 1;
+
 static kmem_cache_t *zil_lwb_cache;
 static kmem_cache_t *zil_zcw_cache;
+static taskq_t *zil_lwb_issue_taskq;
 
 static void zil_lwb_commit(zilog_t *zilog, lwb_t *lwb, itx_t *itx);
 static itx_t *zil_itx_clone(itx_t *oitx);
@@ -700,6 +722,7 @@ zil_claim_clone_range(zilog_t *zilog, const lr_t *lrc, void *tx,
 		if (!BP_IS_HOLE(bp) && !BP_IS_EMBEDDED(bp))
 			brt_pending_add(spa, bp, tx);
 	}
+	brt_prefetch_bps(spa, lr->lr_bps, lr->lr_nbps);
 
 	return (0);
 }
@@ -1560,6 +1583,77 @@ zil_lwb_flush_wait_all(zilog_t *zilog, uint64_t txg)
 #endif
 }
 
+static void zil_vdev_flush_done(zio_t *zio);
+
+/*
+ * Create the zio of a flush epoch of the given top-level vdev.  Its flush
+ * commands are only added once it is issued, so that they cover all the
+ * writes of lwbs that joined the epoch before then.
+ */
+static zio_t *
+zil_vdev_flush_epoch(vdev_t *vd)
+{
+	return (zio_null(NULL, vd->vdev_spa, NULL, zil_vdev_flush_done, vd,
+	    ZIO_FLAG_CANFAIL | ZIO_FLAG_DONT_PROPAGATE));
+}
+
+static void
+zil_vdev_flush_issue(zio_t *zio, vdev_t *vd)
+{
+	zio_flush(zio, vd);
+	zio_nowait(zio);
+}
+
+static void
+zil_vdev_flush_done(zio_t *zio)
+{
+	vdev_t *vd = zio->io_private;
+	zio_t *next;
+
+	mutex_enter(&vd->vdev_zil_flush_lock);
+	ASSERT(vd->vdev_zil_flush_active);
+	next = vd->vdev_zil_flush_next;
+	vd->vdev_zil_flush_next = NULL;
+	if (next == NULL)
+		vd->vdev_zil_flush_active = B_FALSE;
+	mutex_exit(&vd->vdev_zil_flush_lock);
+
+	if (next != NULL)
+		zil_vdev_flush_issue(next, vd);
+}
+
+/*
+ * Make the lwb root zio wait for a flush of the top-level vdev that is
+ * issued after this point.  If a flush is already running it may have been
+ * issued before the lwb's write completed, so join the next epoch instead,
+ * which is started by zil_vdev_flush_done() when the running one completes.
+ */
+static void
+zil_vdev_flush(zio_t *pio, vdev_t *vd)
+{
+	zio_t *zio;
+
+	if (!zil_flush_coalesce) {
+		zio_flush(pio, vd);
+		return;
+	}
+
+	mutex_enter(&vd->vdev_zil_flush_lock);
+	if (vd->vdev_zil_flush_active) {
+		if (vd->vdev_zil_flush_next == NULL)
+			vd->vdev_zil_flush_next = zil_vdev_flush_epoch(vd);
+		zio_add_child(pio, vd->vdev_zil_flush_next);
+		mutex_exit(&vd->vdev_zil_flush_lock);
+		return;
+	}
+	vd->vdev_zil_flush_active = B_TRUE;
+	zio = zil_vdev_flush_epoch(vd);
+	zio_add_child(pio, zio);
+	mutex_exit(&vd->vdev_zil_flush_lock);
+
+	zil_vdev_flush_issue(zio, vd);
+}
+
 /*
  * This is called when an lwb's write zio completes. The callback's purpose is
  * to issue the flush commands for the vdevs in the lwb's lwb_vdev_tree. The
@@ -1659,7 +1753,7 @@ zil_lwb_write_done(zio_t *zio)
 			 * since these "zio_flush" errors will not be
 			 * propagated up to "zil_lwb_flush_vdevs_done".
 			 */
-			zio_flush(lwb->lwb_root_zio, vd);
+			zil_vdev_flush(lwb->lwb_root_zio, vd);
 		}
 		kmem_free(zv, sizeof (*zv));
 	}
@@ -2062,6 +2156,43 @@ next_lwb:
 		goto next_lwb;
 }
 
+static void
+zil_lwb_write_issue_task(void *arg)
+{
+	lwb_t *lwb = arg;
+
+	zil_lwb_write_issue(lwb->lwb_zilog, lwb);
+}
+
+/*
+ * Issue the lwbs closed by one commit.  zil_lwb_write_issue() only issues an
+ * lwb once the previous one has given it its block pointer, so the lwbs may
+ * be filled concurrently; whichever thread finds the next lwb ready issues it.
+ */
+static void
+zil_lwb_write_issue_list(zilog_t *zilog, list_t *ilwbs)
+{
+	lwb_t *lwb, *first;
+
+	ASSERT(!MUTEX_HELD(&zilog->zl_issuer_lock));
+
+	first = list_remove_head(ilwbs);
+	if (first == NULL)
+		return;
+
+	while ((lwb = list_remove_head(ilwbs)) != NULL) {
+		if (zil_lwb_issue_taskq != NULL) {
+			taskq_dispatch_ent(zil_lwb_issue_taskq,
+			    zil_lwb_write_issue_task, lwb, 0,
+			    &lwb->lwb_issue_ent);
+		} else {
+			zil_lwb_write_issue(zilog, first);
+			first = lwb;
+		}
+	}
+	zil_lwb_write_issue(zilog, first);
+}
+
 /*
  * Maximum amount of data that can be put into single log block.
  */
@@ -3137,7 +3268,6 @@ static uint64_t
 zil_commit_writer(zilog_t *zilog, zil_commit_waiter_t *zcw)
 {
 	list_t ilwbs;
-	lwb_t *lwb;
 	uint64_t wtxg = 0;
 
 	ASSERT(!MUTEX_HELD(&zilog->zl_lock));
@@ -3174,8 +3304,7 @@ zil_commit_writer(zilog_t *zilog, zil_commit_waiter_t *zcw)
 
 out:
 	mutex_exit(&zilog->zl_issuer_lock);
-	while ((lwb = list_remove_head(&ilwbs)) != NULL)
-		zil_lwb_write_issue(zilog, lwb);
+	zil_lwb_write_issue_list(zilog, &ilwbs);
 	list_destroy(&ilwbs);
 	return (wtxg);
 }
@@ -3790,6 +3919,7 @@ zil_lwb_cons(void *vbuf, void *unused, int kmflag)
 	avl_create(&lwb->lwb_vdev_tree, zil_lwb_vdev_compare,
 	    sizeof (zil_vdev_node_t), offsetof(zil_vdev_node_t, zv_node));
 	mutex_init(&lwb->lwb_vdev_lock, NULL, MUTEX_DEFAULT, NULL);
+	taskq_init_ent(&lwb->lwb_issue_ent);
 	return (0);
 }
 
@@ -3813,6 +3943,15 @@ zil_init(void)
 	zil_zcw_cache = kmem_cache_create("zil_zcw_cache",
 	    sizeof (zil_commit_waiter_t), 0, NULL, NULL, NULL, NULL, NULL, 0);
 
+	/*
+	 * All entries are queued via taskq_dispatch_ent(), so min/maxalloc
+	 * configuration is not required.
+	 */
+	if (zil_parallel_issue) {
+		zil_lwb_issue_taskq = taskq_create("zil_lwb_issue", 100,
+		    defclsyspri, 0, 0, TASKQ_DYNAMIC | TASKQ_THREADS_CPU_PCT);
+	}
+
 	zil_sums_init(&zil_sums_global);
 	zil_kstats_global = kstat_create("zfs", 0, "zil", "misc",
 	    KSTAT_TYPE_NAMED, sizeof (zil_stats) / sizeof (kstat_named_t),
@@ -3829,6 +3968,10 @@ zil_init(void)
 void
 zil_fini(void)
 {
+	if (zil_lwb_issue_taskq != NULL) {
+		taskq_destroy(zil_lwb_issue_taskq);
+		zil_lwb_issue_taskq = NULL;
+	}
 	kmem_cache_destroy(zil_zcw_cache);
 	kmem_cache_destroy(zil_lwb_cache);
 
@@ -4412,3 +4555,9 @@ ZFS_MODULE_PARAM(zfs_zil, zil_, maxblocksize, UINT, ZMOD_RW,
 
 ZFS_MODULE_PARAM(zfs_zil, zil_, maxcopied, UINT, ZMOD_RW,
 	"Limit in bytes WR_COPIED size");
+
+ZFS_MODULE_PARAM(zfs_zil, zil_, flush_coalesce, INT, ZMOD_RW,
+	"Share ZIL cache flushes of a vdev between datasets");
+
+ZFS_MODULE_PARAM(zfs_zil, zil_, parallel_issue, INT, ZMOD_RD,
+	"Fill and issue the log blocks of a commit in parallel");
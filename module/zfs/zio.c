@@ -3254,12 +3254,13 @@ static void
 zio_ddt_child_read_done(zio_t *zio)
 {
 	blkptr_t *bp = zio->io_bp;
+	ddt_t *ddt = ddt_select(zio->io_spa, bp);
 	ddt_entry_t *dde = zio->io_private;
 	ddt_phys_t *ddp;
 	zio_t *pio = zio_unique_parent(zio);
 
 	mutex_enter(&pio->io_lock);
-	ddp = ddt_phys_select(dde, bp);
+	ddp = ddt_phys_select(ddt, dde, bp);
 	if (zio->io_error == 0)
 		ddt_phys_clear(ddp);	/* this ddp doesn't need repair */
 
@@ -3283,7 +3284,7 @@ zio_ddt_read_start(zio_t *zio)
 		ddt_t *ddt = ddt_select(zio->io_spa, bp);
 		ddt_entry_t *dde = ddt_repair_start(ddt, bp);
 		ddt_phys_t *ddp = dde->dde_phys;
-		ddt_phys_t *ddp_self = ddt_phys_select(dde, bp);
+		ddt_phys_t *ddp_self = ddt_phys_select(ddt, dde, bp);
 		blkptr_t blk;
 
 		ASSERT(zio->io_vsd == NULL);
@@ -3292,7 +3293,7 @@ zio_ddt_read_start(zio_t *zio)
 		if (ddp_self == NULL)
 			return (zio);
 
-		for (int p = 0; p < DDT_PHYS_TYPES; p++, ddp++) {
+		for (int p = 0; p < DDT_NPHYS(ddt); p++, ddp++) {
 			if (ddp->ddp_phys_birth == 0 || ddp == ddp_self)
 				continue;
 			ddt_bp_create(ddt->ddt_checksum, &dde->dde_key, ddp,
@@ -3372,9 +3373,12 @@ zio_ddt_collision(zio_t *zio, ddt_t *ddt, ddt_entry_t *dde)
 	 * loaded).
 	 */
 
-	for (int p = DDT_PHYS_SINGLE; p <= DDT_PHYS_TRIPLE; p++) {
+	for (int p = 0; p < DDT_NPHYS(ddt); p++) {
 		zio_t *lio = dde->dde_lead_zio[p];
 
+		if (DDT_PHYS_IS_DITTO(ddt, p))
+			continue;
+
 		if (lio != NULL && do_raw) {
 			return (lio->io_size != zio->io_size ||
 			    abd_cmp(zio->io_abd, lio->io_abd) != 0);
@@ -3384,9 +3388,12 @@ zio_ddt_collision(zio_t *zio, ddt_t *ddt, ddt_entry_t *dde)
 		}
 	}
 
-	for (int p = DDT_PHYS_SINGLE; p <= DDT_PHYS_TRIPLE; p++) {
+	for (int p = 0; p < DDT_NPHYS(ddt); p++) {
 		ddt_phys_t *ddp = &dde->dde_phys[p];
 
+		if (DDT_PHYS_IS_DITTO(ddt, p))
+			continue;
+
 		if (ddp->ddp_phys_birth != 0 && do_raw) {
 			blkptr_t blk = *zio->io_bp;
 			uint64_t psize;
@@ -3452,8 +3459,8 @@ zio_ddt_collision(zio_t *zio, ddt_t *ddt, ddt_entry_t *dde)
 static void
 zio_ddt_child_write_ready(zio_t *zio)
 {
-	int p = zio->io_prop.zp_copies;
 	ddt_t *ddt = ddt_select(zio->io_spa, zio->io_bp);
+	int p = DDT_PHYS_FOR_COPIES(ddt, zio->io_prop.zp_copies);
 	ddt_entry_t *dde = zio->io_private;
 	ddt_phys_t *ddp = &dde->dde_phys[p];
 	zio_t *pio;
@@ -3477,8 +3484,8 @@ zio_ddt_child_write_ready(zio_t *zio)
 static void
 zio_ddt_child_write_done(zio_t *zio)
 {
-	int p = zio->io_prop.zp_copies;
 	ddt_t *ddt = ddt_select(zio->io_spa, zio->io_bp);
+	int p = DDT_PHYS_FOR_COPIES(ddt, zio->io_prop.zp_copies);
 	ddt_entry_t *dde = zio->io_private;
 	ddt_phys_t *ddp = &dde->dde_phys[p];
 
@@ -3506,11 +3513,11 @@ zio_ddt_write(zio_t *zio)
 	blkptr_t *bp = zio->io_bp;
 	uint64_t txg = zio->io_txg;
 	zio_prop_t *zp = &zio->io_prop;
-	int p = zp->zp_copies;
 	zio_t *cio = NULL;
 	ddt_t *ddt = ddt_select(spa, bp);
 	ddt_entry_t *dde;
 	ddt_phys_t *ddp;
+	int p;
 
 	ASSERT(BP_GET_DEDUP(bp));
 	ASSERT(BP_GET_CHECKSUM(bp) == zp->zp_checksum);
@@ -3528,8 +3535,29 @@ zio_ddt_write(zio_t *zio)
 		ddt_exit(ddt);
 		return (zio);
 	}
+	p = DDT_PHYS_FOR_COPIES(ddt, zp->zp_copies);
 	ddp = &dde->dde_phys[p];
 
+	/*
+	 * A flat entry only has room for the copies the block was first
+	 * written with. If that's fewer than we want now, the existing block
+	 * isn't good enough, so write this one as an ordinary block instead.
+	 */
+	if (ddt->ddt_flags & DDT_FLAG_FLAT) {
+		int have_dvas = dde->dde_lead_zio[p] != NULL ?
+		    dde->dde_lead_zio[p]->io_prop.zp_copies :
+		    ddt_phys_dva_count(ddp, BP_IS_ENCRYPTED(bp));
+
+		if (have_dvas > 0 && have_dvas < zp->zp_copies) {
+			zp->zp_dedup = B_FALSE;
+			BP_SET_DEDUP(bp, B_FALSE);
+			if (zio->io_bp_override == NULL)
+				zio->io_pipeline = ZIO_WRITE_PIPELINE;
+			ddt_exit(ddt);
+			return (zio);
+		}
+	}
+
 	if (zp->zp_dedup_verify && zio_ddt_collision(zio, ddt, dde)) {
 		/*
 		 * If we're using a weak checksum, upgrade to a strong checksum
@@ -3599,13 +3627,25 @@ zio_ddt_free(zio_t *zio)
 
 	ddt_enter(ddt);
 	freedde = dde = ddt_lookup(ddt, bp, B_TRUE);
-	if (dde) {
-		ddp = ddt_phys_select(dde, bp);
-		if (ddp)
-			ddt_phys_decref(ddp);
-	}
+	ddp = (dde != NULL) ? ddt_phys_select(ddt, dde, bp) : NULL;
+	if (ddp)
+		ddt_phys_decref(ddp);
 	ddt_exit(ddt);
 
+	/*
+	 * If a flat table has no phys for this block, its entry was pruned,
+	 * and the block is no longer tracked by the DDT. It may have been
+	 * cloned since, so it goes through the BRT like any other block, and
+	 * is then freed directly, along with its gang children if it has any.
+	 */
+	if (ddp == NULL && (ddt->ddt_flags & DDT_FLAG_FLAT)) {
+		if (brt_maybe_exists(spa, bp) && !brt_entry_decref(spa, bp))
+			return (zio);
+		zio->io_pipeline |= ZIO_STAGE_DVA_FREE;
+		if (BP_IS_GANG(bp))
+			zio->io_pipeline |= ZIO_GANG_STAGES;
+	}
+
 	return (zio);
 }
 
@@ -160,6 +160,54 @@ abd_fletcher_4_byteswap(abd_t *abd, uint64_t size,
 	abd_fletcher_4_impl(abd, size, &acd);
 }
 
+/*
+ * Holding the FPU disables preemption on some platforms, so give it up
+ * after this much data even in the middle of a batch.
+ */
+#define	FLETCHER_4_BATCH_FPU_BYTES	(1ULL << 20)
+
+static void
+abd_fletcher_4_batch_impl(abd_t **abds, const uint64_t *sizes, uint_t n,
+    zio_byteorder_t byteorder, zio_cksum_t *zcps)
+{
+	fletcher_4_ctx_t ctx;
+	uint64_t held = 0;
+
+	zio_abd_checksum_data_t acd = {
+		.acd_byteorder	= byteorder,
+		.acd_ctx	= &ctx
+	};
+
+	fletcher_4_abd_ops.acf_batch_init(&acd);
+	for (uint_t i = 0; i < n; i++) {
+		if (held >= FLETCHER_4_BATCH_FPU_BYTES) {
+			fletcher_4_abd_ops.acf_batch_fini(&acd);
+			fletcher_4_abd_ops.acf_batch_init(&acd);
+			held = 0;
+		}
+		acd.acd_zcp = &zcps[i];
+		abd_fletcher_4_impl(abds[i], sizes[i], &acd);
+		held += sizes[i];
+	}
+	fletcher_4_abd_ops.acf_batch_fini(&acd);
+}
+
+void
+abd_fletcher_4_native_batch(abd_t **abds, const uint64_t *sizes, uint_t n,
+    const void *ctx_template, zio_cksum_t *zcps)
+{
+	(void) ctx_template;
+	abd_fletcher_4_batch_impl(abds, sizes, n, ZIO_CHECKSUM_NATIVE, zcps);
+}
+
+void
+abd_fletcher_4_byteswap_batch(abd_t **abds, const uint64_t *sizes, uint_t n,
+    const void *ctx_template, zio_cksum_t *zcps)
+{
+	(void) ctx_template;
+	abd_fletcher_4_batch_impl(abds, sizes, n, ZIO_CHECKSUM_BYTESWAP, zcps);
+}
+
 zio_checksum_info_t zio_checksum_table[ZIO_CHECKSUM_FUNCTIONS] = {
 	{{NULL, NULL}, NULL, NULL, 0, "inherit"},
 	{{NULL, NULL}, NULL, NULL, 0, "on"},
@@ -411,6 +459,31 @@ zio_checksum_compute(zio_t *zio, enum zio_checksum checksum,
 	}
 }
 
+/*
+ * MAC checksums are a special case since half of this checksum will
+ * actually be the encryption MAC. This will be verified by the
+ * decryption process, so we just check the truncated checksum now.
+ * Objset blocks use embedded MACs so we don't truncate the checksum
+ * for them.
+ */
+static void
+zio_checksum_truncate_mac(zio_checksum_info_t *ci, const blkptr_t *bp,
+    zio_cksum_t *actual_cksum, zio_cksum_t *expected_cksum)
+{
+	if (bp != NULL && BP_USES_CRYPT(bp) &&
+	    BP_GET_TYPE(bp) != DMU_OT_OBJSET) {
+		if (!(ci->ci_flags & ZCHECKSUM_FLAG_DEDUP)) {
+			actual_cksum->zc_word[0] ^= actual_cksum->zc_word[2];
+			actual_cksum->zc_word[1] ^= actual_cksum->zc_word[3];
+		}
+
+		actual_cksum->zc_word[2] = 0;
+		actual_cksum->zc_word[3] = 0;
+		expected_cksum->zc_word[2] = 0;
+		expected_cksum->zc_word[3] = 0;
+	}
+}
+
 int
 zio_checksum_error_impl(spa_t *spa, const blkptr_t *bp,
     enum zio_checksum checksum, abd_t *abd, uint64_t size, uint64_t offset,
@@ -498,25 +571,7 @@ zio_checksum_error_impl(spa_t *spa, const blkptr_t *bp,
 		    spa->spa_cksum_tmpls[checksum], &actual_cksum);
 	}
 
-	/*
-	 * MAC checksums are a special case since half of this checksum will
-	 * actually be the encryption MAC. This will be verified by the
-	 * decryption process, so we just check the truncated checksum now.
-	 * Objset blocks use embedded MACs so we don't truncate the checksum
-	 * for them.
-	 */
-	if (bp != NULL && BP_USES_CRYPT(bp) &&
-	    BP_GET_TYPE(bp) != DMU_OT_OBJSET) {
-		if (!(ci->ci_flags & ZCHECKSUM_FLAG_DEDUP)) {
-			actual_cksum.zc_word[0] ^= actual_cksum.zc_word[2];
-			actual_cksum.zc_word[1] ^= actual_cksum.zc_word[3];
-		}
-
-		actual_cksum.zc_word[2] = 0;
-		actual_cksum.zc_word[3] = 0;
-		expected_cksum.zc_word[2] = 0;
-		expected_cksum.zc_word[3] = 0;
-	}
+	zio_checksum_truncate_mac(ci, bp, &actual_cksum, &expected_cksum);
 
 	if (info != NULL) {
 		info->zbc_checksum_name = ci->ci_name;
@@ -556,6 +611,122 @@ zio_checksum_error(zio_t *zio, zio_bad_cksum_t *info)
 	return (error);
 }
 
+/*
+ * Return B_TRUE if the zio's checksum is still to be verified, and can be
+ * verified as part of a batch.  Embedded checksums are left to
+ * zio_checksum_verify(), since they're verified with the data modified.
+ */
+static boolean_t
+zio_checksum_batchable(zio_t *zio)
+{
+	blkptr_t *bp = zio->io_bp;
+	enum zio_checksum checksum;
+
+	if (zio->io_type != ZIO_TYPE_READ || zio->io_error != 0 ||
+	    !(zio->io_pipeline & ZIO_STAGE_CHECKSUM_VERIFY) ||
+	    bp == NULL || BP_IS_GANG(bp) || zio->io_abd == NULL)
+		return (B_FALSE);
+
+	checksum = BP_GET_CHECKSUM(bp);
+	if (checksum >= ZIO_CHECKSUM_FUNCTIONS)
+		return (B_FALSE);
+
+	return (zio_checksum_table[checksum].ci_func[0] != NULL &&
+	    !(zio_checksum_table[checksum].ci_flags &
+	    ZCHECKSUM_FLAG_EMBEDDED));
+}
+
+/*
+ * Checksum a batch of zios which share a checksum function and byte order,
+ * and skip the checksum stage of each one whose checksum matches.
+ */
+static void
+zio_checksum_verify_batch_impl(zio_t **zios, uint_t n)
+{
+	abd_t *abds[ZIO_CHECKSUM_BATCH_MAX];
+	uint64_t sizes[ZIO_CHECKSUM_BATCH_MAX];
+	zio_cksum_t zcps[ZIO_CHECKSUM_BATCH_MAX];
+	spa_t *spa = zios[0]->io_spa;
+	enum zio_checksum checksum = BP_GET_CHECKSUM(zios[0]->io_bp);
+	int byteswap = BP_SHOULD_BYTESWAP(zios[0]->io_bp);
+	zio_checksum_info_t *ci = &zio_checksum_table[checksum];
+	void *tmpl;
+
+	ASSERT3U(n, <=, ZIO_CHECKSUM_BATCH_MAX);
+
+	for (uint_t i = 0; i < n; i++) {
+		abds[i] = zios[i]->io_abd;
+		sizes[i] = BP_GET_PSIZE(zios[i]->io_bp);
+	}
+
+	zio_checksum_template_init(checksum, spa);
+	tmpl = spa->spa_cksum_tmpls[checksum];
+
+	switch (checksum) {
+	case ZIO_CHECKSUM_FLETCHER_4:
+		if (byteswap)
+			abd_fletcher_4_byteswap_batch(abds, sizes, n, tmpl,
+			    zcps);
+		else
+			abd_fletcher_4_native_batch(abds, sizes, n, tmpl,
+			    zcps);
+		break;
+	default:
+		for (uint_t i = 0; i < n; i++)
+			ci->ci_func[byteswap](abds[i], sizes[i], tmpl,
+			    &zcps[i]);
+		break;
+	}
+
+	for (uint_t i = 0; i < n; i++) {
+		const blkptr_t *bp = zios[i]->io_bp;
+		zio_cksum_t expected_cksum = bp->blk_cksum;
+
+		zio_checksum_truncate_mac(ci, bp, &zcps[i], &expected_cksum);
+		if (ZIO_CHECKSUM_EQUAL(zcps[i], expected_cksum))
+			zio_checksum_verified(zios[i]);
+	}
+}
+
+/*
+ * Verify the checksums of several zios whose data became available at the
+ * same time, such as the reads making up an aggregated vdev read.  This lets
+ * checksum implementations pay their per-call setup cost, e.g. claiming the
+ * FPU for fletcher4, once per batch rather than once per block.  Each zio
+ * whose checksum matches has its checksum stage skipped; any other zio is
+ * left for zio_checksum_verify() to check and report as usual.
+ */
+void
+zio_checksum_verify_batch(zio_t **zios, uint_t nzios)
+{
+	zio_t *batch[ZIO_CHECKSUM_BATCH_MAX];
+	uint_t n = 0;
+
+	/* Fault injection is only done by zio_checksum_error(). */
+	if (zio_injection_enabled)
+		return;
+
+	for (uint_t i = 0; i < nzios; i++) {
+		zio_t *zio = zios[i];
+
+		if (!zio_checksum_batchable(zio))
+			continue;
+
+		if (n > 0 && (n == ZIO_CHECKSUM_BATCH_MAX ||
+		    zio->io_spa != batch[0]->io_spa ||
+		    BP_GET_CHECKSUM(zio->io_bp) !=
+		    BP_GET_CHECKSUM(batch[0]->io_bp) ||
+		    BP_SHOULD_BYTESWAP(zio->io_bp) !=
+		    BP_SHOULD_BYTESWAP(batch[0]->io_bp))) {
+			zio_checksum_verify_batch_impl(batch, n);
+			n = 0;
+		}
+		batch[n++] = zio;
+	}
+	if (n > 0)
+		zio_checksum_verify_batch_impl(batch, n);
+}
+
 /*
  * Called by a spa_t that's about to be deallocated. This steps through
  * all of the checksum context templates and deallocates any that were
@@ -702,6 +702,18 @@ test_scrub(const char *pool)
 	nvlist_free(required);
 }
 
+static void
+test_ddt_prune(const char *pool)
+{
+	nvlist_t *required = fnvlist_alloc();
+
+	fnvlist_add_uint64(required, DDT_PRUNE_AGE, UINT64_MAX);
+
+	IOC_INPUT_TEST(ZFS_IOC_DDT_PRUNE, pool, required, NULL, 0);
+
+	nvlist_free(required);
+}
+
 static int
 zfs_destroy(const char *dataset)
 {
@@ -884,6 +896,8 @@ zfs_ioc_input_tests(const char *pool)
 
 	test_scrub(pool);
 
+	test_ddt_prune(pool);
+
 	/*
 	 * cleanup
 	 */
@@ -1039,6 +1053,7 @@ validate_ioc_values(void)
 	CHECK(ZFS_IOC_BASE + 83 == ZFS_IOC_WAIT);
 	CHECK(ZFS_IOC_BASE + 84 == ZFS_IOC_WAIT_FS);
 	CHECK(ZFS_IOC_BASE + 87 == ZFS_IOC_POOL_SCRUB);
+	CHECK(ZFS_IOC_BASE + 89 == ZFS_IOC_DDT_PRUNE);
 	CHECK(ZFS_IOC_PLATFORM_BASE + 1 == ZFS_IOC_EVENTS_NEXT);
 	CHECK(ZFS_IOC_PLATFORM_BASE + 2 == ZFS_IOC_EVENTS_CLEAR);
 	CHECK(ZFS_IOC_PLATFORM_BASE + 3 == ZFS_IOC_EVENTS_SEEK);